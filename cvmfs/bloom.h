@@ -0,0 +1,84 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_BLOOM_H_
+#define CVMFS_BLOOM_H_
+
+#include <stdint.h>
+
+#include <cstdlib>
+
+#include "hash.h"
+#include "smalloc.h"
+
+/**
+ * Fixed-size Bloom filter over MD5 digests, such as the path hashes of a
+ * catalog.  The digests are uniformly distributed, so the probe positions are
+ * derived from the two 64bit halves of the digest by double hashing instead of
+ * hashing the key again.
+ *
+ * The filter is meant to be filled once and queried afterwards.  Concurrent
+ * calls to Contains() are safe, concurrent calls to Insert() are not.
+ */
+class Md5BloomFilter {
+ public:
+  static const unsigned kBitsPerEntry = 10;
+  static const unsigned kNumProbes = 7;  // ~1% false positive rate
+
+  explicit Md5BloomFilter(const uint64_t expected_size) {
+    num_words_ = (expected_size * kBitsPerEntry + 63) / 64;
+    if (num_words_ == 0)
+      num_words_ = 1;
+    num_bits_ = num_words_ * 64;
+    bitmap_ = static_cast<uint64_t *>(scalloc(num_words_, sizeof(uint64_t)));
+    size_ = 0;
+  }
+
+  ~Md5BloomFilter() {
+    free(bitmap_);
+  }
+
+  void Insert(const shash::Md5 &key) {
+    uint64_t h1, h2;
+    key.ToIntPair(&h1, &h2);
+    h2 |= 1;
+    for (unsigned i = 0; i < kNumProbes; ++i) {
+      const uint64_t bit = (h1 + i*h2) % num_bits_;
+      bitmap_[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    size_++;
+  }
+
+  /**
+   * False means that the key was certainly never inserted.  True means the key
+   * was probably inserted.
+   */
+  bool Contains(const shash::Md5 &key) const {
+    uint64_t h1, h2;
+    key.ToIntPair(&h1, &h2);
+    h2 |= 1;
+    for (unsigned i = 0; i < kNumProbes; ++i) {
+      const uint64_t bit = (h1 + i*h2) % num_bits_;
+      if ((bitmap_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+        return false;
+    }
+    return true;
+  }
+
+  uint64_t size() const { return size_; }
+  uint64_t num_bits() const { return num_bits_; }
+  uint64_t GetMemorySize() const { return num_words_ * sizeof(uint64_t); }
+
+ private:
+  // Not copyable
+  Md5BloomFilter(const Md5BloomFilter &other);
+  Md5BloomFilter &operator= (const Md5BloomFilter &other);
+
+  uint64_t *bitmap_;
+  uint64_t num_words_;
+  uint64_t num_bits_;
+  uint64_t size_;
+};
+
+#endif  // CVMFS_BLOOM_H_
@@ -21,7 +21,11 @@
  * rename().  This concept is taken over from GROW-FS.
  *
  * Identical URLs won't be concurrently downloaded.  The first thread performs
- * the download and informs the other, waiting threads on pipes.
+ * the download and wakes up the other, waiting threads by a condition
+ * variable.  The waiting threads open the committed object themselves.  If
+ * several processes share the cache directory, a lock file per object in txn
+ * ensures that only one of them downloads it.  The others wait for the object
+ * to appear in the cache.
  */
 
 #define __STDC_FORMAT_MACROS
@@ -30,6 +34,7 @@
 #include "cache.h"
 
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -40,7 +45,9 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <ctime>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
@@ -65,6 +72,12 @@ using namespace std;  // NOLINT
 namespace cache {
 
 uint64_t kBigFile = 25*1024*1024;  // As of 25M, a file is considered "big file"
+/**
+ * A process waiting for another process' download gives up waiting if the
+ * download made no progress for so many seconds.
+ */
+const unsigned kCoalesceStallTimeout = 60;
+const unsigned kCoalesceMaxPollMs = 250;
 
 /**
  * A CallQuard object can be placed at the beginning of a function.  It counts
@@ -104,30 +117,55 @@ atomic_int32 CallGuard::global_drainout_ = 0;
  * Everything that should be reused per thread
  */
 struct ThreadLocalStorage {
-  int pipe_wait[2];
-  vector<int> other_pipes_waiting;
   download::JobInfo download_job;
 };
 
-typedef map< shash::Any, vector<int> * > ThreadQueues;
+/**
+ * A download in flight that other threads wait for.  Protected by
+ * lock_queues_download_.  The last thread that leaves, the downloader or a
+ * waiter, frees it.
+ */
+struct InflightDownload {
+  InflightDownload() : finished(false), result(-EIO), fd(-1), num_waiting(0) {
+    int retval = pthread_cond_init(&cond_finished, NULL);
+    assert(retval == 0);
+  }
+  ~InflightDownload() {
+    if (fd >= 0)
+      close(fd);
+    pthread_cond_destroy(&cond_finished);
+  }
+  pthread_cond_t cond_finished;
+  bool finished;
+  int result;  /**< file descriptor of the downloader or negative error code */
+  /**
+   * Duplicate of the downloader's file descriptor for the waiters, so that
+   * they get the object even if it has been evicted in the meantime
+   */
+  int fd;
+  unsigned num_waiting;
+};
+
+typedef map<shash::Any, InflightDownload *> ThreadQueues;
 
 string *cache_path_ = NULL;
 bool alien_cache_ = false;
 ThreadQueues *queues_download_ = NULL;  /**< maps currently
-  downloaded chunks to an array of writer's ends of a pipe to signal the waiting
-  threads when the download has finished */
+  downloaded chunks to the state shared with the waiting threads */
 pthread_mutex_t lock_queues_download_ = PTHREAD_MUTEX_INITIALIZER;
 pthread_key_t thread_local_storage_;
 vector<ThreadLocalStorage *> *tls_blocks_;
 pthread_mutex_t lock_tls_blocks_ = PTHREAD_MUTEX_INITIALIZER;
 atomic_int64 num_download_;
+bool coalesce_downloads_ = false;
+atomic_int64 num_download_coalesced_;  /**< downloaded by other processes */
+atomic_int64 num_download_bundled_;  /**< files unpacked from bundles */
+atomic_int64 num_download_packed_;  /**< files downloaded from packs */
 
 CacheModes cache_mode_;
 
 
 static void CleanupTLS(ThreadLocalStorage *tls) {
-  close(tls->pipe_wait[0]);
-  close(tls->pipe_wait[1]);
   delete tls;
 }
 
@@ -151,15 +189,22 @@ static void TLSDestructor(void *data) {
 /**
  * Initializes the cache directory with the 256 subdirectories and /txn.
  *
+ * @param coalesce_downloads  other processes use the cache directory, too
  * \return True on success, false otherwise
  */
-bool Init(const string &cache_path, const bool alien_cache) {
+bool Init(const string &cache_path, const bool alien_cache,
+          const bool coalesce_downloads)
+{
   cache_mode_ = kCacheReadWrite;
   cache_path_ = new string(cache_path);
   alien_cache_ = alien_cache;
+  coalesce_downloads_ = coalesce_downloads;
   queues_download_ = new ThreadQueues();
   tls_blocks_ = new vector<ThreadLocalStorage *>();
   atomic_init64(&num_download_);
+  atomic_init64(&num_download_coalesced_);
+  atomic_init64(&num_download_bundled_);
+  atomic_init64(&num_download_packed_);
 
   if (alien_cache_) {
     if (!MakeCacheDirectories(cache_path, 0770)) {
@@ -422,6 +467,123 @@ static bool CommitFromMem(const shash::Any &id, const unsigned char *buffer,
 }
 
 
+static inline string GetDownloadLockPath(const shash::Any &id) {
+  return *cache_path_ + "/txn/download." + id.ToString();
+}
+
+
+/**
+ * Tries to become the process that downloads an object into the shared cache.
+ * A lock file that is unlinked by its previous owner in the meantime does not
+ * count, the lock is taken on the new file then.
+ *
+ * \return File descriptor of the locked file, -2 if another process holds the
+ *         lock, -1 on error
+ */
+static int TryLockDownload(const string &lock_path) {
+  while (true) {
+    const int fd = open(lock_path.c_str(), O_RDWR | O_CREAT,
+                        alien_cache_ ? 0660 : 0600);
+    if (fd < 0)
+      return -1;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      const bool is_locked = (errno == EWOULDBLOCK);
+      close(fd);
+      return is_locked ? -2 : -1;
+    }
+
+    platform_stat64 info_fd;
+    platform_stat64 info_path;
+    if ((platform_fstat(fd, &info_fd) == 0) &&
+        (platform_stat(lock_path.c_str(), &info_path) == 0) &&
+        (info_fd.st_ino == info_path.st_ino))
+    {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+
+/**
+ * Removes the lock file before releasing the lock, so that waiting processes
+ * detect the stale file in TryLockDownload().
+ */
+static void UnlockDownload(const string &lock_path, const int fd_lock) {
+  unlink(lock_path.c_str());
+  flock(fd_lock, LOCK_UN);
+  close(fd_lock);
+}
+
+
+/**
+ * Waits for another process that downloads the object.  The downloader
+ * writes the path of its temporary file into the lock file, so that its
+ * progress can be watched.  A crashed downloader releases the lock
+ * automatically, a stalled one is not waited for longer than
+ * kCoalesceStallTimeout seconds.
+ *
+ * @param[out] fd_lock  The lock file if this process has to download the
+ *                      object itself, -1 if it has to download without lock
+ * \return Read-only file descriptor of the object in the cache, or a negative
+ *         value if the object has to be downloaded by this process
+ */
+static int WaitForDownload(const shash::Any &id, const string &lock_path,
+                           int *fd_lock)
+{
+  *fd_lock = -1;
+  unsigned poll_ms = 10;
+  int64_t last_size = -1;
+  time_t timestamp_progress = time(NULL);
+  while (true) {
+    int fd_object = cache::Open(id);
+    if (fd_object >= 0)
+      return fd_object;
+
+    *fd_lock = TryLockDownload(lock_path);
+    if (*fd_lock != -2) {
+      // The downloader is gone, maybe it succeeded right before
+      fd_object = cache::Open(id);
+      if ((fd_object >= 0) && (*fd_lock >= 0)) {
+        UnlockDownload(lock_path, *fd_lock);
+        *fd_lock = -1;
+      }
+      return fd_object;
+    }
+
+    char temp_path[PATH_MAX];
+    ssize_t length = 0;
+    const int fd_info = open(lock_path.c_str(), O_RDONLY);
+    if (fd_info >= 0) {
+      length = read(fd_info, temp_path, sizeof(temp_path) - 1);
+      close(fd_info);
+    }
+    platform_stat64 info;
+    if (length > 0) {
+      temp_path[length] = '\0';
+      if ((platform_stat(temp_path, &info) == 0) &&
+          (info.st_size != last_size))
+      {
+        last_size = info.st_size;
+        timestamp_progress = time(NULL);
+      }
+    }
+    if (time(NULL) > timestamp_progress +
+                     static_cast<time_t>(kCoalesceStallTimeout))
+    {
+      LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
+               "download of %s by another process stalled, "
+               "downloading it again", id.ToString().c_str());
+      *fd_lock = -1;
+      return -1;
+    }
+
+    SafeSleepMs(poll_ms);
+    poll_ms = std::min(2 * poll_ms, kCoalesceMaxPollMs);
+  }
+}
+
+
 /**
  * Returns a read-only file descriptor for a specific catalog entry, which could
  * be a complete file in the CAS as well as a chunk of a file.
@@ -434,6 +596,8 @@ static bool CommitFromMem(const shash::Any &id, const unsigned char *buffer,
  * @param[in] hash_suffix  optional hash suffix to append in the download job
  * @param[in] size         the required disk size of the downloaded data chunk
  * @param[in] cvmfs_path   Path of the chunk as seen in cvmfs
+ * @param[in] pack         if not NULL, the file is downloaded as a byte range
+ *                         of this pack
  *
  * \return Read-only file descriptor for the file pointing into local cache.
  *         On failure a negative error code.
@@ -442,7 +606,8 @@ static int Fetch(const shash::Any &checksum,
                  const string     &hash_suffix,
                  const uint64_t    size,
                  const string     &cvmfs_path,
-                 download::DownloadManager *download_manager)
+                 download::DownloadManager *download_manager,
+                 const FilePackLocation *pack = NULL)
 {
   CallGuard call_guard;
   int fd_return;  // Read-only file descriptor that is returned
@@ -476,8 +641,6 @@ static int Fetch(const shash::Any &checksum,
                             pthread_getspecific(thread_local_storage_));
   if (tls == NULL) {
     tls = new ThreadLocalStorage();
-    retval = pipe(tls->pipe_wait);
-    assert(retval == 0);
     tls->download_job.destination = download::kDestinationFile;
     tls->download_job.compressed = true;
     tls->download_job.probe_hosts = true;
@@ -489,18 +652,47 @@ static int Fetch(const shash::Any &checksum,
   }
 
   // Lock queue and start downloading or enqueue
+  InflightDownload *inflight;
   pthread_mutex_lock(&lock_queues_download_);
   ThreadQueues::iterator iDownloadQueue = queues_download_->find(checksum);
   if (iDownloadQueue != queues_download_->end()) {
     LogCvmfs(kLogCache, kLogDebug, "waiting for download of %s",
              cvmfs_path.c_str());
 
-    iDownloadQueue->second->push_back(tls->pipe_wait[1]);
+    inflight = iDownloadQueue->second;
+    inflight->num_waiting++;
+    while (!inflight->finished)
+      pthread_cond_wait(&inflight->cond_finished, &lock_queues_download_);
+    const int result = inflight->result;
+    const int fd_dup = (inflight->fd >= 0) ? dup(inflight->fd) : -1;
+    inflight->num_waiting--;
+    if (inflight->num_waiting == 0)
+      delete inflight;
     pthread_mutex_unlock(&lock_queues_download_);
-    ReadPipe(tls->pipe_wait[0], &fd_return, sizeof(int));
 
-    LogCvmfs(kLogCache, kLogDebug, "received from another thread fd %d for %s",
-             fd_return, cvmfs_path.c_str());
+    if (result < 0) {
+      LogCvmfs(kLogCache, kLogDebug,
+               "download of %s by another thread failed (%d)",
+               cvmfs_path.c_str(), result);
+      return result;
+    }
+    // The downloader has just inserted the object into the cache quota, so
+    // there is no need to touch it.  A new open file description keeps the
+    // file offset apart from the other threads' descriptors; the duplicate
+    // serves if the object has been evicted in the meantime.
+    fd_return = cache::Open(checksum);
+    if (fd_return >= 0) {
+      if (fd_dup >= 0)
+        close(fd_dup);
+    } else {
+      fd_return = fd_dup;
+      if (fd_return < 0) {
+        return Fetch(checksum, hash_suffix, size, cvmfs_path,
+                     download_manager, pack);
+      }
+    }
+    LogCvmfs(kLogCache, kLogDebug, "opened %s downloaded by another thread",
+             cvmfs_path.c_str());
     return fd_return;
   } else {
     // Seems we are the first one, check again in the cache (race condition)
@@ -512,20 +704,45 @@ static int Fetch(const shash::Any &checksum,
     }
 
     // Create a new queue for this chunk
-    (*queues_download_)[checksum] = &tls->other_pipes_waiting;
+    inflight = new InflightDownload();
+    (*queues_download_)[checksum] = inflight;
     pthread_mutex_unlock(&lock_queues_download_);
   }
 
   // The download path starts here
-  LogCvmfs(kLogCache, kLogDebug, "downloading %s", cvmfs_path.c_str());
-  atomic_inc64(&num_download_);
-
-  const string url = "/data" + checksum.MakePath(1, 2) + hash_suffix;
+  const string url = (pack == NULL) ?
+    "/data" + checksum.MakePath(1, 2) + hash_suffix :
+    "/data" + pack->pack_hash().MakePath(1, 2) + FilePackLocation::kCasSuffix;
   string final_path;
   string temp_path;
-  int fd;  // Used to write the downloaded file
+  int fd = -1;  // Used to write the downloaded file
   FILE *f = NULL;
   int result = -EIO;
+  string lock_path;
+  int fd_lock = -1;
+
+  // Another process sharing the cache might download the object already
+  if (coalesce_downloads_) {
+    lock_path = GetDownloadLockPath(checksum);
+    fd_lock = TryLockDownload(lock_path);
+    if (fd_lock == -2) {
+      LogCvmfs(kLogCache, kLogDebug,
+               "waiting for another process downloading %s",
+               cvmfs_path.c_str());
+      fd_return = WaitForDownload(checksum, lock_path, &fd_lock);
+      if (fd_return >= 0) {
+        atomic_inc64(&num_download_coalesced_);
+        quota::Touch(checksum);
+        result = fd_return;
+        goto fetch_finalize;
+      }
+    }
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "downloading %s", cvmfs_path.c_str());
+  atomic_inc64(&num_download_);
+  if (pack != NULL)
+    atomic_inc64(&num_download_packed_);
 
   fd = StartTransaction(checksum, &final_path, &temp_path);
   if (fd < 0) {
@@ -541,10 +758,19 @@ static int Fetch(const shash::Any &checksum,
     LogCvmfs(kLogCache, kLogDebug, "could not fdopen %s", final_path.c_str());
     goto fetch_finalize;
   }
+  if (fd_lock >= 0) {
+    // Lets waiting processes watch the progress
+    if (write(fd_lock, temp_path.data(), temp_path.length()) < 0) {
+      LogCvmfs(kLogCache, kLogDebug, "could not write %s (%d)",
+               lock_path.c_str(), errno);
+    }
+  }
 
   tls->download_job.url = &url;
   tls->download_job.destination_file = f;
   tls->download_job.expected_hash = &checksum;
+  tls->download_job.range_offset = (pack == NULL) ? 0 : pack->offset();
+  tls->download_job.range_size = (pack == NULL) ? 0 : pack->size();
   download_manager->Fetch(&tls->download_job);
 
   if (tls->download_job.error_code == download::kFailOk) {
@@ -601,15 +827,21 @@ static int Fetch(const shash::Any &checksum,
     else close(fd);
     AbortTransaction(temp_path);
   }
+  if (fd_lock >= 0)
+    UnlockDownload(lock_path, fd_lock);
 
-  // Signal the waiting threads and remove the queue
+  // Wake up the waiting threads and remove the queue
   pthread_mutex_lock(&lock_queues_download_);
-  for (unsigned i = 0, s = tls->other_pipes_waiting.size(); i < s; ++i) {
-    int fd_dup = (result >= 0) ? dup(result) : result;
-    WritePipe(tls->other_pipes_waiting[i], &fd_dup, sizeof(int));
-  }
-  tls->other_pipes_waiting.clear();
+  inflight->finished = true;
+  inflight->result = result;
   queues_download_->erase(checksum);
+  if (inflight->num_waiting == 0) {
+    delete inflight;
+  } else {
+    if (result >= 0)
+      inflight->fd = dup(result);
+    pthread_cond_broadcast(&inflight->cond_finished);
+  }
   pthread_mutex_unlock(&lock_queues_download_);
 
   return result;
@@ -618,7 +850,8 @@ static int Fetch(const shash::Any &checksum,
 
 /**
  * Returns a read-only file descriptor for a specific catalog entry.
- * After successful call, the file resides in local cache.
+ * After successful call, the file resides in local cache.  A packed file is
+ * downloaded as a byte range of its pack.
  *
  * @param[in] d           Demanded catalog entry
  * @param[in] cvmfs_path  Path of the chunk as seen in cvmfs
@@ -629,6 +862,16 @@ int FetchDirent(const catalog::DirectoryEntry &d,
                 const string &cvmfs_path,
                 download::DownloadManager *download_manager)
 {
+  if (d.IsPackedFile()) {
+    FilePackLocation location;
+    if (!d.catalog()->LookupPackedFile(PathString(cvmfs_path), &location)) {
+      LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+               "no pack location for %s", cvmfs_path.c_str());
+      return -EIO;
+    }
+    return Fetch(d.checksum(), "", d.size(), cvmfs_path, download_manager,
+                 &location);
+  }
   return Fetch(d.checksum(), "", d.size(), cvmfs_path, download_manager);
 }
 
@@ -653,11 +896,95 @@ int FetchChunk(const FileChunk &chunk, const string &cvmfs_path,
 }
 
 
+/**
+ * Fetches the bundle of the small files of a directory and commits the
+ * bundled files that are not yet in the cache.  The bundle is verified by its
+ * content hash from the catalog, which vouches for the bundled files.  Once
+ * unpacked, the bundle is removed from the cache so that the files do not
+ * occupy the cache twice.
+ *
+ * @param[in] bundle      Bundle as registered in the catalog
+ * @param[in] cvmfs_path  Path of the bundled directory as seen in cvmfs
+ * @param[in] file_paths  Paths of the files of the directory by content hash,
+ *                        used for the cache catalog
+ * \return Number of files committed to the cache, negative error code else
+ */
+int FetchBundle(const FileBundle &bundle, const string &cvmfs_path,
+                const map<shash::Any, string> &file_paths,
+                download::DownloadManager *download_manager)
+{
+  if (cache_mode_ == kCacheReadOnly)
+    return -EROFS;
+
+  const int fd = Fetch(bundle.content_hash(),
+                       FileBundle::kCasSuffix,
+                       bundle.size(),
+                       cvmfs_path,
+                       download_manager);
+  if (fd < 0)
+    return fd;
+
+  unsigned char *buffer =
+    static_cast<unsigned char *>(smalloc(bundle.size()));
+  const int64_t nbytes = pread(fd, buffer, bundle.size(), 0);
+  close(fd);
+  quota::Remove(bundle.content_hash());
+  FileBundleIndex index;
+  if ((nbytes != static_cast<int64_t>(bundle.size())) ||
+      !ParseFileBundleIndex(buffer, bundle.size(), &index))
+  {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "failed to read bundle %s of %s",
+             bundle.content_hash().ToString().c_str(), cvmfs_path.c_str());
+    free(buffer);
+    return -EIO;
+  }
+
+  int num_committed = 0;
+  for (unsigned i = 0; i < index.size(); ++i) {
+    const int fd_entry = cache::Open(index[i].content_hash);
+    if (fd_entry >= 0) {
+      close(fd_entry);
+      continue;
+    }
+    const map<shash::Any, string>::const_iterator path =
+      file_paths.find(index[i].content_hash);
+    if (CommitFromMem(index[i].content_hash, buffer + index[i].offset,
+                      index[i].size,
+                      (path == file_paths.end()) ? cvmfs_path : path->second))
+    {
+      num_committed++;
+    }
+  }
+  free(buffer);
+
+  LogCvmfs(kLogCache, kLogDebug, "committed %d of %u files bundled in %s",
+           num_committed, index.size(), cvmfs_path.c_str());
+  atomic_xadd64(&num_download_bundled_, num_committed);
+  return num_committed;
+}
+
+
 int64_t GetNumDownloads() {
   return atomic_read64(&num_download_);
 }
 
 
+int64_t GetNumCoalescedDownloads() {
+  return atomic_read64(&num_download_coalesced_);
+}
+
+
+int64_t GetNumBundledDownloads() {
+  return atomic_read64(&num_download_bundled_);
+}
+
+
+int64_t GetNumPackedDownloads() {
+  return atomic_read64(&num_download_packed_);
+}
+
+
 CatalogManager::CatalogManager(const string &repo_name,
                                signature::SignatureManager *signature_manager,
                                download::DownloadManager *download_manager)
@@ -671,6 +998,197 @@ CatalogManager::CatalogManager(const string &repo_name,
   loaded_inodes_ = all_inodes_ = 0;
   atomic_init32(&certificate_hits_);
   atomic_init32(&certificate_misses_);
+  prefetch_terminate_ = false;
+  num_sibling_loads_ = 0;
+  atomic_init32(&prefetch_queued_);
+  atomic_init32(&prefetch_downloads_);
+  atomic_init32(&prefetch_hits_);
+  int retval = pthread_mutex_init(&lock_prefetch_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_prefetch_queue_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_catalogs_inflight_, NULL);
+  assert(retval == 0);
+}
+
+
+/**
+ * Starts the threads that download nested catalogs in the background.  Has to
+ * be called after fork().  Without prefetch threads, catalogs are only loaded
+ * on demand.
+ */
+void CatalogManager::SpawnPrefetcher(const unsigned num_threads) {
+  assert(prefetch_threads_.empty());
+  for (unsigned i = 0; i < num_threads; ++i) {
+    pthread_t thread;
+    int retval = pthread_create(&thread, NULL, MainPrefetch, this);
+    assert(retval == 0);
+    prefetch_threads_.push_back(thread);
+  }
+  LogCvmfs(kLogCache, kLogDebug, "started %u catalog prefetch threads",
+           num_threads);
+}
+
+
+void *CatalogManager::MainPrefetch(void *data) {
+  CatalogManager *catalog_mgr = static_cast<CatalogManager *>(data);
+  LogCvmfs(kLogCache, kLogDebug, "starting catalog prefetch thread");
+
+  while (true) {
+    pthread_mutex_lock(&catalog_mgr->lock_prefetch_);
+    while (catalog_mgr->prefetch_queue_.empty() &&
+           !catalog_mgr->prefetch_terminate_)
+    {
+      pthread_cond_wait(&catalog_mgr->cond_prefetch_queue_,
+                        &catalog_mgr->lock_prefetch_);
+    }
+    if (catalog_mgr->prefetch_terminate_) {
+      pthread_mutex_unlock(&catalog_mgr->lock_prefetch_);
+      break;
+    }
+    const PrefetchJob job = catalog_mgr->prefetch_queue_.front();
+    catalog_mgr->prefetch_queue_.pop_front();
+    pthread_mutex_unlock(&catalog_mgr->lock_prefetch_);
+
+    catalog_mgr->PrefetchCatalog(job);
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "stopping catalog prefetch thread");
+  return NULL;
+}
+
+
+/**
+ * Downloads a catalog into the cache as a regular, unpinned cache entry.  It
+ * gets pinned when it is actually loaded.
+ */
+void CatalogManager::PrefetchCatalog(const PrefetchJob &job) {
+  CallGuard call_guard;
+  if (cache_mode_ == kCacheReadOnly)
+    return;
+  // Skip catalogs that are being loaded anyway
+  if (!AcquireCatalogLoad(job.hash, false))
+    return;
+  if (FileExists(GetPathInCache(job.hash))) {
+    ReleaseCatalogLoad(job.hash);
+    return;
+  }
+
+  string final_path;
+  string temp_path;
+  int fd = StartTransaction(job.hash, &final_path, &temp_path);
+  if (fd < 0) {
+    ReleaseCatalogLoad(job.hash);
+    return;
+  }
+  FILE *f = fdopen(fd, "w");
+  if (!f) {
+    close(fd);
+    AbortTransaction(temp_path);
+    ReleaseCatalogLoad(job.hash);
+    return;
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "prefetching %s", job.cvmfs_path.c_str());
+  const string url = "/data" + job.hash.MakePath(1, 2) + "C";
+  download::JobInfo download_catalog(&url, true, true, f, &job.hash);
+  download_manager_->Fetch(&download_catalog);
+  fclose(f);
+  if (download_catalog.error_code != download::kFailOk) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to prefetch catalog %s (%d)",
+             job.hash.ToString().c_str(), download_catalog.error_code);
+    AbortTransaction(temp_path);
+    ReleaseCatalogLoad(job.hash);
+    return;
+  }
+
+  const int64_t size = GetFileSize(temp_path.c_str());
+  if ((size <= 0) || (uint64_t(size) > quota::GetMaxFileSize())) {
+    AbortTransaction(temp_path);
+    ReleaseCatalogLoad(job.hash);
+    return;
+  }
+  if (CommitTransaction(final_path, temp_path, job.cvmfs_path,
+                        job.hash, uint64_t(size)) == 0)
+  {
+    atomic_inc32(&prefetch_downloads_);
+    pthread_mutex_lock(&lock_prefetch_);
+    catalogs_prefetched_.insert(job.hash);
+    pthread_mutex_unlock(&lock_prefetch_);
+  }
+  ReleaseCatalogLoad(job.hash);
+}
+
+
+/**
+ * Marks a catalog as being downloaded.  If it is already being downloaded,
+ * either waits for the other download to finish or returns false.
+ */
+bool CatalogManager::AcquireCatalogLoad(const shash::Any &hash,
+                                        const bool wait)
+{
+  pthread_mutex_lock(&lock_prefetch_);
+  while (catalogs_inflight_.find(hash) != catalogs_inflight_.end()) {
+    if (!wait) {
+      pthread_mutex_unlock(&lock_prefetch_);
+      return false;
+    }
+    pthread_cond_wait(&cond_catalogs_inflight_, &lock_prefetch_);
+  }
+  catalogs_inflight_.insert(hash);
+  pthread_mutex_unlock(&lock_prefetch_);
+  return true;
+}
+
+
+void CatalogManager::ReleaseCatalogLoad(const shash::Any &hash) {
+  pthread_mutex_lock(&lock_prefetch_);
+  catalogs_inflight_.erase(hash);
+  pthread_cond_broadcast(&cond_catalogs_inflight_);
+  pthread_mutex_unlock(&lock_prefetch_);
+}
+
+
+/**
+ * Nested catalogs below the same parent that are loaded one after another
+ * indicate a tree walk (find, ls -R, ...).  In this case, the not yet loaded
+ * siblings are queued for prefetching.  Called with the catalog tree locked.
+ */
+void CatalogManager::DetectTreeWalk(const catalog::Catalog *catalog) {
+  const catalog::Catalog *parent = catalog->parent();
+  if (parent->path() != prefetch_parent_) {
+    prefetch_parent_ = parent->path();
+    num_sibling_loads_ = 0;
+  }
+  num_sibling_loads_++;
+  if (num_sibling_loads_ != kPrefetchSiblingThreshold)
+    return;
+
+  const catalog::Catalog::NestedCatalogList *siblings =
+    parent->ListNestedCatalogs();
+  pthread_mutex_lock(&lock_prefetch_);
+  for (catalog::Catalog::NestedCatalogList::const_iterator
+       i = siblings->begin(), iEnd = siblings->end(); i != iEnd; ++i)
+  {
+    if (prefetch_queue_.size() >= kMaxPrefetchQueue)
+      break;
+    if (i->hash.IsNull() ||
+        (mounted_catalogs_.find(i->path) != mounted_catalogs_.end()))
+    {
+      continue;
+    }
+    PrefetchJob job;
+    job.hash = i->hash;
+    job.cvmfs_path = "file catalog at " + repo_name_ + ":" +
+      string(i->path.GetChars(), i->path.GetLength()) +
+      " (" + i->hash.ToString() + ")";
+    prefetch_queue_.push_back(job);
+    atomic_inc32(&prefetch_queued_);
+  }
+  pthread_cond_broadcast(&cond_prefetch_queue_);
+  pthread_mutex_unlock(&lock_prefetch_);
+  LogCvmfs(kLogCache, kLogDebug, "tree walk below %s, queued siblings",
+           parent->path().c_str());
 }
 
 
@@ -711,12 +1229,36 @@ void CatalogManager::ActivateCatalog(const catalog::Catalog *catalog) {
     all_inodes_ = counters.GetAllEntries();
   }
   loaded_inodes_ += counters.GetSelfEntries();
+
+  if (!prefetch_threads_.empty() && !catalog->IsRoot())
+    DetectTreeWalk(catalog);
 }
 
 
+/**
+ * Serializes with the prefetcher: if the catalog is currently prefetched, waits
+ * for the download to finish and then takes it from the cache.
+ */
 catalog::LoadError CatalogManager::LoadCatalogCas(const shash::Any &hash,
                                                   const string &cvmfs_path,
                                                   std::string *catalog_path)
+{
+  AcquireCatalogLoad(hash, true);
+  const catalog::LoadError result =
+    DoLoadCatalogCas(hash, cvmfs_path, catalog_path);
+
+  pthread_mutex_lock(&lock_prefetch_);
+  if (catalogs_prefetched_.erase(hash) > 0)
+    atomic_inc32(&prefetch_hits_);
+  pthread_mutex_unlock(&lock_prefetch_);
+  ReleaseCatalogLoad(hash);
+  return result;
+}
+
+
+catalog::LoadError CatalogManager::DoLoadCatalogCas(const shash::Any &hash,
+                                                    const string &cvmfs_path,
+                                                    std::string *catalog_path)
 {
   CallGuard call_guard;
   int64_t size;
@@ -982,7 +1524,34 @@ void CatalogManager::UnloadCatalog(const catalog::Catalog *catalog) {
 }
 
 
+/**
+ * Mountpoints of the currently attached catalogs, parents before children.
+ */
+vector<string> CatalogManager::GetMountpoints() {
+  vector<string> result;
+  ReadLock();
+  for (map<PathString, shash::Any>::const_iterator
+       i = mounted_catalogs_.begin(), iEnd = mounted_catalogs_.end();
+       i != iEnd; ++i)
+  {
+    result.push_back(string(i->first.GetChars(), i->first.GetLength()));
+  }
+  Unlock();
+  return result;
+}
+
+
 CatalogManager::~CatalogManager() {
+  pthread_mutex_lock(&lock_prefetch_);
+  prefetch_terminate_ = true;
+  pthread_cond_broadcast(&cond_prefetch_queue_);
+  pthread_mutex_unlock(&lock_prefetch_);
+  for (unsigned i = 0; i < prefetch_threads_.size(); ++i)
+    pthread_join(prefetch_threads_[i], NULL);
+  pthread_cond_destroy(&cond_catalogs_inflight_);
+  pthread_cond_destroy(&cond_prefetch_queue_);
+  pthread_mutex_destroy(&lock_prefetch_);
+
   LogCvmfs(kLogCache, kLogDebug, "unpinning / unloading all catalogs");
 
   if (cache_mode_ == kCacheReadWrite) {
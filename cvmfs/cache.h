@@ -7,14 +7,19 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <string>
 #include <map>
+#include <set>
+#include <deque>
 #include <vector>
 
 #include "catalog_mgr.h"
 #include "signature.h"
+#include "file_bundle.h"
 #include "file_chunk.h"
+#include "file_pack.h"
 #include "shortstring.h"
 #include "atomic.h"
 #include "manifest_fetch.h"
@@ -40,7 +45,8 @@ enum CacheModes {
   kCacheReadOnly,
 };
 
-bool Init(const std::string &cache_path, const bool alien_cache);
+bool Init(const std::string &cache_path, const bool alien_cache,
+          const bool coalesce_downloads = false);
 void Fini();
 
 int Open(const shash::Any &id);
@@ -50,7 +56,14 @@ int FetchDirent(const catalog::DirectoryEntry &d,
 int FetchChunk(const FileChunk &chunk,
                const std::string &cvmfs_path,
                download::DownloadManager *download_manager);
+int FetchBundle(const FileBundle &bundle,
+                const std::string &cvmfs_path,
+                const std::map<shash::Any, std::string> &file_paths,
+                download::DownloadManager *download_manager);
 int64_t GetNumDownloads();
+int64_t GetNumCoalescedDownloads();
+int64_t GetNumBundledDownloads();
+int64_t GetNumPackedDownloads();
 
 CacheModes GetCacheMode();
 void TearDown2ReadOnly();
@@ -70,6 +83,7 @@ class CatalogManager : public catalog::AbstractCatalogManager {
   virtual ~CatalogManager();
 
   bool InitFixed(const shash::Any &root_hash);
+  void SpawnPrefetcher(const unsigned num_threads);
 
   shash::Any GetRootHash() {
     ReadLock();
@@ -81,6 +95,14 @@ class CatalogManager : public catalog::AbstractCatalogManager {
     return "hits: " + StringifyInt(atomic_read32(&certificate_hits_)) + "    " +
     "misses: " + StringifyInt(atomic_read32(&certificate_misses_)) + "\n";
   }
+  std::vector<std::string> GetMountpoints();
+  std::string GetPrefetchStats() {
+    return "queued: " + StringifyInt(atomic_read32(&prefetch_queued_)) +
+    "    " +
+    "downloaded: " + StringifyInt(atomic_read32(&prefetch_downloads_)) +
+    "    " +
+    "used: " + StringifyInt(atomic_read32(&prefetch_hits_)) + "\n";
+  }
   bool offline_mode() const { return offline_mode_; }
   uint64_t all_inodes() const { return all_inodes_; }
   uint64_t loaded_inodes() const { return loaded_inodes_; }
@@ -97,9 +119,30 @@ class CatalogManager : public catalog::AbstractCatalogManager {
   void ActivateCatalog(const catalog::Catalog *catalog);
 
  private:
+  /**
+   * Nested catalogs of the same parent that are loaded one after another
+   * indicate a tree walk.  This many sibling loads trigger the download of
+   * the remaining siblings in the background.
+   */
+  static const unsigned kPrefetchSiblingThreshold = 2;
+  static const unsigned kMaxPrefetchQueue = 1024;
+
+  struct PrefetchJob {
+    shash::Any hash;
+    std::string cvmfs_path;
+  };
+
   catalog::LoadError LoadCatalogCas(const shash::Any &hash,
                                     const std::string &cvmfs_path,
                                     std::string *catalog_path);
+  catalog::LoadError DoLoadCatalogCas(const shash::Any &hash,
+                                      const std::string &cvmfs_path,
+                                      std::string *catalog_path);
+  bool AcquireCatalogLoad(const shash::Any &hash, const bool wait);
+  void ReleaseCatalogLoad(const shash::Any &hash);
+  void DetectTreeWalk(const catalog::Catalog *catalog);
+  void PrefetchCatalog(const PrefetchJob &job);
+  static void *MainPrefetch(void *data);
 
   /**
    * required for unpinning
@@ -116,6 +159,25 @@ class CatalogManager : public catalog::AbstractCatalogManager {
   uint64_t all_inodes_;
   uint64_t loaded_inodes_;
   BackoffThrottle backoff_throttle_;
+
+  /**
+   * Background download of nested catalogs.  Catalogs that are currently
+   * downloaded, by the prefetcher or by a regular load, are in
+   * catalogs_inflight_.  A catalog is never downloaded twice concurrently.
+   */
+  std::vector<pthread_t> prefetch_threads_;
+  std::deque<PrefetchJob> prefetch_queue_;
+  std::set<shash::Any> catalogs_inflight_;
+  std::set<shash::Any> catalogs_prefetched_;
+  bool prefetch_terminate_;
+  pthread_mutex_t lock_prefetch_;
+  pthread_cond_t cond_prefetch_queue_;
+  pthread_cond_t cond_catalogs_inflight_;
+  PathString prefetch_parent_;  /**< parent of the last loaded catalog */
+  unsigned num_sibling_loads_;
+  atomic_int32 prefetch_queued_;
+  atomic_int32 prefetch_downloads_;
+  atomic_int32 prefetch_hits_;
 };
 
 
@@ -2,11 +2,15 @@
  * This file is part of the CernVM File System.
  */
 
+#define __STDC_FORMAT_MACROS
+
 #include "catalog.h"
 
-#include <cassert>
+#include <inttypes.h>
 #include <errno.h>
 
+#include <cassert>
+
 #include "platform.h"
 #include "catalog_mgr.h"
 #include "util.h"
@@ -59,6 +63,11 @@ Catalog::Catalog(const PathString &path,
   nested_catalog_cache_ = NULL;
   uid_map_ = NULL;
   gid_map_ = NULL;
+  statistics_ = NULL;
+  path_filter_ = NULL;
+  atomic_init32(&path_filter_ready_);
+  path_filter_threshold_ = 0;
+  atomic_init64(&num_path_filter_misses_);
   sql_listing_ = NULL;
   sql_lookup_md5path_ = NULL;
   sql_lookup_inode_ = NULL;
@@ -66,6 +75,9 @@ Catalog::Catalog(const PathString &path,
   sql_list_nested_ = NULL;
   sql_all_chunks_ = NULL;
   sql_chunks_listing_ = NULL;
+  sql_lookup_bundle_ = NULL;
+  sql_lookup_packed_ = NULL;
+  sql_all_entries_ = NULL;
 }
 
 
@@ -73,8 +85,10 @@ Catalog::~Catalog() {
   pthread_mutex_destroy(lock_);
   free(lock_);
   FinalizePreparedStatements();
+  delete sql_all_entries_;
   delete database_;
   delete nested_catalog_cache_;
+  delete path_filter_;
 }
 
 
@@ -92,10 +106,16 @@ void Catalog::InitPreparedStatements() {
   sql_list_nested_     = new SqlNestedCatalogListing(database());
   sql_all_chunks_      = new SqlAllChunks(database());
   sql_chunks_listing_  = new SqlChunksListing(database());
+  if (database().schema_revision() >= 2)
+    sql_lookup_bundle_ = new SqlBundleLookup(database());
+  if (database().schema_revision() >= 3)
+    sql_lookup_packed_ = new SqlPackedLookup(database());
 }
 
 
 void Catalog::FinalizePreparedStatements() {
+  delete sql_lookup_packed_;
+  delete sql_lookup_bundle_;
   delete sql_chunks_listing_;
   delete sql_all_chunks_;
   delete sql_listing_;
@@ -184,6 +204,56 @@ bool Catalog::OpenDatabase(const string &db_path) {
 }
 
 
+/**
+ * Builds a path filter once the negative lookups in this catalog could have
+ * paid for a full scan of the catalog table.  Catalogs that are only used for
+ * positive lookups, or hardly used at all, never scan their table.  Only
+ * valid for read-only catalogs.
+ */
+void Catalog::EnablePathFilter() {
+  assert(!IsWritable() && IsInitialized());
+  const uint64_t threshold = max_row_id_ / kPathFilterRowsPerMiss;
+  path_filter_threshold_ =
+    (threshold > kPathFilterMinMisses) ? threshold : kPathFilterMinMisses;
+}
+
+
+/**
+ * Fills a Bloom filter with all path hashes of the catalog.  Lookups of paths
+ * that are ruled out by the filter are answered without querying SQlite,
+ * which speeds up the many ENOENT lookups of interpreters walking their
+ * search paths.  Only valid for read-only catalogs.
+ * @return true if the filter was built, false on SQlite errors
+ */
+bool Catalog::BuildPathFilter() const {
+  assert(!IsWritable() && (path_filter_ == NULL));
+
+  Md5BloomFilter *filter = new Md5BloomFilter(max_row_id_);
+  pthread_mutex_lock(lock_);
+  Sql sql_md5paths(database(), "SELECT md5path_1, md5path_2 FROM catalog;");
+  while (sql_md5paths.FetchRow()) {
+    filter->Insert(sql_md5paths.RetrieveMd5(0, 1));
+  }
+  const bool retval = sql_md5paths.GetLastError() == SQLITE_DONE;
+  pthread_mutex_unlock(lock_);
+
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogDebug,
+             "failed to build path filter for catalog %s (SqliteErrorcode: %d)",
+             path_.c_str(), sql_md5paths.GetLastError());
+    delete filter;
+    return false;
+  }
+
+  LogCvmfs(kLogCatalog, kLogDebug,
+           "built path filter for catalog %s (%"PRIu64" entries, %"PRIu64" "
+           "bytes)", path_.c_str(), filter->size(), filter->GetMemorySize());
+  path_filter_ = filter;
+  atomic_inc32(&path_filter_ready_);
+  return true;
+}
+
+
 /**
  * Performs a lookup on this Catalog for a given inode
  * @param inode the inode to perform the lookup for
@@ -223,10 +293,18 @@ bool Catalog::LookupInode(const inode_t inode, DirectoryEntry *dirent,
  * @return true if DirectoryEntry was successfully found, false otherwise
  */
 bool Catalog::LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
-                          DirectoryEntry *dirent) const
+                          DirectoryEntry *dirent,
+                          shash::Md5 *parent_md5path) const
 {
   assert(IsInitialized());
 
+  const bool has_path_filter = HasPathFilter();
+  if (has_path_filter && !path_filter_->Contains(md5path)) {
+    if (statistics_)
+      atomic_inc64(&statistics_->num_lookup_path_filtered);
+    return false;
+  }
+
   pthread_mutex_lock(lock_);
   sql_lookup_md5path_->BindPathHash(md5path);
   bool found = sql_lookup_md5path_->FetchRow();
@@ -234,9 +312,25 @@ bool Catalog::LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
     *dirent = sql_lookup_md5path_->GetDirent(this, expand_symlink);
     FixTransitionPoint(md5path, dirent);
   }
+  if (found && (parent_md5path != NULL))
+    *parent_md5path = sql_lookup_md5path_->GetParentPathHash();
   sql_lookup_md5path_->Reset();
   pthread_mutex_unlock(lock_);
 
+  if (!found) {
+    if (has_path_filter) {
+      if (statistics_)
+        atomic_inc64(&statistics_->num_lookup_path_filter_fp);
+    } else if ((path_filter_threshold_ > 0) &&
+               (static_cast<uint64_t>(
+                  atomic_xadd64(&num_path_filter_misses_, 1) + 1) ==
+                path_filter_threshold_))
+    {
+      // Only one thread reaches the threshold
+      BuildPathFilter();
+    }
+  }
+
   return found;
 }
 
@@ -254,6 +348,16 @@ bool Catalog::LookupMd5Path(const shash::Md5 &md5path,
 }
 
 
+/**
+ * Like LookupMd5Path but also retrieves the path hash of the parent directory.
+ */
+bool Catalog::LookupMd5Path(const shash::Md5 &md5path, DirectoryEntry *dirent,
+                            shash::Md5 *parent_md5path) const
+{
+  return LookupEntry(md5path, true, dirent, parent_md5path);
+}
+
+
 bool Catalog::LookupRawSymlink(const PathString &path,
                                LinkString *raw_symlink) const
 {
@@ -337,6 +441,32 @@ bool Catalog::AllChunksEnd() {
 }
 
 
+bool Catalog::AllEntriesBegin() {
+  if (sql_all_entries_ == NULL)
+    sql_all_entries_ = new SqlAllEntries(database());
+  return sql_all_entries_->Reset();
+}
+
+
+bool Catalog::AllEntriesNext(DirectoryEntry *dirent,
+                             shash::Md5 *md5path, shash::Md5 *parent_md5path)
+{
+  if (!sql_all_entries_->FetchRow())
+    return false;
+  *dirent = sql_all_entries_->GetDirent(this, false);
+  *md5path = sql_all_entries_->GetPathHash();
+  *parent_md5path = sql_all_entries_->GetParentPathHash();
+  return true;
+}
+
+
+bool Catalog::AllEntriesEnd() {
+  if (sql_all_entries_ == NULL)
+    return true;
+  return sql_all_entries_->Reset();
+}
+
+
 bool Catalog::ListMd5PathChunks(const shash::Md5  &md5path,
                                 FileChunkList    *chunks) const
 {
@@ -354,6 +484,52 @@ bool Catalog::ListMd5PathChunks(const shash::Md5  &md5path,
 }
 
 
+/**
+ * Looks up the bundle of the small files in a directory.  Catalogs before
+ * schema revision 2 have no bundles.
+ */
+bool Catalog::LookupMd5PathBundle(const shash::Md5 &md5path,
+                                  FileBundle *bundle) const
+{
+  assert(IsInitialized());
+  if (sql_lookup_bundle_ == NULL)
+    return false;
+
+  pthread_mutex_lock(lock_);
+  sql_lookup_bundle_->BindPathHash(md5path);
+  const bool found = sql_lookup_bundle_->FetchRow();
+  if (found)
+    *bundle = sql_lookup_bundle_->GetFileBundle();
+  sql_lookup_bundle_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
+/**
+ * Looks up where a packed file is stored.  Catalogs before schema revision 3
+ * have no packed files.
+ */
+bool Catalog::LookupMd5PathPacked(const shash::Md5 &md5path,
+                                  FilePackLocation *location) const
+{
+  assert(IsInitialized());
+  if (sql_lookup_packed_ == NULL)
+    return false;
+
+  pthread_mutex_lock(lock_);
+  sql_lookup_packed_->BindPathHash(md5path);
+  const bool found = sql_lookup_packed_->FetchRow();
+  if (found)
+    *location = sql_lookup_packed_->GetFilePackLocation();
+  sql_lookup_packed_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
 uint64_t Catalog::GetTTL() const {
   const string sql = "SELECT value FROM properties WHERE key='TTL';";
 
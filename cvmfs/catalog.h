@@ -14,9 +14,13 @@
 #include <map>
 #include <vector>
 
+#include "atomic.h"
+#include "bloom.h"
 #include "catalog_sql.h"
 #include "directory_entry.h"
+#include "file_bundle.h"
 #include "file_chunk.h"
+#include "file_pack.h"
 #include "hash.h"
 #include "shortstring.h"
 #include "sql.h"
@@ -33,6 +37,7 @@ class AbstractCatalogManager;
 class Catalog;
 
 class Counters;
+struct Statistics;
 
 typedef std::vector<Catalog *> CatalogList;
 typedef std::map<uint64_t, uint64_t> OwnerMap;  // used to map uid/gid
@@ -91,6 +96,11 @@ class Catalog : public SingleCopy {
   friend class swissknife::CommandMigrate; // for catalog version migration
  public:
   static const uint64_t kDefaultTTL = 900;  /**< 15 minutes default TTL */
+  /**
+   * A negative lookup in SQlite costs about as much as scanning 32 rows
+   */
+  static const uint64_t kPathFilterRowsPerMiss = 32;
+  static const uint64_t kPathFilterMinMisses = 64;
 
   Catalog(const PathString  &path,
           const shash::Any   &catalog_hash,
@@ -107,6 +117,8 @@ class Catalog : public SingleCopy {
   bool LookupInode(const inode_t inode,
                    DirectoryEntry *dirent, shash::Md5 *parent_md5path) const;
   bool LookupMd5Path(const shash::Md5 &md5path, DirectoryEntry *dirent) const;
+  bool LookupMd5Path(const shash::Md5 &md5path, DirectoryEntry *dirent,
+                     shash::Md5 *parent_md5path) const;
   inline bool LookupPath(const PathString &path, DirectoryEntry *dirent) const
   {
     return LookupMd5Path(shash::Md5(path.GetChars(), path.GetLength()), dirent);
@@ -132,6 +144,14 @@ class Catalog : public SingleCopy {
   bool AllChunksBegin();
   bool AllChunksNext(shash::Any *hash, ChunkTypes *type);
   bool AllChunksEnd();
+  /**
+   * Iterates over all directory entries in the order of their path hashes.
+   * Symlinks are not expanded.  The statement is prepared on demand.
+   */
+  bool AllEntriesBegin();
+  bool AllEntriesNext(DirectoryEntry *dirent,
+                      shash::Md5 *md5path, shash::Md5 *parent_md5path);
+  bool AllEntriesEnd();
 
   inline bool ListFileChunks(const PathString &path, FileChunkList *chunks) const
   {
@@ -139,6 +159,19 @@ class Catalog : public SingleCopy {
                              chunks);
   }
   bool ListMd5PathChunks(const shash::Md5 &md5path, FileChunkList *chunks) const;
+  inline bool LookupBundle(const PathString &path, FileBundle *bundle) const {
+    return LookupMd5PathBundle(shash::Md5(path.GetChars(), path.GetLength()),
+                               bundle);
+  }
+  bool LookupMd5PathBundle(const shash::Md5 &md5path, FileBundle *bundle) const;
+  inline bool LookupPackedFile(const PathString &path,
+                               FilePackLocation *location) const
+  {
+    return LookupMd5PathPacked(shash::Md5(path.GetChars(), path.GetLength()),
+                               location);
+  }
+  bool LookupMd5PathPacked(const shash::Md5 &md5path,
+                           FilePackLocation *location) const;
 
   uint64_t GetTTL() const;
   uint64_t GetRevision() const;
@@ -175,6 +208,12 @@ class Catalog : public SingleCopy {
 
   void SetInodeAnnotation(InodeAnnotation *new_annotation);
   void SetOwnerMaps(const OwnerMap *uid_map, const OwnerMap *gid_map);
+  void SetStatistics(Statistics *statistics) { statistics_ = statistics; }
+  void EnablePathFilter();
+  bool BuildPathFilter() const;
+  inline bool HasPathFilter() const {
+    return atomic_read32(&path_filter_ready_);
+  }
 
  protected:
   typedef std::map<uint64_t, inode_t> HardlinkGroupMap;
@@ -217,7 +256,8 @@ class Catalog : public SingleCopy {
 
  private:
   bool LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
-                   DirectoryEntry *dirent) const;
+                   DirectoryEntry *dirent,
+                   shash::Md5 *parent_md5path = NULL) const;
   Database *database_;
   pthread_mutex_t *lock_;
 
@@ -237,6 +277,20 @@ class Catalog : public SingleCopy {
   // Point to the maps in the catalog manager
   const OwnerMap *uid_map_;
   const OwnerMap *gid_map_;
+  // Lookup counters of the catalog manager, if any
+  Statistics *statistics_;
+  /**
+   * Negative lookup filter over the md5path column.  Only built for read-only
+   * catalogs once they had enough negative lookups (see EnablePathFilter()),
+   * immutable afterwards.  Valid once path_filter_ready_ is set.
+   */
+  mutable Md5BloomFilter *path_filter_;
+  mutable atomic_int32 path_filter_ready_;
+  /**
+   * Number of negative lookups that build the filter, 0 if disabled
+   */
+  uint64_t path_filter_threshold_;
+  mutable atomic_int64 num_path_filter_misses_;
 
   SqlListing               *sql_listing_;
   SqlLookupPathHash        *sql_lookup_md5path_;
@@ -245,6 +299,9 @@ class Catalog : public SingleCopy {
   SqlNestedCatalogListing  *sql_list_nested_;
   SqlAllChunks             *sql_all_chunks_;
   SqlChunksListing         *sql_chunks_listing_;
+  SqlBundleLookup          *sql_lookup_bundle_;  /**< NULL before revision 2 */
+  SqlPackedLookup          *sql_lookup_packed_;  /**< NULL before revision 3 */
+  SqlAllEntries            *sql_all_entries_;
 };  // class Catalog
 
 }  // namespace catalog
@@ -0,0 +1,296 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_diff.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "logging.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+void CatalogDiff::EntryStream::Clear() {
+  for (unsigned i = 0; i < cursors_.size(); ++i) {
+    cursors_[i]->catalog->AllEntriesEnd();
+    delete cursors_[i]->catalog;
+    delete cursors_[i];
+  }
+  cursors_.clear();
+  heap_.clear();
+}
+
+
+void CatalogDiff::EntryStream::Add(Catalog *catalog, const bool is_top) {
+  cursors_.push_back(new Cursor(catalog, is_top));
+}
+
+
+bool CatalogDiff::EntryStream::Begin() {
+  heap_.clear();
+  for (unsigned i = 0; i < cursors_.size(); ++i) {
+    if (!cursors_[i]->catalog->AllEntriesBegin())
+      return false;
+    if (Fetch(cursors_[i]))
+      heap_.push_back(cursors_[i]);
+  }
+  make_heap(heap_.begin(), heap_.end(), IsAfter);
+  return true;
+}
+
+
+void CatalogDiff::EntryStream::Advance() {
+  assert(!heap_.empty());
+  pop_heap(heap_.begin(), heap_.end(), IsAfter);
+  if (Fetch(heap_.back()))
+    push_heap(heap_.begin(), heap_.end(), IsAfter);
+  else
+    heap_.pop_back();
+}
+
+
+/**
+ * Reads the next entry of a catalog.  The root entry of a nested catalog is
+ * skipped, its mountpoint in the parent catalog represents the directory.
+ */
+bool CatalogDiff::EntryStream::Fetch(Cursor *cursor) {
+  do {
+    cursor->valid = cursor->catalog->AllEntriesNext(&cursor->entry,
+                                                    &cursor->md5path,
+                                                    &cursor->parent_md5path);
+  } while (cursor->valid && !cursor->is_top &&
+           cursor->entry.IsNestedCatalogRoot());
+
+  if (cursor->valid) {
+    uint64_t md5path_1, md5path_2;
+    cursor->md5path.ToIntPair(&md5path_1, &md5path_2);
+    cursor->key = make_pair(static_cast<int64_t>(md5path_1),
+                            static_cast<int64_t>(md5path_2));
+  }
+  return cursor->valid;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+CatalogDiff::~CatalogDiff() { }
+
+
+bool CatalogDiff::Run(const string &root_path,
+                      const shash::Any &old_root_hash,
+                      const shash::Any &new_root_hash)
+{
+  vector<Subtree> subtrees;
+  subtrees.push_back(Subtree(root_path, old_root_hash, new_root_hash));
+  while (!subtrees.empty()) {
+    const Subtree subtree = subtrees.back();
+    subtrees.pop_back();
+
+    bool retval =
+      LoadSubtree(subtree, subtree.mountpoint == root_path, &subtrees);
+    if (retval) {
+      statistics_.max_catalogs_open =
+        max(statistics_.max_catalogs_open,
+            static_cast<uint64_t>(old_stream_.size() + new_stream_.size()));
+      if (!old_stream_.Begin() || !new_stream_.Begin()) {
+        LogCvmfs(kLogCatalog, kLogStderr, "failed to read catalog entries");
+        retval = false;
+      } else {
+        retval = Merge();
+      }
+    }
+    old_stream_.Clear();
+    new_stream_.Clear();
+    if (!retval)
+      return false;
+  }
+  return true;
+}
+
+
+/**
+ * Opens the catalogs of a sub tree that need to be merged together.
+ * Mountpoints are processed from short to long paths, so that all catalogs
+ * that could contain a mountpoint are opened before the mountpoint is looked
+ * at.  A mountpoint that appears in both trees with the same hash is skipped
+ * together with its sub tree.  Other mountpoints that appear in both trees,
+ * or whose path is not covered by the other tree at all, are independent
+ * sub trees that are left for later.
+ */
+bool CatalogDiff::LoadSubtree(const Subtree &subtree, const bool is_top,
+                              vector<Subtree> *subtrees)
+{
+  MountpointMap pending;
+  pending[make_pair(subtree.mountpoint.length(), subtree.mountpoint)] =
+    make_pair(subtree.old_hash, subtree.new_hash);
+
+  while (!pending.empty()) {
+    const MountpointMap::iterator next = pending.begin();
+    const string mountpoint = next->first.second;
+    const shash::Any old_hash = next->second.first;
+    const shash::Any new_hash = next->second.second;
+    pending.erase(next);
+
+    if (!old_hash.IsNull() && (old_hash == new_hash)) {
+      ++statistics_.num_catalogs_skipped;
+      continue;
+    }
+    const bool is_subtree_top = (mountpoint == subtree.mountpoint);
+    if (!is_subtree_top &&
+        ((!old_hash.IsNull() && !new_hash.IsNull()) ||
+         (old_hash.IsNull() && subtree.old_hash.IsNull()) ||
+         (new_hash.IsNull() && subtree.new_hash.IsNull())))
+    {
+      subtrees->push_back(Subtree(mountpoint, old_hash, new_hash));
+      continue;
+    }
+    const bool is_top_catalog = is_top && is_subtree_top;
+    if (!old_hash.IsNull() &&
+        !Open(mountpoint, old_hash, is_top_catalog, false, &pending))
+    {
+      return false;
+    }
+    if (!new_hash.IsNull() &&
+        !Open(mountpoint, new_hash, is_top_catalog, true, &pending))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool CatalogDiff::Open(const string &mountpoint, const shash::Any &hash,
+                       const bool is_top, const bool is_new,
+                       MountpointMap *pending)
+{
+  Catalog *catalog =
+    LoadCatalog(PathString(mountpoint.data(), mountpoint.length()), hash);
+  if (catalog == NULL) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to load catalog %s (%s)",
+             hash.ToString().c_str(), mountpoint.c_str());
+    return false;
+  }
+  ++statistics_.num_catalogs_loaded;
+  (is_new ? new_stream_ : old_stream_).Add(catalog, is_top);
+
+  const Catalog::NestedCatalogList *nested_catalogs =
+    catalog->ListNestedCatalogs();
+  assert(nested_catalogs != NULL);
+  for (Catalog::NestedCatalogList::const_iterator i = nested_catalogs->begin(),
+       iEnd = nested_catalogs->end(); i != iEnd; ++i)
+  {
+    const string nested_mountpoint = i->path.ToString();
+    pair<shash::Any, shash::Any> &hashes =
+      (*pending)[make_pair(nested_mountpoint.length(), nested_mountpoint)];
+    (is_new ? hashes.second : hashes.first) = i->hash;
+  }
+  return true;
+}
+
+
+bool CatalogDiff::Merge() {
+  PathString path;
+  while (true) {
+    Cursor *old_cursor = old_stream_.Peek();
+    Cursor *new_cursor = new_stream_.Peek();
+    if ((old_cursor == NULL) && (new_cursor == NULL))
+      break;
+
+    if ((old_cursor != NULL) && (new_cursor != NULL) &&
+        (old_cursor->key == new_cursor->key))
+    {
+      ++statistics_.num_entries_compared;
+      const DirectoryEntryBase::Differences diff =
+        old_cursor->entry.CompareTo(new_cursor->entry);
+      if (diff != DirectoryEntryBase::Difference::kIdentical) {
+        ++statistics_.num_modified;
+        if (!GetPath(*new_cursor, &path))
+          return false;
+        OnModify(path, old_cursor->entry, new_cursor->entry, diff);
+      }
+      old_stream_.Advance();
+      new_stream_.Advance();
+    } else if ((new_cursor == NULL) ||
+               ((old_cursor != NULL) && (old_cursor->key < new_cursor->key)))
+    {
+      ++statistics_.num_removed;
+      if (!GetPath(*old_cursor, &path))
+        return false;
+      OnRemove(path, old_cursor->entry);
+      old_stream_.Advance();
+    } else {
+      ++statistics_.num_added;
+      if (!GetPath(*new_cursor, &path))
+        return false;
+      OnAdd(path, new_cursor->entry);
+      new_stream_.Advance();
+    }
+  }
+  return true;
+}
+
+
+/**
+ * Fails if the parent directories of the entry are inconsistent, e.g. in a
+ * corrupted catalog.
+ */
+bool CatalogDiff::GetPath(const Cursor &cursor, PathString *path) {
+  if (cursor.md5path == cursor.root_md5path) {
+    *path = cursor.catalog->path();
+    return true;
+  }
+
+  if (!GetDirectoryPath(cursor, cursor.parent_md5path, path)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to find the parent directory "
+             "of %s in catalog %s", cursor.entry.name().c_str(),
+             cursor.catalog->hash().ToString().c_str());
+    return false;
+  }
+  path->Append("/", 1);
+  path->Append(cursor.entry.name().GetChars(),
+               cursor.entry.name().GetLength());
+  return true;
+}
+
+
+/**
+ * Reconstructs the path of a directory from the parent path hashes.  The
+ * parent directories of an entry are in the same catalog up to the root of
+ * the catalog.
+ */
+bool CatalogDiff::GetDirectoryPath(const Cursor &cursor,
+                                   const shash::Md5 &md5path,
+                                   PathString *path)
+{
+  if (md5path == cursor.root_md5path) {
+    *path = cursor.catalog->path();
+    return true;
+  }
+  map<shash::Md5, PathString>::const_iterator cached = path_cache_.find(md5path);
+  if (cached != path_cache_.end()) {
+    *path = cached->second;
+    return true;
+  }
+
+  DirectoryEntry dirent;
+  shash::Md5 parent_md5path;
+  if (!cursor.catalog->LookupMd5Path(md5path, &dirent, &parent_md5path))
+    return false;
+  if (!GetDirectoryPath(cursor, parent_md5path, path))
+    return false;
+  path->Append("/", 1);
+  path->Append(dirent.name().GetChars(), dirent.name().GetLength());
+
+  if (path_cache_.size() >= kMaxCachedPaths)
+    path_cache_.clear();
+  path_cache_[md5path] = *path;
+  return true;
+}
+
+}  // namespace catalog
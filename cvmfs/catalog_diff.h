@@ -0,0 +1,179 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_DIFF_H_
+#define CVMFS_CATALOG_DIFF_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catalog.h"
+#include "directory_entry.h"
+#include "hash.h"
+#include "shortstring.h"
+#include "util.h"
+
+namespace catalog {
+
+/**
+ * Computes the changes between two revisions of a catalog tree.
+ *
+ * The nested catalogs of both trees are paired by their mountpoints.  Pairs
+ * with the same content hash are identical including all their nested
+ * catalogs, so they are not opened at all.  A mountpoint that exists in both
+ * trees bounds a sub tree that is compared on its own, one after another.
+ * Within such a sub tree, the entries of the changed catalogs are read in the
+ * order of their path hashes and merge-joined between both revisions.  The
+ * catalogs of a nested catalog that exists only in one revision are merged
+ * together with the catalogs of its parent, so that an entry that moved into
+ * a new (or out of a removed) nested catalog is matched as well.
+ *
+ * Changes are reported through the virtual callbacks while the catalogs are
+ * read, in path hash order per sub tree.  Only the catalogs of one sub tree
+ * are open at a time, memory consumption does not depend on the number of
+ * entries.  The paths of the reported entries are reconstructed by looking up
+ * their parent directories.
+ *
+ * Sub classes provide the catalogs, see LoadCatalog().
+ */
+class CatalogDiff : SingleCopy {
+ public:
+  struct Statistics {
+    Statistics() : num_catalogs_loaded(0), num_catalogs_skipped(0),
+      max_catalogs_open(0), num_entries_compared(0), num_added(0),
+      num_removed(0), num_modified(0) { }
+    uint64_t num_catalogs_loaded;
+    uint64_t num_catalogs_skipped;  ///< unchanged nested catalogs
+    uint64_t max_catalogs_open;
+    uint64_t num_entries_compared;
+    uint64_t num_added;
+    uint64_t num_removed;
+    uint64_t num_modified;
+  };
+
+  CatalogDiff() { }
+  virtual ~CatalogDiff();
+
+  /**
+   * Compares the trees of the catalogs with the given root hashes.  Either
+   * hash can be null, which makes all entries of the other tree additions or
+   * removals.
+   * @param root_path  the mountpoint of both root catalogs ("" for the
+   *                   repository root)
+   */
+  bool Run(const std::string &root_path,
+           const shash::Any &old_root_hash,
+           const shash::Any &new_root_hash);
+
+  const Statistics &statistics() const { return statistics_; }
+
+ protected:
+  /**
+   * Provides the catalog with the given hash.  The diff engine takes
+   * ownership of the returned catalog.
+   * @return  NULL on failure, which aborts the diff
+   */
+  virtual Catalog *LoadCatalog(const PathString &mountpoint,
+                               const shash::Any &catalog_hash) = 0;
+
+  virtual void OnAdd(const PathString &path, const DirectoryEntry &entry) = 0;
+  virtual void OnRemove(const PathString &path,
+                        const DirectoryEntry &entry) = 0;
+  virtual void OnModify(const PathString &path,
+                        const DirectoryEntry &old_entry,
+                        const DirectoryEntry &new_entry,
+                        const DirectoryEntryBase::Differences diff) = 0;
+
+ private:
+  static const unsigned kMaxCachedPaths = 64 * 1024;
+
+  /**
+   * The position of the sorted entry scan of a single catalog.
+   */
+  struct Cursor {
+    Cursor(Catalog *c, const bool top)
+      : catalog(c), is_top(top), valid(false),
+        root_md5path(c->path().GetChars(), c->path().GetLength()),
+        key(0, 0) { }
+    Catalog *catalog;
+    bool is_top;  ///< the root entry is no nested catalog root in this diff
+    bool valid;
+    shash::Md5 root_md5path;
+    DirectoryEntry entry;
+    shash::Md5 md5path;
+    shash::Md5 parent_md5path;
+    std::pair<int64_t, int64_t> key;  ///< sort order of the catalog table
+  };
+
+  /**
+   * Merges the sorted entry scans of all catalogs of one revision.
+   */
+  class EntryStream {
+   public:
+    EntryStream() { }
+    ~EntryStream() { Clear(); }
+    void Add(Catalog *catalog, const bool is_top);
+    /**
+     * Closes all catalogs.
+     */
+    void Clear();
+    unsigned size() const { return cursors_.size(); }
+    bool Begin();
+    /**
+     * The cursor with the smallest path hash or NULL at the end.
+     */
+    Cursor *Peek() const { return heap_.empty() ? NULL : heap_.front(); }
+    /**
+     * Moves the cursor returned by Peek() to its next entry.
+     */
+    void Advance();
+
+   private:
+    static bool Fetch(Cursor *cursor);
+    static bool IsAfter(const Cursor *a, const Cursor *b) {
+      return a->key > b->key;
+    }
+    std::vector<Cursor *> cursors_;
+    std::vector<Cursor *> heap_;  ///< min-heap of the valid cursors
+  };
+
+  /**
+   * The old and the new catalog of a mountpoint, either can be null.
+   */
+  struct Subtree {
+    Subtree(const std::string &m, const shash::Any &o, const shash::Any &n)
+      : mountpoint(m), old_hash(o), new_hash(n) { }
+    std::string mountpoint;
+    shash::Any old_hash;
+    shash::Any new_hash;
+  };
+  typedef std::map<std::pair<unsigned, std::string>,
+                   std::pair<shash::Any, shash::Any> > MountpointMap;
+
+  bool LoadSubtree(const Subtree &subtree, const bool is_top,
+                   std::vector<Subtree> *subtrees);
+  bool Open(const std::string &mountpoint, const shash::Any &hash,
+            const bool is_top, const bool is_new, MountpointMap *pending);
+  bool Merge();
+  bool GetPath(const Cursor &cursor, PathString *path);
+  bool GetDirectoryPath(const Cursor &cursor, const shash::Md5 &md5path,
+                        PathString *path);
+
+  EntryStream old_stream_;
+  EntryStream new_stream_;
+  /**
+   * Recently reconstructed directory paths.  A path hash denotes the same path
+   * in both revisions.
+   */
+  std::map<shash::Md5, PathString> path_cache_;
+  Statistics statistics_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_DIFF_H_
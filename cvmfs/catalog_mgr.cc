@@ -31,6 +31,7 @@ AbstractCatalogManager::AbstractCatalogManager() {
   retval = pthread_key_create(&pkey_sqlitemem_, NULL);
   assert(retval == 0);
   remount_listener_ = NULL;
+  path_filters_ = true;
 }
 
 
@@ -49,6 +50,12 @@ void AbstractCatalogManager::SetInodeAnnotation(InodeAnnotation *new_annotation)
 }
 
 
+void AbstractCatalogManager::SetPathFilters(const bool enabled) {
+  assert(catalogs_.empty());
+  path_filters_ = enabled;
+}
+
+
 void AbstractCatalogManager::SetOwnerMaps(const OwnerMap &uid_map,
                                           const OwnerMap &gid_map)
 {
@@ -670,6 +677,7 @@ bool AbstractCatalogManager::AttachCatalog(const string &db_path,
   new_catalog->set_inode_range(range);
   new_catalog->SetInodeAnnotation(inode_annotation_);
   new_catalog->SetOwnerMaps(&uid_map_, &gid_map_);
+  new_catalog->SetStatistics(&statistics_);
 
   // Add catalog to the manager
   if (!new_catalog->IsInitialized()) {
@@ -678,6 +686,10 @@ bool AbstractCatalogManager::AttachCatalog(const string &db_path,
     inode_gauge_ -= inode_chunk_size;
     return false;
   }
+
+  // Read-only catalogs don't change, negative lookups can be pre-filtered
+  if (path_filters_ && !new_catalog->IsWritable())
+    new_catalog->EnablePathFilter();
   CheckInodeWatermark();
 
   // The revision of the catalog tree is given by the root catalog revision
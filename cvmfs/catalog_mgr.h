@@ -53,6 +53,8 @@ struct Statistics {
   atomic_int64 num_lookup_inode;
   atomic_int64 num_lookup_path;
   atomic_int64 num_lookup_path_negative;
+  atomic_int64 num_lookup_path_filtered;  // ruled out by the path filter
+  atomic_int64 num_lookup_path_filter_fp;  // passed the filter, not found
   atomic_int64 num_listing;
   atomic_int64 num_nested_listing;
 
@@ -60,6 +62,8 @@ struct Statistics {
     atomic_init64(&num_lookup_inode);
     atomic_init64(&num_lookup_path);
     atomic_init64(&num_lookup_path_negative);
+    atomic_init64(&num_lookup_path_filtered);
+    atomic_init64(&num_lookup_path_filter_fp);
     atomic_init64(&num_listing);
     atomic_init64(&num_nested_listing);
   }
@@ -73,6 +77,12 @@ struct Statistics {
       "lookup(path-negative): " +
         StringifyInt(atomic_read64(&num_lookup_path_negative)) +
       "    " +
+      "lookup(path-filtered): " +
+        StringifyInt(atomic_read64(&num_lookup_path_filtered)) +
+      "    " +
+      "lookup(path-filter-false-positive): " +
+        StringifyInt(atomic_read64(&num_lookup_path_filter_fp)) +
+      "    " +
       "listing: " + StringifyInt(atomic_read64(&num_listing)) +
       "    " +
       "listing nested catalogs: " +
@@ -168,6 +178,11 @@ class AbstractCatalogManager {
     Unlock();
   }
   void SetOwnerMaps(const OwnerMap &uid_map, const OwnerMap &gid_map);
+  /**
+   * Bloom filters for negative lookups in read-only catalogs, on by default.
+   * Must be set before catalogs are attached.
+   */
+  void SetPathFilters(const bool enabled);
 
   Statistics statistics() const { return statistics_; }
   uint64_t inode_gauge() {
@@ -272,6 +287,7 @@ class AbstractCatalogManager {
   RemountListener *remount_listener_;
   OwnerMap uid_map_;
   OwnerMap gid_map_;
+  bool path_filters_;
 
   //Catalog *Inode2Catalog(const inode_t inode);
   std::string PrintHierarchyRecursively(const Catalog *catalog,
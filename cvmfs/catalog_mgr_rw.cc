@@ -393,6 +393,78 @@ void WritableCatalogManager::AddChunkedFile(const DirectoryEntryBase  &entry,
 }
 
 
+/**
+ * Adds a file that is stored in a pack instead of its own object.
+ * @param location where the compressed file is stored in the pack
+ */
+void WritableCatalogManager::AddPackedFile(const DirectoryEntryBase &entry,
+                                           const std::string &parent_directory,
+                                           const FilePackLocation &location)
+{
+  DirectoryEntry full_entry(entry);
+  full_entry.set_is_packed_file(true);
+
+  AddFile(full_entry, parent_directory);
+
+  const string parent_path = MakeRelativePath(parent_directory);
+  const string file_path   = entry.GetFullPath(parent_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(parent_path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "catalog for file '%s' cannot be found",
+             file_path.c_str());
+    assert(false);
+  }
+
+  catalog->SetPackLocation(file_path, location);
+  SyncUnlock();
+}
+
+
+/**
+ * Registers the bundle of the small files of a directory in the catalog that
+ * contains these files.
+ * @param directory_path the path of the bundled directory
+ */
+void WritableCatalogManager::SetBundle(const std::string &directory_path,
+                                       const FileBundle &bundle)
+{
+  const string path = MakeRelativePath(directory_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr,
+             "catalog for directory '%s' cannot be found", path.c_str());
+    assert(false);
+  }
+
+  catalog->SetBundle(path, bundle);
+  SyncUnlock();
+}
+
+
+/**
+ * Removes the bundle of a directory.  Has to be called before the directory
+ * itself is removed.
+ */
+void WritableCatalogManager::RemoveBundle(const std::string &directory_path) {
+  const string path = MakeRelativePath(directory_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr,
+             "catalog for directory '%s' cannot be found", path.c_str());
+    assert(false);
+  }
+
+  catalog->RemoveBundle(path);
+  SyncUnlock();
+}
+
+
 /**
  * Add a hardlink group to the catalogs.
  * @param entries a list of DirectoryEntries describing the new files
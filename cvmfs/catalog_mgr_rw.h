@@ -71,6 +71,9 @@ class WritableCatalogManager : public AbstractCatalogManager {
   void AddChunkedFile(const DirectoryEntryBase &entry,
                       const std::string &parent_directory,
                       const FileChunkList &file_chunks);
+  void AddPackedFile(const DirectoryEntryBase &entry,
+                     const std::string &parent_directory,
+                     const FilePackLocation &location);
   void RemoveFile(const std::string &file_path);
 
   void AddDirectory(const DirectoryEntryBase &entry,
@@ -79,6 +82,10 @@ class WritableCatalogManager : public AbstractCatalogManager {
                       const std::string &directory_path);
   void RemoveDirectory(const std::string &directory_path);
 
+  // Bundles of small files
+  void SetBundle(const std::string &directory_path, const FileBundle &bundle);
+  void RemoveBundle(const std::string &directory_path);
+
   // Hardlink group handling
   void AddHardlinkGroup(DirectoryEntryBaseList &entries,
                         const std::string &parent_directory);
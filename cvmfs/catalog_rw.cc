@@ -30,9 +30,14 @@ WritableCatalog::WritableCatalog(const string      &path,
   sql_chunk_insert_(NULL),
   sql_chunks_remove_(NULL),
   sql_chunks_count_(NULL),
+  sql_bundle_insert_(NULL),
+  sql_bundle_remove_(NULL),
+  sql_packed_insert_(NULL),
+  sql_packed_remove_(NULL),
   sql_max_link_id_(NULL),
   sql_inc_linkcount_(NULL),
-  dirty_(false)
+  dirty_(false),
+  max_link_id_(-1)
 {
   read_only_ = false;
 }
@@ -80,6 +85,18 @@ void WritableCatalog::InitPreparedStatements() {
 
   bool retval = Sql(database(), "PRAGMA foreign_keys = ON;").Execute();
   assert(retval);
+
+  // Writable catalogs are scratch copies that are thrown away if the publish
+  // process fails.  Hence there is no need for durability; all changes go
+  // into the single transaction opened by SetDirty(), which may grow large.
+  // The rollback journal is kept in memory (not switched off) so that the
+  // transaction can still be undone by SQLite in case of a failed statement.
+  retval = Sql(database(), "PRAGMA synchronous = OFF;").Execute() &&
+           Sql(database(), "PRAGMA journal_mode = MEMORY;").Execute() &&
+           Sql(database(), "PRAGMA cache_size = " +
+                           StringifyInt(-kCacheSizeKb) + ";").Execute();
+  assert(retval);
+
   sql_insert_        = new SqlDirentInsert     (database());
   sql_unlink_        = new SqlDirentUnlink     (database());
   sql_touch_         = new SqlDirentTouch      (database());
@@ -87,6 +104,10 @@ void WritableCatalog::InitPreparedStatements() {
   sql_chunk_insert_  = new SqlChunkInsert      (database());
   sql_chunks_remove_ = new SqlChunksRemove     (database());
   sql_chunks_count_  = new SqlChunksCount      (database());
+  sql_bundle_insert_ = new SqlBundleInsert     (database());
+  sql_bundle_remove_ = new SqlBundleRemove     (database());
+  sql_packed_insert_ = new SqlPackedInsert     (database());
+  sql_packed_remove_ = new SqlPackedRemove     (database());
   sql_max_link_id_   = new SqlMaxHardlinkGroup (database());
   sql_inc_linkcount_ = new SqlIncLinkcount     (database());
 }
@@ -102,15 +123,24 @@ void WritableCatalog::FinalizePreparedStatements() {
   delete sql_chunk_insert_;
   delete sql_chunks_remove_;
   delete sql_chunks_count_;
+  delete sql_bundle_insert_;
+  delete sql_bundle_remove_;
+  delete sql_packed_insert_;
+  delete sql_packed_remove_;
   delete sql_max_link_id_;
   delete sql_inc_linkcount_;
 }
 
 
 /**
- * Find out the maximal hardlink group id in this catalog.
+ * Find out the maximal hardlink group id in this catalog.  The id is queried
+ * from the database (a full table scan) only once and then kept up to date by
+ * AddEntry() and UpdateEntry().
  */
 uint32_t WritableCatalog::GetMaxLinkId() const {
+  if (max_link_id_ >= 0)
+    return max_link_id_;
+
   int result = -1;
 
   if (sql_max_link_id_->FetchRow()) {
@@ -118,10 +148,17 @@ uint32_t WritableCatalog::GetMaxLinkId() const {
   }
   sql_max_link_id_->Reset();
 
+  max_link_id_ = static_cast<uint32_t>(result);
   return result;
 }
 
 
+void WritableCatalog::UpdateMaxLinkId(const DirectoryEntry &entry) {
+  if ((max_link_id_ >= 0) && (entry.hardlink_group() > max_link_id_))
+    max_link_id_ = entry.hardlink_group();
+}
+
+
 /**
  * Adds a direcotry entry.
  * @param entry the DirectoryEntry to add to the catalog
@@ -147,6 +184,7 @@ void WritableCatalog::AddEntry(const DirectoryEntry &entry,
   assert(retval);
   sql_insert_->Reset();
 
+  UpdateMaxLinkId(entry);
   delta_counters_.Increment(entry);
 }
 
@@ -170,6 +208,9 @@ void WritableCatalog::RemoveEntry(const string &file_path) {
   if (entry.IsChunkedFile()) {
     RemoveFileChunks(file_path);
   }
+  if (entry.IsPackedFile()) {
+    RemovePackLocation(file_path);
+  }
 
   // remove the entry itself
   retval =
@@ -221,6 +262,8 @@ void WritableCatalog::UpdateEntry(const DirectoryEntry &entry,
     sql_update_->Execute();
   assert(retval);
   sql_update_->Reset();
+
+  UpdateMaxLinkId(entry);
 }
 
 void WritableCatalog::AddFileChunk(const std::string &entry_path,
@@ -272,6 +315,90 @@ void WritableCatalog::RemoveFileChunks(const std::string &entry_path) {
 }
 
 
+/**
+ * Registers the bundle of the small files in a directory, replacing a
+ * previous one.
+ * @param directory   the directory that contains the bundled files
+ */
+void WritableCatalog::SetBundle(const std::string &directory,
+                                const FileBundle &bundle)
+{
+  if (database().schema_revision() < 2) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg, "catalog %s does not support "
+             "bundles, not bundling %s", path().c_str(), directory.c_str());
+    return;
+  }
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(directory)));
+
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "setting bundle %s for %s",
+           bundle.content_hash().ToString().c_str(), directory.c_str());
+
+  bool retval =
+    sql_bundle_insert_->BindPathHash(path_hash) &&
+    sql_bundle_insert_->BindFileBundle(bundle)  &&
+    sql_bundle_insert_->Execute();
+  assert(retval);
+  sql_bundle_insert_->Reset();
+}
+
+
+/**
+ * Removes the bundle of a directory, if there is any.
+ */
+void WritableCatalog::RemoveBundle(const std::string &directory) {
+  if (database().schema_revision() < 2)
+    return;
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(directory)));
+
+  bool retval =
+    sql_bundle_remove_->BindPathHash(path_hash) &&
+    sql_bundle_remove_->Execute();
+  assert(retval);
+  sql_bundle_remove_->Reset();
+}
+
+
+/**
+ * Registers where a packed file is stored.  Without the location, the file
+ * cannot be read, so the catalog has to support packed files.
+ * @param entry_path   the path of the packed file
+ */
+void WritableCatalog::SetPackLocation(const std::string &entry_path,
+                                      const FilePackLocation &location)
+{
+  assert(database().schema_revision() >= 3);
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "packed %s into %s at offset %"PRIu64,
+           entry_path.c_str(), location.pack_hash().ToString().c_str(),
+           location.offset());
+
+  bool retval =
+    sql_packed_insert_->BindPathHash(path_hash)         &&
+    sql_packed_insert_->BindFilePackLocation(location)  &&
+    sql_packed_insert_->Execute();
+  assert(retval);
+  sql_packed_insert_->Reset();
+}
+
+
+void WritableCatalog::RemovePackLocation(const std::string &entry_path) {
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+
+  bool retval =
+    sql_packed_remove_->BindPathHash(path_hash) &&
+    sql_packed_remove_->Execute();
+  assert(retval);
+  sql_packed_remove_->Reset();
+}
+
+
 /**
  * Sets the last modified time stamp of this catalog to current time.
  */
@@ -372,6 +499,7 @@ void WritableCatalog::MoveToNestedRecursively(
 {
   // After creating a new nested catalog we have to move all elements
   // now contained by the new one.  List and move them recursively.
+  MoveBundleToNested(directory, new_nested_catalog);
   DirectoryEntryList listing;
   bool retval = ListingPath(PathString(directory.data(), directory.length()),
                             &listing);
@@ -395,6 +523,8 @@ void WritableCatalog::MoveToNestedRecursively(
                               grand_child_mountpoints);
     } else if (i->IsChunkedFile()) {
       MoveFileChunksToNested(full_path, new_nested_catalog);
+    } else if (i->IsPackedFile()) {
+      MovePackLocationToNested(full_path, new_nested_catalog);
     }
 
     // Remove the entry from the current catalog
@@ -439,6 +569,31 @@ void WritableCatalog::MoveFileChunksToNested(
 }
 
 
+void WritableCatalog::MoveBundleToNested(
+  const std::string  &directory,
+  WritableCatalog    *new_nested_catalog)
+{
+  FileBundle bundle;
+  if (!LookupBundle(PathString(directory), &bundle))
+    return;
+
+  new_nested_catalog->SetBundle(directory, bundle);
+  RemoveBundle(directory);
+}
+
+
+void WritableCatalog::MovePackLocationToNested(
+  const std::string  &full_path,
+  WritableCatalog    *new_nested_catalog)
+{
+  FilePackLocation location;
+  const bool retval = LookupPackedFile(PathString(full_path), &location);
+  assert(retval);
+
+  new_nested_catalog->SetPackLocation(full_path, location);
+}
+
+
 /**
  * Insert a nested catalog reference into this catalog.
  * The attached catalog object of this mountpoint can be specified (optional)
@@ -600,6 +755,7 @@ void WritableCatalog::CopyToParent() {
   Sql sql_update_link_ids(database(), update_link_ids);
   bool retval = sql_update_link_ids.Execute();
   assert(retval);
+  max_link_id_ = -1;
 
   // Remove the nested catalog root.
   // It is already present in the parent.
@@ -621,9 +777,23 @@ void WritableCatalog::CopyToParent() {
   retval = Sql(database(), "INSERT INTO other.chunks "
                            "SELECT * FROM main.chunks;").Execute();
   assert(retval);
+  if ((database().schema_revision() >= 2) &&
+      (parent->database().schema_revision() >= 2))
+  {
+    retval = Sql(database(), "INSERT OR REPLACE INTO other.bundles "
+                             "SELECT * FROM main.bundles;").Execute();
+    assert(retval);
+  }
+  if (database().schema_revision() >= 3) {
+    assert(parent->database().schema_revision() >= 3);
+    retval = Sql(database(), "INSERT INTO other.packed "
+                             "SELECT * FROM main.packed;").Execute();
+    assert(retval);
+  }
   retval = Sql(database(), "DETACH other;").Execute();
   assert(retval);
   parent->SetDirty();
+  parent->max_link_id_ = -1;
 
   // Change the just copied nested catalog root to an ordinary directory
   // (the nested catalog is merged into it's parent)
@@ -35,6 +35,12 @@ class WritableCatalog : public Catalog {
   friend class swissknife::CommandMigrate; // needed for catalog migrations
 
  public:
+  /**
+   * SQLite page cache of a writable catalog, big enough to keep the indices
+   * of catalogs with a few hundred thousand entries in memory
+   */
+  static const int kCacheSizeKb = 64 * 1024;
+
   WritableCatalog(const std::string &path,
                   const shash::Any  &catalog_hash,
                   Catalog           *parent);
@@ -62,6 +68,11 @@ class WritableCatalog : public Catalog {
   void IncLinkcount(const std::string &path_within_group, const int delta);
   void AddFileChunk(const std::string &entry_path, const FileChunk &chunk);
   void RemoveFileChunks(const std::string &entry_path);
+  void SetBundle(const std::string &directory, const FileBundle &bundle);
+  void RemoveBundle(const std::string &directory);
+  void SetPackLocation(const std::string &entry_path,
+                       const FilePackLocation &location);
+  void RemovePackLocation(const std::string &entry_path);
 
   // Creation and removal of catalogs
   void Partition(WritableCatalog *new_nested_catalog);
@@ -113,13 +124,20 @@ class WritableCatalog : public Catalog {
   SqlChunkInsert      *sql_chunk_insert_;
   SqlChunksRemove     *sql_chunks_remove_;
   SqlChunksCount      *sql_chunks_count_;
+  SqlBundleInsert     *sql_bundle_insert_;
+  SqlBundleRemove     *sql_bundle_remove_;
+  SqlPackedInsert     *sql_packed_insert_;
+  SqlPackedRemove     *sql_packed_remove_;
   SqlMaxHardlinkGroup *sql_max_link_id_;
   SqlIncLinkcount     *sql_inc_linkcount_;
 
   bool dirty_;  /**< Indicates if the catalog has been changed */
+  mutable int64_t max_link_id_;  /**< Cached GetMaxLinkId(), -1 if unknown */
 
   DeltaCounters delta_counters_;
 
+  void UpdateMaxLinkId(const DirectoryEntry &entry);
+
   inline void SetDirty() {
     if (!dirty_)
       Transaction();
@@ -143,6 +161,10 @@ class WritableCatalog : public Catalog {
                             WritableCatalog *new_nested_catalog);
   void MoveFileChunksToNested(const std::string  &full_path,
                               WritableCatalog    *new_nested_catalog);
+  void MoveBundleToNested(const std::string  &directory,
+                          WritableCatalog    *new_nested_catalog);
+  void MovePackLocationToNested(const std::string  &full_path,
+                                WritableCatalog    *new_nested_catalog);
 
   void CopyToParent();
   void CopyCatalogsToParent();
@@ -26,7 +26,29 @@ const float Database::kSchemaEpsilon = 0.0005;  // floats get imprecise in SQlit
 // ChangeLog
 //   0 --> 1: add size column to nested catalog table,
 //            add schema_revision property
-const unsigned Database::kLatestSchemaRevision = 1;
+//   1 --> 2: add bundles table
+//   2 --> 3: add packed table
+const unsigned Database::kLatestSchemaRevision = 3;
+
+
+/**
+ * Bundles are keyed by the path hash of the directory of the bundled files.
+ */
+static const char *kCreateBundlesTable =
+  "CREATE TABLE bundles "
+  "(parent_1 INTEGER, parent_2 INTEGER, hash BLOB, size INTEGER, "
+  " max_file_size INTEGER, num_files INTEGER, "
+  " CONSTRAINT pk_bundles PRIMARY KEY (parent_1, parent_2));";
+
+/**
+ * Locations of the files that are stored in packs, keyed by the path hash of
+ * the file.  Offset and size refer to the compressed file in the pack.
+ */
+static const char *kCreatePackedTable =
+  "CREATE TABLE packed "
+  "(md5path_1 INTEGER, md5path_2 INTEGER, pack BLOB, offset INTEGER, "
+  " size INTEGER, "
+  " CONSTRAINT pk_packed PRIMARY KEY (md5path_1, md5path_2));";
 
 
 static void SqlError(const std::string &error_msg, const Database &database) {
@@ -133,6 +155,40 @@ Database::Database(const std::string filename,
 
       schema_revision_ = 1;
     }
+
+    if (IsEqualSchema(schema_version_, 2.5) && (schema_revision_ == 1)) {
+      LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision");
+      Sql sql_upgrade(*this, kCreateBundlesTable);
+      if (!sql_upgrade.Execute()) {
+        LogCvmfs(kLogCatalog, kLogDebug, "failed to create bundles table");
+        goto database_failure;
+      }
+      Sql sql_revision(*this, "UPDATE properties SET value = 2 "
+                       "WHERE key = 'schema_revision';");
+      if (!sql_revision.Execute()) {
+        LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+        goto database_failure;
+      }
+
+      schema_revision_ = 2;
+    }
+
+    if (IsEqualSchema(schema_version_, 2.5) && (schema_revision_ == 2)) {
+      LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision");
+      Sql sql_upgrade(*this, kCreatePackedTable);
+      if (!sql_upgrade.Execute()) {
+        LogCvmfs(kLogCatalog, kLogDebug, "failed to create packed table");
+        goto database_failure;
+      }
+      Sql sql_revision(*this, "UPDATE properties SET value = 3 "
+                       "WHERE key = 'schema_revision';");
+      if (!sql_revision.Execute()) {
+        LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+        goto database_failure;
+      }
+
+      schema_revision_ = 3;
+    }
   }
 
   ready_ = true;
@@ -224,6 +280,8 @@ bool Database::Create(const string &filename,
     " CONSTRAINT pk_chunks PRIMARY KEY (md5path_1, md5path_2, offset, size), "
     " FOREIGN KEY (md5path_1, md5path_2) REFERENCES "
     "   catalog(md5path_1, md5path_2));")                         .Execute()  &&
+  Sql(database, kCreateBundlesTable)                             .Execute()  &&
+  Sql(database, kCreatePackedTable)                              .Execute()  &&
   Sql(database,
     "CREATE TABLE properties (key TEXT, value TEXT, "
     "CONSTRAINT pk_properties PRIMARY KEY (key));")               .Execute()  &&
@@ -324,6 +382,8 @@ unsigned SqlDirent::CreateDatabaseFlags(const DirectoryEntry &entry) const {
 
   if (entry.IsChunkedFile())
     database_flags |= kFlagFileChunk;
+  if (entry.IsPackedFile())
+    database_flags |= kFlagFilePacked;
 
   return database_flags;
 }
@@ -494,6 +554,7 @@ DirectoryEntry SqlLookup::GetDirent(const Catalog *catalog,
     result.uid_             = g_uid;
     result.gid_             = g_gid;
     result.is_chunked_file_ = false;
+    result.is_packed_file_  = false;
   } else {
     const uint64_t hardlinks = RetrieveInt64(1);
     result.linkcount_        = Hardlinks2Linkcount(hardlinks);
@@ -503,6 +564,7 @@ DirectoryEntry SqlLookup::GetDirent(const Catalog *catalog,
     result.uid_              = RetrieveInt64(13);
     result.gid_              = RetrieveInt64(14);
     result.is_chunked_file_  = (database_flags & kFlagFileChunk);
+    result.is_packed_file_   = (database_flags & kFlagFilePacked);
     if (result.catalog_->uid_map_) {
       OwnerMap::const_iterator i = result.catalog_->uid_map_->find(result.uid_);
       if (i != result.catalog_->uid_map_->end())
@@ -871,6 +933,142 @@ int SqlChunksCount::GetChunkCount() const {
 //------------------------------------------------------------------------------
 
 
+SqlBundleInsert::SqlBundleInsert(const Database &database) {
+  const string statement =
+    "INSERT OR REPLACE INTO bundles "
+    "(parent_1, parent_2, hash, size, max_file_size, num_files) "
+    //   1         2        3     4        5            6
+    "VALUES (:p_1, :p_2, :hash, :size, :max_file_size, :num_files);";
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlBundleInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlBundleInsert::BindFileBundle(const FileBundle &bundle) {
+  return
+    BindSha1Blob(3, bundle.content_hash()) &&
+    BindInt64(4,    bundle.size())         &&
+    BindInt64(5,    bundle.max_file_size()) &&
+    BindInt64(6,    bundle.num_files());
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlBundleRemove::SqlBundleRemove(const Database &database) {
+  const string statement =
+    "DELETE FROM bundles "
+    "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2);";
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlBundleRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlBundleLookup::SqlBundleLookup(const Database &database) {
+  const string statement =
+    "SELECT hash, size, max_file_size, num_files FROM bundles "
+    //        0     1         2             3
+    "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2);";
+    //                   1                       2
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlBundleLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+FileBundle SqlBundleLookup::GetFileBundle() const {
+  return FileBundle(RetrieveSha1Blob(0),
+                    RetrieveInt64(1),
+                    RetrieveInt64(2),
+                    RetrieveInt64(3));
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPackedInsert::SqlPackedInsert(const Database &database) {
+  const string statement =
+    "INSERT OR REPLACE INTO packed "
+    "(md5path_1, md5path_2, pack, offset, size) "
+    //    1          2        3      4      5
+    "VALUES (:md5_1, :md5_2, :pack, :offset, :size);";
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlPackedInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlPackedInsert::BindFilePackLocation(const FilePackLocation &location) {
+  return
+    BindSha1Blob(3, location.pack_hash()) &&
+    BindInt64(4,    location.offset())    &&
+    BindInt64(5,    location.size());
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPackedRemove::SqlPackedRemove(const Database &database) {
+  const string statement =
+    "DELETE FROM packed "
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);";
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlPackedRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPackedLookup::SqlPackedLookup(const Database &database) {
+  const string statement =
+    "SELECT pack, offset, size FROM packed "
+    //        0      1      2
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);";
+    //                    1                          2
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlPackedLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+FilePackLocation SqlPackedLookup::GetFilePackLocation() const {
+  return FilePackLocation(RetrieveSha1Blob(0),
+                          RetrieveInt64(1),
+                          RetrieveInt64(2));
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlMaxHardlinkGroup::SqlMaxHardlinkGroup(const Database &database) {
   Init(database.sqlite_db(), "SELECT max(hardlinks) FROM catalog;");
 }
@@ -950,6 +1148,17 @@ bool SqlCreateCounter::BindInitialValue(const int64_t value) {
 //------------------------------------------------------------------------------
 
 
+SqlAllEntries::SqlAllEntries(const Database &database) {
+  const string statement =
+    "SELECT " + GetFieldsToSelect(database) + " FROM catalog "
+    "ORDER BY md5path_1, md5path_2;";
+  Init(database.sqlite_db(), statement);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlAllChunks::SqlAllChunks(const Database &database) {
   string sql = "SELECT DISTINCT hash, "
   "CASE WHEN flags & " + StringifyInt(SqlDirent::kFlagFile) + " THEN " +
@@ -957,11 +1166,25 @@ SqlAllChunks::SqlAllChunks(const Database &database) {
   "WHEN flags & " + StringifyInt(SqlDirent::kFlagDir) + " THEN " +
     StringifyInt(kChunkMicroCatalog) + " END " +
   "AS chunk_type FROM catalog WHERE hash IS NOT NULL";
+  // Packed files are only stored inside their packs
+  if (database.schema_revision() >= 3) {
+    sql += " AND (flags & " + StringifyInt(SqlDirent::kFlagFilePacked) +
+      ") = 0";
+  }
   if (database.schema_version() >= 2.4-Database::kSchemaEpsilon) {
     sql += " UNION SELECT DISTINCT hash, " + StringifyInt(kChunkPiece) + " " +
       "FROM chunks";
   }
-  sql += ";";
+  if (database.schema_revision() >= 2) {
+    sql += " UNION SELECT DISTINCT hash, " + StringifyInt(kChunkBundle) + " " +
+      "FROM bundles";
+  }
+  if (database.schema_revision() >= 3) {
+    sql += " UNION SELECT DISTINCT pack, " + StringifyInt(kChunkPack) + " " +
+      "FROM packed";
+  }
+  // The order allows to merge the chunk lists of two catalogs
+  sql += " ORDER BY hash, chunk_type;";
   Init(database.sqlite_db(), sql);
 }
 
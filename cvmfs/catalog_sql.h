@@ -27,7 +27,9 @@
 
 #include "hash.h"
 #include "directory_entry.h"
+#include "file_bundle.h"
 #include "file_chunk.h"
+#include "file_pack.h"
 #include "shortstring.h"
 #include "sql.h"
 
@@ -36,13 +38,16 @@ namespace catalog {
 class Catalog;
 
 /**
- * Content-addressable chunks can be entire files, micro catalogs (ending L) or
- * pieces of large files
+ * Content-addressable chunks can be entire files, micro catalogs (ending L),
+ * pieces of large files (ending P), bundles of small files (ending B), or
+ * packs of small files (ending K)
  */
 enum ChunkTypes {
   kChunkFile = 0,
   kChunkMicroCatalog,
   kChunkPiece,
+  kChunkBundle,
+  kChunkPack,
 };
 
 
@@ -201,6 +206,7 @@ class SqlDirent : public Sql {
   const static int kFlagLink                = 8;
   const static int kFlagFileStat            = 16;  // currently unused
   const static int kFlagFileChunk           = 64;
+  const static int kFlagFilePacked          = 128;
 
  protected:
   /**
@@ -460,6 +466,76 @@ class SqlChunksCount : public Sql {
 //------------------------------------------------------------------------------
 
 
+class SqlBundleInsert : public Sql {
+ public:
+  SqlBundleInsert(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindFileBundle(const FileBundle &bundle);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlBundleRemove : public Sql {
+ public:
+  SqlBundleRemove(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Only available from schema revision 2 on.
+ */
+class SqlBundleLookup : public Sql {
+ public:
+  SqlBundleLookup(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  FileBundle GetFileBundle() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlPackedInsert : public Sql {
+ public:
+  SqlPackedInsert(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindFilePackLocation(const FilePackLocation &location);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlPackedRemove : public Sql {
+ public:
+  SqlPackedRemove(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Only available from schema revision 3 on.
+ */
+class SqlPackedLookup : public Sql {
+ public:
+  SqlPackedLookup(const Database &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  FilePackLocation GetFilePackLocation() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
 class SqlMaxHardlinkGroup : public Sql {
  public:
   SqlMaxHardlinkGroup(const Database &database);
@@ -505,6 +581,21 @@ class SqlCreateCounter : public Sql {
 //------------------------------------------------------------------------------
 
 
+/**
+ * Lists all directory entries of a catalog, ordered by path hash.
+ */
+class SqlAllEntries : public SqlLookup {
+ public:
+  SqlAllEntries(const Database &database);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Lists the distinct content hashes of a catalog, ordered by hash and type.
+ */
 class SqlAllChunks : public Sql {
  public:
   SqlAllChunks(const Database &database);
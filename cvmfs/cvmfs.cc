@@ -70,7 +70,9 @@
 #include "download.h"
 #include "wpad.h"
 #include "cache.h"
+#include "ram_cache.h"
 #include "nfs_maps.h"
+#include "warmup.h"
 #include "hash.h"
 #include "talk.h"
 #include "monitor.h"
@@ -114,6 +116,14 @@ const unsigned kReloadSafetyMargin = 500;  // in milliseconds
 const unsigned kDefaultNumConnections = 16;
 const uint64_t kDefaultMemcache = 16*1024*1024;  // 16M RAM for meta-data caches
 const uint64_t kDefaultCacheSizeMb = 1024*1024*1024;  // 1G
+const unsigned kWorkingSetFiles = 5000;  /**< Max. recorded files for warm-up */
+const uint64_t kRamCacheMaxObject = 64*1024;  /**< Larger files stay on disk */
+/**
+ * File handles of files served from the RAM cache carry this bit, the rest is
+ * the address of the RamObject.  Disk cache file descriptors are small
+ * positive numbers, handles of chunked files are negative.
+ */
+const uint64_t kRamHandleFlag = uint64_t(1) << 62;
 const unsigned int kShortTermTTL = 180;  /**< If catalog reload fails, try again
                                               in 3 minutes */
 const time_t kIndefiniteDeadline = time_t(-1);
@@ -178,10 +188,14 @@ download::DownloadManager *download_manager_ = NULL;
 lru::InodeCache *inode_cache_ = NULL;
 lru::PathCache *path_cache_ = NULL;
 lru::Md5PathCache *md5path_cache_ = NULL;
+cache::RamCache *ram_cache_ = NULL;  /**< NULL if disabled */
 glue::InodeTracker *inode_tracker_ = NULL;
 
 double kcache_timeout_ = kDefaultKCacheTimeout;
 bool fixed_catalog_ = false;
+unsigned catalog_prefetch_threads_ = 0;  /**< zero: no catalog prefetching */
+unsigned warm_connections_ = 0;  /**< opened to the proxy/host at mount */
+bool bundled_fetch_ = false;  /**< fetch small files by directory bundles */
 
 /**
  * in maintenance mode, cache timeout is 0 and catalogs are not reloaded
@@ -349,6 +363,16 @@ string GetCertificateStats() {
   return catalog_manager_->GetCertificateStats();
 }
 
+string GetCatalogPrefetchStats() {
+  return catalog_manager_->GetPrefetchStats();
+}
+
+string GetRamCacheStats() {
+  if (ram_cache_ == NULL)
+    return "disabled\n";
+  return ram_cache_->PrintStatistics();
+}
+
 string GetFsStats() {
   return "lookup(all): " + StringifyInt(atomic_read64(&num_fs_lookup_)) + "  " +
     "lookup(negative): " + StringifyInt(atomic_read64(&num_fs_lookup_negative_))
@@ -994,6 +1018,147 @@ static void cvmfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 }
 
 
+/**
+ * Used by the warmup module to load a catalog or a file of the previous
+ * session's working set.  Paths are resolved against the current catalogs.
+ */
+static bool ReplayWorkingSet(const warmup::EntryType type, const string &path)
+{
+  if (atomic_read32(&maintenance_mode_) == 1)
+    return false;
+
+  catalog::DirectoryEntry dirent;
+  FileChunkList chunks;
+  const PathString path_str(path.data(), path.length());
+  remount_fence_->Enter();
+  bool found = catalog_manager_->LookupPath(path_str, catalog::kLookupSole,
+                                            &dirent);
+  if (found && (type == warmup::kEntryFile) && dirent.IsChunkedFile())
+    found = dirent.catalog()->ListFileChunks(path_str, &chunks);
+  remount_fence_->Leave();
+  if (!found)
+    return false;
+  if (type == warmup::kEntryCatalog)
+    return true;
+  if (!dirent.IsRegular())
+    return false;
+
+  if (!dirent.IsChunkedFile()) {
+    const int fd = cache::FetchDirent(dirent, path, download_manager_);
+    if (fd < 0)
+      return false;
+    close(fd);
+    return true;
+  }
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    const int fd = cache::FetchChunk(*chunks.AtPtr(i), path, download_manager_);
+    if (fd < 0)
+      return false;
+    close(fd);
+  }
+  return true;
+}
+
+
+/**
+ * Used by the warmup module to store the working set periodically.
+ */
+static vector<string> GetWorkingSetCatalogs() {
+  return catalog_manager_->GetMountpoints();
+}
+
+
+static inline bool IsRamHandle(const uint64_t fh) {
+  return (static_cast<int64_t>(fh) >= 0) && (fh & kRamHandleFlag);
+}
+
+
+static inline cache::RamObject *RamHandle2Object(const uint64_t fh) {
+  return reinterpret_cast<cache::RamObject *>(
+    static_cast<uintptr_t>(fh & ~kRamHandleFlag));
+}
+
+
+/**
+ * Copies a small file from the disk cache into a new RAM cache object.  On
+ * success, the file descriptor is closed and set to -1.
+ */
+static cache::RamObject *LoadRamObject(const shash::Any &checksum,
+                                       const uint64_t size, int *fd)
+{
+  cache::RamObject *object = cache::RamObject::Create(size);
+  uint64_t nbytes = 0;
+  while (nbytes < size) {
+    const ssize_t retval = pread(*fd, object->data() + nbytes, size - nbytes,
+                                 nbytes);
+    if (retval <= 0) {
+      if ((retval < 0) && (errno == EINTR))
+        continue;
+      object->Release();
+      return NULL;
+    }
+    nbytes += retval;
+  }
+  close(*fd);
+  *fd = -1;
+  ram_cache_->Insert(checksum, object);
+  return object;
+}
+
+
+/**
+ * On a cache miss of a small file, fetches the bundle of its directory, if
+ * there is one.  The sibling files are cached in the same round-trip.
+ */
+static void FetchBundleOf(const catalog::DirectoryEntry &dirent,
+                          const PathString &path)
+{
+  if (dirent.IsChunkedFile() || (dirent.size() == 0))
+    return;
+  const int fd = cache::Open(dirent.checksum());
+  if (fd >= 0) {
+    close(fd);
+    return;
+  }
+
+  FileBundle bundle;
+  const PathString parent_path = GetParentPath(path);
+  if (!dirent.catalog()->LookupBundle(parent_path, &bundle) ||
+      (dirent.size() > bundle.max_file_size()))
+  {
+    return;
+  }
+
+  // The small files of the listing, also used as names for the cache catalog
+  catalog::DirectoryEntryList listing;
+  if (!dirent.catalog()->ListingPath(parent_path, &listing))
+    return;
+  map<shash::Any, string> file_paths;
+  for (unsigned i = 0; i < listing.size(); ++i) {
+    if (listing[i].IsRegular() && !listing[i].IsChunkedFile() &&
+        (listing[i].size() > 0) &&
+        (listing[i].size() <= bundle.max_file_size()))
+    {
+      file_paths[listing[i].checksum()] = parent_path.ToString() + "/" +
+                                          listing[i].name().ToString();
+    }
+  }
+  // Otherwise the bundle is not the one of the current directory contents
+  if ((file_paths.size() != bundle.num_files()) ||
+      (file_paths.find(dirent.checksum()) == file_paths.end()))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug, "bundle of %s does not cover %s",
+             parent_path.c_str(), path.c_str());
+    return;
+  }
+
+  const int retval = cache::FetchBundle(bundle, parent_path.ToString(),
+                                        file_paths, download_manager_);
+  LogCvmfs(kLogCvmfs, kLogDebug, "fetched bundle of %s for %s (%d)",
+           parent_path.c_str(), path.c_str(), retval);
+}
+
+
 /**
  * Open a file from cache.  If necessary, file is downloaded first.
  *
@@ -1043,6 +1208,7 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
   }
 
   atomic_inc64(&num_fs_open_);  // Count actual open / fetch operations
+  warmup::RecordFile(path);
 
   if (dirent.IsChunkedFile()) {
     LogCvmfs(kLogCvmfs, kLogDebug,
@@ -1103,8 +1269,35 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
     return;
   }
 
-  fd = cache::FetchDirent(dirent, string(path.GetChars(), path.GetLength()),
-                          download_manager_);
+  // Small files are served from memory and don't occupy a file descriptor
+  cache::RamObject *ram_object = NULL;
+  const bool use_ram_cache =
+    (ram_cache_ != NULL) && (dirent.size() <= kRamCacheMaxObject);
+  if (use_ram_cache) {
+    ram_object = ram_cache_->Lookup(dirent.checksum());
+    if ((ram_object != NULL) &&
+        (cache::GetCacheMode() == cache::kCacheReadWrite))
+    {
+      quota::Touch(dirent.checksum());
+    }
+  }
+  if (ram_object == NULL) {
+    if (bundled_fetch_)
+      FetchBundleOf(dirent, path);
+    fd = cache::FetchDirent(dirent, string(path.GetChars(), path.GetLength()),
+                            download_manager_);
+    if ((fd >= 0) && use_ram_cache)
+      ram_object = LoadRamObject(dirent.checksum(), dirent.size(), &fd);
+  }
+  if (ram_object != NULL) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "file %s opened from RAM cache",
+             path.c_str());
+    fi->keep_cache = 0;
+    fi->fh = kRamHandleFlag |
+             static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ram_object));
+    fuse_reply_open(req, fi);
+    return;
+  }
 
   if (fd >= 0) {
     if (atomic_xadd32(&open_files_, 1) <
@@ -1160,6 +1353,16 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
            uint64_t(catalog_manager_->MangleInode(ino)), size, off, fi->fh);
   atomic_inc64(&num_fs_read_);
 
+  // Served from memory without copying
+  if (IsRamHandle(fi->fh)) {
+    cache::RamObject *ram_object = RamHandle2Object(fi->fh);
+    size_t nbytes = 0;
+    if (uint64_t(off) < ram_object->size)
+      nbytes = std::min(size, size_t(ram_object->size - off));
+    fuse_reply_buf(req, ram_object->data() + (nbytes ? off : 0), nbytes);
+    return;
+  }
+
   // Get data chunk (<=128k guaranteed by Fuse)
   char *data = static_cast<char *>(alloca(size));
   unsigned int overall_bytes_fetched = 0;
@@ -1288,6 +1491,12 @@ static void cvmfs_release(fuse_req_t req, fuse_ino_t ino,
            uint64_t(ino));
   const int64_t fd = fi->fh;
 
+  if (IsRamHandle(fi->fh)) {
+    RamHandle2Object(fi->fh)->Release();
+    fuse_reply_err(req, 0);
+    return;
+  }
+
   // do we have a chunked file?
   if (static_cast<int64_t>(fi->fh) < 0) {
     const uint64_t chunk_handle =
@@ -1704,6 +1913,7 @@ bool g_monitor_ready = false;
 bool g_signature_ready = false;
 bool g_quota_ready = false;
 bool g_talk_ready = false;
+bool g_warmup_ready = false;
 bool g_running_created = false;
 
 int g_fd_lockfile = -1;
@@ -1749,10 +1959,20 @@ static int Init(const loader::LoaderExports *loader_exports) {
   cvmfs::loader_exports_ = loader_exports;
 
   uint64_t mem_cache_size = cvmfs::kDefaultMemcache;
+  uint64_t ram_cache_size = 0;
   unsigned timeout = cvmfs::kDefaultTimeout;
   unsigned timeout_direct = cvmfs::kDefaultTimeout;
   unsigned proxy_reset_after = 0;
+  bool proxy_shard = false;
   unsigned host_reset_after = 0;
+  bool adaptive_hosts = false;
+  unsigned max_host_connections = 0;
+  unsigned keepalive_timeout = 0;
+  bool http2 = false;
+  bool http2_prior_knowledge = false;
+  unsigned http2_max_streams = 0;
+  bool hedged_requests = false;
+  unsigned hedge_percentile = 95;
   unsigned max_retries = 1;
   unsigned backoff_init = 2000;
   unsigned backoff_max = 10000;
@@ -1765,6 +1985,8 @@ static int Init(const loader::LoaderExports *loader_exports) {
   bool nfs_shared = false;
   string nfs_shared_dir = string(cvmfs::kDefaultCachedir);
   bool shared_cache = false;
+  bool working_set = false;
+  bool catalog_bloom = true;
   int64_t quota_limit = cvmfs::kDefaultCacheSizeMb;
   string hostname = "localhost";
   string proxies = "";
@@ -1812,14 +2034,54 @@ static int Init(const loader::LoaderExports *loader_exports) {
   // Overwrite default options
   if (options::GetValue("CVMFS_MEMCACHE_SIZE", &parameter))
     mem_cache_size = String2Uint64(parameter) * 1024*1024;
+  if (options::GetValue("CVMFS_RAM_CACHE_SIZE", &parameter))
+    ram_cache_size = String2Uint64(parameter) * 1024*1024;
   if (options::GetValue("CVMFS_TIMEOUT", &parameter))
     timeout = String2Uint64(parameter);
   if (options::GetValue("CVMFS_TIMEOUT_DIRECT", &parameter))
     timeout_direct = String2Uint64(parameter);
   if (options::GetValue("CVMFS_PROXY_RESET_AFTER", &parameter))
     proxy_reset_after = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_PROXY_SHARD", &parameter) &&
+      options::IsOn(parameter))
+  {
+    proxy_shard = true;
+  }
   if (options::GetValue("CVMFS_HOST_RESET_AFTER", &parameter))
     host_reset_after = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_ADAPTIVE_HOSTS", &parameter) &&
+      options::IsOn(parameter))
+  {
+    adaptive_hosts = true;
+  }
+  if (options::GetValue("CVMFS_MAX_HOST_CONNECTIONS", &parameter))
+    max_host_connections = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_KEEPALIVE_TIMEOUT", &parameter))
+    keepalive_timeout = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_HTTP2", &parameter)) {
+    if (parameter == "prior-knowledge") {
+      http2 = true;
+      http2_prior_knowledge = true;
+    } else {
+      http2 = options::IsOn(parameter);
+    }
+  }
+  if (options::GetValue("CVMFS_HTTP2_MAX_STREAMS", &parameter))
+    http2_max_streams = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_HEDGED_REQUESTS", &parameter) &&
+      options::IsOn(parameter))
+  {
+    hedged_requests = true;
+  }
+  if (options::GetValue("CVMFS_HEDGE_PERCENTILE", &parameter))
+    hedge_percentile = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_WARM_CONNECTIONS", &parameter))
+    cvmfs::warm_connections_ = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_BUNDLED_FETCH", &parameter) &&
+      options::IsOn(parameter))
+  {
+    cvmfs::bundled_fetch_ = true;
+  }
   if (options::GetValue("CVMFS_MAX_RETRIES", &parameter))
     max_retries = String2Uint64(parameter);
   if (options::GetValue("CVMFS_BACKOFF_INIT", &parameter))
@@ -1830,6 +2092,8 @@ static int Init(const loader::LoaderExports *loader_exports) {
     tracefile = parameter;
   if (options::GetValue("CVMFS_MAX_TTL", &parameter))
     max_ttl = String2Uint64(parameter);
+  if (options::GetValue("CVMFS_CATALOG_PREFETCH", &parameter))
+    cvmfs::catalog_prefetch_threads_ = String2Uint64(parameter);
   if (options::GetValue("CVMFS_KCACHE_TIMEOUT", &parameter))
     kcache_timeout = String2Int64(parameter);
   if (options::GetValue("CVMFS_QUOTA_LIMIT", &parameter))
@@ -1886,6 +2150,16 @@ static int Init(const loader::LoaderExports *loader_exports) {
       cachedir = cachedir + "/" + loader_exports->repository_name;
     }
   }
+  if (options::GetValue("CVMFS_WORKING_SET", &parameter) &&
+      options::IsOn(parameter))
+  {
+    working_set = true;
+  }
+  if (options::GetValue("CVMFS_CATALOG_BLOOM", &parameter) &&
+      !options::IsOn(parameter))
+  {
+    catalog_bloom = false;
+  }
   if (options::GetValue("CVMFS_ALIEN_CACHE", &parameter)) {
     alien_cache = parameter;
   }
@@ -1955,6 +2229,8 @@ static int Init(const loader::LoaderExports *loader_exports) {
   cvmfs::md5path_cache_ =
     new lru::Md5PathCache((memcache_num_units*7) & mask_64);
   cvmfs::inode_tracker_ = new glue::InodeTracker();
+  if (ram_cache_size > 0)
+    cvmfs::ram_cache_ = new cache::RamCache(ram_cache_size);
 
   cvmfs::directory_handles_ = new cvmfs::DirectoryHandles();
   cvmfs::directory_handles_->set_empty_key((uint64_t)(-1));
@@ -2047,7 +2323,7 @@ static int Init(const loader::LoaderExports *loader_exports) {
       return loader::kFailCacheDir;
     }
   }
-  if (!cache::Init(alien_cache, alien_cache != ".")) {
+  if (!cache::Init(alien_cache, alien_cache != ".", shared_cache)) {
     *g_boot_error = "Failed to setup cache in " + *cvmfs::cachedir_ +
                     ": " + strerror(errno);
     return loader::kFailCacheDir;
@@ -2159,7 +2435,21 @@ static int Init(const loader::LoaderExports *loader_exports) {
   }
   cvmfs::download_manager_->SetTimeout(timeout, timeout_direct);
   cvmfs::download_manager_->SetProxyGroupResetDelay(proxy_reset_after);
+  if (proxy_shard)
+    cvmfs::download_manager_->EnableProxySharding();
   cvmfs::download_manager_->SetHostResetDelay(host_reset_after);
+  if (adaptive_hosts)
+    cvmfs::download_manager_->EnableAdaptiveHosts();
+  cvmfs::download_manager_->SetConnectionPolicy(max_host_connections,
+                                                keepalive_timeout);
+  if (http2 && !cvmfs::download_manager_->EnableHttp2(http2_prior_knowledge,
+                                                      http2_max_streams))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+             "libcurl does not support HTTP/2, using HTTP/1.1");
+  }
+  if (hedged_requests)
+    cvmfs::download_manager_->EnableHedgedRequests(hedge_percentile);
   cvmfs::download_manager_->SetRetryParameters(max_retries,
                                                backoff_init,
                                                backoff_max);
@@ -2208,6 +2498,7 @@ static int Init(const loader::LoaderExports *loader_exports) {
     cvmfs::catalog_manager_->SetInodeAnnotation(cvmfs::inode_annotation_);
   }
   cvmfs::catalog_manager_->SetOwnerMaps(uid_map, gid_map);
+  cvmfs::catalog_manager_->SetPathFilters(catalog_bloom);
 
   // Load specific tag (root hash has precedence)
   if ((root_hash == "") && (*cvmfs::repository_tag_ != "")) {
@@ -2274,6 +2565,14 @@ static int Init(const loader::LoaderExports *loader_exports) {
   cvmfs::remount_fence_ = new cvmfs::RemountFence();
   auto_umount::SetMountpoint(*cvmfs::mountpoint_);
 
+  // Working set of the previous session, replayed after fork()
+  if (working_set) {
+    warmup::Init("./workingset." + *cvmfs::repository_name_,
+                 cvmfs::kWorkingSetFiles, cvmfs::ReplayWorkingSet,
+                 cvmfs::GetWorkingSetCatalogs);
+    g_warmup_ready = true;
+  }
+
   return loader::kFailOk;
 }
 
@@ -2311,7 +2610,13 @@ static void Spawn() {
     monitor::Spawn();
   }
   cvmfs::download_manager_->Spawn();
+  if (cvmfs::warm_connections_ > 0)
+    cvmfs::download_manager_->WarmConnections(cvmfs::warm_connections_);
   quota::Spawn();
+  if (cvmfs::catalog_prefetch_threads_ > 0) {
+    cvmfs::catalog_manager_->SpawnPrefetcher(
+      cvmfs::catalog_prefetch_threads_);
+  }
   cvmfs::watchdog_listener_ =
     quota::RegisterWatchdogListener(*cvmfs::repository_name_ + "-watchdog");
   cvmfs::unpin_listener_ =
@@ -2320,6 +2625,8 @@ static void Spawn() {
   talk::Spawn();
   if (cvmfs::nfs_maps_)
     nfs_maps::Spawn();
+  if (g_warmup_ready)
+    warmup::Spawn();
 
   if (*cvmfs::tracefile_ != "")
     tracer::Init(8192, 7000, *cvmfs::tracefile_);
@@ -2339,6 +2646,9 @@ static void Fini() {
   signal(SIGALRM, SIG_IGN);
   if (g_talk_ready) talk::Fini();
 
+  // Replay uses the catalogs
+  if (g_warmup_ready) warmup::Fini(cvmfs::catalog_manager_->GetMountpoints());
+
   // Must be before quota is stopped
   delete cvmfs::catalog_manager_;
   cvmfs::catalog_manager_ = NULL;
@@ -2374,6 +2684,7 @@ static void Fini() {
   delete cvmfs::path_cache_;
   delete cvmfs::inode_cache_;
   delete cvmfs::md5path_cache_;
+  delete cvmfs::ram_cache_;
   delete cvmfs::cachedir_;
   delete cvmfs::nfs_shared_dir_;
   delete cvmfs::tracefile_;
@@ -2390,6 +2701,7 @@ static void Fini() {
   cvmfs::path_cache_ = NULL;
   cvmfs::inode_cache_ = NULL;
   cvmfs::md5path_cache_ = NULL;
+  cvmfs::ram_cache_ = NULL;
   cvmfs::cachedir_ = NULL;
   cvmfs::nfs_shared_dir_ = NULL;
   cvmfs::tracefile_ = NULL;
@@ -48,6 +48,8 @@ std::string PrintInodeTrackerStatistics();
 std::string PrintInodeGeneration();
 catalog::Statistics GetCatalogStatistics();
 std::string GetCertificateStats();
+std::string GetCatalogPrefetchStats();
+std::string GetRamCacheStats();
 std::string GetFsStats();
 
 }  // namespace cvmfs
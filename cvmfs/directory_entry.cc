@@ -58,5 +58,9 @@ DirectoryEntryBase::Differences DirectoryEntry::CompareTo(
     result |= Difference::kChunkedFileFlag;
   }
 
+  if (IsPackedFile() != other.IsPackedFile()) {
+    result |= Difference::kPackedFileFlag;
+  }
+
   return result;
 }
@@ -10,10 +10,13 @@
 #define CVMFS_DIRECTORY_ENTRY_H_
 
 #include <sys/types.h>
+#include <stdint.h>
 
 #include <list>
 #include <string>
 
+#include <cassert>
+#include <cstdlib>
 #include <cstring>
 
 #include "platform.h"
@@ -22,6 +25,7 @@
 #include "shortstring.h"
 #include "globals.h"
 #include "bigvector.h"
+#include "smalloc.h"
 
 namespace publish {
 class SyncItem;
@@ -34,6 +38,7 @@ class CommandMigrate;
 namespace catalog {
 
 class DirectoryEntryTestFactory;
+class PackedDirectoryEntry;
 
 class Catalog;
 typedef uint64_t inode_t;
@@ -54,6 +59,9 @@ class DirectoryEntryBase {
   // simplify file system like _touch_ of DirectoryEntry objects
   friend class SqlDirentTouch;
 
+  // packs and unpacks all fields for the in-memory caches
+  friend class PackedDirectoryEntry;
+
  public:
   struct Difference {
     static const unsigned int kIdentical                    = 0x000; // 000000000000
@@ -67,6 +75,7 @@ class DirectoryEntryBase {
     static const unsigned int kHardlinkGroup                = 0x080; // 000010000000
     static const unsigned int kNestedCatalogTransitionFlags = 0x100; // 000100000000
     static const unsigned int kChunkedFileFlag              = 0x200; // 001000000000
+    static const unsigned int kPackedFileFlag               = 0x400; // 010000000000
   };
   typedef unsigned int Differences;
 
@@ -202,6 +211,7 @@ class DirectoryEntry : public DirectoryEntryBase {
   friend class swissknife::CommandMigrate; // fixing DirectoryEntry glitches
   friend class WritableCatalogManager;     // TODO: remove this dependency
   friend class DirectoryEntryTestFactory;  // create DirectoryEntries for unit-test purposes
+  friend class PackedDirectoryEntry;       // compact copy for the caches
 
  public:
   /**
@@ -218,7 +228,8 @@ class DirectoryEntry : public DirectoryEntryBase {
     hardlink_group_(0),
     is_nested_catalog_root_(false),
     is_nested_catalog_mountpoint_(false),
-    is_chunked_file_(false) {}
+    is_chunked_file_(false),
+    is_packed_file_(false) {}
 
   inline DirectoryEntry() :
     catalog_(NULL),
@@ -226,10 +237,17 @@ class DirectoryEntry : public DirectoryEntryBase {
     hardlink_group_(0),
     is_nested_catalog_root_(false),
     is_nested_catalog_mountpoint_(false),
-    is_chunked_file_(false) {}
+    is_chunked_file_(false),
+    is_packed_file_(false) {}
 
   inline explicit DirectoryEntry(SpecialDirents special_type) :
-    catalog_((Catalog *)(-1)) { };
+    catalog_((Catalog *)(-1)),
+    cached_mtime_(0),
+    hardlink_group_(0),
+    is_nested_catalog_root_(false),
+    is_nested_catalog_mountpoint_(false),
+    is_chunked_file_(false),
+    is_packed_file_(false) { };
 
   inline SpecialDirents GetSpecial() const {
     return (catalog_ == (Catalog *)(-1)) ? kDirentNegative : kDirentNormal;
@@ -250,6 +268,7 @@ class DirectoryEntry : public DirectoryEntryBase {
     return is_nested_catalog_mountpoint_;
   }
   inline bool IsChunkedFile() const { return is_chunked_file_; }
+  inline bool IsPackedFile() const { return is_packed_file_; }
 
   inline const Catalog *catalog() const  { return catalog_; }
   inline uint32_t hardlink_group() const { return hardlink_group_; }
@@ -269,6 +288,10 @@ class DirectoryEntry : public DirectoryEntryBase {
     is_chunked_file_ = val;
   }
 
+  inline void set_is_packed_file(const bool val) {
+    is_packed_file_ = val;
+  }
+
 private:
   // Associated cvmfs catalog
   Catalog* catalog_;
@@ -284,8 +307,192 @@ private:
   bool is_nested_catalog_root_;
   bool is_nested_catalog_mountpoint_;
   bool is_chunked_file_;
+  bool is_packed_file_;  /**< stored in a pack, see file_pack.h */
 };
 
+
+/**
+ * Compact copy of a DirectoryEntry for the inode and md5 path caches (lru.h),
+ * which keep their values in fixed-size hash table slots.  The content hash
+ * takes only the digest size of its algorithm (nothing for a null hash) and
+ * shares an inline buffer with the name.  Names that don't fit and symlink
+ * targets are stored out of line.
+ */
+class PackedDirectoryEntry {
+ public:
+  static const unsigned kInlineSize = 40;
+
+  PackedDirectoryEntry() :
+    inode_(DirectoryEntryBase::kInvalidInode),
+    parent_inode_(DirectoryEntryBase::kInvalidInode),
+    size_(0), mtime_(0), cached_mtime_(0), catalog_(NULL), out_of_line_(NULL),
+    uid_(0), gid_(0), linkcount_(0), hardlink_group_(0), mode_(0),
+    symlink_length_(0), name_length_(0), algorithm_(shash::kAny), flags_(0)
+  { }
+
+  explicit PackedDirectoryEntry(const DirectoryEntry &dirent) :
+    out_of_line_(NULL)
+  {
+    Pack(dirent);
+  }
+
+  PackedDirectoryEntry(const PackedDirectoryEntry &other) :
+    out_of_line_(NULL)
+  {
+    CopyFrom(other);
+  }
+
+  PackedDirectoryEntry &operator= (const PackedDirectoryEntry &other) {
+    if (&other != this)
+      CopyFrom(other);
+    return *this;
+  }
+
+  ~PackedDirectoryEntry() { free(out_of_line_); }
+
+  void Unpack(DirectoryEntry *dirent) const {
+    dirent->inode_ = inode_;
+    dirent->parent_inode_ = parent_inode_;
+    dirent->size_ = size_;
+    dirent->mtime_ = mtime_;
+    dirent->mode_ = mode_;
+    dirent->uid_ = uid_;
+    dirent->gid_ = gid_;
+    dirent->linkcount_ = linkcount_;
+    dirent->checksum_ = shash::Any(static_cast<shash::Algorithms>(algorithm_));
+    if (flags_ & kFlagDigest) {
+      memcpy(dirent->checksum_.digest, inline_,
+             shash::kDigestSizes[algorithm_]);
+    }
+    dirent->name_.Assign(GetNameChars(), name_length_);
+    dirent->symlink_.Assign(out_of_line_ + GetOutOfLineNameLength(),
+                            symlink_length_);
+
+    dirent->catalog_ = catalog_;
+    dirent->cached_mtime_ = cached_mtime_;
+    dirent->hardlink_group_ = hardlink_group_;
+    dirent->is_nested_catalog_root_ = flags_ & kFlagNestedCatalogRoot;
+    dirent->is_nested_catalog_mountpoint_ =
+      flags_ & kFlagNestedCatalogMountpoint;
+    dirent->is_chunked_file_ = flags_ & kFlagChunkedFile;
+    dirent->is_packed_file_ = flags_ & kFlagPackedFile;
+  }
+
+  unsigned GetOutOfLineSize() const {
+    return GetOutOfLineNameLength() + symlink_length_;
+  }
+
+ private:
+  static const unsigned char kFlagDigest = 0x01;
+  static const unsigned char kFlagNestedCatalogRoot = 0x02;
+  static const unsigned char kFlagNestedCatalogMountpoint = 0x04;
+  static const unsigned char kFlagChunkedFile = 0x08;
+  static const unsigned char kFlagPackedFile = 0x10;
+
+  void Pack(const DirectoryEntry &dirent) {
+    inode_ = dirent.inode_;
+    parent_inode_ = dirent.parent_inode_;
+    size_ = dirent.size_;
+    mtime_ = dirent.mtime_;
+    mode_ = dirent.mode_;
+    uid_ = dirent.uid_;
+    gid_ = dirent.gid_;
+    linkcount_ = dirent.linkcount_;
+    catalog_ = dirent.catalog_;
+    cached_mtime_ = dirent.cached_mtime_;
+    hardlink_group_ = dirent.hardlink_group_;
+
+    algorithm_ = dirent.checksum_.algorithm;
+    flags_ = 0;
+    unsigned digest_size = 0;
+    if (!dirent.checksum_.IsNull()) {
+      flags_ |= kFlagDigest;
+      digest_size = shash::kDigestSizes[algorithm_];
+      memcpy(inline_, dirent.checksum_.digest, digest_size);
+    }
+    if (dirent.is_nested_catalog_root_)
+      flags_ |= kFlagNestedCatalogRoot;
+    if (dirent.is_nested_catalog_mountpoint_)
+      flags_ |= kFlagNestedCatalogMountpoint;
+    if (dirent.is_chunked_file_)
+      flags_ |= kFlagChunkedFile;
+    if (dirent.is_packed_file_)
+      flags_ |= kFlagPackedFile;
+
+    assert(dirent.name_.GetLength() <= 255);
+    name_length_ = dirent.name_.GetLength();
+    symlink_length_ = dirent.symlink_.GetLength();
+    const unsigned out_of_line_size = GetOutOfLineSize();
+    if (out_of_line_size > 0)
+      out_of_line_ = static_cast<char *>(smalloc(out_of_line_size));
+    memcpy(const_cast<char *>(GetNameChars()), dirent.name_.GetChars(),
+           name_length_);
+    if (symlink_length_ > 0) {
+      memcpy(out_of_line_ + GetOutOfLineNameLength(),
+             dirent.symlink_.GetChars(), symlink_length_);
+    }
+  }
+
+  void CopyFrom(const PackedDirectoryEntry &other) {
+    inode_ = other.inode_;
+    parent_inode_ = other.parent_inode_;
+    size_ = other.size_;
+    mtime_ = other.mtime_;
+    cached_mtime_ = other.cached_mtime_;
+    catalog_ = other.catalog_;
+    uid_ = other.uid_;
+    gid_ = other.gid_;
+    linkcount_ = other.linkcount_;
+    hardlink_group_ = other.hardlink_group_;
+    mode_ = other.mode_;
+    symlink_length_ = other.symlink_length_;
+    name_length_ = other.name_length_;
+    algorithm_ = other.algorithm_;
+    flags_ = other.flags_;
+    memcpy(inline_, other.inline_, kInlineSize);
+
+    free(out_of_line_);
+    out_of_line_ = NULL;
+    const unsigned out_of_line_size = GetOutOfLineSize();
+    if (out_of_line_size > 0) {
+      out_of_line_ = static_cast<char *>(smalloc(out_of_line_size));
+      memcpy(out_of_line_, other.out_of_line_, out_of_line_size);
+    }
+  }
+
+  unsigned GetDigestSize() const {
+    return (flags_ & kFlagDigest) ? shash::kDigestSizes[algorithm_] : 0;
+  }
+  bool IsNameInline() const {
+    return GetDigestSize() + name_length_ <= kInlineSize;
+  }
+  unsigned GetOutOfLineNameLength() const {
+    return IsNameInline() ? 0 : name_length_;
+  }
+  const char *GetNameChars() const {
+    return IsNameInline() ? inline_ + GetDigestSize() : out_of_line_;
+  }
+
+  inode_t inode_;
+  inode_t parent_inode_;
+  uint64_t size_;
+  time_t mtime_;
+  time_t cached_mtime_;
+  Catalog *catalog_;
+  char *out_of_line_;  /**< name, if not inline, followed by symlink target */
+  uint32_t uid_;
+  uint32_t gid_;
+  uint32_t linkcount_;
+  uint32_t hardlink_group_;
+  uint16_t mode_;
+  uint16_t symlink_length_;
+  unsigned char name_length_;
+  unsigned char algorithm_;
+  unsigned char flags_;
+  char inline_[kInlineSize];  /**< digest followed by the name, if it fits */
+};
+
+
 /**
  * Saves memory for large directory listings
  */
@@ -11,7 +11,7 @@
  * blocks but there is a separate I/O thread using asynchronous I/O, which
  * maintains all concurrent connections simultaneously.  As there might be more
  * than 1024 file descriptors for the CernVM-FS process, the I/O thread uses
- * poll and the libcurl multi socket interface.
+ * epoll (kqueue on OS X) and the libcurl multi socket interface.
  *
  * While downloading, files can be decompressed and the secure hash can be
  * calculated on the fly.
@@ -22,6 +22,15 @@
  * fail-over to the next host in the chain until all hosts are probed.
  * Similarly a chain of proxy sets can be configured.  Inside a proxy set,
  * proxies are selected randomly (load-balancing set).
+ *
+ * The latency and throughput of the hosts are tracked from the transfers.
+ * With adaptive hosts, the best performing host is selected automatically.
+ *
+ * With proxy sharding, all proxies of a load-balancing set are used at the
+ * same time.  Every URL is consistently mapped to one of them.
+ *
+ * If libcurl supports it, HTTP/2 can be used for direct connections to the
+ * hosts.
  */
 
 //TODO: MS for time summing
@@ -36,7 +45,7 @@
 #include <pthread.h>
 #include <alloca.h>
 #include <errno.h>
-#include <poll.h>
+#include <sys/select.h>
 #include <sys/time.h>
 
 #include <cassert>
@@ -44,12 +53,16 @@
 #include <cstring>
 #include <cstdio>
 
+#include <algorithm>
+#include <map>
 #include <set>
 
 #include "duplex_curl.h"
 #include "logging.h"
 #include "atomic.h"
 #include "hash.h"
+#include "murmur.h"
+#include "platform.h"
 #include "prng.h"
 #include "util.h"
 #include "compression.h"
@@ -58,8 +71,90 @@
 
 using namespace std;  // NOLINT
 
+// HTTP/2 multiplexing and falling back to HTTP/1.1 need libcurl >= 7.51
+#if LIBCURL_VERSION_NUM >= 0x073300
+#define CVMFS_CURL_HTTP2
+#endif
+
 namespace download {
 
+/**
+ * Weight of a new sample in the moving averages of the host statistics.
+ */
+const double kHostEwmaWeight = 0.2;
+/**
+ * Smaller transfers are dominated by latency, they are not used to estimate
+ * the throughput.
+ */
+const double kHostMinThroughputBytes = 64 * 1024;
+/**
+ * Transfer size used to weigh latency against throughput in the host score.
+ */
+const double kHostTypicalTransferBytes = 256 * 1024;
+/**
+ * Adaptive hosts switch only if the best score is clearly better.
+ */
+const double kHostSwitchRatio = 0.8;
+/**
+ * At most one request per interval (in seconds) is used to measure a host
+ * other than the current one.
+ */
+const unsigned kHostExplorationInterval = 10;
+/**
+ * A failed proxy is taken out of the rotation of a sharded proxy group for
+ * this many seconds, doubled with every consecutive failure up to the maximum.
+ */
+const unsigned kProxyCircuitOpenSeconds = 30;
+const unsigned kProxyCircuitMaxOpenSeconds = 600;
+/**
+ * Upper bounds (in ms) of the connect time histogram bins, the last bin is
+ * open-ended.
+ */
+const double kConnectTimeBinBounds[Statistics::kNumConnectTimeBins - 1] =
+  {1.0, 2.0, 5.0, 10.0, 20.0, 50.0, 100.0, 200.0, 500.0, 1000.0};
+/**
+ * Maximum number of socket events handled per wakeup of the I/O thread, more
+ * events are returned by the next wait.
+ */
+const int kMaxPollEvents = 256;
+/**
+ * Requests are hedged only if their proxy or host has enough latency samples.
+ * Deadlines shorter than the minimum delay (in ms) are not worth a duplicate.
+ */
+const uint64_t kHedgeMinSamples = 20;
+const double kHedgeMinDelayMs = 10.0;
+/**
+ * At most this fraction of the requests is duplicated, so that a slow period
+ * does not double the load on the proxies and hosts.
+ */
+const double kHedgeMaxRatio = 0.1;
+
+
+double HostStatistics::GetScore() const {
+  if ((latency_ms < 0.0) || (timestamp_failure > timestamp_sample))
+    return -1.0;
+  double score = latency_ms;
+  if (throughput > 0.0)
+    score += 1000.0 * kHostTypicalTransferBytes / throughput;
+  return score;
+}
+
+
+static uint64_t GetTimestampMs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+
+static void UpdateEwma(const double sample, double *average) {
+  if (*average < 0.0)
+    *average = sample;
+  else
+    *average = kHostEwmaWeight * sample + (1.0 - kHostEwmaWeight) * *average;
+}
+
+
 /**
  * Escape special chars from the URL, except for ':' and '/',
  * which should keep their meaning.
@@ -108,28 +203,100 @@ static Failures PrepareDownloadDestination(JobInfo *info) {
 }
 
 
+/**
+ * Returns the first digit of the status code of an HTTP/1.x or HTTP/2 status
+ * line or '\0' if the line is malformed.
+ */
+static char GetStatusClass(const string &status_line) {
+  const size_t separator = status_line.find(' ');
+  if ((status_line.length() < 10) || (separator == string::npos))
+    return '\0';
+
+  unsigned i;
+  for (i = separator; (i < status_line.length()) && (status_line[i] == ' ');
+       ++i) {}
+  return (i < status_line.length()) ? status_line[i] : '\0';
+}
+
+
+/**
+ * Decides the race between a request and its hedge.  The first transfer with
+ * a successful status line wins.  A transfer with an error status drops out
+ * of the race, so that the other one continues alone.
+ *
+ * \return false if the calling transfer has to be aborted
+ */
+static bool RunRace(JobInfo *info, const bool is_hedge,
+                    const string &header_line)
+{
+  switch (info->hedge_state) {
+    case kHedgeNone:
+      return true;
+    case kHedgeLost:
+      return !is_hedge;
+    case kHedgeWon:
+      return is_hedge;
+    default:
+      break;
+  }
+
+  if (!HasPrefix(header_line, "HTTP/", false))
+    return true;
+  const char status_class = GetStatusClass(header_line);
+  if (status_class == '1')
+    return true;
+  const bool is_success = (status_class == '2');
+  info->hedge_state = (is_success == is_hedge) ? kHedgeWon : kHedgeLost;
+  if (!is_success) {
+    // Classified like in HandleHeader()
+    const bool via_proxy =
+      !(is_hedge ? info->hedge_proxy : info->proxy).empty();
+    if ((status_class == '5') || !via_proxy ||
+        (header_line.find(" 404") != string::npos))
+    {
+      info->hedge_loser_error = kFailHostHttp;
+    } else {
+      info->hedge_loser_error = kFailProxyHttp;
+    }
+  }
+  return is_success;
+}
+
+
 /**
  * Called by curl for every HTTP header. Not called for file:// transfers.
  */
-static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
-                                 void *info_link)
+static size_t HandleHeader(void *ptr, const size_t num_bytes, JobInfo *info,
+                           const bool is_hedge)
 {
-  const size_t num_bytes = size*nmemb;
   const string header_line(static_cast<const char *>(ptr), num_bytes);
-  JobInfo *info = static_cast<JobInfo *>(info_link);
 
   //LogCvmfs(kLogDownload, kLogDebug, "REMOVE-ME: Header callback with line %s",
   //         header_line.c_str());
 
-  // Check for http status code errors
-  if (HasPrefix(header_line, "HTTP/1.", false)) {
-    if (header_line.length() < 10)
+  if (!RunRace(info, is_hedge, header_line))
+    return 0;
+
+  // Check for http status code errors (HTTP/1.x or HTTP/2 status line)
+  if (HasPrefix(header_line, "HTTP/", false)) {
+    const size_t separator = header_line.find(' ');
+    if ((header_line.length() < 10) || (separator == string::npos))
       return 0;
+    info->got_response = true;
 
     unsigned i;
-    for (i = 8; (i < header_line.length()) && (header_line[i] == ' '); ++i) {}
+    for (i = separator; (i < header_line.length()) && (header_line[i] == ' ');
+         ++i) {}
 
     if (header_line[i] == '2') {
+      // A server that ignores the byte range sends the entire object
+      if ((info->range_size > 0) && (header_line.compare(i, 3, "206") != 0)) {
+        LogCvmfs(kLogDownload, kLogDebug, "byte range not served: %s",
+                 header_line.c_str());
+        info->error_code = (info->proxy == "") ? kFailHostHttp :
+                                                 kFailProxyHttp;
+        return 0;
+      }
       return num_bytes;
     } else {
       LogCvmfs(kLogDownload, kLogDebug, "http status error code: %s",
@@ -169,18 +336,50 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
 
 
 /**
- * Called by curl for every received data chunk.
+ * Restricts the transfer to the byte range of the job, if any.  The range is
+ * cleared when the handle returns to the pool.
  */
-static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
-                               void *info_link)
+static void SetRangeOption(const JobInfo *info, CURL *handle) {
+  if (info->range_size == 0)
+    return;
+  const string range = StringifyInt(info->range_offset) + "-" +
+    StringifyInt(info->range_offset + info->range_size - 1);
+  curl_easy_setopt(handle, CURLOPT_RANGE, range.c_str());
+}
+
+
+static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
+                                 void *info_link)
 {
-  const size_t num_bytes = size*nmemb;
-  JobInfo *info = static_cast<JobInfo *>(info_link);
+  return HandleHeader(ptr, size*nmemb, static_cast<JobInfo *>(info_link),
+                      false);
+}
+
+
+static size_t CallbackCurlHedgeHeader(void *ptr, size_t size, size_t nmemb,
+                                      void *info_link)
+{
+  return HandleHeader(ptr, size*nmemb, static_cast<JobInfo *>(info_link),
+                      true);
+}
 
+
+/**
+ * Called by curl for every received data chunk.
+ */
+static size_t HandleData(void *ptr, const size_t num_bytes, JobInfo *info,
+                         const bool is_hedge)
+{
   //LogCvmfs(kLogDownload, kLogDebug, "Data callback with %d bytes", num_bytes);
 
   if (num_bytes == 0)
     return 0;
+  // The loser of a race must not touch the destination
+  if (((info->hedge_state == kHedgeLost) && is_hedge) ||
+      ((info->hedge_state == kHedgeWon) && !is_hedge))
+  {
+    return 0;
+  }
 
   if (info->expected_hash)
     shash::Update((unsigned char *)ptr, num_bytes, info->hash_context);
@@ -224,8 +423,23 @@ static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
 }
 
 
+static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
+                               void *info_link)
+{
+  return HandleData(ptr, size*nmemb, static_cast<JobInfo *>(info_link), false);
+}
+
+
+static size_t CallbackCurlHedgeData(void *ptr, size_t size, size_t nmemb,
+                                    void *info_link)
+{
+  return HandleData(ptr, size*nmemb, static_cast<JobInfo *>(info_link), true);
+}
+
+
 /**
- * Called when new curl sockets arrive or existing curl sockets depart.
+ * Called when new curl sockets arrive or existing curl sockets depart.  Known
+ * sockets carry a non-NULL socketp, so that no lookup is necessary.
  */
 int DownloadManager::CallbackCurlSocket(CURL *easy, curl_socket_t s, int action,
                                         void *userp, void *socketp)
@@ -233,65 +447,41 @@ int DownloadManager::CallbackCurlSocket(CURL *easy, curl_socket_t s, int action,
   //LogCvmfs(kLogDownload, kLogDebug, "CallbackCurlSocket called with easy "
   //         "handle %p, socket %d, action %d", easy, s, action);
   DownloadManager *download_mgr = static_cast<DownloadManager *>(userp);
-  if (action == CURL_POLL_NONE)
+  if ((action == CURL_POLL_NONE) || (download_mgr->poller_ < 0))
     return 0;
 
-  // Find s in watch_fds_
-  unsigned index;
-  for (index = 0; index < download_mgr->watch_fds_inuse_; ++index) {
-    if (download_mgr->watch_fds_[index].fd == s)
-      break;
-  }
-  // Or create newly
-  if (index == download_mgr->watch_fds_inuse_) {
-    // Extend array if necessary
-    if (download_mgr->watch_fds_inuse_ == download_mgr->watch_fds_size_)
-    {
-      download_mgr->watch_fds_size_ *= 2;
-      download_mgr->watch_fds_ = static_cast<struct pollfd *>(
-        srealloc(download_mgr->watch_fds_,
-                 download_mgr->watch_fds_size_*sizeof(struct pollfd)));
-    }
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].fd = s;
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].events = 0;
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].revents = 0;
-    download_mgr->watch_fds_inuse_++;
+  if (action == CURL_POLL_REMOVE) {
+    platform_poller_unwatch(download_mgr->poller_, s);
+    return 0;
   }
 
-  switch (action) {
-    case CURL_POLL_IN:
-      download_mgr->watch_fds_[index].events |= POLLIN | POLLPRI;
-      break;
-    case CURL_POLL_OUT:
-      download_mgr->watch_fds_[index].events |= POLLOUT | POLLWRBAND;
-      break;
-    case CURL_POLL_INOUT:
-      download_mgr->watch_fds_[index].events |=
-        POLLIN | POLLPRI | POLLOUT | POLLWRBAND;
-      break;
-    case CURL_POLL_REMOVE:
-      if (index < download_mgr->watch_fds_inuse_-1)
-        download_mgr->watch_fds_[index] =
-          download_mgr->watch_fds_[download_mgr->watch_fds_inuse_-1];
-      download_mgr->watch_fds_inuse_--;
-      // Shrink array if necessary
-      if ((download_mgr->watch_fds_inuse_ > download_mgr->watch_fds_max_) &&
-          (download_mgr->watch_fds_inuse_ < download_mgr->watch_fds_size_/2))
-      {
-        download_mgr->watch_fds_size_ /= 2;
-        //LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds_ (%d)",
-        //         watch_fds_size_);
-        download_mgr->watch_fds_ = static_cast<struct pollfd *>(
-          srealloc(download_mgr->watch_fds_,
-                   download_mgr->watch_fds_size_*sizeof(struct pollfd)));
-        //LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds_ done",
-        //         watch_fds_size_);
-      }
-      break;
-    default:
-      break;
+  const bool is_new = (socketp == NULL);
+  const bool read = (action == CURL_POLL_IN) || (action == CURL_POLL_INOUT);
+  const bool write = (action == CURL_POLL_OUT) || (action == CURL_POLL_INOUT);
+  if (!platform_poller_watch(download_mgr->poller_, s, read, write, is_new)) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogErr,
+             "failed to watch curl socket %d (%d)", s, errno);
+    return -1;
+  }
+  if (is_new) {
+    curl_multi_assign(download_mgr->curl_multi_, s,
+                      static_cast<void *>(download_mgr));
   }
+  return 0;
+}
+
 
+/**
+ * Called when libcurl changes the time it wants to be called back without
+ * socket activity.
+ */
+int DownloadManager::CallbackCurlTimer(CURLM *multi,
+                                       long timeout_ms,  // NOLINT
+                                       void *userp)
+{
+  DownloadManager *download_mgr = static_cast<DownloadManager *>(userp);
+  download_mgr->curl_deadline_ms_ = (timeout_ms < 0) ? -1 :
+    static_cast<int64_t>(GetTimestampMs()) + timeout_ms;
   return 0;
 }
 
@@ -303,87 +493,126 @@ void *DownloadManager::MainDownload(void *data) {
   LogCvmfs(kLogDownload, kLogDebug, "download I/O thread started");
   DownloadManager *download_mgr = static_cast<DownloadManager *>(data);
 
-  download_mgr->watch_fds_ =
-    static_cast<struct pollfd *>(smalloc(2 * sizeof(struct pollfd)));
-  download_mgr->watch_fds_size_ = 2;
-  download_mgr->watch_fds_[0].fd = download_mgr->pipe_terminate_[0];
-  download_mgr->watch_fds_[0].events = POLLIN | POLLPRI;
-  download_mgr->watch_fds_[0].revents = 0;
-  download_mgr->watch_fds_[1].fd = download_mgr->pipe_jobs_[0];
-  download_mgr->watch_fds_[1].events = POLLIN | POLLPRI;
-  download_mgr->watch_fds_[1].revents = 0;
-  download_mgr->watch_fds_inuse_ = 2;
+  download_mgr->poller_ = platform_poller_create();
+  assert(download_mgr->poller_ >= 0);
+  bool retval_watch =
+    platform_poller_watch(download_mgr->poller_,
+                          download_mgr->pipe_terminate_[0], true, false, true);
+  assert(retval_watch);
+  retval_watch =
+    platform_poller_watch(download_mgr->poller_,
+                          download_mgr->pipe_jobs_[0], true, false, true);
+  assert(retval_watch);
+  platform_poll_event events[kMaxPollEvents];
 
   int still_running = 0;
+  bool has_idle_connections = false;
+  bool terminate = false;
   struct timeval timeval_start, timeval_stop;
   gettimeofday(&timeval_start, NULL);
-  while (true) {
+  while (!terminate) {
     int timeout;
     if (still_running) {
-      timeout = 1;
+      const uint64_t now = GetTimestampMs();
+      timeout = -1;
+      if (download_mgr->curl_deadline_ms_ >= 0) {
+        const int64_t remaining =
+          download_mgr->curl_deadline_ms_ - static_cast<int64_t>(now);
+        timeout = (remaining > 0) ? static_cast<int>(remaining) : 0;
+      }
+      // Wake up for the next hedged request
+      if (!download_mgr->hedge_queue_->empty()) {
+        const uint64_t deadline = download_mgr->hedge_queue_->begin()->first;
+        const int timeout_hedge =
+          (deadline > now) ? static_cast<int>(deadline - now) : 0;
+        if ((timeout < 0) || (timeout_hedge < timeout))
+          timeout = timeout_hedge;
+      }
     } else {
       timeout = -1;
       gettimeofday(&timeval_stop, NULL);
       download_mgr->statistics_->transfer_time +=
         DiffTimeSeconds(timeval_start, timeval_stop);
+      if (has_idle_connections && (download_mgr->opt_idle_timeout_ > 0))
+        timeout = download_mgr->opt_idle_timeout_ * 1000;
     }
-    int retval = poll(download_mgr->watch_fds_, download_mgr->watch_fds_inuse_,
-                      timeout);
-    if (retval < 0) {
+    int num_events = platform_poller_wait(download_mgr->poller_, events,
+                                          kMaxPollEvents, timeout);
+    if (num_events < 0) {
       continue;
     }
 
-    // Handle timeout
-    if (retval == 0) {
-      retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                        CURL_SOCKET_TIMEOUT,
-                                        0,
-                                        &still_running);
+    // No transfers during the idle timeout
+    if ((num_events == 0) && !still_running && has_idle_connections) {
+      download_mgr->CloseIdleConnections();
+      has_idle_connections = false;
+      continue;
     }
 
-    // Terminate I/O thread
-    if (download_mgr->watch_fds_[0].revents)
-      break;
-
-    // New job arrives
-    if (download_mgr->watch_fds_[1].revents) {
-      download_mgr->watch_fds_[1].revents = 0;
-      JobInfo *info;
-      ReadPipe(download_mgr->pipe_jobs_[0], &info, sizeof(info));
-      //LogCvmfs(kLogDownload, kLogDebug, "IO thread, got job: url %s, compressed %d, nocache %d, destination %d, file %p, expected hash %p, wait at %d", info->url->c_str(), info->compressed, info->nocache,
-      //         info->destination, info->destination_file, info->expected_hash, info->wait_at[1]);
-
-      if (!still_running)
-        gettimeofday(&timeval_start, NULL);
-      CURL *handle = download_mgr->AcquireCurlHandle();
-      download_mgr->InitializeRequest(info, handle);
-      download_mgr->SetUrlOptions(info);
-      curl_multi_add_handle(download_mgr->curl_multi_, handle);
-      retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                        CURL_SOCKET_TIMEOUT,
-                                        0,
-                                        &still_running);
-      //LogCvmfs(kLogDownload, kLogDebug, "socket action returned with %d, still_running %d", retval, still_running);
+    // Handle timeout, also if socket activity did not let the poller time out
+    if ((download_mgr->curl_deadline_ms_ >= 0) &&
+        (static_cast<int64_t>(GetTimestampMs()) >=
+         download_mgr->curl_deadline_ms_))
+    {
+      curl_multi_socket_action(download_mgr->curl_multi_,
+                               CURL_SOCKET_TIMEOUT,
+                               0,
+                               &still_running);
     }
 
-    // Activity on curl sockets
-    for (unsigned i = 2; i < download_mgr->watch_fds_inuse_; ++i) {
-      if (download_mgr->watch_fds_[i].revents) {
-        int ev_bitmask = 0;
-        if (download_mgr->watch_fds_[i].revents & (POLLIN | POLLPRI))
-          ev_bitmask |= CURL_CSELECT_IN;
-        if (download_mgr->watch_fds_[i].revents & (POLLOUT | POLLWRBAND))
-          ev_bitmask |= CURL_CSELECT_IN;
-        if (download_mgr->watch_fds_[i].revents & (POLLERR | POLLHUP | POLLNVAL))
-          ev_bitmask |= CURL_CSELECT_ERR;
-        download_mgr->watch_fds_[i].revents = 0;
-
-        retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                          download_mgr->watch_fds_[i].fd,
-                                          ev_bitmask,
-                                          &still_running);
-        //LogCvmfs(kLogDownload, kLogDebug, "socket action on socket %d, returned with %d, still_running %d", watch_fds_[i].fd, retval, still_running);
+    for (int i = 0; i < num_events; ++i) {
+      const int fd = platform_poll_fd(events[i]);
+
+      // Terminate I/O thread
+      if (fd == download_mgr->pipe_terminate_[0]) {
+        terminate = true;
+        break;
+      }
+
+      // New job arrives
+      if (fd == download_mgr->pipe_jobs_[0]) {
+        JobInfo *info;
+        ReadPipe(download_mgr->pipe_jobs_[0], &info, sizeof(info));
+        //LogCvmfs(kLogDownload, kLogDebug, "IO thread, got job: url %s, compressed %d, nocache %d, destination %d, file %p, expected hash %p, wait at %d", info->url->c_str(), info->compressed, info->nocache,
+        //         info->destination, info->destination_file, info->expected_hash, info->wait_at[1]);
+
+        if (!still_running)
+          gettimeofday(&timeval_start, NULL);
+        CURL *handle = download_mgr->AcquireCurlHandle();
+        download_mgr->InitializeRequest(info, handle);
+        download_mgr->SetUrlOptions(info);
+        curl_multi_add_handle(download_mgr->curl_multi_, handle);
+        download_mgr->ScheduleHedge(info);
+        curl_multi_socket_action(download_mgr->curl_multi_,
+                                 CURL_SOCKET_TIMEOUT,
+                                 0,
+                                 &still_running);
+        continue;
       }
+
+      // Activity on a curl socket
+      int ev_bitmask = 0;
+      if (platform_poll_readable(events[i]))
+        ev_bitmask |= CURL_CSELECT_IN;
+      if (platform_poll_writable(events[i]))
+        ev_bitmask |= CURL_CSELECT_OUT;
+      if (platform_poll_error(events[i]))
+        ev_bitmask |= CURL_CSELECT_ERR;
+      curl_multi_socket_action(download_mgr->curl_multi_, fd, ev_bitmask,
+                               &still_running);
+      //LogCvmfs(kLogDownload, kLogDebug, "socket action on socket %d, still_running %d", fd, still_running);
+    }
+    if (terminate)
+      break;
+
+    // Duplicate requests that are waiting for a response for too long
+    if (!download_mgr->hedge_queue_->empty() &&
+        download_mgr->StartDueHedges())
+    {
+      curl_multi_socket_action(download_mgr->curl_multi_,
+                               CURL_SOCKET_TIMEOUT,
+                               0,
+                               &still_running);
     }
 
     // Check if transfers are completed
@@ -393,20 +622,30 @@ void *DownloadManager::MainDownload(void *data) {
                                             &msgs_in_queue)))
     {
       if (curl_msg->msg == CURLMSG_DONE) {
-        download_mgr->statistics_->num_requests++;
+        has_idle_connections = true;
         JobInfo *info;
         CURL *easy_handle = curl_msg->easy_handle;
         int curl_error = curl_msg->data.result;
         curl_easy_getinfo(easy_handle, CURLINFO_PRIVATE, &info);
+        // Hedges are not counted, they are limited relative to the requests
+        if (easy_handle != info->hedge_handle)
+          download_mgr->statistics_->num_requests++;
         //LogCvmfs(kLogDownload, kLogDebug, "Done message for %s", info->url->c_str());
 
         curl_multi_remove_handle(download_mgr->curl_multi_, easy_handle);
+        download_mgr->UnscheduleHedge(info);
+        if ((info->hedge_handle != NULL) &&
+            !download_mgr->FinishRace(info, easy_handle, curl_error))
+        {
+          // The other transfer of the race continues
+          continue;
+        }
         if (download_mgr->VerifyAndFinalize(curl_error, info)) {
           curl_multi_add_handle(download_mgr->curl_multi_, easy_handle);
-          retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                            CURL_SOCKET_TIMEOUT,
-                                            0,
-                                            &still_running);
+          curl_multi_socket_action(download_mgr->curl_multi_,
+                                   CURL_SOCKET_TIMEOUT,
+                                   0,
+                                   &still_running);
         } else {
           // Return easy handle into pool and write result back
           download_mgr->ReleaseCurlHandle(easy_handle);
@@ -425,13 +664,30 @@ void *DownloadManager::MainDownload(void *data) {
     curl_easy_cleanup(*i);
   }
   download_mgr->pool_handles_inuse_->clear();
-  free(download_mgr->watch_fds_);
+  close(download_mgr->poller_);
+  download_mgr->poller_ = -1;
 
   LogCvmfs(kLogDownload, kLogDebug, "download I/O thread terminated");
   return NULL;
 }
 
 
+/**
+ * Opens a connection by a HEAD request that stays in the connection cache.
+ */
+void *DownloadManager::MainWarmConnection(void *data) {
+  DownloadManager *download_mgr = static_cast<DownloadManager *>(data);
+  const string url = "/.cvmfspublished";
+  JobInfo info(&url, true);
+  const Failures retval = download_mgr->Fetch(&info);
+  if (retval != kFailOk) {
+    LogCvmfs(kLogDownload, kLogDebug, "failed to warm up a connection (%d)",
+             retval);
+  }
+  return NULL;
+}
+
+
 //------------------------------------------------------------------------------
 
 
@@ -467,6 +723,11 @@ void DownloadManager::ReleaseCurlHandle(CURL *handle) {
   set<CURL *>::iterator elem = pool_handles_inuse_->find(handle);
   assert(elem != pool_handles_inuse_->end());
 
+  // Hedges use their own callbacks
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, CallbackCurlHeader);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlData);
+  curl_easy_setopt(handle, CURLOPT_RANGE, NULL);
+
   if (pool_handles_idle_->size() > pool_max_handles_)
     curl_easy_cleanup(*elem);
   else
@@ -485,6 +746,14 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
   info->curl_handle = handle;
   info->error_code = kFailOk;
   info->nocache = false;
+  info->http2 = false;
+  info->got_response = false;
+  info->hedge_state = kHedgeNone;
+  info->hedge_handle = NULL;
+  info->hedge_deadline_ms = 0;
+  info->timestamp_start_ms = 0;
+  info->hedge_timestamp_start_ms = 0;
+  info->hedge_loser_error = kFailOk;
   info->num_used_proxies = 1;
   info->num_used_hosts = 1;
   info->num_retries = 0;
@@ -514,6 +783,7 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
     curl_easy_setopt(handle, CURLOPT_NOBODY, 1);
   else
     curl_easy_setopt(handle, CURLOPT_HTTPGET, 1);
+  SetRangeOption(info, handle);
   if (opt_ipv4_only_)
     curl_easy_setopt(handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
 }
@@ -567,59 +837,585 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
       }
     }
   }
-  // Check if host needs to be reset
-  if (opt_timestamp_backup_host_ > 0) {
-    const time_t now = time(NULL);
-    if (static_cast<int64_t>(now) >
-        static_cast<int64_t>(opt_timestamp_backup_host_ +
-                             opt_host_reset_after_))
-    {
-      LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
-               "switching host from %s to %s (reset host)",
-               (*opt_host_chain_)[opt_host_chain_current_].c_str(),
-               (*opt_host_chain_)[0].c_str());
-      opt_host_chain_current_ = 0;
-      opt_timestamp_backup_host_ = 0;
-    }
+  // Check if host needs to be reset (adaptive hosts select the host by score)
+  if ((opt_timestamp_backup_host_ > 0) && !opt_adaptive_hosts_) {
+    const time_t now = time(NULL);
+    if (static_cast<int64_t>(now) >
+        static_cast<int64_t>(opt_timestamp_backup_host_ +
+                             opt_host_reset_after_))
+    {
+      LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+               "switching host from %s to %s (reset host)",
+               (*opt_host_chain_)[opt_host_chain_current_].c_str(),
+               (*opt_host_chain_)[0].c_str());
+      opt_host_chain_current_ = 0;
+      opt_timestamp_backup_host_ = 0;
+    }
+  }
+
+  if (opt_proxy_shard_ && opt_proxy_groups_) {
+    info->proxy = SelectShardProxyUnlocked(*info->url);
+  } else if (!opt_proxy_groups_ ||
+             ((*opt_proxy_groups_)[opt_proxy_groups_current_][0] == "DIRECT"))
+  {
+    info->proxy = "";
+  } else {
+    info->proxy = (*opt_proxy_groups_)[opt_proxy_groups_current_][0];
+  }
+  curl_easy_setopt(info->curl_handle, CURLOPT_PROXY, info->proxy.c_str());
+  if (info->proxy != "") {
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, opt_timeout_proxy_);
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, opt_timeout_proxy_);
+  } else {
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, opt_timeout_direct_);
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, opt_timeout_direct_);
+  }
+  if (opt_dns_server_)
+    curl_easy_setopt(curl_handle, CURLOPT_DNS_SERVERS, opt_dns_server_);
+
+  if (info->probe_hosts && opt_host_chain_) {
+    unsigned host = opt_host_chain_current_;
+    // Measure another host with the first attempt of a request now and then
+    if (opt_adaptive_hosts_ && (opt_host_chain_->size() > 1) &&
+        (info->num_used_hosts == 1) && (info->num_used_proxies == 1) &&
+        (info->num_retries == 0) && !info->nocache)
+    {
+      const time_t now = time(NULL);
+      if (now >= opt_timestamp_exploration_ +
+                 static_cast<time_t>(kHostExplorationInterval))
+      {
+        opt_timestamp_exploration_ = now;
+        // Recently failed hosts are left alone for the host reset delay
+        for (unsigned i = 0; i < opt_host_chain_->size(); ++i) {
+          const unsigned candidate =
+            (opt_host_exploration_next_ + i) % opt_host_chain_->size();
+          const HostStatistics &candidate_statistics =
+            (*opt_host_chain_statistics_)[candidate];
+          if ((candidate == opt_host_chain_current_) ||
+              (static_cast<int64_t>(now) <
+               static_cast<int64_t>(candidate_statistics.timestamp_failure +
+                                    opt_host_reset_after_)))
+          {
+            continue;
+          }
+          host = candidate;
+          opt_host_exploration_next_ = candidate + 1;
+          LogCvmfs(kLogDownload, kLogDebug, "exploring host %s",
+                   (*opt_host_chain_)[host].c_str());
+          break;
+        }
+      }
+    }
+    url_prefix = (*opt_host_chain_)[host];
+  }
+  info->url_prefix = url_prefix;
+#ifdef CVMFS_CURL_HTTP2
+  if (opt_http2_) {
+    // Forward proxies speak HTTP/1.1
+    info->http2 = (info->proxy == "") && !url_prefix.empty() &&
+      (opt_http2_prior_knowledge_ || HasPrefix(url_prefix, "https://", true)) &&
+      (http1_hosts_.find(url_prefix) == http1_hosts_.end());
+    long http_version = CURL_HTTP_VERSION_1_1;  // NOLINT(runtime/int)
+    if (info->http2) {
+      http_version = opt_http2_prior_knowledge_ ?
+                     CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE :
+                     CURL_HTTP_VERSION_2TLS;
+    }
+    curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, http_version);
+    // Wait for a multiplexed connection instead of opening another one
+    curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, info->http2 ? 1L : 0L);
+  }
+#endif
+  pthread_mutex_unlock(lock_options_);
+
+  curl_easy_setopt(curl_handle, CURLOPT_URL,
+                   EscapeUrl((url_prefix + *(info->url))).c_str());
+  //LogCvmfs(kLogDownload, kLogDebug, "set url %s for info %p / curl handle %p",
+  //         EscapeUrl((url_prefix + *(info->url))).c_str(), info, curl_handle);
+}
+
+
+/**
+ * Adds transfer time and downloaded bytes to the global counters.
+ */
+void DownloadManager::UpdateStatistics(CURL *handle) {
+  double val;
+
+  if (curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &val) == CURLE_OK)
+    statistics_->transferred_bytes += val;
+
+  // Transfers that reused a connection did not connect
+  long num_connects = 0;  // NOLINT(runtime/int)
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects);
+  if (num_connects > 0) {
+    statistics_->num_connections += num_connects;
+    if (curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &val) == CURLE_OK) {
+      const double connect_ms = val * 1000.0;
+      unsigned bin = 0;
+      while ((bin < Statistics::kNumConnectTimeBins - 1) &&
+             (connect_ms >= kConnectTimeBinBounds[bin]))
+      {
+        ++bin;
+      }
+      statistics_->connect_time_histogram[bin]++;
+    }
+  }
+
+#ifdef CVMFS_CURL_HTTP2
+  long http_version;  // NOLINT(runtime/int)
+  if ((curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &http_version) ==
+       CURLE_OK) && (http_version == CURL_HTTP_VERSION_2_0))
+  {
+    statistics_->num_http2_requests++;
+    if (num_connects == 0)
+      statistics_->num_multiplexed++;
+  }
+#endif
+}
+
+
+/**
+ * Remembers a host that failed to answer an HTTP/2 request with an HTTP/2
+ * protocol error.  The request is repeated with HTTP/1.1 then, as are all
+ * further requests to the host.  Transient errors such as a reset connection
+ * do not demote the host.
+ * @return  true if the request should be repeated with HTTP/1.1
+ */
+bool DownloadManager::FallbackToHttp1(const int curl_error,
+                                      const JobInfo *info)
+{
+#ifdef CVMFS_CURL_HTTP2
+  if (!info->http2)
+    return false;
+  switch (curl_error) {
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+    case CURLE_WEIRD_SERVER_REPLY:
+      break;
+    default:
+      return false;
+  }
+
+  char *effective_url = NULL;
+  if ((curl_easy_getinfo(info->curl_handle, CURLINFO_EFFECTIVE_URL,
+                         &effective_url) != CURLE_OK) ||
+      (effective_url == NULL))
+  {
+    return false;
+  }
+  pthread_mutex_lock(lock_options_);
+  const int host = FindHostUnlocked(effective_url);
+  if ((host >= 0) && http1_hosts_.insert((*opt_host_chain_)[host]).second) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "host %s failed to speak HTTP/2 (curl error %d), "
+             "falling back to HTTP/1.1",
+             (*opt_host_chain_)[host].c_str(), curl_error);
+  }
+  pthread_mutex_unlock(lock_options_);
+  return host >= 0;
+#else
+  return false;
+#endif
+}
+
+
+/**
+ * Feeds the outcome of a transfer from the host chain into the statistics of
+ * the host that served it.
+ */
+void DownloadManager::UpdateHostStatistics(CURL *handle,
+                                           const Failures error_code)
+{
+  bool is_host_failure = false;
+  switch (error_code) {
+    case kFailOk:
+      break;
+    case kFailHostResolve:
+    case kFailHostConnection:
+    case kFailHostHttp:
+      is_host_failure = true;
+      break;
+    default:
+      return;
+  }
+
+  char *effective_url = NULL;
+  double time_first_byte = 0.0;
+  double time_total = 0.0;
+  double size = 0.0;
+  if ((curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL,
+                         &effective_url) != CURLE_OK) ||
+      (effective_url == NULL))
+  {
+    return;
+  }
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &time_first_byte);
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &time_total);
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &size);
+  const time_t now = time(NULL);
+
+  pthread_mutex_lock(lock_options_);
+  const int host = FindHostUnlocked(effective_url);
+  if (host >= 0) {
+    HostStatistics *host_statistics = &(*opt_host_chain_statistics_)[host];
+    if (is_host_failure) {
+      host_statistics->num_failures++;
+      host_statistics->timestamp_failure = now;
+    } else {
+      host_statistics->num_transfers++;
+      host_statistics->timestamp_sample = now;
+      UpdateEwma(time_first_byte * 1000.0, &host_statistics->latency_ms);
+      if ((size >= kHostMinThroughputBytes) && (time_total > time_first_byte))
+      {
+        UpdateEwma(size / (time_total - time_first_byte),
+                   &host_statistics->throughput);
+      }
+    }
+    if (opt_adaptive_hosts_)
+      SelectHostUnlocked();
+  }
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Adds the time to the first byte of a successful transfer to the latencies
+ * of its proxy or host.
+ */
+void DownloadManager::UpdateLatency(const JobInfo *info) {
+  double time_first_byte;
+  if ((curl_easy_getinfo(info->curl_handle, CURLINFO_STARTTRANSFER_TIME,
+                         &time_first_byte) != CURLE_OK) ||
+      (time_first_byte <= 0.0))
+  {
+    return;
+  }
+  AddLatency(info->proxy.empty() ? info->url_prefix : info->proxy,
+             time_first_byte * 1000.0);
+}
+
+
+void DownloadManager::AddLatency(const string &endpoint, const double ms) {
+  pthread_mutex_lock(lock_options_);
+  statistics_->first_byte_latency.Add(ms);
+  if (!endpoint.empty())
+    latencies_[endpoint].Add(ms);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Sets the deadline after which a new request is duplicated.  Requests to a
+ * proxy or host without enough latency samples are not hedged.  Only called
+ * by the I/O thread.
+ */
+void DownloadManager::ScheduleHedge(JobInfo *info) {
+  if (!opt_hedge_ || info->head_request)
+    return;
+  const string &endpoint = info->proxy.empty() ? info->url_prefix : info->proxy;
+  if (endpoint.empty())
+    return;
+
+  pthread_mutex_lock(lock_options_);
+  map<string, LatencyHistogram>::const_iterator iter =
+    latencies_.find(endpoint);
+  if ((iter == latencies_.end()) ||
+      (iter->second.num_samples < kHedgeMinSamples))
+  {
+    pthread_mutex_unlock(lock_options_);
+    return;
+  }
+  double delay_ms =
+    iter->second.GetQuantile(static_cast<double>(opt_hedge_percentile_) / 100);
+  pthread_mutex_unlock(lock_options_);
+
+  if (delay_ms < kHedgeMinDelayMs)
+    delay_ms = kHedgeMinDelayMs;
+  info->timestamp_start_ms = GetTimestampMs();
+  info->hedge_deadline_ms =
+    info->timestamp_start_ms + static_cast<uint64_t>(delay_ms);
+  hedge_queue_->insert(make_pair(info->hedge_deadline_ms, info));
+}
+
+
+void DownloadManager::UnscheduleHedge(JobInfo *info) {
+  if (info->hedge_deadline_ms == 0)
+    return;
+  hedge_queue_->erase(make_pair(info->hedge_deadline_ms, info));
+  info->hedge_deadline_ms = 0;
+}
+
+
+/**
+ * Hedges the requests whose deadline passed before they received a response.
+ * Only called by the I/O thread.
+ *
+ * \return true if at least one hedge was started
+ */
+bool DownloadManager::StartDueHedges() {
+  bool result = false;
+  const uint64_t now = GetTimestampMs();
+  while (!hedge_queue_->empty() && (hedge_queue_->begin()->first <= now)) {
+    JobInfo *info = hedge_queue_->begin()->second;
+    hedge_queue_->erase(hedge_queue_->begin());
+    info->hedge_deadline_ms = 0;
+    if (!info->got_response && StartHedge(info))
+      result = true;
+  }
+  return result;
+}
+
+
+/**
+ * Sends a duplicate of the request to another proxy of the current
+ * load-balancing group or, without proxy, to the next host.  Hedges use
+ * HTTP/1.1.
+ *
+ * \return false if there is no other proxy or host or if the hedging budget
+ *         is exhausted
+ */
+bool DownloadManager::StartHedge(JobInfo *info) {
+  if (static_cast<double>(statistics_->num_hedged) >=
+      kHedgeMaxRatio * static_cast<double>(statistics_->num_requests) + 1.0)
+  {
+    return false;
+  }
+
+  string proxy = info->proxy;
+  string url_prefix = info->url_prefix;
+  bool found = false;
+  pthread_mutex_lock(lock_options_);
+  if (!info->proxy.empty() && opt_proxy_groups_) {
+    const vector<string> &group =
+      (*opt_proxy_groups_)[opt_proxy_groups_current_];
+    const time_t now = time(NULL);
+    const unsigned pos =
+      find(group.begin(), group.end(), info->proxy) - group.begin();
+    for (unsigned i = 1; i <= group.size(); ++i) {
+      const string &candidate = group[(pos + i) % group.size()];
+      if ((candidate == "DIRECT") || (candidate == info->proxy))
+        continue;
+      if (opt_proxy_shard_) {
+        map<string, ProxyHealth>::const_iterator health =
+          proxy_health_.find(candidate);
+        if ((health != proxy_health_.end()) && !health->second.IsAvailable(now))
+          continue;
+      }
+      proxy = candidate;
+      found = true;
+      break;
+    }
+  }
+  if (!found && info->probe_hosts && opt_host_chain_ &&
+      (opt_host_chain_->size() > 1) && !url_prefix.empty())
+  {
+    const int host = FindHostUnlocked(url_prefix + "/");
+    if (host >= 0) {
+      url_prefix = (*opt_host_chain_)[(host + 1) % opt_host_chain_->size()];
+      found = true;
+    }
+  }
+  const unsigned timeout =
+    proxy.empty() ? opt_timeout_direct_ : opt_timeout_proxy_;
+  const string dns_server = opt_dns_server_ ? opt_dns_server_ : "";
+  pthread_mutex_unlock(lock_options_);
+  if (!found)
+    return false;
+
+  CURL *handle = AcquireCurlHandle();
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, CallbackCurlHedgeHeader);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlHedgeData);
+  curl_easy_setopt(handle, CURLOPT_PRIVATE, static_cast<void *>(info));
+  curl_easy_setopt(handle, CURLOPT_WRITEHEADER, static_cast<void *>(info));
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, static_cast<void *>(info));
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER,
+                   info->nocache ? http_headers_nocache_ : http_headers_);
+  curl_easy_setopt(handle, CURLOPT_HTTPGET, 1);
+  SetRangeOption(info, handle);
+  if (opt_ipv4_only_)
+    curl_easy_setopt(handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+  curl_easy_setopt(handle, CURLOPT_PROXY, proxy.c_str());
+  curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, timeout);
+  curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, timeout);
+  if (!dns_server.empty())
+    curl_easy_setopt(handle, CURLOPT_DNS_SERVERS, dns_server.c_str());
+#ifdef CVMFS_CURL_HTTP2
+  if (opt_http2_) {
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 0L);
+  }
+#endif
+  curl_easy_setopt(handle, CURLOPT_URL,
+                   EscapeUrl((url_prefix + *(info->url))).c_str());
+
+  LogCvmfs(kLogDownload, kLogDebug, "hedging %s (proxy %s, host %s)",
+           info->url->c_str(), proxy.c_str(), url_prefix.c_str());
+  info->hedge_handle = handle;
+  info->hedge_proxy = proxy;
+  info->hedge_url_prefix = url_prefix;
+  info->hedge_state = kHedgeRacing;
+  info->hedge_loser_error = kFailOk;
+  info->hedge_timestamp_start_ms = GetTimestampMs();
+  statistics_->num_hedged++;
+  curl_multi_add_handle(curl_multi_, handle);
+  return true;
+}
+
+
+/**
+ * Error class of a transfer that failed before it received a status line.
+ */
+static Failures ClassifyTransportError(const int curl_error,
+                                       const bool via_proxy)
+{
+  switch (curl_error) {
+    case CURLE_OK:
+      return kFailOk;
+    case CURLE_COULDNT_RESOLVE_PROXY:
+      return kFailProxyResolve;
+    case CURLE_COULDNT_RESOLVE_HOST:
+      return kFailHostResolve;
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_PARTIAL_FILE:
+      return via_proxy ? kFailProxyConnection : kFailHostConnection;
+    default:
+      return kFailOther;
+  }
+}
+
+
+/**
+ * Called for a finished transfer of a race, which is already removed from the
+ * multi handle.  The winner ends the race and the other transfer is removed.
+ * Otherwise the finished transfer is dropped and the other one continues
+ * alone.
+ *
+ * \return true if the finished transfer has to be verified as usual
+ */
+bool DownloadManager::FinishRace(JobInfo *info, CURL *handle,
+                                 const int curl_error)
+{
+  const bool is_hedge = (handle == info->hedge_handle);
+  CURL *other = is_hedge ? info->curl_handle : info->hedge_handle;
+  bool is_winner;
+  switch (info->hedge_state) {
+    case kHedgeWon:
+      is_winner = is_hedge;
+      break;
+    case kHedgeLost:
+      is_winner = !is_hedge;
+      break;
+    default:
+      is_winner = (curl_error == CURLE_OK);
   }
 
-  if (!opt_proxy_groups_ ||
-      ((*opt_proxy_groups_)[opt_proxy_groups_current_][0] == "DIRECT"))
+  // The transfer that drops out failed with an error status or with a
+  // transport error.  Otherwise it was just slower than the other one.
+  CURL *loser = is_winner ? other : handle;
+  const bool loser_is_hedge = (loser == info->hedge_handle);
+  const string loser_proxy = loser_is_hedge ? info->hedge_proxy : info->proxy;
+  Failures loser_error = info->hedge_loser_error;
+  if ((loser_error == kFailOk) && !is_winner &&
+      (info->hedge_state == kHedgeRacing))
   {
-    info->proxy = "";
+    loser_error = ClassifyTransportError(curl_error, !loser_proxy.empty());
+  }
+  if (loser_error != kFailOk) {
+    if (info->probe_hosts)
+      UpdateHostStatistics(loser, loser_error);
+    if (opt_proxy_shard_)
+      UpdateProxyHealth(loser_proxy, loser_error);
   } else {
-    info->proxy = (*opt_proxy_groups_)[opt_proxy_groups_current_][0];
+    if (opt_proxy_shard_)
+      AbandonProxyTransfer(loser_proxy);
+    // A slow loser never reaches VerifyAndFinalize().  Without a sample, the
+    // latencies of its endpoint would lack exactly the tail that hedging
+    // reacts to.  Its time so far is a lower bound of its latency.
+    double time_first_byte = 0.0;
+    curl_easy_getinfo(loser, CURLINFO_STARTTRANSFER_TIME, &time_first_byte);
+    double ms = time_first_byte * 1000.0;
+    if (ms <= 0.0) {
+      ms = static_cast<double>(GetTimestampMs() - (loser_is_hedge ?
+        info->hedge_timestamp_start_ms : info->timestamp_start_ms));
+    }
+    const string &loser_url_prefix =
+      loser_is_hedge ? info->hedge_url_prefix : info->url_prefix;
+    AddLatency(loser_proxy.empty() ? loser_url_prefix : loser_proxy, ms);
   }
-  curl_easy_setopt(info->curl_handle, CURLOPT_PROXY, info->proxy.c_str());
-  if (info->proxy != "") {
-    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, opt_timeout_proxy_);
-    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, opt_timeout_proxy_);
+
+  CURL *survivor;
+  if (is_winner) {
+    curl_multi_remove_handle(curl_multi_, other);
+    ReleaseCurlHandle(other);
+    survivor = handle;
   } else {
-    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, opt_timeout_direct_);
-    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, opt_timeout_direct_);
+    ReleaseCurlHandle(handle);
+    survivor = other;
   }
-  if (opt_dns_server_)
-    curl_easy_setopt(curl_handle, CURLOPT_DNS_SERVERS, opt_dns_server_);
+  if (survivor == info->hedge_handle) {
+    info->curl_handle = survivor;
+    info->proxy = info->hedge_proxy;
+    info->url_prefix = info->hedge_url_prefix;
+    info->http2 = false;
+    statistics_->num_hedges_won++;
+  }
+  LogCvmfs(kLogDownload, kLogDebug, "%s of hedged request %s finished first "
+           "(curl error %d)", is_hedge ? "hedge" : "original",
+           info->url->c_str(), curl_error);
+  info->hedge_handle = NULL;
+  info->hedge_state = kHedgeNone;
+  return is_winner;
+}
 
-  if (info->probe_hosts && opt_host_chain_)
-    url_prefix = (*opt_host_chain_)[opt_host_chain_current_];
-  pthread_mutex_unlock(lock_options_);
 
-  curl_easy_setopt(curl_handle, CURLOPT_URL,
-                   EscapeUrl((url_prefix + *(info->url))).c_str());
-  //LogCvmfs(kLogDownload, kLogDebug, "set url %s for info %p / curl handle %p",
-  //         EscapeUrl((url_prefix + *(info->url))).c_str(), info, curl_handle);
+/**
+ * Finds the host of the host chain that is the prefix of url.
+ * @return  index in the host chain or -1
+ */
+int DownloadManager::FindHostUnlocked(const string &url) const {
+  if (!opt_host_chain_)
+    return -1;
+  for (unsigned i = 0; i < opt_host_chain_->size(); ++i) {
+    if (HasPrefix(url, (*opt_host_chain_)[i] + "/", true))
+      return i;
+  }
+  return -1;
 }
 
 
 /**
- * Adds transfer time and downloaded bytes to the global counters.
+ * Switches to the host with the best score if it is clearly better than the
+ * current host or if the current host failed.
  */
-void DownloadManager::UpdateStatistics(CURL *handle) {
-  double val;
+void DownloadManager::SelectHostUnlocked() {
+  const vector<HostStatistics> &host_statistics = *opt_host_chain_statistics_;
+  int best_host = -1;
+  double best_score = 0.0;
+  for (unsigned i = 0; i < host_statistics.size(); ++i) {
+    const double score = host_statistics[i].GetScore();
+    if ((score >= 0.0) && ((best_host < 0) || (score < best_score))) {
+      best_host = i;
+      best_score = score;
+    }
+  }
+  if ((best_host < 0) ||
+      (static_cast<unsigned>(best_host) == opt_host_chain_current_))
+  {
+    return;
+  }
 
-  if (curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &val) == CURLE_OK)
-    statistics_->transferred_bytes += val;
+  const double current_score =
+    host_statistics[opt_host_chain_current_].GetScore();
+  if ((current_score >= 0.0) && (best_score > kHostSwitchRatio * current_score))
+    return;
+
+  LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
+           "switching host from %s to %s (adaptive, score %.0f vs. %.0f)",
+           (*opt_host_chain_)[opt_host_chain_current_].c_str(),
+           (*opt_host_chain_)[best_host].c_str(), current_score, best_score);
+  opt_host_chain_current_ = best_host;
+  opt_timestamp_backup_host_ = 0;
 }
 
 
@@ -675,6 +1471,7 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
   LogCvmfs(kLogDownload, kLogDebug, "Verify downloaded url %s (curl error %d)",
            info->url->c_str(), curl_error);
   UpdateStatistics(info->curl_handle);
+  const bool http1_fallback = FallbackToHttp1(curl_error, info);
 
   // Verification and error classification
   switch (curl_error) {
@@ -739,16 +1536,31 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
       // Error set by callback
       break;
     default:
+      if (http1_fallback) {
+        info->error_code = kFailHostConnection;
+        break;
+      }
       LogCvmfs(kLogDownload, kLogSyslogErr, "unexpected curl error (%d) while "
                "trying to fetch %s", curl_error, info->url->c_str());
       info->error_code = kFailOther;
       break;
   }
 
+  // The HTTP/1.1 retry is not a failure of the host or the proxy
+  if (info->probe_hosts && !http1_fallback)
+    UpdateHostStatistics(info->curl_handle, info->error_code);
+  if (info->error_code == kFailOk)
+    UpdateLatency(info);
+  if (opt_proxy_shard_ && !http1_fallback)
+    UpdateProxyHealth(info->proxy, info->error_code);
+
   // Determination if download should be repeated
   bool try_again = false;
   bool same_url_retry = CanRetry(info);
-  if (info->error_code != kFailOk) {
+  if (http1_fallback) {
+    try_again = true;
+    same_url_retry = true;
+  } else if (info->error_code != kFailOk) {
     pthread_mutex_lock(lock_options_);
     if ((info->error_code) == kFailBadData && !info->nocache)
       try_again = true;
@@ -776,6 +1588,9 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
             opt_host_chain_ &&
             (info->num_used_hosts < opt_host_chain_->size()))
         {
+          // The proxies were probably not at fault
+          if (opt_proxy_shard_)
+            ResetProxyHealthUnlocked();
           // reset proxy group if not already performed by other handle
           if (opt_proxy_groups_) {
             if ((opt_proxy_groups_current_ > 0) ||
@@ -833,6 +1648,13 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
     if (info->compressed)
       zlib::DecompressInit(&info->zstream);
 
+    // Same host and proxy, but HTTP/1.1
+    if (http1_fallback) {
+      info->error_code = kFailOk;
+      SetUrlOptions(info);
+      return true;
+    }
+
     // Failure handling
     bool switch_proxy = false;
     bool switch_host = false;
@@ -912,9 +1734,8 @@ DownloadManager::DownloadManager() {
   pipe_terminate_[0] = pipe_terminate_[1] = -1;
 
   pipe_jobs_[0] = pipe_jobs_[1] = -1;
-  watch_fds_ = NULL;
-  watch_fds_size_ = 0;
-  watch_fds_inuse_ = 0;
+  poller_ = -1;
+  curl_deadline_ms_ = -1;
   watch_fds_max_ = 0;
 
   lock_options_ =
@@ -932,15 +1753,29 @@ DownloadManager::DownloadManager() {
   opt_host_chain_ = NULL;
   opt_host_chain_rtt_ = NULL;
   opt_host_chain_current_ = 0;
+  opt_host_chain_statistics_ = NULL;
+  opt_adaptive_hosts_ = false;
+  opt_timestamp_exploration_ = 0;
+  opt_host_exploration_next_ = 0;
   opt_proxy_groups_ = NULL;
   opt_proxy_groups_current_ = 0;
   opt_proxy_groups_current_burned_ = 0;
   opt_num_proxies_ = 0;
+  opt_proxy_shard_ = false;
   opt_max_retries_ = 0;
   opt_backoff_init_ms_ = 0;
   opt_backoff_max_ms_ = 0;
 
   opt_ipv4_only_ = false;
+  opt_max_host_connections_ = 0;
+  opt_idle_timeout_ = 0;
+  multi_pipelining_ = false;
+  opt_http2_ = false;
+  opt_http2_prior_knowledge_ = false;
+  opt_http2_max_streams_ = 0;
+  opt_hedge_ = false;
+  opt_hedge_percentile_ = 0;
+  hedge_queue_ = NULL;
 
   opt_timestamp_backup_proxies_ = 0;
   opt_timestamp_failover_proxies_ = 0;
@@ -979,6 +1814,7 @@ void DownloadManager::Init(const unsigned max_pool_handles,
   opt_host_chain_current_ = 0;
 
   statistics_ = new Statistics();
+  hedge_queue_ = new set< pair<uint64_t, JobInfo *> >();
 
   // Prepare HTTP headers
   string cernvm_id = "User-Agent: cvmfs ";
@@ -1003,15 +1839,7 @@ void DownloadManager::Init(const unsigned max_pool_handles,
   http_headers_nocache_ = curl_slist_append(http_headers_nocache_,
                                             cernvm_id.c_str());
 
-  curl_multi_ = curl_multi_init();
-  assert(curl_multi_ != NULL);
-  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETFUNCTION, CallbackCurlSocket);
-  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETDATA,
-                    static_cast<void *>(this));
-  curl_multi_setopt(curl_multi_, CURLMOPT_MAXCONNECTS, watch_fds_max_);
-  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
-                    pool_max_handles_);
-  //curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
+  InitMultiHandle();
 
   prng_.InitLocaltime();
 
@@ -1032,6 +1860,11 @@ void DownloadManager::Init(const unsigned max_pool_handles,
 
 
 void DownloadManager::Fini() {
+  // Warm-up requests need the I/O thread to finish
+  for (unsigned i = 0; i < threads_warm_.size(); ++i)
+    pthread_join(threads_warm_[i], NULL);
+  threads_warm_.clear();
+
   if (atomic_xadd32(&multi_threaded_, 0) == 1) {
     // Shutdown I/O thread
     char buf = 'T';
@@ -1062,12 +1895,16 @@ void DownloadManager::Fini() {
 
   delete statistics_;
   statistics_ = NULL;
+  delete hedge_queue_;
+  hedge_queue_ = NULL;
 
   delete opt_host_chain_;
   delete opt_host_chain_rtt_;
+  delete opt_host_chain_statistics_;
   delete opt_proxy_groups_;
   opt_host_chain_ = NULL;
   opt_host_chain_rtt_ = NULL;
+  opt_host_chain_statistics_ = NULL;
   opt_proxy_groups_ = NULL;
 
   curl_global_cleanup();
@@ -1090,6 +1927,54 @@ void DownloadManager::Spawn() {
 }
 
 
+/**
+ * Creates the multi handle with the connection pool policy.
+ */
+void DownloadManager::InitMultiHandle() {
+  curl_multi_ = curl_multi_init();
+  assert(curl_multi_ != NULL);
+  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETFUNCTION, CallbackCurlSocket);
+  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETDATA,
+                    static_cast<void *>(this));
+  curl_multi_setopt(curl_multi_, CURLMOPT_TIMERFUNCTION, CallbackCurlTimer);
+  curl_multi_setopt(curl_multi_, CURLMOPT_TIMERDATA,
+                    static_cast<void *>(this));
+  curl_deadline_ms_ = -1;
+  curl_multi_setopt(curl_multi_, CURLMOPT_MAXCONNECTS, watch_fds_max_);
+  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    pool_max_handles_);
+  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    opt_max_host_connections_);
+  if (multi_pipelining_)
+    curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
+#ifdef CVMFS_CURL_HTTP2
+  if (opt_http2_) {
+    curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING,
+      multi_pipelining_ ? (CURLPIPE_HTTP1 | CURLPIPE_MULTIPLEX) :
+                          CURLPIPE_MULTIPLEX);
+#if LIBCURL_VERSION_NUM >= 0x074300
+    if (opt_http2_max_streams_ > 0) {
+      curl_multi_setopt(curl_multi_, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                        static_cast<long>(opt_http2_max_streams_));  // NOLINT
+    }
+#endif
+  }
+#endif
+}
+
+
+/**
+ * The connection cache belongs to the multi handle, replacing the multi
+ * handle closes all cached connections.  Only called by the I/O thread while
+ * no transfers are running.  Closed sockets leave the poller by themselves.
+ */
+void DownloadManager::CloseIdleConnections() {
+  LogCvmfs(kLogDownload, kLogDebug, "closing idle connections");
+  curl_multi_cleanup(curl_multi_);
+  InitMultiHandle();
+}
+
+
 /**
  * Downloads data from an unsecure outside channel (currently HTTP or file).
  */
@@ -1214,11 +2099,15 @@ void DownloadManager::SetHostChain(const string &host_list) {
   opt_timestamp_backup_host_ = 0;
   delete opt_host_chain_;
   delete opt_host_chain_rtt_;
+  delete opt_host_chain_statistics_;
   opt_host_chain_current_ = 0;
+  opt_host_exploration_next_ = 0;
+  http1_hosts_.clear();
 
   if (host_list == "") {
     opt_host_chain_ = NULL;
     opt_host_chain_rtt_ = NULL;
+    opt_host_chain_statistics_ = NULL;
     pthread_mutex_unlock(lock_options_);
     return;
   }
@@ -1229,27 +2118,44 @@ void DownloadManager::SetHostChain(const string &host_list) {
   //         (*opt_host_chain_)[0].c_str());
   for (unsigned i = 0, s = opt_host_chain_->size(); i < s; ++i)
     opt_host_chain_rtt_->push_back(-1);
+  opt_host_chain_statistics_ =
+    new vector<HostStatistics>(opt_host_chain_->size());
   pthread_mutex_unlock(lock_options_);
 }
 
 
 /**
  * Retrieves the currently set chain of hosts, their round trip times, and the
- * currently used host.
+ * currently used host.  Optionally, the statistics of the hosts are retrieved
+ * as well.
  */
 void DownloadManager::GetHostInfo(vector<string> *host_chain, vector<int> *rtt,
-                                  unsigned *current_host)
+                                  unsigned *current_host,
+                                  vector<HostStatistics> *host_statistics)
 {
   pthread_mutex_lock(lock_options_);
   if (opt_host_chain_) {
     *current_host = opt_host_chain_current_;
     *host_chain = *opt_host_chain_;
     *rtt = *opt_host_chain_rtt_;
+    if (host_statistics)
+      *host_statistics = *opt_host_chain_statistics_;
   }
   pthread_mutex_unlock(lock_options_);
 }
 
 
+/**
+ * Selects the host by the observed latency and throughput instead of by the
+ * order of the host chain.
+ */
+void DownloadManager::EnableAdaptiveHosts() {
+  pthread_mutex_lock(lock_options_);
+  opt_adaptive_hosts_ = true;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
 /**
  * Jumps to the next proxy in the ring of forward proxy servers.
  * Selects one randomly from a load-balancing group.
@@ -1264,6 +2170,13 @@ void DownloadManager::SwitchProxy(JobInfo *info) {
     pthread_mutex_unlock(lock_options_);
     return;
   }
+  // Sharded proxies: the circuit breaker of the failed proxy is already open,
+  // the next proxy is selected per request
+  if (opt_proxy_shard_ && info) {
+    statistics_->num_proxy_failover++;
+    pthread_mutex_unlock(lock_options_);
+    return;
+  }
   if (info &&
       ((*opt_proxy_groups_)[opt_proxy_groups_current_][0] != info->proxy))
   {
@@ -1394,9 +2307,22 @@ void DownloadManager::SwitchHost() {
 }
 
 
+static size_t CallbackCurlDiscard(void *ptr, size_t size, size_t nmemb,
+                                  void *info_link)
+{
+  return size * nmemb;
+}
+
+
 /**
- * Orders the hostlist according to RTT of downloading .cvmfschecksum.
- * Sets the current host to the best-responsive host.
+ * Orders the hostlist according to RTT of downloading .cvmfspublished.
+ * Sets the current host to the best-responsive host.  All hosts are probed
+ * concurrently, so that the probing takes as long as the slowest host but not
+ * as long as the sum of all hosts.  The probes bypass proxy caches, so that
+ * the RTTs are the ones of the hosts.  They are merged into the host
+ * statistics, which live transfers keep updating while the probes run.
+ * If a probe fails because of the proxy, it is repeated through the next proxy
+ * of the current proxy group before the host is marked as failed.
  * If you change the host list in between by SetHostChain(), it will be
  * overwritten by this function.
  */
@@ -1406,34 +2332,147 @@ void DownloadManager::ProbeHosts() {
   unsigned current_host;
 
   GetHostInfo(&host_chain, &host_rtt, &current_host);
+  if (host_chain.empty())
+    return;
+
+  pthread_mutex_lock(lock_options_);
+  vector<string> proxies;
+  if (opt_proxy_groups_) {
+    const vector<string> &group =
+      (*opt_proxy_groups_)[opt_proxy_groups_current_];
+    for (unsigned j = 0; j < group.size(); ++j)
+      proxies.push_back((group[j] == "DIRECT") ? "" : group[j]);
+  }
+  if (proxies.empty())
+    proxies.push_back("");
+  const long timeout_direct_ms = 1000 * opt_timeout_direct_;  // NOLINT
+  const long timeout_proxy_ms = 1000 * opt_timeout_proxy_;  // NOLINT
+  const string dns_server = opt_dns_server_ ? opt_dns_server_ : "";
+  pthread_mutex_unlock(lock_options_);
 
-  // Stopwatch, two times to fill caches first
-  unsigned i, retries;
-  string url;
-  JobInfo info(&url, false, false, NULL);
-  for (retries = 0; retries < 2; ++retries) {
+  // The shared multi handle belongs to the I/O thread, the probes use their
+  // own one.  Two rounds, the first one fills the caches.
+  CURLM *curl_multi = curl_multi_init();
+  assert(curl_multi != NULL);
+  vector<CURL *> handles(host_chain.size(), NULL);
+  vector<string> urls(host_chain.size());
+  vector<unsigned> proxy_index(host_chain.size(), 0);
+  unsigned i;
+  for (i = 0; i < host_chain.size(); ++i) {
+    urls[i] = host_chain[i] + "/.cvmfspublished";
+    host_rtt[i] = 0;
+  }
+  for (unsigned round = 0; round < 2; ++round) {
     for (i = 0; i < host_chain.size(); ++i) {
-      url = host_chain[i] + "/.cvmfspublished";
-
-      struct timeval tv_start, tv_end;
-      gettimeofday(&tv_start, NULL);
-      Failures result = Fetch(&info);
-      gettimeofday(&tv_end, NULL);
-      if (info.destination_mem.data)
-        free(info.destination_mem.data);
-      if (result == kFailOk) {
-        host_rtt[i] = int(DiffTimeSeconds(tv_start, tv_end) * 1000);
-        LogCvmfs(kLogDownload, kLogDebug, "probing host %s had %dms rtt",
-                 url.c_str(), host_rtt[i]);
+      if (host_rtt[i] == INT_MAX)
+        continue;
+      if (handles[i] == NULL) {
+        handles[i] = curl_easy_init();
+        assert(handles[i] != NULL);
+        curl_easy_setopt(handles[i], CURLOPT_NOSIGNAL, 1);
+        curl_easy_setopt(handles[i], CURLOPT_FAILONERROR, 1);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION,
+                         CallbackCurlDiscard);
+        curl_easy_setopt(handles[i], CURLOPT_HTTPHEADER,
+                         http_headers_nocache_);
+        curl_easy_setopt(handles[i], CURLOPT_PROXY, proxies[0].c_str());
+        curl_easy_setopt(handles[i], CURLOPT_TIMEOUT_MS,
+          proxies[0].empty() ? timeout_direct_ms : timeout_proxy_ms);
+        curl_easy_setopt(handles[i], CURLOPT_URL, urls[i].c_str());
+        if (opt_ipv4_only_)
+          curl_easy_setopt(handles[i], CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+        if (dns_server != "")
+          curl_easy_setopt(handles[i], CURLOPT_DNS_SERVERS, dns_server.c_str());
+        curl_easy_setopt(handles[i], CURLOPT_PRIVATE,
+                         reinterpret_cast<char *>(&host_rtt[i]));
+      }
+      curl_multi_add_handle(curl_multi, handles[i]);
+    }
+
+    int still_running = 1;
+    while (still_running > 0) {
+      while (curl_multi_perform(curl_multi, &still_running) ==
+             CURLM_CALL_MULTI_PERFORM) { }
+
+      int msgs_in_queue;
+      CURLMsg *curl_msg;
+      while ((curl_msg = curl_multi_info_read(curl_multi, &msgs_in_queue))) {
+        if (curl_msg->msg != CURLMSG_DONE)
+          continue;
+        int *rtt;
+        char *effective_url;
+        curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, &rtt);
+        curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_EFFECTIVE_URL,
+                          &effective_url);
+        if (curl_msg->data.result == CURLE_OK) {
+          double time_total = 0.0;
+          curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_TOTAL_TIME,
+                            &time_total);
+          *rtt = int(time_total * 1000);
+          LogCvmfs(kLogDownload, kLogDebug, "probing host %s had %dms rtt",
+                   effective_url, *rtt);
+        } else {
+          LogCvmfs(kLogDownload, kLogDebug, "error while probing host %s: %s",
+                   effective_url, curl_easy_strerror(curl_msg->data.result));
+          *rtt = INT_MAX;
+
+          // Not the host's fault, try the next proxy of the group
+          const unsigned host = rtt - &host_rtt[0];
+          const string &proxy = proxies[proxy_index[host]];
+          const Failures error =
+            ClassifyTransportError(curl_msg->data.result, !proxy.empty());
+          if (((error == kFailProxyResolve) ||
+               (error == kFailProxyConnection)) &&
+              (proxy_index[host] + 1 < proxies.size()))
+          {
+            const string &next_proxy = proxies[++proxy_index[host]];
+            LogCvmfs(kLogDownload, kLogDebug, "probing host %s through "
+                     "proxy %s", effective_url, next_proxy.c_str());
+            // The message does not survive the removal of its handle
+            CURL *handle = curl_msg->easy_handle;
+            curl_multi_remove_handle(curl_multi, handle);
+            curl_easy_setopt(handle, CURLOPT_PROXY, next_proxy.c_str());
+            curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS,
+              next_proxy.empty() ? timeout_direct_ms : timeout_proxy_ms);
+            *rtt = 0;
+            curl_multi_add_handle(curl_multi, handle);
+            ++still_running;
+            continue;
+          }
+        }
+        curl_multi_remove_handle(curl_multi, curl_msg->easy_handle);
+      }
+      if (still_running == 0)
+        break;
+
+      // Wait for activity, at most until the next curl timeout
+      long timeout_curl = -1;  // NOLINT(runtime/int)
+      curl_multi_timeout(curl_multi, &timeout_curl);
+      if ((timeout_curl < 0) || (timeout_curl > 1000))
+        timeout_curl = 1000;
+      fd_set fdread, fdwrite, fdexcep;
+      FD_ZERO(&fdread);
+      FD_ZERO(&fdwrite);
+      FD_ZERO(&fdexcep);
+      int max_fd = -1;
+      curl_multi_fdset(curl_multi, &fdread, &fdwrite, &fdexcep, &max_fd);
+      if (max_fd < 0) {
+        SafeSleepMs(timeout_curl < 100 ? timeout_curl : 100);
       } else {
-        LogCvmfs(kLogDownload, kLogDebug, "error while probing host %s: %d",
-                 url.c_str(), result);
-        host_rtt[i] = INT_MAX;
+        struct timeval timeout;
+        timeout.tv_sec = timeout_curl / 1000;
+        timeout.tv_usec = (timeout_curl % 1000) * 1000;
+        select(max_fd + 1, &fdread, &fdwrite, &fdexcep, &timeout);
       }
     }
   }
+  for (i = 0; i < handles.size(); ++i) {
+    if (handles[i] != NULL)
+      curl_easy_cleanup(handles[i]);
+  }
+  curl_multi_cleanup(curl_multi);
 
-  // Sort entries, insertion sort on both, rtt and hosts
+  // Sort entries, insertion sort on rtt and hosts
   for (i = 1; i < host_chain.size(); ++i) {
     int val_rtt = host_rtt[i];
     string val_host = host_chain[i];
@@ -1445,16 +2484,37 @@ void DownloadManager::ProbeHosts() {
     host_rtt[pos+1] = val_rtt;
     host_chain[pos+1] = val_host;
   }
-  for (i = 0; i < host_chain.size(); ++i) {
-    if (host_rtt[i] == INT_MAX) host_rtt[i] = -2;
-  }
 
   pthread_mutex_lock(lock_options_);
+  // Add the probes to the current statistics instead of replacing them
+  const time_t now = time(NULL);
+  vector<HostStatistics> host_statistics(host_chain.size());
+  for (i = 0; i < host_chain.size(); ++i) {
+    for (unsigned j = 0; opt_host_chain_ && (j < opt_host_chain_->size());
+         ++j)
+    {
+      if ((*opt_host_chain_)[j] == host_chain[i]) {
+        host_statistics[i] = (*opt_host_chain_statistics_)[j];
+        break;
+      }
+    }
+    if (host_rtt[i] == INT_MAX) {
+      host_statistics[i].num_failures++;
+      host_statistics[i].timestamp_failure = now;
+      host_rtt[i] = -2;
+    } else {
+      UpdateEwma(host_rtt[i], &host_statistics[i].latency_ms);
+      host_statistics[i].timestamp_sample = now;
+    }
+  }
   delete opt_host_chain_;
   delete opt_host_chain_rtt_;
+  delete opt_host_chain_statistics_;
   opt_host_chain_ = new vector<string>(host_chain);
   opt_host_chain_rtt_ = new vector<int>(host_rtt);
+  opt_host_chain_statistics_ = new vector<HostStatistics>(host_statistics);
   opt_host_chain_current_ = 0;
+  opt_host_exploration_next_ = 0;
   pthread_mutex_unlock(lock_options_);
 }
 
@@ -1468,6 +2528,7 @@ void DownloadManager::SetProxyChain(const string &proxy_list) {
 
   opt_timestamp_backup_proxies_ = 0;
   opt_timestamp_failover_proxies_ = 0;
+  proxy_health_.clear();
   delete opt_proxy_groups_;
   if (proxy_list == "") {
     opt_proxy_groups_ = NULL;
@@ -1503,9 +2564,12 @@ void DownloadManager::SetProxyChain(const string &proxy_list) {
 
 /**
  * Retrieves the proxy chain and the currently active load-balancing group.
+ * Optionally, the circuit breakers of the sharded proxies are retrieved as
+ * well.
  */
 void DownloadManager::GetProxyInfo(vector< vector<string> > *proxy_chain,
-                                   unsigned *current_group)
+                                   unsigned *current_group,
+                                   map<string, ProxyHealth> *proxy_health)
 {
   pthread_mutex_lock(lock_options_);
 
@@ -1518,8 +2582,186 @@ void DownloadManager::GetProxyInfo(vector< vector<string> > *proxy_chain,
 
   *proxy_chain = *opt_proxy_groups_;
   *current_group = opt_proxy_groups_current_;
+  if (proxy_health)
+    *proxy_health = proxy_health_;
+
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Spreads the requests over all the proxies of the current load-balancing
+ * group instead of using one of them at a time.
+ */
+void DownloadManager::EnableProxySharding() {
+  pthread_mutex_lock(lock_options_);
+  opt_proxy_shard_ = true;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Rendezvous hashing: the available proxy with the highest weight for the key
+ * is selected.  If a proxy fails, only its keys move to other proxies.  If all
+ * the proxies of the group are failed, the next group is used.
+ * @return  the proxy URL or the empty string for DIRECT
+ */
+string DownloadManager::SelectShardProxyUnlocked(const string &key) {
+  const time_t now = time(NULL);
+  for (unsigned i = 0; i < opt_proxy_groups_->size(); ++i) {
+    const vector<string> &group =
+      (*opt_proxy_groups_)[opt_proxy_groups_current_];
+    const string *selected = NULL;
+    uint64_t selected_weight = 0;
+    for (unsigned j = 0; j < group.size(); ++j) {
+      if (!proxy_health_[group[j]].IsAvailable(now))
+        continue;
+      const uint64_t seed =
+        MurmurHash64A(group[j].data(), group[j].length(), 0);
+      const uint64_t weight =
+        MurmurHash64A(key.data(), key.length(), seed);
+      if ((selected == NULL) || (weight > selected_weight)) {
+        selected = &group[j];
+        selected_weight = weight;
+      }
+    }
+
+    if (selected != NULL) {
+      ProxyHealth *health = &proxy_health_[*selected];
+      health->num_requests++;
+      if (health->timestamp_retry > 0)
+        health->is_probing = true;
+      return (*selected == "DIRECT") ? "" : *selected;
+    }
+
+    if (opt_proxy_groups_->size() == 1)
+      break;
+    const string old_proxy = group[0];
+    opt_proxy_groups_current_ =
+      (opt_proxy_groups_current_ + 1) % opt_proxy_groups_->size();
+    opt_proxy_groups_current_burned_ = 1;
+    if (opt_proxy_groups_reset_after_ > 0) {
+      if (opt_proxy_groups_current_ > 0) {
+        if (opt_timestamp_backup_proxies_ == 0)
+          opt_timestamp_backup_proxies_ = now;
+      } else {
+        opt_timestamp_backup_proxies_ = 0;
+      }
+    }
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "switching proxy from %s to %s (all sharded proxies failed)",
+             old_proxy.c_str(),
+             (*opt_proxy_groups_)[opt_proxy_groups_current_][0].c_str());
+  }
+
+  // All proxies are failed, keep trying the current group
+  const string &fallback = (*opt_proxy_groups_)[opt_proxy_groups_current_][0];
+  proxy_health_[fallback].num_requests++;
+  return (fallback == "DIRECT") ? "" : fallback;
+}
+
+
+/**
+ * Opens the circuit of the proxy that failed a request or closes the circuit
+ * of a proxy that served a request.  Errors that say nothing about the proxy
+ * leave the circuit as it is, but a probing request is over in any case.
+ */
+void DownloadManager::UpdateProxyHealth(const string &proxy_url,
+                                        const Failures error_code)
+{
+  bool is_proxy_failure = false;
+  bool is_conclusive = true;
+  switch (error_code) {
+    case kFailProxyResolve:
+    case kFailProxyConnection:
+    case kFailProxyHttp:
+      is_proxy_failure = true;
+      break;
+    case kFailLocalIO:
+    case kFailBadUrl:
+    case kFailOther:
+      is_conclusive = false;
+      break;
+    default:
+      break;
+  }
+  const string proxy = (proxy_url == "") ? "DIRECT" : proxy_url;
+
+  pthread_mutex_lock(lock_options_);
+  map<string, ProxyHealth>::iterator iter = proxy_health_.find(proxy);
+  if (iter == proxy_health_.end()) {
+    // Proxy chain changed in the meantime
+    pthread_mutex_unlock(lock_options_);
+    return;
+  }
+  ProxyHealth *health = &iter->second;
+  if (!is_conclusive) {
+    // The next request probes the proxy again
+    health->is_probing = false;
+    pthread_mutex_unlock(lock_options_);
+    return;
+  }
+  if (!is_proxy_failure) {
+    if (health->timestamp_retry > 0) {
+      LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
+               "proxy %s is back in use", proxy.c_str());
+    }
+    health->num_consecutive_failures = 0;
+    health->timestamp_retry = 0;
+    health->is_probing = false;
+    pthread_mutex_unlock(lock_options_);
+    return;
+  }
+
+  health->num_failures++;
+  // Concurrent requests that were already in flight do not prolong the
+  // open period
+  const time_t now = time(NULL);
+  if ((health->timestamp_retry == 0) || health->is_probing) {
+    unsigned open_seconds = kProxyCircuitOpenSeconds;
+    for (unsigned i = 0; (i < health->num_consecutive_failures) &&
+         (open_seconds < kProxyCircuitMaxOpenSeconds); ++i)
+    {
+      open_seconds *= 2;
+    }
+    if (open_seconds > kProxyCircuitMaxOpenSeconds)
+      open_seconds = kProxyCircuitMaxOpenSeconds;
+    health->num_consecutive_failures++;
+    health->timestamp_retry = now + open_seconds;
+    health->is_probing = false;
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "taking proxy %s out of the rotation for %u seconds",
+             proxy.c_str(), open_seconds);
+  }
+  pthread_mutex_unlock(lock_options_);
+}
 
+
+/**
+ * Records a transfer through the proxy that was aborted because the other
+ * transfer of its race won.  A slow proxy remains in the rotation, but if the
+ * transfer probed the proxy, the probe failed.
+ */
+void DownloadManager::AbandonProxyTransfer(const string &proxy_url) {
+  const string proxy = (proxy_url == "") ? "DIRECT" : proxy_url;
+  pthread_mutex_lock(lock_options_);
+  map<string, ProxyHealth>::const_iterator iter = proxy_health_.find(proxy);
+  const bool is_probing =
+    (iter != proxy_health_.end()) && iter->second.is_probing;
   pthread_mutex_unlock(lock_options_);
+  if (is_probing)
+    UpdateProxyHealth(proxy_url, kFailProxyConnection);
+}
+
+
+void DownloadManager::ResetProxyHealthUnlocked() {
+  for (map<string, ProxyHealth>::iterator i = proxy_health_.begin(),
+       iEnd = proxy_health_.end(); i != iEnd; ++i)
+  {
+    i->second.num_consecutive_failures = 0;
+    i->second.timestamp_retry = 0;
+    i->second.is_probing = false;
+  }
 }
 
 
@@ -1631,10 +2873,99 @@ void DownloadManager::SetRetryParameters(const unsigned max_retries,
 
 
 void DownloadManager::ActivatePipelining() {
+  multi_pipelining_ = true;
   curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
 }
 
 
+/**
+ * Limits the connections per proxy or host and closes idle connections after
+ * idle_timeout seconds.  Has to be called before Spawn().
+ */
+void DownloadManager::SetConnectionPolicy(const unsigned max_host_connections,
+                                          const unsigned idle_timeout)
+{
+  opt_max_host_connections_ = max_host_connections;
+  opt_idle_timeout_ = idle_timeout;
+  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    opt_max_host_connections_);
+}
+
+
+/**
+ * Opens num_connections connections to the current proxy or host
+ * concurrently, so that the first requests don't pay for the connection
+ * setup.  Has to be called after Spawn().  Returns immediately, the
+ * connections are established in the background.  An unreachable proxy or
+ * host thus does not delay the mount by its timeouts.
+ */
+void DownloadManager::WarmConnections(const unsigned num_connections) {
+  const unsigned num_threads = std::min(num_connections, pool_max_handles_);
+  for (unsigned i = 0; i < num_threads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, MainWarmConnection,
+                       static_cast<void *>(this)) == 0)
+    {
+      threads_warm_.push_back(thread);
+    }
+  }
+  LogCvmfs(kLogDownload, kLogDebug, "warming up %u connections",
+           static_cast<unsigned>(threads_warm_.size()));
+}
+
+
+/**
+ * Multiplexes the requests to a host over HTTP/2 connections, at most
+ * max_streams at a time per connection (0: as many as the host allows, the
+ * limit needs libcurl >= 7.67).  Without prior knowledge, only https hosts are
+ * asked for HTTP/2.  Has to be called before Spawn().
+ * @return  false if libcurl does not support HTTP/2
+ */
+bool DownloadManager::EnableHttp2(const bool prior_knowledge,
+                                  const unsigned max_streams)
+{
+#ifdef CVMFS_CURL_HTTP2
+  curl_version_info_data *version_info = curl_version_info(CURLVERSION_NOW);
+  if (!(version_info->features & CURL_VERSION_HTTP2))
+    return false;
+
+  opt_http2_ = true;
+  opt_http2_prior_knowledge_ = prior_knowledge;
+  opt_http2_max_streams_ = max_streams;
+  curl_multi_cleanup(curl_multi_);
+  InitMultiHandle();
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+/**
+ * Duplicates requests that did not receive a response within the given
+ * percentile of the first byte latencies of their proxy or host.  The
+ * duplicate goes to another proxy of the load-balancing group or, for direct
+ * connections, to the next host of the host chain.
+ */
+void DownloadManager::EnableHedgedRequests(const unsigned percentile) {
+  pthread_mutex_lock(lock_options_);
+  opt_hedge_ = true;
+  opt_hedge_percentile_ = (percentile > 100) ? 100 : percentile;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Retrieves the first byte latencies of the proxies and hosts.
+ */
+void DownloadManager::GetLatencyInfo(map<string, LatencyHistogram> *latencies)
+{
+  pthread_mutex_lock(lock_options_);
+  *latencies = latencies_;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
 //------------------------------------------------------------------------------
 
 
@@ -1645,7 +2976,39 @@ string Statistics::Print() const {
   "Number of requests: " + StringifyInt(num_requests) + "\n" +
   "Number of retries: " + StringifyInt(num_retries) + "\n" +
   "Number of proxy failovers: " + StringifyInt(num_proxy_failover) + "\n" +
-  "Number of host failovers: " + StringifyInt(num_host_failover) + "\n";
+  "Number of host failovers: " + StringifyInt(num_host_failover) + "\n" +
+  "Number of new connections: " + StringifyInt(num_connections) + "\n" +
+  "Connection reuse ratio: " + PrintReuseRatio() + "\n" +
+  "Connect time histogram (ms): " + PrintConnectTimeHistogram() + "\n" +
+  "Number of HTTP/2 requests: " + StringifyInt(num_http2_requests) +
+  " (" + StringifyInt(num_multiplexed) + " multiplexed)\n" +
+  "First byte latency: " + first_byte_latency.PrintQuantiles() + "\n" +
+  "Number of hedged requests: " + StringifyInt(num_hedged) +
+  " (" + StringifyInt(num_hedges_won) + " won by the hedge)\n";
+}
+
+
+string Statistics::PrintReuseRatio() const {
+  if ((num_requests == 0) || (num_connections > num_requests))
+    return "n/a";
+  const uint64_t permille =
+    (1000 * (num_requests - num_connections)) / num_requests;
+  return StringifyInt(permille / 10) + "." + StringifyInt(permille % 10) + "%";
+}
+
+
+string Statistics::PrintConnectTimeHistogram() const {
+  string result;
+  for (unsigned i = 0; i < kNumConnectTimeBins; ++i) {
+    if (i > 0)
+      result += " ";
+    if (i < kNumConnectTimeBins - 1)
+      result += "<" + StringifyInt(int64_t(kConnectTimeBinBounds[i]));
+    else
+      result += ">=" + StringifyInt(int64_t(kConnectTimeBinBounds[i - 1]));
+    result += ":" + StringifyInt(connect_time_histogram[i]);
+  }
+  return result;
 }
 
 }  // namespace download
@@ -12,6 +12,7 @@
 
 #include <cstdio>
 
+#include <map>
 #include <string>
 #include <vector>
 #include <set>
@@ -21,6 +22,7 @@
 #include "prng.h"
 #include "hash.h"
 #include "atomic.h"
+#include "latency_histogram.h"
 
 namespace download {
 
@@ -55,13 +57,38 @@ enum Failures {
 };  // Failures
 
 
+/**
+ * A duplicate of a slow request to another proxy or host.  The first of the
+ * two transfers that receives a successful status line wins, the other one is
+ * aborted.
+ */
+enum HedgeState {
+  kHedgeNone = 0,
+  kHedgeRacing,
+  kHedgeLost,  ///< the original request won
+  kHedgeWon,
+};  // HedgeState
+
+
 struct Statistics {
+  /**
+   * Connect times are counted in bins up to 1ms, 2ms, 5ms, ..., 1s, and more.
+   */
+  static const unsigned kNumConnectTimeBins = 11;
+
   double transferred_bytes;
   double transfer_time;
   uint64_t num_requests;
   uint64_t num_retries;
   uint64_t num_proxy_failover;
   uint64_t num_host_failover;
+  uint64_t num_connections;  ///< newly opened, the other requests reused one
+  uint64_t connect_time_histogram[kNumConnectTimeBins];
+  uint64_t num_http2_requests;
+  uint64_t num_multiplexed;  ///< HTTP/2 requests on an existing connection
+  uint64_t num_hedged;  ///< requests duplicated to another proxy or host
+  uint64_t num_hedges_won;  ///< duplicates that were faster than the original
+  LatencyHistogram first_byte_latency;
 
   Statistics() {
     transferred_bytes = 0.0;
@@ -70,12 +97,67 @@ struct Statistics {
     num_retries = 0;
     num_proxy_failover = 0;
     num_host_failover = 0;
+    num_connections = 0;
+    num_http2_requests = 0;
+    num_multiplexed = 0;
+    num_hedged = 0;
+    num_hedges_won = 0;
+    for (unsigned i = 0; i < kNumConnectTimeBins; ++i)
+      connect_time_histogram[i] = 0;
   }
 
   std::string Print() const;
+  std::string PrintReuseRatio() const;
+  std::string PrintConnectTimeHistogram() const;
 };  // Statistics
 
 
+/**
+ * Observed performance of a host of the host chain.  Latency and throughput
+ * are exponentially weighted moving averages of real transfers, seeded by
+ * host probing.
+ */
+struct HostStatistics {
+  HostStatistics() : latency_ms(-1.0), throughput(-1.0), num_transfers(0),
+    num_failures(0), timestamp_sample(0), timestamp_failure(0) { }
+
+  /**
+   * Expected duration of a typical transfer in ms, lower is better.
+   * @return  negative if the host has no data or failed more recently than
+   *          it succeeded
+   */
+  double GetScore() const;
+
+  double latency_ms;   ///< time to the first byte, < 0: unknown
+  double throughput;   ///< bytes per second of larger transfers, < 0: unknown
+  uint64_t num_transfers;
+  uint64_t num_failures;
+  time_t timestamp_sample;
+  time_t timestamp_failure;
+};
+
+
+/**
+ * Circuit breaker of a proxy server in proxy sharding mode.  A failed proxy
+ * is skipped until timestamp_retry.  Then a single request is sent through
+ * it; its outcome closes the circuit or opens it again for twice as long.
+ */
+struct ProxyHealth {
+  ProxyHealth() : num_requests(0), num_failures(0),
+    num_consecutive_failures(0), timestamp_retry(0), is_probing(false) { }
+
+  bool IsAvailable(const time_t now) const {
+    return (timestamp_retry == 0) || ((now >= timestamp_retry) && !is_probing);
+  }
+
+  uint64_t num_requests;
+  uint64_t num_failures;
+  unsigned num_consecutive_failures;
+  time_t timestamp_retry;  ///< 0: circuit is closed
+  bool is_probing;  ///< a request tests the proxy after the circuit was open
+};
+
+
 /**
  * Contains all the information to specify a download job.
  */
@@ -93,26 +175,37 @@ struct JobInfo {
   FILE *destination_file;
   const std::string *destination_path;
   const shash::Any *expected_hash;
+  /**
+   * Restricts the transfer to range_size bytes from range_offset of the
+   * object, if range_size is not zero.  The expected hash refers to the range.
+   */
+  uint64_t range_offset;
+  uint64_t range_size;
 
   // One constructor per destination + head request
-  JobInfo() { wait_at[0] = wait_at[1] = -1; head_request = false; }
+  JobInfo() : range_offset(0), range_size(0)
+    { wait_at[0] = wait_at[1] = -1; head_request = false; }
   JobInfo(const std::string *u, const bool c, const bool ph,
           const std::string *p, const shash::Any *h) : url(u), compressed(c),
           probe_hosts(ph), head_request(false),
-          destination(kDestinationPath), destination_path(p), expected_hash(h)
+          destination(kDestinationPath), destination_path(p), expected_hash(h),
+          range_offset(0), range_size(0)
           { wait_at[0] = wait_at[1] = -1; }
   JobInfo(const std::string *u, const bool c, const bool ph, FILE *f,
           const shash::Any *h) : url(u), compressed(c), probe_hosts(ph),
           head_request(false),
-          destination(kDestinationFile), destination_file(f), expected_hash(h)
+          destination(kDestinationFile), destination_file(f), expected_hash(h),
+          range_offset(0), range_size(0)
           { wait_at[0] = wait_at[1] = -1; }
   JobInfo(const std::string *u, const bool c, const bool ph,
           const shash::Any *h) : url(u), compressed(c), probe_hosts(ph),
-          head_request(false), destination(kDestinationMem), expected_hash(h)
+          head_request(false), destination(kDestinationMem), expected_hash(h),
+          range_offset(0), range_size(0)
           { wait_at[0] = wait_at[1] = -1; }
   JobInfo(const std::string *u, const bool ph) :
           url(u), compressed(false), probe_hosts(ph), head_request(true),
-          destination(kDestinationNone), expected_hash(NULL)
+          destination(kDestinationNone), expected_hash(NULL),
+          range_offset(0), range_size(0)
           { wait_at[0] = wait_at[1] = -1; }
   ~JobInfo() {
     if (wait_at[0] >= 0) {
@@ -127,7 +220,18 @@ struct JobInfo {
   shash::ContextPtr hash_context;
   int wait_at[2];  /**< Pipe used for the return value */
   std::string proxy;
+  std::string url_prefix;  ///< host of the host chain or empty
   bool nocache;
+  bool http2;
+  bool got_response;  ///< the status line was received
+  HedgeState hedge_state;
+  CURL *hedge_handle;
+  std::string hedge_proxy;
+  std::string hedge_url_prefix;
+  uint64_t hedge_deadline_ms;
+  uint64_t timestamp_start_ms;  ///< start of a request that can be hedged
+  uint64_t hedge_timestamp_start_ms;
+  Failures hedge_loser_error;  ///< error status of the transfer that lost
   Failures error_code;
   unsigned char num_used_proxies;
   unsigned char num_used_hosts;
@@ -152,12 +256,16 @@ class DownloadManager {
   const Statistics &GetStatistics();
   void SetHostChain(const std::string &host_list);
   void GetHostInfo(std::vector<std::string> *host_chain,
-                   std::vector<int> *rtt, unsigned *current_host);
+                   std::vector<int> *rtt, unsigned *current_host,
+                   std::vector<HostStatistics> *host_statistics = NULL);
   void ProbeHosts();
+  void EnableAdaptiveHosts();
   void SwitchHost();
   void SetProxyChain(const std::string &proxy_list);
   void GetProxyInfo(std::vector< std::vector<std::string> > *proxy_chain,
-                    unsigned *current_group);
+                    unsigned *current_group,
+                    std::map<std::string, ProxyHealth> *proxy_health = NULL);
+  void EnableProxySharding();
   void RebalanceProxies();
   void SwitchProxyGroup();
   void SetProxyGroupResetDelay(const unsigned seconds);
@@ -168,19 +276,46 @@ class DownloadManager {
                           const unsigned backoff_init_ms,
                           const unsigned backoff_max_ms);
   void ActivatePipelining();
+  void SetConnectionPolicy(const unsigned max_host_connections,
+                           const unsigned idle_timeout);
+  void WarmConnections(const unsigned num_connections);
+  bool EnableHttp2(const bool prior_knowledge, const unsigned max_streams);
+  void EnableHedgedRequests(const unsigned percentile);
+  void GetLatencyInfo(std::map<std::string, LatencyHistogram> *latencies);
  private:
   static int CallbackCurlSocket(CURL *easy, curl_socket_t s, int action,
                                 void *userp, void *socketp);
+  static int CallbackCurlTimer(CURLM *multi, long timeout_ms,  // NOLINT
+                               void *userp);
   static void *MainDownload(void *data);
+  static void *MainWarmConnection(void *data);
 
   void SwitchHost(JobInfo *info);
   void SwitchProxy(JobInfo *info);
   void RebalanceProxiesUnlocked();
+  std::string SelectShardProxyUnlocked(const std::string &key);
+  void UpdateProxyHealth(const std::string &proxy_url,
+                         const Failures error_code);
+  void AbandonProxyTransfer(const std::string &proxy_url);
+  void ResetProxyHealthUnlocked();
   CURL *AcquireCurlHandle();
   void ReleaseCurlHandle(CURL *handle);
+  void InitMultiHandle();
+  void CloseIdleConnections();
   void InitializeRequest(JobInfo *info, CURL *handle);
   void SetUrlOptions(JobInfo *info);
   void UpdateStatistics(CURL *handle);
+  void UpdateHostStatistics(CURL *handle, const Failures error_code);
+  void UpdateLatency(const JobInfo *info);
+  void AddLatency(const std::string &endpoint, const double ms);
+  void ScheduleHedge(JobInfo *info);
+  void UnscheduleHedge(JobInfo *info);
+  bool StartDueHedges();
+  bool StartHedge(JobInfo *info);
+  bool FinishRace(JobInfo *info, CURL *handle, const int curl_error);
+  bool FallbackToHttp1(const int curl_error, const JobInfo *info);
+  void SelectHostUnlocked();
+  int FindHostUnlocked(const std::string &url) const;
   bool CanRetry(const JobInfo *info);
   void Backoff(JobInfo *info);
   bool VerifyAndFinalize(const int curl_error, JobInfo *info);
@@ -190,17 +325,28 @@ class DownloadManager {
   std::set<CURL *> *pool_handles_inuse_;
   uint32_t pool_max_handles_;
   CURLM *curl_multi_;
+  bool multi_pipelining_;
   curl_slist *http_headers_;
   curl_slist *http_headers_nocache_;
 
   pthread_t thread_download_;
+  std::vector<pthread_t> threads_warm_;  /**< joined in Fini() */
   atomic_int32 multi_threaded_;
   int pipe_terminate_[2];
 
   int pipe_jobs_[2];
-  struct pollfd *watch_fds_;
-  uint32_t watch_fds_size_;
-  uint32_t watch_fds_inuse_;
+  /**
+   * The I/O thread waits for the job and terminate pipes and for the curl
+   * sockets with an epoll (Linux) or kqueue (OS X) descriptor.  Only sockets
+   * with activity are passed to libcurl.
+   */
+  int poller_;
+  /**
+   * Absolute time in ms when libcurl wants to be called back, -1: none.  It
+   * must not move with every poller wakeup, otherwise socket activity would
+   * keep postponing the timeouts of other transfers.
+   */
+  int64_t curl_deadline_ms_;
   uint32_t watch_fds_max_;
 
   pthread_mutex_t *lock_options_;
@@ -213,17 +359,68 @@ class DownloadManager {
                                             filled by probe_hosts.  Contains time to get .cvmfschecksum in ms.
                                             -1 is unprobed, -2 is error */
   unsigned opt_host_chain_current_;
+  std::vector<HostStatistics> *opt_host_chain_statistics_;
+
+  /**
+   * With adaptive hosts, the host with the best score is used instead of the
+   * first one of the chain.  Once in a while, a request is sent to another
+   * host in order to keep its statistics up to date.
+   */
+  bool opt_adaptive_hosts_;
+  time_t opt_timestamp_exploration_;
+  unsigned opt_host_exploration_next_;
   std::vector< std::vector<std::string> > *opt_proxy_groups_;
   unsigned opt_proxy_groups_current_;
   unsigned opt_proxy_groups_current_burned_;
   unsigned opt_num_proxies_;
 
+  /**
+   * With proxy sharding, requests are spread over all proxies of the current
+   * group.  The proxy of a request is chosen by rendezvous hashing of its URL,
+   * so that all clients send the same object through the same proxy.  Failed
+   * proxies are taken out of the rotation by their circuit breakers.
+   */
+  bool opt_proxy_shard_;
+  std::map<std::string, ProxyHealth> proxy_health_;
+
   unsigned opt_max_retries_;
   unsigned opt_backoff_init_ms_;
   unsigned opt_backoff_max_ms_;
 
   bool opt_ipv4_only_;
 
+  /**
+   * Connection pool policy.  At most opt_max_host_connections_ connections
+   * are opened to the same proxy or host (0: unlimited).  Idle connections
+   * are closed after opt_idle_timeout_ seconds without transfers (0: never).
+   * Only effective in multi-threaded mode.
+   */
+  unsigned opt_max_host_connections_;
+  unsigned opt_idle_timeout_;
+
+  /**
+   * HTTP/2 multiplexes the requests to a host over a single connection.  It
+   * is used for direct connections to https hosts (negotiated by ALPN) and,
+   * with prior knowledge, to http hosts.  Hosts that fail to speak HTTP/2 are
+   * remembered and used with HTTP/1.1 from then on.
+   */
+  bool opt_http2_;
+  bool opt_http2_prior_knowledge_;
+  unsigned opt_http2_max_streams_;
+  std::set<std::string> http1_hosts_;
+
+  /**
+   * With hedged requests, a request that did not receive a response within the
+   * given percentile of the first byte latencies of its proxy or host is
+   * duplicated to another proxy of the group or to another host.  The
+   * latencies are tracked per proxy or host.  The I/O thread keeps the
+   * requests that can still be hedged ordered by their deadline.
+   */
+  bool opt_hedge_;
+  unsigned opt_hedge_percentile_;
+  std::map<std::string, LatencyHistogram> latencies_;
+  std::set< std::pair<uint64_t, JobInfo *> > *hedge_queue_;
+
   /**
    * More than one proxy group can be considered as group of primary proxies
    * followed by backup proxy groups, e.g. at another site.
@@ -0,0 +1,193 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "file_bundle.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "compression.h"
+#include "logging.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+const std::string FileBundle::kCasSuffix = "B";
+
+
+/**
+ * Reads up to one byte more than the expected size of the source, so that a
+ * grown file is detected as a size mismatch.
+ */
+static bool ReadBundleSource(const FileBundleSource &source, string *content) {
+  content->clear();
+  FILE *fsrc = fopen(source.local_path.c_str(), "r");
+  if (fsrc == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to open %s for bundling (%d)",
+             source.local_path.c_str(), errno);
+    return false;
+  }
+  unsigned char buf[4096];
+  size_t nbytes;
+  while ((content->length() <= source.size) &&
+         ((nbytes = fread(buf, 1, sizeof(buf), fsrc)) > 0))
+  {
+    content->append(reinterpret_cast<char *>(buf), nbytes);
+  }
+  const bool read_error = ferror(fsrc);
+  fclose(fsrc);
+  if (read_error) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to read %s for bundling",
+             source.local_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Compresses the file content like the spooler does and checks it against the
+ * content hash from the catalog.
+ */
+static bool VerifyBundleSource(const FileBundleSource &source,
+                               const string &content)
+{
+  if (content.length() != source.size)
+    return false;
+  void *compressed = NULL;
+  uint64_t compressed_size = 0;
+  if (!zlib::CompressMem2Mem(content.data(), content.length(),
+                             &compressed, &compressed_size))
+  {
+    return false;
+  }
+  shash::Any hash(source.content_hash.algorithm);
+  shash::HashMem(static_cast<unsigned char *>(compressed), compressed_size,
+                 &hash);
+  free(compressed);
+  return hash == source.content_hash;
+}
+
+
+/**
+ * Writes the uncompressed bundle of the given files to dest_path.  Every file
+ * is compressed and hashed again, so that the bundle only contains files that
+ * match their content hash.  Files that were modified in the meantime are left
+ * out; the number of bundled files is returned in num_files.  Fails if a file
+ * cannot be read.
+ */
+bool WriteFileBundle(const vector<FileBundleSource> &sources,
+                     const string &dest_path,
+                     uint64_t *bundle_size,
+                     unsigned *num_files)
+{
+  *bundle_size = 0;
+  *num_files = 0;
+
+  string index;
+  vector<string> contents;
+  for (unsigned i = 0; i < sources.size(); ++i) {
+    string content;
+    if (!ReadBundleSource(sources[i], &content))
+      return false;
+    if (!VerifyBundleSource(sources[i], content)) {
+      LogCvmfs(kLogPublish, kLogStderr, "Warning: %s does not match %s, "
+               "not bundled", sources[i].local_path.c_str(),
+               sources[i].content_hash.ToString().c_str());
+      continue;
+    }
+    index += sources[i].content_hash.ToString() + " " +
+             StringifyInt(sources[i].size) + "\n";
+    contents.push_back(string());
+    contents.back().swap(content);
+  }
+  index += "\n";
+
+  FILE *fdest = fopen(dest_path.c_str(), "w");
+  if (fdest == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to create bundle %s (%d)",
+             dest_path.c_str(), errno);
+    return false;
+  }
+  uint64_t nbytes = index.length();
+  bool retval = fwrite(index.data(), 1, index.length(), fdest) ==
+                index.length();
+  for (unsigned i = 0; retval && (i < contents.size()); ++i) {
+    retval = fwrite(contents[i].data(), 1, contents[i].length(), fdest) ==
+             contents[i].length();
+    nbytes += contents[i].length();
+  }
+  retval = (fclose(fdest) == 0) && retval;
+  if (!retval) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to write bundle %s",
+             dest_path.c_str());
+    unlink(dest_path.c_str());
+    return false;
+  }
+
+  *bundle_size = nbytes;
+  *num_files = contents.size();
+  return true;
+}
+
+
+/**
+ * Parses the index at the beginning of an uncompressed bundle.  Fails if the
+ * index is malformed or if it refers to data beyond the end of the buffer.
+ */
+bool ParseFileBundleIndex(const unsigned char *buffer,
+                          const uint64_t size,
+                          FileBundleIndex *index)
+{
+  index->clear();
+  const char *text = reinterpret_cast<const char *>(buffer);
+  const unsigned hash_length = 2*shash::kDigestSizes[shash::kSha1];
+  vector<FileBundleEntry> entries;
+
+  uint64_t pos = 0;
+  while (true) {
+    const char *eol = static_cast<const char *>(
+      memchr(text + pos, '\n', size - pos));
+    if (eol == NULL)
+      return false;
+    const uint64_t line_length = eol - (text + pos);
+    if (line_length == 0) {
+      ++pos;
+      break;
+    }
+
+    const string line(text + pos, line_length);
+    if ((line.length() < hash_length + 2) || (line[hash_length] != ' '))
+      return false;
+    const string hex_hash = line.substr(0, hash_length);
+    for (unsigned i = 0; i < hash_length; ++i) {
+      const char c = hex_hash[i];
+      if (!(((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f'))))
+        return false;
+    }
+    const string str_size = line.substr(hash_length + 1);
+    if (!IsNumeric(str_size))
+      return false;
+    entries.push_back(FileBundleEntry(
+      shash::Any(shash::kSha1, shash::HexPtr(hex_hash)), 0,
+      String2Uint64(str_size)));
+    pos += line_length + 1;
+  }
+
+  for (unsigned i = 0; i < entries.size(); ++i) {
+    if (entries[i].size > size - pos)
+      return false;
+    entries[i].offset = pos;
+    pos += entries[i].size;
+  }
+  if (pos != size)
+    return false;
+
+  index->swap(entries);
+  return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * A file bundle packs the small regular files of a directory into a single
+ * content-addressed object, so that a client can fetch all of them in one
+ * round-trip.  The individual files remain addressable by their own content
+ * hashes.
+ *
+ * The uncompressed bundle starts with a text index, one line
+ * "<content hash> <size>" per file, terminated by an empty line.  The file
+ * contents follow in the order of the index.  The bundle is stored compressed
+ * like any other object.  Its content hash is recorded in the catalog, so that
+ * the bundle is as trustworthy as the catalog.
+ */
+
+#ifndef CVMFS_FILE_BUNDLE_H_
+#define CVMFS_FILE_BUNDLE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+
+/**
+ * Describes the bundle of a directory as registered in the catalog.
+ */
+class FileBundle {
+ public:
+  static const std::string kCasSuffix;
+  /**
+   * Larger bundles are not assembled by the publisher.
+   */
+  static const uint64_t kMaxSize = 8*1024*1024;
+
+ public:
+  FileBundle() :
+    content_hash_(shash::Any(shash::kSha1)), size_(0), max_file_size_(0),
+    num_files_(0) { }
+  FileBundle(const shash::Any &hash,
+             const uint64_t    size,
+             const uint64_t    max_file_size,
+             const uint64_t    num_files) :
+    content_hash_(hash),
+    size_(size),
+    max_file_size_(max_file_size),
+    num_files_(num_files) { }
+
+  inline const shash::Any& content_hash()  const { return content_hash_; }
+  inline uint64_t          size()          const { return size_; }
+  inline uint64_t          max_file_size() const { return max_file_size_; }
+  inline uint64_t          num_files()     const { return num_files_; }
+
+ protected:
+  shash::Any content_hash_;  //!< content hash of the compressed bundle
+  uint64_t   size_;          //!< uncompressed size of the bundle
+  uint64_t   max_file_size_; //!< files up to this size are in the bundle
+  /**
+   * Number of distinct non-empty files up to max_file_size_.  A client
+   * compares it with the listing of the directory before fetching the bundle.
+   */
+  uint64_t   num_files_;
+};
+
+
+/**
+ * A file inside a bundle.  The offset refers to the uncompressed bundle.
+ */
+struct FileBundleEntry {
+  FileBundleEntry() : content_hash(shash::kSha1), offset(0), size(0) { }
+  FileBundleEntry(const shash::Any &hash, const uint64_t o, const uint64_t s) :
+    content_hash(hash), offset(o), size(s) { }
+
+  shash::Any content_hash;
+  uint64_t   offset;
+  uint64_t   size;
+};
+
+typedef std::vector<FileBundleEntry> FileBundleIndex;
+
+
+/**
+ * Input to WriteFileBundle(): a file of the union file system with the
+ * content hash and size it has in the catalog.
+ */
+struct FileBundleSource {
+  FileBundleSource(const shash::Any &hash, const uint64_t s,
+                   const std::string &path) :
+    content_hash(hash), size(s), local_path(path) { }
+
+  shash::Any  content_hash;
+  uint64_t    size;
+  std::string local_path;
+};
+
+bool WriteFileBundle(const std::vector<FileBundleSource> &sources,
+                     const std::string &dest_path,
+                     uint64_t *bundle_size,
+                     unsigned *num_files);
+bool ParseFileBundleIndex(const unsigned char *buffer,
+                          const uint64_t size,
+                          FileBundleIndex *index);
+
+#endif  // CVMFS_FILE_BUNDLE_H_
@@ -0,0 +1,93 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "file_pack.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cassert>
+
+#include "logging.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+const std::string FilePackLocation::kCasSuffix = "K";
+
+
+FilePackWriter::FilePackWriter() :
+  file_(NULL),
+  size_(0)
+{ }
+
+
+/**
+ * Removes a pack that has not been closed.
+ */
+FilePackWriter::~FilePackWriter() {
+  if (file_ != NULL) {
+    fclose(file_);
+    unlink(path_.c_str());
+  }
+}
+
+
+bool FilePackWriter::Open(const string &path_prefix) {
+  assert(file_ == NULL);
+  file_ = CreateTempFile(path_prefix, 0600, "w", &path_);
+  if (file_ == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to create pack %s (%d)",
+             path_prefix.c_str(), errno);
+    return false;
+  }
+  size_ = 0;
+  return true;
+}
+
+
+/**
+ * Appends a file that is already compressed, e.g. by a worker thread, at the
+ * end of the pack.
+ *
+ * @param buffer  the compressed file
+ * @param size    the size of the compressed file
+ * @param offset  receives the offset of the compressed file in the pack
+ */
+bool FilePackWriter::Append(const unsigned char *buffer,
+                            const uint64_t size,
+                            uint64_t *offset)
+{
+  assert(file_ != NULL);
+  if (fwrite(buffer, 1, size, file_) != size) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to append to pack %s (%d)",
+             path_.c_str(), errno);
+    return false;
+  }
+
+  *offset = size_;
+  size_ += size;
+  return true;
+}
+
+
+/**
+ * Finishes the pack and calculates its content hash.  The pack remains in
+ * path() for upload.
+ *
+ * @param pack_hash  receives the hash of the pack, has to be initialized with
+ *                   the hash algorithm
+ */
+bool FilePackWriter::Close(shash::Any *pack_hash) {
+  assert(file_ != NULL);
+  const int retval = fclose(file_);
+  file_ = NULL;
+  if ((retval != 0) || !shash::HashFile(path_, pack_hash)) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to finish pack %s",
+             path_.c_str());
+    unlink(path_.c_str());
+    return false;
+  }
+  return true;
+}
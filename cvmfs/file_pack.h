@@ -0,0 +1,85 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * A file pack stores small files in a single object instead of one object per
+ * file.  The pack is the plain concatenation of the compressed files, so that
+ * every byte range of a packed file is exactly the object it would otherwise
+ * be stored as.  A client fetches such a byte range and verifies it by the
+ * content hash of the file, like any other object.  The location of every
+ * packed file is recorded in the catalog.
+ *
+ * The pack itself is not compressed again.  Its content hash is the hash of
+ * the stored bytes.
+ *
+ * Squid does not cache the replies to byte range requests unless it is
+ * configured with "range_offset_limit -1", so that it fetches and caches the
+ * entire pack, and with a maximum_object_size of at least kMaxPackSize.
+ */
+
+#ifndef CVMFS_FILE_PACK_H_
+#define CVMFS_FILE_PACK_H_
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <string>
+
+#include "hash.h"
+
+/**
+ * Describes where a packed file is stored.  Offset and size refer to the
+ * compressed file inside the pack.
+ */
+class FilePackLocation {
+ public:
+  static const std::string kCasSuffix;
+  /**
+   * The publisher starts a new pack once a pack reaches this size.
+   */
+  static const uint64_t kMaxPackSize = 16*1024*1024;
+
+ public:
+  FilePackLocation() :
+    pack_hash_(shash::Any(shash::kSha1)), offset_(0), size_(0) { }
+  FilePackLocation(const shash::Any &pack_hash,
+                   const uint64_t    offset,
+                   const uint64_t    size) :
+    pack_hash_(pack_hash),
+    offset_(offset),
+    size_(size) { }
+
+  inline const shash::Any& pack_hash() const { return pack_hash_; }
+  inline uint64_t          offset()    const { return offset_; }
+  inline uint64_t          size()      const { return size_; }
+
+ protected:
+  shash::Any pack_hash_;
+  uint64_t   offset_;
+  uint64_t   size_;
+};
+
+
+/**
+ * Appends compressed files to a pack in a temporary file.
+ */
+class FilePackWriter {
+ public:
+  FilePackWriter();
+  ~FilePackWriter();
+
+  bool Open(const std::string &path_prefix);
+  bool Append(const unsigned char *buffer,
+              const uint64_t size,
+              uint64_t *offset);
+  bool Close(shash::Any *pack_hash);
+
+  inline const std::string &path() const { return path_; }
+  inline uint64_t size() const { return size_; }
+
+ private:
+  FILE        *file_;
+  std::string  path_;
+  uint64_t     size_;  //!< number of bytes written so far
+};
+
+#endif  // CVMFS_FILE_PACK_H_
@@ -8,14 +8,11 @@ using namespace upload;
 
 
 CharBuffer* AbstractReader::CreateBuffer(const size_t size) {
-  ++buffers_in_flight_counter_;
-  CharBuffer *buffer = new CharBuffer(size);
-  return buffer;
+  return buffer_pool_.Acquire(size);
 }
 
 
 void AbstractReader::ReleaseBuffer(CharBuffer *buffer) {
-  delete buffer;
-  --buffers_in_flight_counter_;
+  buffer_pool_.Release(buffer);
 }
 
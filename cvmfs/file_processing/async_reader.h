@@ -11,11 +11,17 @@
 #include <tbb/task.h>
 #include <tbb/tbb_thread.h>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <list>
 
 #include <string>
+#include <vector>
 
 #include "char_buffer.h"
+#include "char_buffer_pool.h"
 #include "../util_concurrency.h"
 
 namespace upload { // TODO: remove this... wrong namespace (for testing)
@@ -25,7 +31,7 @@ class AbstractFile;
 class AbstractReader {
  public:
   AbstractReader(const unsigned int max_buffers_in_flight) :
-    buffers_in_flight_counter_(max_buffers_in_flight)
+    buffer_pool_(max_buffers_in_flight)
   {}
 
   virtual ~AbstractReader() {}
@@ -43,14 +49,15 @@ class AbstractReader {
 
  protected:
   /**
-   * Creates a new Buffer object with the provided size. If too many buffers
-   * are currently processed, this method blocks until a Buffer slot gets free.
+   * Creates a new Buffer object of at least the provided size. If too many
+   * buffers are currently processed, this method blocks until a Buffer slot
+   * gets free.
    */
   CharBuffer *CreateBuffer(const size_t size);
 
 
  private:
-  SynchronizingCounter<uint32_t> buffers_in_flight_counter_;
+  CharBufferPool buffer_pool_;  ///< recycles buffers, limits buffers in flight
 };
 
 
@@ -64,6 +71,16 @@ class AbstractReader {
  * individual File needs to be processed sequentially. Though data Blocks of
  * different Files are independent of each other and allow for higher throughput.
  *
+ * The read() system calls are not issued by the Reader thread itself but by a
+ * pool of I/O threads using pread().  Every open File has at most one read
+ * request in flight, so up to max_files_in_flight reads are pending at any
+ * time.  This keeps fast storage busy when publishing many small files, where
+ * a single thread doing blocking reads would be bound by syscall latency.
+ * Finished reads are passed back through a completion queue and scheduled for
+ * processing in the order they finish.  With zero I/O threads, the Reader
+ * thread does the reads itself, which is faster if the data are already in the
+ * page cache.
+ *
  * Note: The Reader produces CharBuffers that are passed into the processing
  *       pipeline. The Reader claims ownership of these specific CharBuffers,
  *       thus they need to be released using the Reader::ReleaseBuffer() method!
@@ -72,6 +89,23 @@ template <class FileScrubbingTaskT, class FileT>
 class Reader : public AbstractReader,
                public Observable<FileT*> {
  protected:
+  struct OpenFile;
+  typedef std::list<OpenFile> OpenFileList;
+
+  /**
+   * A pread() of the next data Block of an OpenFile, handed to the I/O threads.
+   * The I/O thread fills the buffer and passes the request back through the
+   * completion queue.
+   */
+  struct ReadRequest {
+    ReadRequest() : buffer(NULL), bytes_to_read(0), bytes_read(0) {}
+
+    typename OpenFileList::iterator  open_file;     ///< the File being read
+    CharBuffer                      *buffer;        ///< destination (knows the file offset)
+    size_t                           bytes_to_read; ///< size of the data Block
+    size_t                           bytes_read;    ///< result of the read
+  };
+
   /**
    * Internal structure to keep information about each currently open File.
    */
@@ -83,11 +117,11 @@ class Reader : public AbstractReader,
     FileT               *file;               ///< reference to the associated File structure
     int                  file_descriptor;    ///< open file descriptor of the file
     off_t                file_marker;        ///< current position of file read-in
+    ReadRequest          pending_read;       ///< the read currently in flight
 
     FileScrubbingTaskT  *previous_task;      ///< previously scheduled TBB task (for synchronization)
     tbb::task           *previous_sync_task; ///< previously scheduled TBB task (for synchronization)
   };
-  typedef std::list<OpenFile> OpenFileList;
 
   struct FileJob {
     FileJob(FileT *file) : file(file), terminate(false) {}
@@ -97,17 +131,22 @@ class Reader : public AbstractReader,
     bool   terminate;
   };
   typedef tbb::concurrent_bounded_queue<FileJob> JobQueue;
+  typedef tbb::concurrent_bounded_queue<ReadRequest*> ReadRequestQueue;
 
  public:
+  static const unsigned int kDefaultIoThreads = 8;
+
   Reader(const size_t       max_buffer_size,
          const unsigned int max_files_in_flight,
          const unsigned int number_of_tbb_threads =
-                          tbb::task_scheduler_init::default_num_threads() + 1) :
+                          tbb::task_scheduler_init::default_num_threads() + 1,
+         const unsigned int number_of_io_threads = kDefaultIoThreads) :
     AbstractReader(max_files_in_flight * 5),
     max_buffer_size_(max_buffer_size),
     draining_(false),
     files_in_flight_counter_(max_files_in_flight),
     tbb_worker_count_(number_of_tbb_threads),
+    io_thread_count_(number_of_io_threads),
     running_(false) {}
 
   virtual ~Reader() {
@@ -135,6 +174,7 @@ class Reader : public AbstractReader,
       // thread to terminate
       queue_.push(FileJob());
       read_thread_.join();
+      StopIoThreads();
       running_ = false;
     }
   }
@@ -155,7 +195,12 @@ class Reader : public AbstractReader,
   void OpenNewFile(FileT          *file);
   void CloseFile(OpenFile         &file);
 
-  bool ReadAndScheduleNextBuffer(OpenFile &open_file);
+  void SubmitNextRead(typename OpenFileList::iterator open_file);
+  void ScheduleReadBuffer(ReadRequest *finished_read);
+
+  void IoThread();
+  void StopIoThreads();
+  void Read(ReadRequest *request);
 
   void FinalizedFile(AbstractFile *file);
 
@@ -170,6 +215,12 @@ class Reader : public AbstractReader,
 
   const unsigned int              tbb_worker_count_;
   tbb::tbb_thread                 read_thread_;
+
+  const unsigned int              io_thread_count_;
+  std::vector<tbb::tbb_thread*>   io_threads_;
+  ReadRequestQueue                submission_queue_; ///< reads to be done by the I/O threads
+  ReadRequestQueue                completion_queue_; ///< finished reads
+
   Future<bool>                    thread_started_executing_;
   bool                            running_;
 };
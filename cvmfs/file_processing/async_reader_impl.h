@@ -14,6 +14,15 @@ bool Reader<FileScrubbingTaskT, FileT>::Initialize() {
   //       in AbstractUploader. It might be worth to facter out that code into
   //       an extra template that handles clean thread creation/destruction
   //       and perhaps the connection of the thread using a tbb::[...]queue
+
+  // the I/O threads are started first, they only wait for read requests
+  for (unsigned int i = 0; i < io_thread_count_; ++i) {
+    io_threads_.push_back(
+      new tbb::tbb_thread(&ThreadProxy<Reader>,
+                           this,
+                          &Reader<FileScrubbingTaskT, FileT>::IoThread));
+  }
+
   tbb::tbb_thread thread(&ThreadProxy<Reader>,
                           this,
                          &Reader<FileScrubbingTaskT, FileT>::ReadThread);
@@ -38,35 +47,93 @@ void Reader<FileScrubbingTaskT, FileT>::ReadThread() {
   thread_started_executing_.Set(true);
 
   while (HasData()) {
-    // acquire a new job from the job queue:
-    // -> if the queue is empty, just continue on the work currently in flight
-    // -> if the popped value is NULL, the drainout is initiated
+    bool made_progress = false;
+
+    // acquire new jobs from the job queue:
+    // -> if no file is open, block until a new job arrives
+    // -> if the popped value is a termination job, the drainout is initiated
     FileJob job;
-    const bool popped_new_job = TryToAcquireNewJob(job);
-    if (popped_new_job) {
-      if (! job.terminate) {
-        OpenNewFile(job.file);
-      } else {
+    while (TryToAcquireNewJob(job)) {
+      made_progress = true;
+      if (job.terminate) {
         EnableDraining();
+        break;
       }
+      OpenNewFile(job.file);
     }
 
-    // read File Blocks in a round robin fashion and schedule these blocks for
-    // processing
-    typename OpenFileList::iterator       i    = open_files_.begin();
-    typename OpenFileList::const_iterator iend = open_files_.end();
-    for (; i != iend; ++i) {
-      const bool finished_reading = ReadAndScheduleNextBuffer(*i);
-      if (finished_reading) {
-        OpenFile file = *i;
-        i = open_files_.erase(i);
-        CloseFile(file);
-      }
+    // schedule the data Blocks of finished reads for processing and submit
+    // the next reads; if there was nothing else to do, wait for a read to
+    // finish
+    ReadRequest *finished_read = NULL;
+    while (completion_queue_.try_pop(finished_read)) {
+      made_progress = true;
+      ScheduleReadBuffer(finished_read);
+    }
+    if (! made_progress && ! open_files_.empty()) {
+      completion_queue_.pop(finished_read);
+      ScheduleReadBuffer(finished_read);
     }
   }
 }
 
 
+/**
+ * Works off read requests until it receives a NULL request.
+ */
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::IoThread() {
+  while (true) {
+    ReadRequest *request = NULL;
+    submission_queue_.pop(request);
+    if (request == NULL) {
+      break;
+    }
+
+    Read(request);
+    completion_queue_.push(request);
+  }
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::Read(ReadRequest *request) {
+  const int     fd     = request->open_file->file_descriptor;
+  CharBuffer   *buffer = request->buffer;
+  const size_t  size   = request->bytes_to_read;
+  size_t        total  = 0;
+  while (total < size) {
+    const ssize_t bytes_read = pread(fd,
+                                     buffer->ptr() + total,
+                                     size - total,
+                                     buffer->base_offset() + total);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      break;
+    }
+    total += bytes_read;
+  }
+
+  buffer->SetUsedBytes(total);
+  request->bytes_read = total;
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::StopIoThreads() {
+  for (unsigned int i = 0; i < io_threads_.size(); ++i) {
+    submission_queue_.push(NULL);
+  }
+  for (unsigned int i = 0; i < io_threads_.size(); ++i) {
+    io_threads_[i]->join();
+    delete io_threads_[i];
+  }
+  io_threads_.clear();
+}
+
+
 template <class FileScrubbingTaskT, class FileT>
 bool Reader<FileScrubbingTaskT, FileT>::TryToAcquireNewJob(FileJob &next_job) {
   // in draining mode we only process files that are already open
@@ -103,6 +170,8 @@ void Reader<FileScrubbingTaskT, FileT>::OpenNewFile(FileT *file) {
   open_file.file            = file;
   open_file.file_descriptor = fd;
   open_files_.push_back(open_file);
+
+  SubmitNextRead(--open_files_.end());
 }
 
 
@@ -126,10 +195,53 @@ void Reader<FileScrubbingTaskT, FileT>::FinalizedFile(AbstractFile *file) {
 
 
 template <class FileScrubbingTaskT, class FileT>
-bool Reader<FileScrubbingTaskT, FileT>::
-                                ReadAndScheduleNextBuffer(OpenFile &open_file) {
-  assert (open_file.file != NULL);
-  assert (open_file.file_descriptor > 0);
+void Reader<FileScrubbingTaskT, FileT>::SubmitNextRead(
+                                typename OpenFileList::iterator open_file) {
+  assert (open_file->file != NULL);
+  assert (open_file->file_descriptor > 0);
+
+  // figure out how many bytes need to be read in this step and create a
+  // CharBuffer to accomodate these bytes
+  const size_t file_size     = open_file->file->size();
+  const size_t bytes_to_read =
+    std::min(file_size - static_cast<size_t>(open_file->file_marker),
+             max_buffer_size_);
+  CharBuffer *buffer = CreateBuffer(bytes_to_read);
+  buffer->SetBaseOffset(open_file->file_marker);
+  open_file->file_marker += bytes_to_read;
+
+  ReadRequest &request = open_file->pending_read;
+  request.open_file     = open_file;
+  request.buffer        = buffer;
+  request.bytes_to_read = bytes_to_read;
+  request.bytes_read    = 0;
+
+  // without I/O threads, the Reader thread reads the data Block itself
+  if (io_threads_.empty()) {
+    Read(&request);
+    completion_queue_.push(&request);
+  } else {
+    submission_queue_.push(&request);
+  }
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::ScheduleReadBuffer(
+                                                  ReadRequest *finished_read) {
+  const typename OpenFileList::iterator open_file = finished_read->open_file;
+  CharBuffer *buffer = finished_read->buffer;
+
+  // check if everything worked as expected
+  assert (finished_read->bytes_to_read == finished_read->bytes_read);
+
+  // check if the file has been fully read, otherwise keep the I/O threads
+  // busy with the next data Block while this one is processed
+  const bool finished_reading =
+    (static_cast<size_t>(open_file->file_marker) == open_file->file->size());
+  if (! finished_reading) {
+    SubmitNextRead(open_file);
+  }
 
 
   // All asynchronous tasks for a single File need to be processed sequentially,
@@ -174,33 +286,12 @@ bool Reader<FileScrubbingTaskT, FileT>::
 
 
 
-  // figure out how many bytes need to be read in this step and create a
-  // CharBuffer to accomodate these bytes
-  const size_t file_size     = open_file.file->size();
-  const size_t bytes_to_read =
-    std::min(file_size - static_cast<size_t>(open_file.file_marker),
-             max_buffer_size_);
-  CharBuffer *buffer = CreateBuffer(bytes_to_read);
-  buffer->SetBaseOffset(open_file.file_marker);
-
-  // read the next data Block into the just created CharBuffer and check if
-  // everything worked as expected
-  const size_t bytes_read = read(open_file.file_descriptor,
-                                 buffer->ptr(),
-                                 bytes_to_read);
-  assert (bytes_to_read == bytes_read);
-  buffer->SetUsedBytes(bytes_read);
-  open_file.file_marker += bytes_read;
-
-  // check if the file has been fully read
-  const bool finished_reading =
-    (static_cast<size_t>(open_file.file_marker) == file_size);
 
   // create an asynchronous task (FileScrubbingTaskT) to process the data chunk,
   // together with a synchronization task that ensures the correct execution
   // order of the FileScrubbingTasks
   FileScrubbingTaskT *new_task =
-    new(tbb::task::allocate_root()) FileScrubbingTaskT(open_file.file,
+    new(tbb::task::allocate_root()) FileScrubbingTaskT(open_file->file,
                                                        buffer,
                                                        finished_reading,
                                                        this);
@@ -209,20 +300,20 @@ bool Reader<FileScrubbingTaskT, FileT>::
 
   // decorate the predecessor task (i-1) with it's successor (i) and allow the
   // predecessor to be scheduled by TBB (task::enqueue)
-  if (open_file.previous_task != NULL) {
-    open_file.previous_task->SetNext(new_task);
-    tbb::task::enqueue(*open_file.previous_sync_task);
+  if (open_file->previous_task != NULL) {
+    open_file->previous_task->SetNext(new_task);
+    tbb::task::enqueue(*open_file->previous_sync_task);
   }
 
-  open_file.previous_task      = new_task;
-  open_file.previous_sync_task = sync_task;
+  open_file->previous_task      = new_task;
+  open_file->previous_sync_task = sync_task;
 
-  // make sure that the last chunk is processed
+  // make sure that the last chunk is processed and close the file
   if (finished_reading) {
-    tbb::task::enqueue(*open_file.previous_sync_task);
+    tbb::task::enqueue(*open_file->previous_sync_task);
+    CloseFile(*open_file);
+    open_files_.erase(open_file);
   }
-
-  return finished_reading;
 }
 
 
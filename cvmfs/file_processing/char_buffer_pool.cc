@@ -0,0 +1,100 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "char_buffer_pool.h"
+
+using namespace upload;
+
+
+CharBufferPool::CharBufferPool(const unsigned int max_buffers_in_flight,
+                               const size_t       max_idle_bytes) :
+  max_idle_bytes_(max_idle_bytes),
+  buffers_in_flight_(NULL)
+{
+  if (max_buffers_in_flight > 0) {
+    buffers_in_flight_ =
+      new SynchronizingCounter<uint32_t>(max_buffers_in_flight);
+  }
+
+  idle_bytes_ = 0;
+  allocated_  = 0;
+  recycled_   = 0;
+
+  for (size_t size = kMinClassSize; size <= kMaxClassSize; size *= 2) {
+    class_sizes_.push_back(size);
+    if (size < kMaxClassSize) {
+      class_sizes_.push_back(size + size / 2);
+    }
+  }
+  for (unsigned int i = 0; i < class_sizes_.size(); ++i) {
+    free_lists_.push_back(new FreeList());
+  }
+}
+
+
+CharBufferPool::~CharBufferPool() {
+  for (unsigned int i = 0; i < free_lists_.size(); ++i) {
+    CharBuffer *buffer;
+    while (free_lists_[i]->try_pop(buffer)) {
+      delete buffer;
+    }
+    delete free_lists_[i];
+  }
+  delete buffers_in_flight_;
+}
+
+
+int CharBufferPool::FindSizeClass(const size_t size) const {
+  for (unsigned int i = 0; i < class_sizes_.size(); ++i) {
+    if (class_sizes_[i] >= size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+CharBuffer* CharBufferPool::Acquire(const size_t size) {
+  if (buffers_in_flight_ != NULL) {
+    ++(*buffers_in_flight_);
+  }
+
+  const int size_class = FindSizeClass(size);
+  if (size_class < 0) {
+    ++allocated_;
+    return new CharBuffer(size);
+  }
+
+  CharBuffer *buffer;
+  if (free_lists_[size_class]->try_pop(buffer)) {
+    idle_bytes_ -= buffer->size_bytes();
+    buffer->SetUsedBytes(0);
+    buffer->SetBaseOffset(0);
+    ++recycled_;
+    return buffer;
+  }
+
+  ++allocated_;
+  return new CharBuffer(class_sizes_[size_class]);
+}
+
+
+void CharBufferPool::Release(CharBuffer *buffer) {
+  assert (buffer != NULL);
+  if (buffers_in_flight_ != NULL) {
+    --(*buffers_in_flight_);
+  }
+
+  // only buffers of exactly the size of a size class are recycled
+  const size_t size       = buffer->size_bytes();
+  const int    size_class = FindSizeClass(size);
+  if (size_class < 0 || class_sizes_[size_class] != size ||
+      idle_bytes_ + size > max_idle_bytes_) {
+    delete buffer;
+    return;
+  }
+
+  idle_bytes_ += size;
+  free_lists_[size_class]->push(buffer);
+}
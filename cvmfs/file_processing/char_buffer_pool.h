@@ -0,0 +1,85 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef UPLOAD_FILE_PROCESSING_CHAR_BUFFER_POOL_H
+#define UPLOAD_FILE_PROCESSING_CHAR_BUFFER_POOL_H
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+
+#include <stdint.h>
+#include <vector>
+
+#include "char_buffer.h"
+#include "../util.h"
+#include "../util_concurrency.h"
+
+namespace upload {
+
+/**
+ * Recycles the CharBuffers of the processing pipeline.  Without it, every data
+ * Block read from a file and every compression output buffer is allocated and
+ * freed again, which churns the allocator and causes page faults for the big
+ * (mmap'ed) allocations when publishing large amounts of data.
+ *
+ * Buffers are kept in size classes of 2^n and 1.5 * 2^n bytes between
+ * kMinClassSize and kMaxClassSize.  Acquire() returns a buffer that is at
+ * least as big as requested, so users need to keep track of the number of
+ * bytes they asked for themselves.  Requests bigger than kMaxClassSize are
+ * served by the allocator directly.  Released buffers are kept for reuse as
+ * long as the idle buffers do not exceed max_idle_bytes.
+ *
+ * Optionally, the pool limits the number of buffers handed out at the same
+ * time.  Acquire() then blocks until another buffer is released, which gives
+ * back-pressure to the producer of data Blocks.
+ *
+ * Note: Any CharBuffer can be given to Release(), not only the ones created by
+ *       this pool.  With a limit on the buffers in flight, however, only the
+ *       buffers from Acquire() must be released.
+ */
+class CharBufferPool : SingleCopy {
+ public:
+  static const size_t kMinClassSize        = 4 * 1024;
+  static const size_t kMaxClassSize        = 4 * 1024 * 1024;
+  static const size_t kDefaultMaxIdleBytes = 64 * 1024 * 1024;
+
+  explicit CharBufferPool(const unsigned int max_buffers_in_flight = 0,
+                          const size_t       max_idle_bytes =
+                                                        kDefaultMaxIdleBytes);
+  ~CharBufferPool();
+
+  /**
+   * Returns an empty buffer of at least the given size.  Blocks if the maximal
+   * number of buffers is in flight.
+   */
+  CharBuffer* Acquire(const size_t size);
+  void Release(CharBuffer *buffer);
+
+  uint64_t allocated()  const { return allocated_;  }
+  uint64_t recycled()   const { return recycled_;   }
+  size_t   idle_bytes() const { return idle_bytes_; }
+
+ protected:
+  /**
+   * Index of the smallest size class fitting size bytes, -1 if there is none.
+   */
+  int FindSizeClass(const size_t size) const;
+
+ private:
+  typedef tbb::concurrent_queue<CharBuffer*> FreeList;
+
+  std::vector<size_t>             class_sizes_;
+  std::vector<FreeList*>          free_lists_;
+  const size_t                    max_idle_bytes_;
+
+  tbb::atomic<size_t>             idle_bytes_;
+  tbb::atomic<uint64_t>           allocated_;  ///< buffers newly allocated
+  tbb::atomic<uint64_t>           recycled_;   ///< buffers served from the pool
+
+  SynchronizingCounter<uint32_t> *buffers_in_flight_;  ///< NULL if unlimited
+};
+
+} // namespace upload
+
+#endif /* UPLOAD_FILE_PROCESSING_CHAR_BUFFER_POOL_H */
@@ -18,7 +18,7 @@ CharBuffer* Chunk::GetDeflateBuffer(const size_t bytes) {
     if (current_deflate_buffer_ != NULL) {
       ScheduleWrite(current_deflate_buffer_);
     }
-    current_deflate_buffer_ = new CharBuffer(bytes);
+    current_deflate_buffer_ = file_->io_dispatcher()->CreateBuffer(bytes);
   }
 
   return current_deflate_buffer_;
@@ -32,6 +32,12 @@ void Chunk::ScheduleWrite(CharBuffer *buffer) {
   if (deferred_write_) {
     assert (! HasUploadStreamHandle());
     deferred_buffers_.push_back(buffer);
+  } else if (hold_back_) {
+    assert (! HasUploadStreamHandle());
+    deferred_buffers_.push_back(buffer);
+    if (compressed_size_ > file_->io_dispatcher()->max_held_back_bytes()) {
+      UploadHeldBackBuffers();
+    }
   } else {
     file_->io_dispatcher()->ScheduleWrite(this, buffer);
   }
@@ -39,7 +45,7 @@ void Chunk::ScheduleWrite(CharBuffer *buffer) {
 
 
 void Chunk::FlushDeferredWrites(const bool delete_buffers) {
-  assert (deferred_write_);
+  assert (deferred_write_ || hold_back_);
 
   std::vector<CharBuffer*>::const_iterator i    = deferred_buffers_.begin();
   std::vector<CharBuffer*>::const_iterator iend = deferred_buffers_.end();
@@ -48,12 +54,33 @@ void Chunk::FlushDeferredWrites(const bool delete_buffers) {
   }
   deferred_buffers_.clear();
   deferred_write_ = false;
+  hold_back_      = false;
+}
+
+
+void Chunk::UploadHeldBackBuffers() {
+  assert (hold_back_);
+  FlushDeferredWrites();
+}
+
+
+void Chunk::DropHeldBackBuffers() {
+  assert (hold_back_);
+
+  std::vector<CharBuffer*>::const_iterator i    = deferred_buffers_.begin();
+  std::vector<CharBuffer*>::const_iterator iend = deferred_buffers_.end();
+  for (; i != iend; ++i) {
+    file_->io_dispatcher()->ReleaseBuffer(*i);
+  }
+  deferred_buffers_.clear();
+  hold_back_ = false;
 }
 
 
 void Chunk::Initialize() {
   done_            = false;
   compressed_size_ = 0;
+  hold_back_       = (file_->io_dispatcher()->max_held_back_bytes() > 0);
 
   content_hash_context_.buffer = smalloc(content_hash_context_.size);
   shash::Init(content_hash_context_);
@@ -108,6 +135,7 @@ Chunk::Chunk(const Chunk &other) :
   is_bulk_chunk_(other.is_bulk_chunk_),
   is_fully_defined_(other.is_fully_defined_),
   deferred_write_(other.deferred_write_),
+  hold_back_(false),
   deferred_buffers_(other.deferred_buffers_),
   zlib_initialized_(false),
   content_hash_context_(other.content_hash_context_),
@@ -36,7 +36,7 @@ class Chunk {
   Chunk(File* file, const off_t offset) :
     file_(file), file_offset_(offset), chunk_size_(0),
     is_bulk_chunk_(false), is_fully_defined_(false), deferred_write_(false),
-    zlib_initialized_(false), content_hash_context_(shash::kSha1),
+    hold_back_(false), zlib_initialized_(false), content_hash_context_(shash::kSha1),
     content_hash_(shash::kSha1), content_hash_initialized_(false),
     upload_stream_handle_(NULL), current_deflate_buffer_(NULL),
     bytes_written_(0)
@@ -50,6 +50,7 @@ class Chunk {
   bool IsBulkChunk()           const { return is_bulk_chunk_;                }
   bool IsFullyDefined()        const { return is_fully_defined_;             }
   bool HasUploadStreamHandle() const { return upload_stream_handle_ != NULL; }
+  bool IsHoldingBack()         const { return hold_back_;                    }
 
   void Finalize();
   void ScheduleCommit();
@@ -80,9 +81,21 @@ class Chunk {
    */
   void EnableDeferredWrite() {
     assert (! HasUploadStreamHandle());
+    assert (deferred_buffers_.empty());
     deferred_write_ = true;
+    hold_back_      = false;  // Buffers will be shared with the bulk chunk
   }
 
+  /**
+   * Small Chunks hold back all their Buffers until the content hash is known,
+   * so that the upload can be skipped if the object already exists in the
+   * backend storage.  Once the held back data exceeds the limit given by the
+   * IoDispatcher, the Buffers are scheduled for writing as usual.
+   * (See IoDispatcher::ScheduleCommit())
+   */
+  void UploadHeldBackBuffers();
+  void DropHeldBackBuffers();
+
   File*             file()                   const { return file_;             }
   off_t             offset()                 const { return file_offset_;      }
   size_t            size()                   const { return chunk_size_;       }
@@ -128,6 +141,8 @@ class Chunk {
   bool                     is_fully_defined_;
 
   bool                     deferred_write_;
+  bool                     hold_back_;         ///< Buffers are held back for de-
+                                               ///< duplication (see IsHoldingBack())
   std::vector<CharBuffer*> deferred_buffers_;  ///< Buffers stored for a deferred write
                                                ///< (see EnableDeferredWrite())
 
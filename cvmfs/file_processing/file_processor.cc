@@ -93,3 +93,13 @@ void FileProcessor::FileDone(File *file) {
 void FileProcessor::WaitForProcessing() {
   io_dispatcher_->Wait();
 }
+
+
+uint64_t FileProcessor::GetNumberOfDeduplicatedChunks() const {
+  return io_dispatcher_->deduplicated_chunks();
+}
+
+
+uint64_t FileProcessor::GetDeduplicatedBytes() const {
+  return io_dispatcher_->deduplicated_bytes();
+}
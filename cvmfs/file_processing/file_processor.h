@@ -83,6 +83,9 @@ class FileProcessor : public Observable<SpoolerResult> {
 
   void WaitForProcessing();
 
+  uint64_t GetNumberOfDeduplicatedChunks() const;
+  uint64_t GetDeduplicatedBytes() const;
+
  protected:
   friend class IoDispatcher;
   void FileDone(File *file);
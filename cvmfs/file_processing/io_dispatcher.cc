@@ -49,6 +49,23 @@ void IoDispatcher::ScheduleWrite(Chunk       *chunk,
 
 void IoDispatcher::ScheduleCommit(Chunk* chunk) {
   assert (chunk->IsFullyProcessed());
+
+  // The content hash of a Chunk is only known after compression, thus small
+  // Chunks keep their compressed data in memory until now and skip the upload
+  // of objects that are already stored
+  if (chunk->IsHoldingBack()) {
+    const std::string path = "data" + chunk->content_hash().MakePath(1, 2) +
+                             chunk->hash_suffix();
+    if (uploader_->Peek(path)) {
+      ++deduplicated_chunks_;
+      deduplicated_bytes_ += chunk->compressed_size();
+      chunk->DropHeldBackBuffers();
+      ChunkDone(chunk);
+      return;
+    }
+    chunk->UploadHeldBackBuffers();
+  }
+
   assert (chunk->HasUploadStreamHandle());
 
   // Finalize the streamed upload for the committed Chunk
@@ -69,7 +86,7 @@ void IoDispatcher::BufferUploadCompleteCallback(
 
   chunk->add_bytes_written(buffer->used_bytes());
   if (delete_buffer) {
-    delete buffer;
+    buffer_pool_.Release(buffer);
   }
 }
 
@@ -82,6 +99,11 @@ void IoDispatcher::ChunkUploadCompleteCallback(const UploaderResults &results,
 
   assert (results.return_code == 0);
 
+  ChunkDone(chunk);
+}
+
+
+void IoDispatcher::ChunkDone(Chunk *chunk) {
   chunk->file()->ChunkCommitted(chunk);
 
   pthread_mutex_lock(&processing_done_mutex_);
@@ -17,6 +17,7 @@
 #include <pthread.h>
 
 #include "char_buffer.h"
+#include "char_buffer_pool.h"
 #include "async_reader.h"
 #include "file.h"
 #include "processor.h"
@@ -119,18 +120,31 @@ class IoDispatcher {
  public:
   typedef tbb::concurrent_bounded_queue<WriteJob> WriteJobQueue;
 
+  static const size_t kDefaultMaxHeldBackBytes = 1024 * 1024;
+
  public:
+  /**
+   * @param max_held_back_bytes  Chunks with at most this many bytes of com-
+   *                             pressed data are only uploaded if they are not
+   *                             yet present in the backend storage (see
+   *                             ScheduleCommit()).  0 disables this check.
+   */
   IoDispatcher(AbstractUploader  *uploader,
                FileProcessor     *file_processor,
-               const size_t       max_read_buffer_size = 512 * 1024) :
+               const size_t       max_read_buffer_size = 512 * 1024,
+               const size_t       max_held_back_bytes  =
+                                                    kDefaultMaxHeldBackBytes) :
     tbb_workers_(tbb::task_scheduler_init::default_num_threads()),
     max_read_buffer_size_(max_read_buffer_size),
+    max_held_back_bytes_(max_held_back_bytes),
     reader_(max_read_buffer_size_, tbb_workers_ * 10),
     uploader_(uploader),
     file_processor_(file_processor)
   {
-    chunks_in_flight_  = 0;
-    file_count_        = 0;
+    chunks_in_flight_    = 0;
+    file_count_          = 0;
+    deduplicated_chunks_ = 0;
+    deduplicated_bytes_  = 0;
     reader_.Initialize();
     const bool mutex_inits_successful = (
       pthread_mutex_init(&processing_done_mutex_,    NULL) == 0 &&
@@ -174,6 +188,13 @@ class IoDispatcher {
 
   void CommitFile(File *file);
 
+  /**
+   * Number of Chunks (and their compressed bytes) that were not uploaded
+   * because they already existed in the backend storage
+   */
+  uint64_t deduplicated_chunks() const { return deduplicated_chunks_; }
+  uint64_t deduplicated_bytes()  const { return deduplicated_bytes_;  }
+
  protected:
   friend class Chunk;
   friend class File;
@@ -191,9 +212,26 @@ class IoDispatcher {
    * This is called by the processing pipeline to a schedule the commit of a
    * specific Chunk. A Chunk must be committed only after all data blocks have
    * been processed and uploaded.
+   * If the Chunk still holds back all of its data, the upload is skipped for
+   * objects that are already present in the backend storage.  In this case,
+   * the Chunk is done before this method returns.
    */
   void ScheduleCommit(Chunk *chunk);
 
+  /**
+   * Provides (recycled) buffers of at least the given size for the compressed
+   * data of Chunks.  They are given back to the pool after their upload.
+   */
+  CharBuffer* CreateBuffer(const size_t size) {
+    return buffer_pool_.Acquire(size);
+  }
+
+  void ReleaseBuffer(CharBuffer *buffer) {
+    buffer_pool_.Release(buffer);
+  }
+
+  size_t max_held_back_bytes() const { return max_held_back_bytes_; }
+
   /**
    * Newly generated Chunks need to be registered to keep track of the number
    * of Chunks currently being processed
@@ -203,20 +241,25 @@ class IoDispatcher {
   }
 
   void ChunkUploadCompleteCallback(const UploaderResults &results, Chunk* chunk);
+  void ChunkDone(Chunk *chunk);
   void BufferUploadCompleteCallback(const UploaderResults      &results,
                                     BufferUploadCompleteParam   buffer_info);
 
  private:
   const unsigned int               tbb_workers_;               ///< number of TBB worker threads to be used
   const size_t                     max_read_buffer_size_;      ///< maximal data block size for file read-in
+  const size_t                     max_held_back_bytes_;       ///< maximal compressed size of Chunks checked for existence
 
   tbb::atomic<unsigned int>        chunks_in_flight_;          ///< number of Chunks currently in processing
   tbb::atomic<unsigned int>        file_count_;                ///< overall number of processed files
+  tbb::atomic<uint64_t>            deduplicated_chunks_;       ///< Chunks found in the backend storage
+  tbb::atomic<uint64_t>            deduplicated_bytes_;        ///< compressed bytes not uploaded
 
   pthread_mutex_t                  processing_done_mutex_;
   pthread_cond_t                   processing_done_condition_;
 
   Reader<FileScrubbingTask, File>  reader_;                    ///< dedicated File Reader object
+  CharBufferPool                   buffer_pool_;               ///< recycles buffers of compressed data
 
   AbstractUploader                *uploader_;                  ///< (weak) reference to the used AbstractUploaer
   FileProcessor                   *file_processor_;            ///< (weak) reference to the FileProcesser in command
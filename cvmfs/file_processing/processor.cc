@@ -188,15 +188,24 @@ void FileScrubbingTask::SpawnTasksAndWaitForProcessing() {
 
 
 void FileScrubbingTask::CommitFinishedChunks() const {
+  // Committing the last Chunk of a File might free the File together with all
+  // of its Chunks (see IoDispatcher::ScheduleCommit()), thus the finished
+  // Chunks are collected before any of them is committed
+  std::vector<Chunk*> finished_chunks;
   std::vector<Chunk*>::const_iterator i    = chunks_to_process_.begin();
   std::vector<Chunk*>::const_iterator iend = chunks_to_process_.end();
   for (; i != iend; ++i) {
     Chunk *current_chunk = *i;
     if (current_chunk->IsFullyProcessed()) {
-      current_chunk->ScheduleCommit();
+      finished_chunks.push_back(current_chunk);
     }
   }
 
+  for (i = finished_chunks.begin(), iend = finished_chunks.end(); i != iend;
+       ++i)
+  {
+    (*i)->ScheduleCommit();
+  }
 }
 
 
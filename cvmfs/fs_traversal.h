@@ -114,7 +114,7 @@ class FileSystemTraversal {
     DoRecursion(dir_path, "");
   }
 
- private:
+ protected:
   // The delegate all hooks are called on
   T *delegate_;
 
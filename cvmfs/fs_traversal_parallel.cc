@@ -0,0 +1,246 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "fs_traversal_parallel.h"
+
+#include <dirent.h>
+#include <errno.h>
+
+#include <cassert>
+
+#include "platform.h"
+
+using namespace std;  // NOLINT
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+DirectoryScanner::DirectoryScanner(const unsigned num_threads,
+                                   const bool recurse,
+                                   const Filter *filter,
+                                   const bool deep_read_ahead)
+  : num_threads_(num_threads)
+  , recurse_(recurse)
+  , filter_(filter)
+  , deep_read_ahead_(deep_read_ahead)
+  , terminate_(false)
+  , num_busy_(0)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_queue_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_scanned_, NULL);
+  assert(retval == 0);
+}
+
+
+DirectoryScanner::~DirectoryScanner() {
+  pthread_mutex_lock(&lock_);
+  terminate_ = true;
+  pthread_cond_broadcast(&cond_queue_);
+  pthread_mutex_unlock(&lock_);
+  for (unsigned i = 0; i < threads_.size(); ++i)
+    pthread_join(threads_[i], NULL);
+
+  for (unsigned i = 0; i < directories_.size(); ++i)
+    delete directories_[i];
+  pthread_cond_destroy(&cond_scanned_);
+  pthread_cond_destroy(&cond_queue_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+DirectoryScanner::Directory *DirectoryScanner::Scan(const string &path) {
+  Directory *directory = new Directory(path, NULL);
+  directory->entered = true;
+  ReadDirectory(directory);
+
+  pthread_mutex_lock(&lock_);
+  directories_.push_back(directory);
+  Enqueue(directory);
+  pthread_mutex_unlock(&lock_);
+  return directory;
+}
+
+
+void DirectoryScanner::Enter(Directory *directory) {
+  if (deep_read_ahead_)
+    return;
+  pthread_mutex_lock(&lock_);
+  if (!directory->entered) {
+    directory->entered = true;
+    if (directory->scanned)
+      EnqueueSubdirectories(directory);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void DirectoryScanner::Wait(Directory *directory) {
+  pthread_mutex_lock(&lock_);
+  while (!directory->scanned)
+    pthread_cond_wait(&cond_scanned_, &lock_);
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void DirectoryScanner::Discard(Directory *directory) {
+  pthread_mutex_lock(&lock_);
+  directory->discarded = true;
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void DirectoryScanner::Release(Directory *directory) {
+  vector<Entry> empty;
+  directory->entries.swap(empty);
+}
+
+
+void DirectoryScanner::Finish() {
+  pthread_mutex_lock(&lock_);
+  for (unsigned i = 0; i < directories_.size(); ++i)
+    directories_[i]->discarded = true;
+  while (!queue_.empty() || (num_busy_ > 0))
+    pthread_cond_wait(&cond_scanned_, &lock_);
+  for (unsigned i = 0; i < directories_.size(); ++i)
+    delete directories_[i];
+  directories_.clear();
+  pthread_mutex_unlock(&lock_);
+}
+
+
+/**
+ * Marks a read directory as scanned.  Its sub directories are queued right
+ * away with deep read-ahead, otherwise once the traversal entered the
+ * directory.  Called with the lock held.
+ */
+void DirectoryScanner::Enqueue(Directory *directory) {
+  directory->scanned = true;
+  pthread_cond_broadcast(&cond_scanned_);
+
+  for (unsigned i = 0; i < directory->entries.size(); ++i) {
+    if (directory->entries[i].subdirectory != NULL)
+      directories_.push_back(directory->entries[i].subdirectory);
+  }
+  if (deep_read_ahead_ || directory->entered)
+    EnqueueSubdirectories(directory);
+}
+
+
+/**
+ * Queues the sub directories such that the first one is read next.  Starts
+ * the threads if necessary.  Called with the lock held.
+ */
+void DirectoryScanner::EnqueueSubdirectories(Directory *directory) {
+  bool has_subdirectories = false;
+  for (unsigned i = directory->entries.size(); i > 0; --i) {
+    Directory *subdirectory = directory->entries[i - 1].subdirectory;
+    if (subdirectory == NULL)
+      continue;
+    queue_.push_front(subdirectory);
+    has_subdirectories = true;
+  }
+  if (!has_subdirectories)
+    return;
+
+  pthread_cond_broadcast(&cond_queue_);
+  while (threads_.size() < num_threads_) {
+    pthread_t thread;
+    int retval = pthread_create(&thread, NULL, MainScan, this);
+    assert(retval == 0);
+    threads_.push_back(thread);
+  }
+}
+
+
+bool DirectoryScanner::IsDiscarded(const Directory *directory) const {
+  for (; directory != NULL; directory = directory->parent) {
+    if (directory->discarded)
+      return true;
+  }
+  return false;
+}
+
+
+void *DirectoryScanner::MainScan(void *data) {
+  DirectoryScanner *scanner = reinterpret_cast<DirectoryScanner *>(data);
+  LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "starting directory scan thread");
+
+  pthread_mutex_lock(&scanner->lock_);
+  while (true) {
+    while (scanner->queue_.empty() && !scanner->terminate_)
+      pthread_cond_wait(&scanner->cond_queue_, &scanner->lock_);
+    if (scanner->terminate_)
+      break;
+
+    Directory *directory = scanner->queue_.front();
+    scanner->queue_.pop_front();
+    const bool discarded = scanner->IsDiscarded(directory);
+    scanner->num_busy_++;
+    pthread_mutex_unlock(&scanner->lock_);
+
+    if (!discarded)
+      scanner->ReadDirectory(directory);
+
+    pthread_mutex_lock(&scanner->lock_);
+    scanner->num_busy_--;
+    scanner->Enqueue(directory);
+  }
+  pthread_mutex_unlock(&scanner->lock_);
+
+  LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "stopping directory scan thread");
+  return NULL;
+}
+
+
+/**
+ * Runs in the scanning threads, so errors are only recorded.  The traversal
+ * reports them once it visits the directory or the entry.
+ */
+void DirectoryScanner::ReadDirectory(Directory *directory) const {
+  const string &path = directory->path;
+  DIR *dip = opendir(path.c_str());
+  if (!dip) {
+    directory->error = errno;
+    LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "failed to open %s (%d)",
+             path.c_str(), directory->error);
+    return;
+  }
+  const int fd = dirfd(dip);
+
+  platform_dirent64 *dit;
+  while ((dit = platform_readdir(dip)) != NULL) {
+    const string name(dit->d_name);
+    if ((name == ".") || (name == ".."))
+      continue;
+
+    Entry entry;
+    entry.name = name;
+    if ((filter_ != NULL) && filter_->IsIgnored(path, name)) {
+      entry.ignored = true;
+      directory->entries.push_back(entry);
+      continue;
+    }
+
+    platform_stat64 info;
+    if (platform_lstatat(fd, dit->d_name, &info) != 0) {
+      entry.error = errno;
+      directory->entries.push_back(entry);
+      continue;
+    }
+    entry.mode = info.st_mode;
+    if (S_ISDIR(info.st_mode) && recurse_)
+      entry.subdirectory = new Directory(path + "/" + name, directory);
+    directory->entries.push_back(entry);
+  }
+  closedir(dip);
+}
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}
+#endif
@@ -0,0 +1,293 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * A variant of the FileSystemTraversal that reads directories with a pool of
+ * threads ahead of the traversal.  Callbacks are still delivered by the
+ * calling thread, in exactly the order of the sequential FileSystemTraversal.
+ */
+
+#ifndef CVMFS_FS_TRAVERSAL_PARALLEL_H_
+#define CVMFS_FS_TRAVERSAL_PARALLEL_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "fs_traversal.h"
+#include "logging.h"
+#include "util.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+/**
+ * Reads directory trees with a number of threads.  Every directory is read
+ * with readdir() and all its entries are classified by an lstat() relative to
+ * the directory file descriptor.  Sub directories are queued for the threads,
+ * in the order a depth-first traversal will visit them.  Threads are only
+ * started once there is a sub directory to scan.
+ *
+ * Without deep read-ahead, only the sub directories of directories that the
+ * traversal entered are read.  That suits traversals that decline many
+ * directories, whose sub trees would otherwise be read in vain.
+ *
+ * Errors of opendir() and lstat() are recorded and left to the traversal,
+ * which reports them only if it actually visits the entry.  The scanner can be
+ * reused for several trees; the threads keep running until destruction.
+ */
+class DirectoryScanner : SingleCopy {
+ public:
+  struct Directory;
+
+  struct Entry {
+    Entry() : mode(0), ignored(false), error(0), subdirectory(NULL) { }
+    std::string  name;
+    mode_t       mode;          ///< st_mode from lstat()
+    bool         ignored;       ///< rejected by the filter, not classified
+    int          error;         ///< errno of a failed lstat()
+    Directory   *subdirectory;  ///< scan of this entry if it is a directory
+  };
+
+  struct Directory {
+    Directory(const std::string &p, Directory *parent_dir)
+      : path(p), parent(parent_dir), scanned(false), entered(false),
+        discarded(false), error(0) { }
+    std::string         path;
+    Directory          *parent;
+    bool                scanned;    ///< entries are valid
+    bool                entered;    ///< visited by the traversal
+    bool                discarded;  ///< not traversed, skip the sub tree
+    int                 error;      ///< errno of a failed opendir()
+    std::vector<Entry>  entries;    ///< in readdir() order, without . and ..
+  };
+
+  /**
+   * Decides which directory entries are ignored.  Called by the scanning
+   * threads concurrently, so it must be thread-safe.
+   */
+  class Filter {
+   public:
+    virtual ~Filter() { }
+    virtual bool IsIgnored(const std::string &path,
+                           const std::string &name) const = 0;
+  };
+
+  /**
+   * @param num_threads number of threads reading directories
+   * @param recurse if false, only the top directory is read
+   * @param filter optional, ignored entries are neither classified nor read
+   * @param deep_read_ahead if false, sub directories are read only once the
+   *                        traversal enters their parent
+   */
+  DirectoryScanner(const unsigned num_threads, const bool recurse,
+                   const Filter *filter = NULL,
+                   const bool deep_read_ahead = true);
+  ~DirectoryScanner();
+
+  /**
+   * Reads path in the calling thread and queues its sub directories.
+   */
+  Directory *Scan(const std::string &path);
+  /**
+   * The traversal visits the directory, its sub directories are going to be
+   * needed.
+   */
+  void Enter(Directory *directory);
+  /**
+   * Blocks until the directory has been read.
+   */
+  void Wait(Directory *directory);
+  /**
+   * The directory will not be traversed.  Its sub directories that have not
+   * yet been read are skipped.
+   */
+  void Discard(Directory *directory);
+  /**
+   * The directory has been traversed, frees its entries.
+   */
+  void Release(Directory *directory);
+  /**
+   * Skips the queued directories, waits for the threads to become idle and
+   * frees all directories.  Afterwards, the scanner can scan the next tree.
+   */
+  void Finish();
+
+ private:
+  static void *MainScan(void *data);
+  void ReadDirectory(Directory *directory) const;
+  void Enqueue(Directory *directory);
+  void EnqueueSubdirectories(Directory *directory);
+  bool IsDiscarded(const Directory *directory) const;
+
+  const unsigned num_threads_;
+  const bool recurse_;
+  const Filter *filter_;
+  const bool deep_read_ahead_;
+  bool terminate_;
+  unsigned num_busy_;  ///< threads currently reading a directory
+  std::vector<pthread_t> threads_;
+  std::deque<Directory *> queue_;       ///< directories to be read
+  std::vector<Directory *> directories_;  ///< all directories, for cleanup
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_queue_;
+  pthread_cond_t cond_scanned_;
+};
+
+
+/**
+ * Drop-in replacement for the FileSystemTraversal.  The file system tree must
+ * not be changed by the callbacks during the traversal.  With a single
+ * thread, it behaves like the FileSystemTraversal.
+ *
+ * With multiple threads, fn_ignore_file is called by the scanning threads and
+ * must be thread-safe.  The scanning threads are kept for subsequent calls of
+ * Recurse().  If fn_new_dir_prefix declines many directories, such as new
+ * directories that are handled by another traversal, deep read-ahead should
+ * be turned off (see DirectoryScanner).
+ */
+template <class T>
+class ParallelFileSystemTraversal : public FileSystemTraversal<T> {
+ public:
+  ParallelFileSystemTraversal(T *delegate,
+                              const std::string &relative_to_directory,
+                              const bool recurse,
+                              const unsigned num_threads,
+                              const bool deep_read_ahead = true) :
+    FileSystemTraversal<T>(delegate, relative_to_directory, recurse),
+    num_threads_(num_threads),
+    deep_read_ahead_(deep_read_ahead),
+    filter_(this),
+    scanner_(NULL),
+    scanner_busy_(false)
+  { }
+
+  ~ParallelFileSystemTraversal() {
+    delete scanner_;
+  }
+
+  void Recurse(const std::string &dir_path) const {
+    if (num_threads_ <= 1) {
+      FileSystemTraversal<T>::Recurse(dir_path);
+      return;
+    }
+
+    assert(this->fn_enter_dir != NULL ||
+           this->fn_leave_dir != NULL ||
+           this->fn_new_file != NULL ||
+           this->fn_new_symlink != NULL ||
+           this->fn_new_dir_prefix != NULL);
+
+    // A callback that starts another traversal gets a scanner of its own
+    if (scanner_busy_) {
+      DirectoryScanner scanner(num_threads_, this->recurse_, &filter_,
+                               deep_read_ahead_);
+      DoRecursion(&scanner, scanner.Scan(dir_path), dir_path, "");
+      return;
+    }
+    if (scanner_ == NULL) {
+      scanner_ = new DirectoryScanner(num_threads_, this->recurse_, &filter_,
+                                      deep_read_ahead_);
+    }
+    scanner_busy_ = true;
+    DoRecursion(scanner_, scanner_->Scan(dir_path), dir_path, "");
+    scanner_->Finish();
+    scanner_busy_ = false;
+  }
+
+ private:
+  /**
+   * Forwards the scanner's questions to fn_ignore_file.
+   */
+  class IgnoreFilter : public DirectoryScanner::Filter {
+   public:
+    explicit IgnoreFilter(const ParallelFileSystemTraversal<T> *traversal)
+      : traversal_(traversal) { }
+    virtual bool IsIgnored(const std::string &path,
+                           const std::string &name) const
+    {
+      return (traversal_->fn_ignore_file != NULL) &&
+             traversal_->Notify(traversal_->fn_ignore_file, path, name);
+    }
+   private:
+    const ParallelFileSystemTraversal<T> *traversal_;
+  };
+  friend class IgnoreFilter;
+
+  void DoRecursion(DirectoryScanner *scanner,
+                   DirectoryScanner::Directory *directory,
+                   const std::string &parent_path,
+                   const std::string &dir_name) const
+  {
+    const std::string &path = directory->path;
+    scanner->Enter(directory);
+    scanner->Wait(directory);
+    LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "entering %s (%s -- %s)",
+             path.c_str(), parent_path.c_str(), dir_name.c_str());
+    if (directory->error != 0) {
+      LogCvmfs(kLogFsTraversal, kLogStderr, "Failed to open %s (%d).\n"
+               "Please check directory permissions.",
+               path.c_str(), directory->error);
+      abort();
+    }
+    this->Notify(this->fn_enter_dir, parent_path, dir_name);
+
+    for (unsigned i = 0; i < directory->entries.size(); ++i) {
+      const DirectoryScanner::Entry &entry = directory->entries[i];
+      if (entry.ignored) {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "ignoring %s/%s",
+                 path.c_str(), entry.name.c_str());
+        continue;
+      }
+      if (entry.error != 0) {
+        LogCvmfs(kLogFsTraversal, kLogStderr, "Failed to stat %s/%s (%d)",
+                 path.c_str(), entry.name.c_str(), entry.error);
+        abort();
+      }
+
+      if (S_ISDIR(entry.mode)) {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing directory %s/%s",
+                 path.c_str(), entry.name.c_str());
+        if (this->Notify(this->fn_new_dir_prefix, path, entry.name) &&
+            this->recurse_)
+        {
+          DoRecursion(scanner, entry.subdirectory, path, entry.name);
+        } else if (entry.subdirectory != NULL) {
+          scanner->Discard(entry.subdirectory);
+        }
+        this->Notify(this->fn_new_dir_postfix, path, entry.name);
+      } else if (S_ISREG(entry.mode)) {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing regular file %s/%s",
+                 path.c_str(), entry.name.c_str());
+        this->Notify(this->fn_new_file, path, entry.name);
+      } else if (S_ISLNK(entry.mode)) {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing symlink %s/%s",
+                 path.c_str(), entry.name.c_str());
+        this->Notify(this->fn_new_symlink, path, entry.name);
+      } else {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "unknown file type %s/%s",
+                 path.c_str(), entry.name.c_str());
+      }
+    }
+
+    LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "leaving %s", path.c_str());
+    scanner->Release(directory);
+    this->Notify(this->fn_leave_dir, parent_path, dir_name);
+  }
+
+  const unsigned num_threads_;
+  const bool deep_read_ahead_;
+  const IgnoreFilter filter_;
+  mutable DirectoryScanner *scanner_;  ///< reused by subsequent traversals
+  mutable bool scanner_busy_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}
+#endif
+
+#endif  // CVMFS_FS_TRAVERSAL_PARALLEL_H_
@@ -0,0 +1,55 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "latency_histogram.h"
+
+#include <cmath>
+
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+namespace download {
+
+void LatencyHistogram::Add(const double ms) {
+  unsigned bin = 0;
+  if (ms >= 1.0)
+    bin = 1 + static_cast<unsigned>(4.0 * log(ms) / log(2.0));
+  if (bin >= kNumBins)
+    bin = kNumBins - 1;
+  bins[bin]++;
+  num_samples++;
+  if (num_samples >= kMaxSamples) {
+    num_samples = 0;
+    for (unsigned i = 0; i < kNumBins; ++i) {
+      bins[i] /= 2;
+      num_samples += bins[i];
+    }
+  }
+}
+
+
+double LatencyHistogram::GetQuantile(const double q) const {
+  if (num_samples == 0)
+    return -1.0;
+  const double rank = q * static_cast<double>(num_samples);
+  uint64_t sum = 0;
+  unsigned bin;
+  for (bin = 0; bin < kNumBins - 1; ++bin) {
+    sum += bins[bin];
+    if (static_cast<double>(sum) >= rank)
+      break;
+  }
+  return pow(2.0, static_cast<double>(bin) / 4.0);
+}
+
+
+string LatencyHistogram::PrintQuantiles() const {
+  if (num_samples == 0)
+    return "n/a";
+  return "p50 " + StringifyInt(int64_t(GetQuantile(0.5))) + " ms, p99 " +
+         StringifyInt(int64_t(GetQuantile(0.99))) + " ms";
+}
+
+}  // namespace download
@@ -0,0 +1,42 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_LATENCY_HISTOGRAM_H_
+#define CVMFS_LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace download {
+
+/**
+ * Times to the first byte of successful transfers in logarithmic bins, four
+ * bins per power of two starting at 1ms.  The counts are halved when there are
+ * enough samples, so that the quantiles follow changes of the endpoint.
+ */
+struct LatencyHistogram {
+  static const unsigned kNumBins = 72;
+  static const uint64_t kMaxSamples = 4096;
+
+  LatencyHistogram() : num_samples(0) {
+    for (unsigned i = 0; i < kNumBins; ++i)
+      bins[i] = 0;
+  }
+
+  void Add(const double ms);
+  /**
+   * @return  upper bound in ms of the bin that contains the quantile q,
+   *          negative if there are no samples
+   */
+  double GetQuantile(const double q) const;
+  std::string PrintQuantiles() const;
+
+  uint64_t bins[kNumBins];
+  uint64_t num_samples;
+};
+
+}  // namespace download
+
+#endif  // CVMFS_LATENCY_HISTOGRAM_H_
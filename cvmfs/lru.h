@@ -120,6 +120,20 @@ struct Statistics {
 };
 
 
+/**
+ * Heap memory owned by a cache value in addition to its hash table slot,
+ * counted in Statistics::allocated.
+ */
+template<class T>
+inline uint64_t GetHeapSize(const T & /* value */) {
+  return 0;
+}
+
+inline uint64_t GetHeapSize(const catalog::PackedDirectoryEntry &value) {
+  return value.GetOutOfLineSize();
+}
+
+
 /**
  * Template class to create a LRU cache
  * @param Key type of the key values
@@ -591,6 +605,9 @@ class LruCache {
     // Check if we have to update an existent entry
     if (this->DoLookup(key, entry)) {
       atomic_inc64(&statistics_.num_update);
+      atomic_xadd64(&statistics_.allocated,
+                    int64_t(GetHeapSize(value)) -
+                    int64_t(GetHeapSize(entry.value)));
       entry.value = value;
       cache_.Insert(key, entry);
       this->Touch(entry);
@@ -608,6 +625,7 @@ class LruCache {
 
     cache_.Insert(key, entry);
     cache_gauge_++;
+    atomic_xadd64(&statistics_.allocated, GetHeapSize(value));
 
     Unlock();
     return true;
@@ -628,12 +646,12 @@ class LruCache {
       return false;
     }
 
-    CacheEntry entry;
-    if (DoLookup(key, entry)) {
+    const CacheEntry *entry = cache_.Find(key);
+    if (entry != NULL) {
       // Hit
       atomic_inc64(&statistics_.num_hit);
-      Touch(entry);
-      *value = entry.value;
+      Touch(*entry);
+      *value = entry->value;
       found = true;
     } else {
       atomic_inc64(&statistics_.num_miss);
@@ -660,6 +678,7 @@ class LruCache {
     if (this->DoLookup(key, entry)) {
       found = true;
       atomic_inc64(&statistics_.num_forget);
+      atomic_xadd64(&statistics_.allocated, -int64_t(GetHeapSize(entry.value)));
 
       entry.list_entry->RemoveFromList();
       delete entry.list_entry;
@@ -716,6 +735,34 @@ class LruCache {
  protected:
   Statistics statistics_;
 
+  /**
+   * Like Lookup() but unpacks the value into result while the cache is
+   * locked.  Unlike a copy of the value, this does not allocate memory for
+   * the usual short names of a PackedDirectoryEntry.
+   */
+  template<class Result>
+  bool LookupUnpacked(const Key &key, Result *result) {
+    bool found = false;
+    Lock();
+    if (pause_) {
+      Unlock();
+      return false;
+    }
+
+    const CacheEntry *entry = cache_.Find(key);
+    if (entry != NULL) {
+      atomic_inc64(&statistics_.num_hit);
+      Touch(*entry);
+      entry->value.Unpack(result);
+      found = true;
+    } else {
+      atomic_inc64(&statistics_.num_miss);
+    }
+
+    Unlock();
+    return found;
+  }
+
  private:
   /**
    *  this just performs a lookup in the cache
@@ -746,6 +793,8 @@ class LruCache {
 
     atomic_inc64(&statistics_.num_replace);
     Key delete_me = lru_list_->PopFront();
+    const CacheEntry *entry = cache_.Find(delete_me);
+    atomic_xadd64(&statistics_.allocated, -int64_t(GetHeapSize(entry->value)));
     cache_.Erase(delete_me);
 
     --cache_gauge_;
@@ -790,11 +839,11 @@ static inline uint32_t hasher_inode(const fuse_ino_t &inode) {
 //uint32_t hasher_inode(const fuse_ino_t &inode);
 
 
-class InodeCache : public LruCache<fuse_ino_t, catalog::DirectoryEntry>
+class InodeCache : public LruCache<fuse_ino_t, catalog::PackedDirectoryEntry>
 {
  public:
   InodeCache(unsigned int cache_size) :
-    LruCache<fuse_ino_t, catalog::DirectoryEntry>(
+    LruCache<fuse_ino_t, catalog::PackedDirectoryEntry>(
       cache_size, fuse_ino_t(-1), hasher_inode)
   {
   }
@@ -803,13 +852,13 @@ class InodeCache : public LruCache<fuse_ino_t, catalog::DirectoryEntry>
     LogCvmfs(kLogLru, kLogDebug, "insert inode --> dirent: %u -> '%s'",
              inode, dirent.name().c_str());
     const bool result =
-      LruCache<fuse_ino_t, catalog::DirectoryEntry>::Insert(inode, dirent);
+      LruCache<fuse_ino_t, catalog::PackedDirectoryEntry>::Insert(
+        inode, catalog::PackedDirectoryEntry(dirent));
     return result;
   }
 
   bool Lookup(const fuse_ino_t &inode, catalog::DirectoryEntry *dirent) {
-    const bool result =
-      LruCache<fuse_ino_t, catalog::DirectoryEntry>::Lookup(inode, dirent);
+    const bool result = LookupUnpacked(inode, dirent);
     LogCvmfs(kLogLru, kLogDebug, "lookup inode --> dirent: %u (%s)",
              inode, result ? "hit" : "miss");
     return result;
@@ -817,7 +866,7 @@ class InodeCache : public LruCache<fuse_ino_t, catalog::DirectoryEntry>
 
   void Drop() {
     LogCvmfs(kLogLru, kLogDebug, "dropping inode cache");
-    LruCache<fuse_ino_t, catalog::DirectoryEntry>::Drop();
+    LruCache<fuse_ino_t, catalog::PackedDirectoryEntry>::Drop();
   }
 };  // InodeCache
 
@@ -853,34 +902,39 @@ class PathCache : public LruCache<fuse_ino_t, PathString> {
 
 
 class Md5PathCache :
-  public LruCache<shash::Md5, catalog::DirectoryEntry>
+  public LruCache<shash::Md5, catalog::PackedDirectoryEntry>
 {
  public:
   Md5PathCache(unsigned int cache_size) :
-    LruCache<shash::Md5, catalog::DirectoryEntry>(
+    LruCache<shash::Md5, catalog::PackedDirectoryEntry>(
       cache_size, shash::Md5(shash::AsciiPtr("!")), hasher_md5)
   {
-    dirent_negative_ = catalog::DirectoryEntry(catalog::kDirentNegative);
+    dirent_negative_ = catalog::PackedDirectoryEntry(
+      catalog::DirectoryEntry(catalog::kDirentNegative));
   }
 
   bool Insert(const shash::Md5 &hash, const catalog::DirectoryEntry &dirent) {
     LogCvmfs(kLogLru, kLogDebug, "insert md5 --> dirent: %s -> '%s'",
              hash.ToString().c_str(), dirent.name().c_str());
     const bool result =
-      LruCache<shash::Md5, catalog::DirectoryEntry>::Insert(hash, dirent);
+      LruCache<shash::Md5, catalog::PackedDirectoryEntry>::Insert(
+        hash, catalog::PackedDirectoryEntry(dirent));
     return result;
   }
 
   bool InsertNegative(const shash::Md5 &hash) {
-    const bool result = Insert(hash, dirent_negative_);
+    LogCvmfs(kLogLru, kLogDebug, "insert md5 --> negative dirent: %s",
+             hash.ToString().c_str());
+    const bool result =
+      LruCache<shash::Md5, catalog::PackedDirectoryEntry>::Insert(
+        hash, dirent_negative_);
     if (result)
       atomic_inc64(&statistics_.num_insert_negative);
     return result;
   }
 
   bool Lookup(const shash::Md5 &hash, catalog::DirectoryEntry *dirent) {
-    const bool result =
-      LruCache<shash::Md5, catalog::DirectoryEntry>::Lookup(hash, dirent);
+    const bool result = LookupUnpacked(hash, dirent);
     LogCvmfs(kLogLru, kLogDebug, "lookup md5 --> dirent: %s (%s)",
              hash.ToString().c_str(), result ? "hit" : "miss");
     return result;
@@ -889,16 +943,16 @@ class Md5PathCache :
   bool Forget(const shash::Md5 &hash) {
     LogCvmfs(kLogLru, kLogDebug, "forget md5: %s",
              hash.ToString().c_str());
-    return LruCache<shash::Md5, catalog::DirectoryEntry>::Forget(hash);
+    return LruCache<shash::Md5, catalog::PackedDirectoryEntry>::Forget(hash);
   }
 
   void Drop() {
     LogCvmfs(kLogLru, kLogDebug, "dropping md5path cache");
-    LruCache<shash::Md5, catalog::DirectoryEntry>::Drop();
+    LruCache<shash::Md5, catalog::PackedDirectoryEntry>::Drop();
   }
 
  private:
-  catalog::DirectoryEntry dirent_negative_;
+  catalog::PackedDirectoryEntry dirent_negative_;
 };  // Md5PathCache
 
 }  // namespace lru
@@ -17,12 +17,14 @@
 #include <sys/mount.h>
 #include <sys/file.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <signal.h>
 #include <limits.h>
 #include <unistd.h>
 #include <mntent.h>
 
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
 
 #include <cstring>
@@ -211,6 +213,15 @@ inline int platform_fstat(int filedes, platform_stat64 *buf) {
   return fstat64(filedes, buf);
 }
 
+/**
+ * lstat() of a path relative to an open directory
+ */
+inline int platform_lstatat(int dirfd, const char *path,
+                            platform_stat64 *buf)
+{
+  return fstatat64(dirfd, path, buf, AT_SYMLINK_NOFOLLOW);
+}
+
 inline bool platform_getxattr(const std::string &path, const std::string &name,
                               std::string *value)
 {
@@ -246,6 +257,68 @@ inline std::string platform_libname(const std::string &base_name) {
 }
 
 
+/**
+ * Event notification for many file descriptors, epoll on Linux.  A poller
+ * watches every registered descriptor for reading and/or writing.
+ */
+typedef struct epoll_event platform_poll_event;
+
+inline int platform_poller_create() {
+  return epoll_create(64);  // the size is only a hint
+}
+
+/**
+ * Registers a file descriptor or changes the events it is watched for.
+ * @param is_new  hint that the file descriptor is not yet registered
+ */
+inline bool platform_poller_watch(const int poller, const int fd,
+                                  const bool read, const bool write,
+                                  const bool is_new)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = (read ? (EPOLLIN | EPOLLPRI) : 0) | (write ? EPOLLOUT : 0);
+  event.data.fd = fd;
+  int retval =
+    epoll_ctl(poller, is_new ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+  if ((retval != 0) && (errno == EEXIST))
+    retval = epoll_ctl(poller, EPOLL_CTL_MOD, fd, &event);
+  else if ((retval != 0) && (errno == ENOENT))
+    retval = epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event);
+  return retval == 0;
+}
+
+inline void platform_poller_unwatch(const int poller, const int fd) {
+  struct epoll_event event;  // must not be NULL for kernels < 2.6.9
+  epoll_ctl(poller, EPOLL_CTL_DEL, fd, &event);
+}
+
+/**
+ * @return  the number of events, 0 on timeout, -1 on error (e.g. EINTR)
+ */
+inline int platform_poller_wait(const int poller, platform_poll_event *events,
+                                const int max_events, const int timeout_ms)
+{
+  return epoll_wait(poller, events, max_events, timeout_ms);
+}
+
+inline int platform_poll_fd(const platform_poll_event &event) {
+  return event.data.fd;
+}
+
+inline bool platform_poll_readable(const platform_poll_event &event) {
+  return event.events & (EPOLLIN | EPOLLPRI);
+}
+
+inline bool platform_poll_writable(const platform_poll_event &event) {
+  return event.events & EPOLLOUT;
+}
+
+inline bool platform_poll_error(const platform_poll_event &event) {
+  return event.events & (EPOLLERR | EPOLLHUP);
+}
+
+
 inline const char* platform_getexepath() {
   static char buf[PATH_MAX] = {0};
   if (strlen(buf) == 0) {
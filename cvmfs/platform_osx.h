@@ -19,6 +19,7 @@
 #include <sys/param.h>
 #include <sys/ucred.h>
 #include <sys/mount.h>
+#include <sys/event.h>
 
 #include <cstring>
 #include <cassert>
@@ -132,6 +133,15 @@ inline int platform_fstat(int filedes, platform_stat64 *buf) {
   return fstat(filedes, buf);
 }
 
+/**
+ * lstat() of a path relative to an open directory
+ */
+inline int platform_lstatat(int dirfd, const char *path,
+                            platform_stat64 *buf)
+{
+  return fstatat(dirfd, path, buf, AT_SYMLINK_NOFOLLOW);
+}
+
 inline bool platform_getxattr(const std::string &path, const std::string &name,
                               std::string *value)
 {
@@ -174,6 +184,71 @@ inline std::string platform_libname(const std::string &base_name) {
   return "lib" + base_name + ".dylib";
 }
 
+/**
+ * Event notification for many file descriptors, kqueue on Mac OS X.  A poller
+ * watches every registered descriptor for reading and/or writing.  Reading
+ * and writing are separate filters, so that a descriptor can be reported
+ * twice by a single wait.
+ */
+typedef struct kevent platform_poll_event;
+
+inline int platform_poller_create() {
+  return kqueue();
+}
+
+/**
+ * Registers a file descriptor or changes the events it is watched for.
+ * @param is_new  hint that the file descriptor is not yet registered
+ */
+inline bool platform_poller_watch(const int poller, const int fd,
+                                  const bool read, const bool write,
+                                  const bool is_new)
+{
+  struct kevent changes[2];
+  EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | (read ? EV_ENABLE : EV_DISABLE),
+         0, 0, NULL);
+  EV_SET(&changes[1], fd, EVFILT_WRITE,
+         EV_ADD | (write ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+  return kevent(poller, changes, 2, NULL, 0, NULL) == 0;
+}
+
+inline void platform_poller_unwatch(const int poller, const int fd) {
+  struct kevent changes[2];
+  EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+  kevent(poller, changes, 2, NULL, 0, NULL);
+}
+
+/**
+ * @return  the number of events, 0 on timeout, -1 on error (e.g. EINTR)
+ */
+inline int platform_poller_wait(const int poller, platform_poll_event *events,
+                                const int max_events, const int timeout_ms)
+{
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+  return kevent(poller, NULL, 0, events, max_events,
+                (timeout_ms < 0) ? NULL : &timeout);
+}
+
+inline int platform_poll_fd(const platform_poll_event &event) {
+  return event.ident;
+}
+
+inline bool platform_poll_readable(const platform_poll_event &event) {
+  return event.filter == EVFILT_READ;
+}
+
+inline bool platform_poll_writable(const platform_poll_event &event) {
+  return event.filter == EVFILT_WRITE;
+}
+
+inline bool platform_poll_error(const platform_poll_event &event) {
+  return event.flags & EV_ERROR;
+}
+
+
 inline const char* platform_getexepath() {
   static const char* path = _dyld_get_image_name(0);
   return path;
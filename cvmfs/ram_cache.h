@@ -0,0 +1,250 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The RAM cache keeps the contents of small files in memory, keyed by content
+ * hash.  It sits on top of the disk cache: objects are fetched into the disk
+ * cache as usual and copied into memory afterwards, so quota accounting of the
+ * disk cache is unaffected.
+ *
+ * Replacement follows the simplified 2Q algorithm (Johnson, Shasha, 1994).
+ * New objects enter a FIFO queue (A1in).  Objects evicted from A1in are
+ * remembered by their hash only (A1out).  Only objects that are requested
+ * again while remembered in A1out enter the LRU queue (Am) of the hot objects.
+ * A single pass over many files, such as a find or a grep, therefore only
+ * cycles through A1in and does not evict the hot set.
+ */
+
+#ifndef CVMFS_RAM_CACHE_H_
+#define CVMFS_RAM_CACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <string>
+
+#include "atomic.h"
+#include "hash.h"
+#include "smalloc.h"
+#include "util.h"
+
+namespace cache {
+
+/**
+ * Reference counted, immutable buffer holding the contents of a file.  The
+ * data follow the header in the same allocation.  Open file handles keep a
+ * reference, so objects can be evicted from the cache while being read.
+ */
+struct RamObject {
+  atomic_int32 refcnt;
+  uint32_t size;
+
+  static RamObject *Create(const uint32_t size) {
+    RamObject *object =
+      static_cast<RamObject *>(smalloc(sizeof(RamObject) + size));
+    atomic_init32(&object->refcnt);
+    atomic_inc32(&object->refcnt);
+    object->size = size;
+    return object;
+  }
+  char *data() { return reinterpret_cast<char *>(this + 1); }
+  void Acquire() { atomic_inc32(&refcnt); }
+  void Release() {
+    if (atomic_xadd32(&refcnt, -1) == 1)
+      free(this);
+  }
+};
+
+
+class RamCache {
+ public:
+  /**
+   * Counting of cache operations.
+   */
+  struct Statistics {
+    Statistics() {
+      atomic_init64(&num_hit);
+      atomic_init64(&num_miss);
+      atomic_init64(&num_insert);
+      atomic_init64(&num_insert_hot);
+      atomic_init64(&num_evict);
+    }
+    atomic_int64 num_hit;
+    atomic_int64 num_miss;
+    atomic_int64 num_insert;
+    atomic_int64 num_insert_hot;
+    atomic_int64 num_evict;
+  };
+
+  static const unsigned kA1inShare = 4;  // A1in gets 1/4 of the capacity
+  static const unsigned kGhostEntries = 8192;  // A1out size
+
+  explicit RamCache(const uint64_t max_size) {
+    max_size_ = max_size;
+    max_size_a1in_ = max_size / kA1inShare;
+    size_a1in_ = size_am_ = 0;
+    int retval = pthread_mutex_init(&lock_, NULL);
+    assert(retval == 0);
+  }
+
+  ~RamCache() {
+    for (Index::iterator i = index_.begin(), iEnd = index_.end();
+         i != iEnd; ++i)
+    {
+      i->second.object->Release();
+    }
+    pthread_mutex_destroy(&lock_);
+  }
+
+  /**
+   * On a hit, the returned object carries an extra reference for the caller.
+   */
+  RamObject *Lookup(const shash::Any &id) {
+    pthread_mutex_lock(&lock_);
+    Index::iterator i = index_.find(id);
+    if (i == index_.end()) {
+      pthread_mutex_unlock(&lock_);
+      atomic_inc64(&statistics_.num_miss);
+      return NULL;
+    }
+    if (i->second.hot)
+      am_.splice(am_.begin(), am_, i->second.position);
+    RamObject *object = i->second.object;
+    object->Acquire();
+    pthread_mutex_unlock(&lock_);
+    atomic_inc64(&statistics_.num_hit);
+    return object;
+  }
+
+  /**
+   * The cache takes its own reference on object.  Objects larger than a
+   * queue are not cached.
+   */
+  void Insert(const shash::Any &id, RamObject *object) {
+    pthread_mutex_lock(&lock_);
+    if (index_.find(id) != index_.end()) {
+      pthread_mutex_unlock(&lock_);
+      return;
+    }
+
+    Entry entry;
+    entry.object = object;
+    Ghosts::iterator ghost = ghosts_.find(id);
+    entry.hot = (ghost != ghosts_.end());
+    if (entry.hot) {
+      a1out_.erase(ghost->second);
+      ghosts_.erase(ghost);
+    }
+    const uint64_t max_queue =
+      entry.hot ? (max_size_ - max_size_a1in_) : max_size_a1in_;
+    if (object->size > max_queue) {
+      pthread_mutex_unlock(&lock_);
+      return;
+    }
+
+    object->Acquire();
+    if (entry.hot) {
+      while (size_am_ + object->size > max_size_ - max_size_a1in_)
+        EvictAm();
+      am_.push_front(id);
+      entry.position = am_.begin();
+      size_am_ += object->size;
+      atomic_inc64(&statistics_.num_insert_hot);
+    } else {
+      while (size_a1in_ + object->size > max_size_a1in_)
+        EvictA1in();
+      a1in_.push_front(id);
+      entry.position = a1in_.begin();
+      size_a1in_ += object->size;
+    }
+    index_[id] = entry;
+    atomic_inc64(&statistics_.num_insert);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  uint64_t GetSize() {
+    pthread_mutex_lock(&lock_);
+    const uint64_t result = size_a1in_ + size_am_;
+    pthread_mutex_unlock(&lock_);
+    return result;
+  }
+
+  std::string PrintStatistics() {
+    return "size: " + StringifyInt(GetSize() / 1024) + " KB  " +
+      "capacity: " + StringifyInt(max_size_ / 1024) + " KB  " +
+      "hits: " + StringifyInt(atomic_read64(&statistics_.num_hit)) + "  " +
+      "misses: " + StringifyInt(atomic_read64(&statistics_.num_miss)) + "  " +
+      "inserts(all): " + StringifyInt(atomic_read64(&statistics_.num_insert)) +
+      "  " +
+      "inserts(hot): " +
+        StringifyInt(atomic_read64(&statistics_.num_insert_hot)) + "  " +
+      "evictions: " + StringifyInt(atomic_read64(&statistics_.num_evict)) +
+      "\n";
+  }
+
+  Statistics statistics() const { return statistics_; }
+
+ private:
+  typedef std::list<shash::Any> Queue;
+  struct Entry {
+    RamObject *object;
+    bool hot;  /**< in Am, otherwise in A1in */
+    Queue::iterator position;
+  };
+  typedef std::map<shash::Any, Entry> Index;
+  typedef std::map<shash::Any, Queue::iterator> Ghosts;
+
+  // Not copyable
+  RamCache(const RamCache &other);
+  RamCache &operator= (const RamCache &other);
+
+  /**
+   * Removes the oldest A1in object and remembers its hash in A1out.
+   */
+  void EvictA1in() {
+    assert(!a1in_.empty());
+    const shash::Any id = a1in_.back();
+    a1in_.pop_back();
+    Index::iterator i = index_.find(id);
+    size_a1in_ -= i->second.object->size;
+    i->second.object->Release();
+    index_.erase(i);
+    atomic_inc64(&statistics_.num_evict);
+
+    if (ghosts_.size() >= kGhostEntries) {
+      ghosts_.erase(a1out_.back());
+      a1out_.pop_back();
+    }
+    a1out_.push_front(id);
+    ghosts_[id] = a1out_.begin();
+  }
+
+  void EvictAm() {
+    assert(!am_.empty());
+    Index::iterator i = index_.find(am_.back());
+    am_.pop_back();
+    size_am_ -= i->second.object->size;
+    i->second.object->Release();
+    index_.erase(i);
+    atomic_inc64(&statistics_.num_evict);
+  }
+
+  uint64_t max_size_;
+  uint64_t max_size_a1in_;
+  uint64_t size_a1in_;
+  uint64_t size_am_;
+  Index index_;
+  Queue a1in_;
+  Queue am_;
+  Queue a1out_;
+  Ghosts ghosts_;
+  pthread_mutex_t lock_;
+  Statistics statistics_;
+};
+
+}  // namespace cache
+
+#endif  // CVMFS_RAM_CACHE_H_
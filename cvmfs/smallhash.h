@@ -79,6 +79,17 @@ class SmallHashBase {
     return found;
   }
 
+  /**
+   * Returns the stored value without copying it, NULL if the key is not in
+   * the table.  The pointer is valid until the table is modified.
+   */
+  const Value *Find(const Key &key) const {
+    uint32_t bucket;
+    uint32_t collisions;
+    const bool found = DoLookup(key, &bucket, &collisions);
+    return found ? values_ + bucket : NULL;
+  }
+
   bool Contains(const Key &key) const {
     uint32_t bucket;
     uint32_t collisions;
@@ -97,13 +108,17 @@ class SmallHashBase {
     uint32_t collisions;
     const bool found = DoLookup(key, &bucket, &collisions);
     if (found) {
+      // Values might own memory, empty slots hold default values
       keys_[bucket] = empty_key_;
+      values_[bucket] = Value();
       size_--;
       bucket = (bucket+1) % capacity_;
       while (!(keys_[bucket] == empty_key_)) {
         Key rehash = keys_[bucket];
         keys_[bucket] = empty_key_;
         DoInsert(rehash, values_[bucket], false);
+        if (keys_[bucket] == empty_key_)
+          values_[bucket] = Value();
         bucket = (bucket+1) % capacity_;
       }
       static_cast<Derived *>(this)->Shrink();  // No-op if fixed-size
@@ -196,8 +211,10 @@ class SmallHashBase {
   void DoClear(const bool reset_capacity) {
     if (reset_capacity)
       static_cast<Derived *>(this)->ResetCapacity();  // No-op if fixed-size
-    for (uint32_t i = 0; i < capacity_; ++i)
+    for (uint32_t i = 0; i < capacity_; ++i) {
       keys_[i] = empty_key_;
+      values_[i] = Value();
+    }
     size_ = 0;
   }
 
@@ -26,6 +26,8 @@
 #include "swissknife_history.h"
 #include "swissknife_migrate.h"
 #include "swissknife_scrub.h"
+#include "swissknife_casindex.h"
+#include "swissknife_diff.h"
 
 using namespace std;  // NOLINT
 using namespace swissknife;
@@ -89,6 +91,8 @@ int main(int argc, char **argv) {
   command_list.push_back(new swissknife::CommandVersion());
   command_list.push_back(new swissknife::CommandMigrate());
   command_list.push_back(new swissknife::CommandScrub());
+  command_list.push_back(new swissknife::CommandCasIndex());
+  command_list.push_back(new swissknife::CommandDiff());
 
   if (argc < 2) {
     swissknife::Usage();
@@ -0,0 +1,42 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * This command lists the data/xx directories of a local backend storage and
+ * writes the object index that is consulted by the local uploader.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "swissknife_casindex.h"
+
+#include <inttypes.h>
+
+#include <string>
+
+#include "logging.h"
+#include "upload_cas_index.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+using namespace swissknife;  // NOLINT
+
+int CommandCasIndex::Main(const swissknife::ArgumentList &args) {
+  const string upstream_path = MakeCanonicalPath(*args.find('r')->second);
+  if (!DirectoryExists(upstream_path + "/data")) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "%s is not a local backend storage",
+             upstream_path.c_str());
+    return 1;
+  }
+
+  uint64_t num_objects = 0;
+  if (!upload::CasIndex::Rebuild(upstream_path, &num_objects)) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to write object index of %s",
+             upstream_path.c_str());
+    return 1;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogStdout, "indexed %"PRIu64" objects in %s",
+           num_objects, upstream_path.c_str());
+  return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_SWISSKNIFE_CASINDEX_H_
+#define CVMFS_SWISSKNIFE_CASINDEX_H_
+
+#include "swissknife.h"
+
+namespace swissknife {
+
+class CommandCasIndex : public Command {
+ public:
+  ~CommandCasIndex() { };
+  std::string GetName() { return "casindex"; };
+  std::string GetDescription() {
+    return "Creates or rebuilds the object index of a local backend storage.\n"
+      "Once the index exists, the local uploader keeps it up to date and "
+      "uses it instead of the file system to find existing objects.";
+  };
+  ParameterList GetParams() {
+    ParameterList result;
+    result.push_back(Parameter('r', "upstream directory", false, false));
+    return result;
+  }
+  int Main(const ArgumentList &args);
+};
+
+}  // namespace swissknife
+
+#endif  // CVMFS_SWISSKNIFE_CASINDEX_H_
@@ -20,12 +20,14 @@
 #include "logging.h"
 #include "manifest.h"
 #include "file_chunk.h"
+#include "file_pack.h"
 #include "util.h"
 #include "catalog_sql.h"
 #include "compression.h"
 #include "shortstring.h"
 #include "download.h"
 #include "history.h"
+#include "upload_cas_index.h"
 
 using namespace std;  // NOLINT
 using namespace swissknife;
@@ -33,6 +35,7 @@ using namespace swissknife;
 namespace {
 bool check_chunks;
 std::string *remote_repository;
+upload::CasIndex *cas_index;
 }
 
 bool CommandCheck::CompareEntries(const catalog::DirectoryEntry &a,
@@ -129,13 +132,17 @@ bool CommandCheck::CompareCounters(const catalog::Counters &a,
 
 
 /**
- * Checks for existance of a file either locally or via HTTP head
+ * Checks for existance of a file either locally (possibly in the object index)
+ * or via HTTP head
  */
 bool CommandCheck::Exists(const string &file)
 {
-  if (remote_repository == NULL)
+  if (remote_repository == NULL) {
+    bool present;
+    if ((cas_index != NULL) && cas_index->Lookup(file, &present))
+      return present;
     return FileExists(file);
-  else {
+  } else {
     const string url = *remote_repository + "/" + file;
     download::JobInfo head(&url, false);
     return g_download_manager->Fetch(&head) == download::kFailOk;
@@ -204,7 +211,9 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
     }
 
     // Check if the chunk is there
-    if (!entries[i].checksum().IsNull() && check_chunks) {
+    if (!entries[i].checksum().IsNull() && !entries[i].IsPackedFile() &&
+        check_chunks)
+    {
       string chunk_path = "data" + entries[i].checksum().MakePath(1, 2);
       if (entries[i].IsDirectory())
         chunk_path += "L";
@@ -215,6 +224,27 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
       }
     }
 
+    // Check if the pack of a packed file is there
+    if (entries[i].IsPackedFile()) {
+      FilePackLocation location;
+      if (!catalog->LookupPackedFile(full_path, &location) ||
+          (location.size() == 0))
+      {
+        LogCvmfs(kLogCvmfs, kLogStderr, "no pack location for packed file %s",
+                 full_path.c_str());
+        retval = false;
+      } else if (check_chunks) {
+        const string pack_path = "data" +
+                                 location.pack_hash().MakePath(1, 2) +
+                                 FilePackLocation::kCasSuffix;
+        if (!Exists(pack_path)) {
+          LogCvmfs(kLogCvmfs, kLogStderr, "pack %s (%s) missing",
+                   location.pack_hash().ToString().c_str(), full_path.c_str());
+          retval = false;
+        }
+      }
+    }
+
     // Add hardlinks to counting map
     if ((entries[i].linkcount() > 1) && !entries[i].IsDirectory()) {
       if (entries[i].hardlink_group() == 0) {
@@ -561,10 +591,13 @@ bool CommandCheck::InspectTree(const string &path,
 int CommandCheck::Main(const swissknife::ArgumentList &args) {
   string tag_name;
   check_chunks = false;
+  bool use_cas_index = false;
   if (args.find('t') != args.end())
     tag_name = *args.find('t')->second;
   if (args.find('c') != args.end())
     check_chunks = true;
+  if (args.find('i') != args.end())
+    use_cas_index = true;
   if (args.find('l') != args.end()) {
     unsigned log_level =
       1 << (kLogLevel0 + String2Uint64(*args.find('l')->second));
@@ -583,6 +616,7 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
   } else {
     remote_repository = NULL;
   }
+  cas_index = NULL;
 
   // Load Manifest
   // TODO: Do this using Manifest::Fetch() in the future
@@ -593,6 +627,15 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
                repository.c_str());
       return 1;
     }
+    if (use_cas_index) {
+      cas_index = new upload::CasIndex(".");
+      if (!cas_index->Open()) {
+        LogCvmfs(kLogCvmfs, kLogStderr, "no object index in %s, "
+                 "run 'cvmfs_swissknife casindex' first", repository.c_str());
+        delete cas_index;
+        return 1;
+      }
+    }
     manifest = manifest::Manifest::LoadFile(".cvmfspublished");
   } else {
     const string url = repository + "/.cvmfspublished";
@@ -674,5 +717,6 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
   bool retval = InspectTree("", root_hash, root_size, NULL, &computed_counters);
 
   delete manifest;
+  delete cas_index;
   return retval ? 0 : 1;
 }
@@ -33,6 +33,8 @@ class CommandCheck : public Command {
     result.push_back(Parameter('l', "log level (0-4, default: 2)", true, false));
     result.push_back(Parameter('c', "check availability of data chunks",
                                true, true));
+    result.push_back(Parameter('i', "look up data chunks in the object index "
+                               "of a local repository", true, true));
     return result;
   }
   int Main(const ArgumentList &args);
@@ -0,0 +1,214 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * This command lists the changes between two revisions of a repository.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "swissknife_diff.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "catalog_diff.h"
+#include "compression.h"
+#include "download.h"
+#include "logging.h"
+#include "manifest.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+using namespace swissknife;  // NOLINT
+
+namespace {
+
+catalog::Catalog *LoadCatalog(const string &repository, const bool is_remote,
+                              const string &temp_dir,
+                              const PathString &mountpoint,
+                              const shash::Any &catalog_hash)
+{
+  const string tmp_path = CreateTempPath(temp_dir + "/catalog", 0600);
+  if (tmp_path.empty())
+    return NULL;
+  const string source = "data" + catalog_hash.MakePath(1, 2) + "C";
+  bool retval;
+  if (is_remote) {
+    const string url = repository + "/" + source;
+    download::JobInfo download_catalog(&url, true, false, &tmp_path,
+                                       &catalog_hash);
+    retval = g_download_manager->Fetch(&download_catalog) == download::kFailOk;
+  } else {
+    retval = zlib::DecompressPath2Path(repository + "/" + source, tmp_path);
+  }
+
+  catalog::Catalog *catalog = NULL;
+  if (retval) {
+    catalog = catalog::Catalog::AttachFreely(mountpoint.ToString(), tmp_path,
+                                             catalog_hash);
+  }
+  unlink(tmp_path.c_str());
+  return catalog;
+}
+
+
+/**
+ * Loads the catalogs from a local repository or via HTTP and prints the
+ * changes.
+ */
+class RepositoryDiff : public catalog::CatalogDiff {
+ public:
+  RepositoryDiff(const string &repository, const bool is_remote,
+                 const string &temp_dir, const bool quiet)
+    : repository_(repository), is_remote_(is_remote), temp_dir_(temp_dir),
+      quiet_(quiet) { }
+
+ protected:
+  catalog::Catalog *LoadCatalog(const PathString &mountpoint,
+                                const shash::Any &catalog_hash)
+  {
+    return ::LoadCatalog(repository_, is_remote_, temp_dir_, mountpoint,
+                         catalog_hash);
+  }
+
+  void OnAdd(const PathString &path, const catalog::DirectoryEntry &entry) {
+    if (!quiet_)
+      LogCvmfs(kLogCvmfs, kLogStdout, "+ %s", PrintPath(path).c_str());
+  }
+
+  void OnRemove(const PathString &path, const catalog::DirectoryEntry &entry) {
+    if (!quiet_)
+      LogCvmfs(kLogCvmfs, kLogStdout, "- %s", PrintPath(path).c_str());
+  }
+
+  void OnModify(const PathString &path,
+                const catalog::DirectoryEntry &old_entry,
+                const catalog::DirectoryEntry &new_entry,
+                const catalog::DirectoryEntryBase::Differences diff)
+  {
+    if (!quiet_) {
+      LogCvmfs(kLogCvmfs, kLogStdout, "M %s [%s]", PrintPath(path).c_str(),
+               PrintDifferences(diff).c_str());
+    }
+  }
+
+ private:
+  static string PrintPath(const PathString &path) {
+    return path.IsEmpty() ? "/" : path.ToString();
+  }
+
+  static string PrintDifferences(
+    const catalog::DirectoryEntryBase::Differences diff)
+  {
+    typedef catalog::DirectoryEntryBase::Difference Difference;
+    string result;
+    if (diff & Difference::kName)          result += ",name";
+    if (diff & Difference::kLinkcount)     result += ",linkcount";
+    if (diff & Difference::kSize)          result += ",size";
+    if (diff & Difference::kMode)          result += ",mode";
+    if (diff & Difference::kMtime)         result += ",mtime";
+    if (diff & Difference::kSymlink)       result += ",symlink";
+    if (diff & Difference::kChecksum)      result += ",content";
+    if (diff & Difference::kHardlinkGroup) result += ",hardlinks";
+    if (diff & Difference::kNestedCatalogTransitionFlags)
+      result += ",nested catalog";
+    if (diff & Difference::kChunkedFileFlag) result += ",chunked";
+    if (diff & Difference::kPackedFileFlag) result += ",packed";
+    return result.empty() ? result : result.substr(1);
+  }
+
+  const string repository_;
+  const bool is_remote_;
+  const string temp_dir_;
+  const bool quiet_;
+};
+
+
+manifest::Manifest *LoadManifest(const string &repository,
+                                 const bool is_remote)
+{
+  if (!is_remote)
+    return manifest::Manifest::LoadFile(repository + "/.cvmfspublished");
+
+  const string url = repository + "/.cvmfspublished";
+  download::JobInfo download_manifest(&url, false, false, NULL);
+  if (g_download_manager->Fetch(&download_manifest) != download::kFailOk)
+    return NULL;
+  manifest::Manifest *manifest = manifest::Manifest::LoadMem(
+    reinterpret_cast<const unsigned char *>(
+      download_manifest.destination_mem.data),
+    download_manifest.destination_mem.size);
+  free(download_manifest.destination_mem.data);
+  return manifest;
+}
+
+}  // anonymous namespace
+
+
+int CommandDiff::Main(const swissknife::ArgumentList &args) {
+  const string repository = MakeCanonicalPath(*args.find('r')->second);
+  const bool is_remote = repository.substr(0, 7) == "http://";
+  const string temp_dir = (args.find('x') != args.end()) ?
+                          *args.find('x')->second : "/tmp";
+  const bool quiet = args.find('q') != args.end();
+  if (is_remote)
+    g_download_manager->Init(1, true);
+
+  shash::Any new_root_hash(shash::kSha1);
+  shash::Any old_root_hash(shash::kSha1);
+  if (args.find('d') != args.end()) {
+    new_root_hash =
+      shash::Any(shash::kSha1, shash::HexPtr(*args.find('d')->second));
+  } else {
+    manifest::Manifest *manifest = LoadManifest(repository, is_remote);
+    if (manifest == NULL) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to load repository manifest");
+      return 1;
+    }
+    new_root_hash = manifest->catalog_hash();
+    delete manifest;
+  }
+
+  if (args.find('s') != args.end()) {
+    old_root_hash =
+      shash::Any(shash::kSha1, shash::HexPtr(*args.find('s')->second));
+  } else {
+    // Use the previous revision of the new root catalog
+    catalog::Catalog *root_catalog = LoadCatalog(
+      repository, is_remote, temp_dir, PathString("", 0), new_root_hash);
+    if (root_catalog == NULL) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to load root catalog %s",
+               new_root_hash.ToString().c_str());
+      return 1;
+    }
+    old_root_hash = root_catalog->GetPreviousRevision();
+    delete root_catalog;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogStderr, "comparing %s to %s",
+           old_root_hash.ToString().c_str(), new_root_hash.ToString().c_str());
+  RepositoryDiff diff(repository, is_remote, temp_dir, quiet);
+  StopWatch watch;
+  watch.Start();
+  const bool retval = diff.Run("", old_root_hash, new_root_hash);
+  watch.Stop();
+  if (!retval) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to compare revisions");
+    return 1;
+  }
+
+  const catalog::CatalogDiff::Statistics &statistics = diff.statistics();
+  LogCvmfs(kLogCvmfs, kLogStderr,
+           "%"PRIu64" added, %"PRIu64" removed, %"PRIu64" modified entries "
+           "(%"PRIu64" catalogs loaded, %"PRIu64" unchanged catalogs skipped, "
+           "%"PRIu64" entries compared in %.2f s)",
+           statistics.num_added, statistics.num_removed,
+           statistics.num_modified, statistics.num_catalogs_loaded,
+           statistics.num_catalogs_skipped, statistics.num_entries_compared,
+           watch.GetTime());
+  return 0;
+}
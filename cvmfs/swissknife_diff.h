@@ -0,0 +1,39 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_SWISSKNIFE_DIFF_H_
+#define CVMFS_SWISSKNIFE_DIFF_H_
+
+#include "swissknife.h"
+
+namespace swissknife {
+
+class CommandDiff : public Command {
+ public:
+  ~CommandDiff() { };
+  std::string GetName() { return "diff"; };
+  std::string GetDescription() {
+    return "CernVM File System repository diff\n"
+      "Lists the added (+), removed (-) and modified (M) entries between two "
+      "revisions of a repository.";
+  };
+  ParameterList GetParams() {
+    ParameterList result;
+    result.push_back(Parameter('r', "repository directory / url",
+                               false, false));
+    result.push_back(Parameter('s', "root catalog hash of the old revision "
+                               "(default: previous revision)", true, false));
+    result.push_back(Parameter('d', "root catalog hash of the new revision "
+                               "(default: current revision)", true, false));
+    result.push_back(Parameter('x', "directory for temporary files "
+                               "(default: /tmp)", true, false));
+    result.push_back(Parameter('q', "only print the summary", true, true));
+    return result;
+  }
+  int Main(const ArgumentList &args);
+};
+
+}  // namespace swissknife
+
+#endif  // CVMFS_SWISSKNIFE_DIFF_H_
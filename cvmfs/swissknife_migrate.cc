@@ -22,9 +22,12 @@ CommandMigrate::CommandMigrate() :
   catalog_count_(0),
   uid_(0),
   gid_(0),
-  root_catalog_(NULL)
+  root_catalog_(NULL),
+  total_catalog_bytes_(0)
 {
   atomic_init32(&catalogs_processed_);
+  atomic_init64(&processed_catalog_bytes_);
+  memset(&migration_start_, 0, sizeof(migration_start_));
 }
 
 
@@ -223,15 +226,31 @@ bool CommandMigrate::DoMigrationAndCommit(
   concurrent_migration.RegisterListener(&CommandMigrate::MigrationCallback,
                                          this);
 
-  // Migrate catalogs recursively (starting with the deepest nested catalogs)
+  // Migrate catalogs bottom-up: leaf catalogs start immediately, their parents
+  // as soon as all nested catalogs are migrated and uploaded
   LogCvmfs(kLogCatalog, kLogStdout, "\nMigrating catalogs...");
   PendingCatalog *root_catalog = new PendingCatalog(root_catalog_);
+  ready_catalogs_ = new FifoChannel<PendingCatalog *>(catalog_count_,
+                                                      catalog_count_);
   migration_stopwatch_.Start();
-  ConvertCatalogsRecursively(root_catalog, concurrent_migration);
+  gettimeofday(&migration_start_, NULL);
+  BuildCatalogGraph(root_catalog);
+  ScheduleReadyCatalogs(root_catalog, concurrent_migration);
+  root_catalog->new_catalog_hash.Get();
   concurrent_migration.WaitForEmptyQueue();
   spooler_->WaitForUpload();
   migration_stopwatch_.Stop();
 
+  const double migration_time = migration_stopwatch_.GetTime();
+  LogCvmfs(kLogCatalog, kLogStdout,
+           "Migrated %d catalogs (%.1f MB) in %.1fs (%.1f catalogs/s, "
+           "%.1f MB/s)",
+           catalog_count_, total_catalog_bytes_ / (1024.0 * 1024.0),
+           migration_time,
+           (migration_time > 0.0) ? catalog_count_ / migration_time : 0.0,
+           (migration_time > 0.0) ?
+             total_catalog_bytes_ / (1024.0 * 1024.0) / migration_time : 0.0);
+
   // check for possible errors during the migration process
   const unsigned int errors = concurrent_migration.GetNumberOfFailedJobs() +
                               spooler_->GetNumberOfErrors();
@@ -363,39 +382,105 @@ void CommandMigrate::UploadCallback(const upload::SpoolerResult &result) {
       pending_catalogs_.erase(i);
     }
 
-    atomic_inc32(&catalogs_processed_);
-    const unsigned int processed = (atomic_read32(&catalogs_processed_) * 100) /
-                                    catalog_count_;
-    LogCvmfs(kLogCatalog, kLogStdout, "[%d%%] migrated and uploaded %sC %s",
-             processed,
-             result.content_hash.ToString().c_str(),
-             catalog->root_path().c_str());
+    PrintProgress(catalog, result.content_hash);
 
-    // The catalog is completely processed... fill the hash-future to allow the
-    // processing of parent catalogs
+    // The catalog is completely processed... fill the hash-future and schedule
+    // the parent catalog if this was its last missing nested catalog
     // NOTE: From now on, this PendingCatalog structure could be deleted and
     //       should not be used anymore!
-    catalog->new_catalog_hash.Set(result.content_hash);
+    CatalogFinished(catalog, result.content_hash);
   }
 }
 
 
-template <class MigratorT>
-void CommandMigrate::ConvertCatalogsRecursively(PendingCatalog *catalog,
-                                                MigratorT       &migrator) {
-  // First migrate all nested catalogs (depth first traversal)
+void CommandMigrate::PrintProgress(const PendingCatalog *catalog,
+                                   const shash::Any     &new_catalog_hash)
+{
+  const int32_t processed_catalogs = atomic_xadd32(&catalogs_processed_, 1) + 1;
+  const int64_t processed_bytes =
+    atomic_xadd64(&processed_catalog_bytes_, catalog->old_catalog_size) +
+    catalog->old_catalog_size;
+
+  // The migration time is roughly proportional to the catalog size, the ETA
+  // is extrapolated from the bytes processed so far
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const double elapsed = DiffTimeSeconds(migration_start_, now);
+  const double bytes_per_second = (elapsed > 0.0)
+                                  ? processed_bytes / elapsed : 0.0;
+  const double eta = (bytes_per_second > 0.0)
+    ? (total_catalog_bytes_ - processed_bytes) / bytes_per_second : 0.0;
+
+  LogCvmfs(kLogCatalog, kLogStdout,
+           "[%d%%] migrated and uploaded %sC %s "
+           "(%.1f catalogs/s, %.1f MB/s, ETA %.0fs)",
+           (processed_catalogs * 100) / catalog_count_,
+           new_catalog_hash.ToString().c_str(),
+           catalog->root_path().c_str(),
+           (elapsed > 0.0) ? processed_catalogs / elapsed : 0.0,
+           bytes_per_second / (1024.0 * 1024.0),
+           eta);
+}
+
+
+/**
+ * Publishes the new hash of an uploaded catalog and hands its parent over to
+ * the migration workers once all of the parent's nested catalogs are done.
+ */
+void CommandMigrate::CatalogFinished(PendingCatalog   *catalog,
+                                     const shash::Any &new_catalog_hash)
+{
+  PendingCatalog *parent = catalog->parent;
+  catalog->new_catalog_hash.Set(new_catalog_hash);
+  if ((parent != NULL) &&
+      (atomic_xadd32(&parent->unfinished_nested_catalogs, -1) == 1))
+  {
+    ready_catalogs_->Enqueue(parent);
+  }
+}
+
+
+/**
+ * Creates the PendingCatalog tree for the loaded catalogs.  Catalogs without
+ * nested catalogs are ready for migration right away.
+ */
+void CommandMigrate::BuildCatalogGraph(PendingCatalog *catalog) {
+  const int64_t old_catalog_size =
+    GetFileSize(catalog->old_catalog->database_path());
+  catalog->old_catalog_size = (old_catalog_size > 0) ? old_catalog_size : 0;
+  total_catalog_bytes_ += catalog->old_catalog_size;
+
   const CatalogList nested_catalogs = catalog->old_catalog->GetChildren();
   CatalogList::const_iterator i    = nested_catalogs.begin();
   CatalogList::const_iterator iend = nested_catalogs.end();
   catalog->nested_catalogs.reserve(nested_catalogs.size());
+  atomic_write32(&catalog->unfinished_nested_catalogs, nested_catalogs.size());
   for (; i != iend; ++i) {
-    PendingCatalog *new_nested = new PendingCatalog(*i);
+    PendingCatalog *new_nested = new PendingCatalog(*i, catalog);
     catalog->nested_catalogs.push_back(new_nested);
-    ConvertCatalogsRecursively(new_nested, migrator);
+    BuildCatalogGraph(new_nested);
   }
 
-  // Migrate this catalog referencing all its (already migrated) children
-  migrator.Schedule(catalog);
+  if (nested_catalogs.empty())
+    ready_catalogs_->Enqueue(catalog);
+}
+
+
+/**
+ * Feeds the ready catalogs into the migration workers.  Since a catalog is
+ * only scheduled after all of its nested catalogs were uploaded, no worker
+ * ever blocks on the results of another catalog and the uploads overlap with
+ * the migration of the next catalogs.  The root catalog is the last one.
+ */
+template <class MigratorT>
+void CommandMigrate::ScheduleReadyCatalogs(PendingCatalog *root_catalog,
+                                           MigratorT      &migrator)
+{
+  PendingCatalog *catalog;
+  do {
+    catalog = ready_catalogs_->Dequeue();
+    migrator.Schedule(catalog);
+  } while (catalog != root_catalog);
 }
 
 
@@ -534,7 +619,7 @@ bool CommandMigrate::AbstractMigrationWorker<DerivedT>::UpdateNestedCatalogRefer
 
   // go through all nested catalogs and update their references (we are curently
   // in their parent catalog)
-  // Note: we might need to wait for the nested catalog to be fully processed.
+  // Note: nested catalogs are fully processed before their parent is scheduled
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
   for (; i != iend; ++i) {
@@ -1018,8 +1103,8 @@ bool CommandMigrate::MigrationWorker_20x::MigrateNestedCatalogMountPoints(
     "WHERE md5path_1 = :md5_1 AND md5path_2 = :md5_2;"
   );
 
-  // update all nested catalog mountpoints (Note: we might need to wait for the
-  //                                              nested catalog to be processed)
+  // update all nested catalog mountpoints (Note: the nested catalogs are
+  //                                              already processed)
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
   for (; i != iend; ++i) {
@@ -1065,7 +1150,7 @@ bool CommandMigrate::MigrationWorker_20x::FixNestedCatalogTransitionPoints(
   SqlLookupPathHash lookup_mountpoint(writable);
   SqlDirentUpdate   update_directory_entry(writable);
 
-  // Unbox the nested catalogs (possibly waiting for migration of them first)
+  // Unbox the nested catalogs (they are already migrated)
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
   for (; i != iend; ++i) {
@@ -1205,7 +1290,7 @@ bool CommandMigrate::MigrationWorker_20x::GenerateCatalogStatistics(
   const Database &writable = data->new_catalog->database();
 
   // Aggregated the statistics counters of all nested catalogs
-  // Note: we might need to wait until nested catalogs are sucessfully processed
+  // Note: nested catalogs are already sucessfully processed
   DeltaCounters stats_counters;
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
@@ -1383,7 +1468,7 @@ bool CommandMigrate::MigrationWorker_217::GenerateNewStatisticsCounters
   const Database &writable = GetWritable(data->old_catalog)->database();
 
   // Aggregated the statistics counters of all nested catalogs
-  // Note: we might need to wait until nested catalogs are sucessfully processed
+  // Note: nested catalogs are already sucessfully processed
   DeltaCounters stats_counters;
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
@@ -7,6 +7,8 @@
 
 #include "swissknife.h"
 
+#include <sys/time.h>
+
 #include <map>
 #include <vector>
 #include <string>
@@ -55,10 +57,16 @@ class CommandMigrate : public Command {
   struct PendingCatalog;
   typedef std::vector<PendingCatalog *> PendingCatalogList;
   struct PendingCatalog {
-    PendingCatalog(const catalog::Catalog *old_catalog = NULL) :
+    PendingCatalog(const catalog::Catalog *old_catalog = NULL,
+                   PendingCatalog         *parent      = NULL) :
       success(false),
       old_catalog(old_catalog),
-      new_catalog(NULL) {}
+      new_catalog(NULL),
+      parent(parent),
+      old_catalog_size(0)
+    {
+      atomic_init32(&unfinished_nested_catalogs);
+    }
     virtual ~PendingCatalog();
 
     inline const std::string root_path() const {
@@ -73,6 +81,13 @@ class CommandMigrate : public Command {
     catalog::WritableCatalog         *new_catalog;
 
     PendingCatalogList                nested_catalogs;
+    PendingCatalog                   *parent;
+    /**
+     * Number of nested catalogs that are not yet migrated and uploaded.  The
+     * catalog is ready for migration when this drops to zero.
+     */
+    atomic_int32                      unfinished_nested_catalogs;
+    uint64_t                          old_catalog_size;
     Future<catalog::DirectoryEntry>   root_entry;
     Future<catalog::DeltaCounters>    nested_statistics;
 
@@ -215,8 +230,13 @@ class CommandMigrate : public Command {
   bool DoMigrationAndCommit(typename MigratorT::worker_context  &context,
                             const std::string                   &manifest_path);
 
+  void BuildCatalogGraph(PendingCatalog *catalog);
   template <class MigratorT>
-  void ConvertCatalogsRecursively(PendingCatalog *catalog, MigratorT &migrator);
+  void ScheduleReadyCatalogs(PendingCatalog *root_catalog, MigratorT &migrator);
+  void CatalogFinished(PendingCatalog   *catalog,
+                       const shash::Any &new_catalog_hash);
+  void PrintProgress(const PendingCatalog *catalog,
+                     const shash::Any     &new_catalog_hash);
   bool RaiseFileDescriptorLimit() const;
   bool ConfigureSQLite() const;
   void AnalyzeCatalogStatistics() const;
@@ -240,6 +260,16 @@ class CommandMigrate : public Command {
   catalog::Catalog const*                        root_catalog_;
   UniquePtr<upload::Spooler>                     spooler_;
   PendingCatalogMap                              pending_catalogs_;
+  /**
+   * Catalogs whose nested catalogs are all migrated and uploaded.  Filled by
+   * the upload callback, drained into the migration workers by the main
+   * thread.
+   */
+  UniquePtr<FifoChannel<PendingCatalog *> >      ready_catalogs_;
+
+  uint64_t               total_catalog_bytes_;
+  atomic_int64           processed_catalog_bytes_;
+  struct timeval         migration_start_;
 
   StopWatch  catalog_loading_stopwatch_;
   StopWatch  migration_stopwatch_;
@@ -6,9 +6,14 @@
 
 #include "swissknife_scrub.h"
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "logging.h"
 #include "smalloc.h"
 
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <sstream>
 
 using namespace swissknife;
@@ -16,6 +21,129 @@ using namespace swissknife;
 const size_t      kHashSubtreeLength = 2;
 const size_t      kHashStringLength  = 40;
 const std::string kTxnDirectoryName  = "txn";
+const unsigned    kDefaultScanThreads = 4;
+
+
+ScrubDatabase::~ScrubDatabase() {
+  if (sqlite_db_ == NULL)
+    return;
+  Checkpoint();
+  delete sql_lookup_;
+  delete sql_insert_;
+  sqlite3_close(sqlite_db_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+bool ScrubDatabase::Open(const std::string &filename) {
+  const int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  if (sqlite3_open_v2(filename.c_str(), &sqlite_db_, flags, NULL) != SQLITE_OK)
+  {
+    LogCvmfs(kLogUtility, kLogStderr, "failed to open scrub database %s",
+             filename.c_str());
+    sqlite3_close(sqlite_db_);
+    sqlite_db_ = NULL;
+    return false;
+  }
+
+  const bool retval =
+    Execute("CREATE TABLE IF NOT EXISTS verified (object TEXT, "
+            "  timestamp INTEGER, "
+            "  CONSTRAINT pk_verified PRIMARY KEY (object));") &&
+    Execute("CREATE TABLE IF NOT EXISTS properties (key TEXT, value TEXT, "
+            "  CONSTRAINT pk_properties PRIMARY KEY (key));") &&
+    Execute("PRAGMA synchronous=NORMAL;");
+  if (!retval) {
+    LogCvmfs(kLogUtility, kLogStderr, "failed to initialize scrub database "
+             "%s (%s)", filename.c_str(), sqlite3_errmsg(sqlite_db_));
+    return false;
+  }
+
+  sql_lookup_ = new sqlite::Sql(sqlite_db_,
+    "SELECT timestamp FROM verified WHERE object = :object;");
+  sql_insert_ = new sqlite::Sql(sqlite_db_,
+    "INSERT OR REPLACE INTO verified (object, timestamp) "
+    "VALUES (:object, :timestamp);");
+  return true;
+}
+
+
+bool ScrubDatabase::Execute(const std::string &statement) {
+  return sqlite::Sql(sqlite_db_, statement).Execute();
+}
+
+
+bool ScrubDatabase::SetProperty(const std::string &key,
+                                const std::string &value)
+{
+  sqlite::Sql sql(sqlite_db_,
+    "INSERT OR REPLACE INTO properties (key, value) VALUES (:key, :value);");
+  return sql.BindText(1, key) && sql.BindText(2, value) && sql.Execute();
+}
+
+
+time_t ScrubDatabase::GetUnfinishedRun() {
+  sqlite::Sql sql(sqlite_db_,
+    "SELECT value FROM properties WHERE key = 'run_started';");
+  if (!sql.FetchRow())
+    return 0;
+  return String2Uint64(reinterpret_cast<const char *>(sql.RetrieveText(0)));
+}
+
+
+bool ScrubDatabase::BeginRun(const time_t timestamp) {
+  return SetProperty("run_started", StringifyInt(timestamp));
+}
+
+
+bool ScrubDatabase::FinishRun() {
+  return Checkpoint() &&
+         Execute("DELETE FROM properties WHERE key = 'run_started';");
+}
+
+
+time_t ScrubDatabase::GetVerificationTime(const std::string &object) {
+  MutexLockGuard guard(lock_);
+  const time_t result =
+    (sql_lookup_->BindText(1, object) && sql_lookup_->FetchRow())
+    ? sql_lookup_->RetrieveInt64(0) : 0;
+  sql_lookup_->Reset();
+  return result;
+}
+
+
+bool ScrubDatabase::SetVerified(const std::string &object,
+                                const time_t timestamp)
+{
+  MutexLockGuard guard(lock_);
+  if ((pending_records_ == 0) && !Execute("BEGIN;"))
+    return false;
+  const bool retval = sql_insert_->BindText(1, object) &&
+                      sql_insert_->BindInt64(2, timestamp) &&
+                      sql_insert_->Execute();
+  sql_insert_->Reset();
+  if (++pending_records_ >= kCheckpointInterval)
+    return CommitPending() && retval;
+  return retval;
+}
+
+
+/**
+ * Commits the pending verification records.
+ */
+bool ScrubDatabase::Checkpoint() {
+  MutexLockGuard guard(lock_);
+  return CommitPending();
+}
+
+
+bool ScrubDatabase::CommitPending() {
+  if (pending_records_ == 0)
+    return true;
+  pending_records_ = 0;
+  return Execute("COMMIT;");
+}
+
 
 CommandScrub::StoredFile::StoredFile(const std::string &path,
                                      const std::string &expected_hash) :
@@ -63,7 +191,16 @@ tbb::task* CommandScrub::StoredFileScrubbingTask::execute() {
 swissknife::ParameterList CommandScrub::GetParams() {
   swissknife::ParameterList result;
   result.push_back(Parameter('r', "repository directory", false, false));
-  // to be extended...
+  result.push_back(Parameter('t', "number of directory scanning threads "
+                                  "(default: 4)", true, false));
+  result.push_back(Parameter('n', "number of I/O threads (default: 8)",
+                             true, false));
+  result.push_back(Parameter('b', "I/O bandwidth limit in MB/s", true, false));
+  result.push_back(Parameter('d', "scrub database for checkpoints and "
+                                  "verification times", true, false));
+  result.push_back(Parameter('a', "skip objects verified within the last N "
+                                  "days (requires -d)", true, false));
+  result.push_back(Parameter('o', "report file (tab separated)", true, false));
   return result;
 }
 
@@ -91,8 +228,41 @@ void CommandScrub::FileCallback(const std::string &relative_path,
     return;
   }
 
+  if (database_ != NULL) {
+    const time_t verified =
+      database_->GetVerificationTime(relative_path + "/" + file_name);
+    if ((verified > 0) && (verified >= skip_verified_since_)) {
+      atomic_inc64(&skipped_objects_);
+      return;
+    }
+  }
+
   assert (reader_ != NULL);
-  reader_->ScheduleRead(new StoredFile(full_path, hash_string));
+  StoredFile *file = new StoredFile(full_path, hash_string);
+  Throttle(file->size());
+  reader_->ScheduleRead(file);
+}
+
+
+/**
+ * Paces the scheduling of reads to the bandwidth limit.  Budget unused during
+ * slow phases is carried over for at most one second.
+ */
+void CommandScrub::Throttle(const uint64_t bytes) {
+  if (bandwidth_limit_ == 0)
+    return;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const double elapsed = DiffTimeSeconds(start_time_, now);
+  const double carry_over_limit = (elapsed - 1.0) * bandwidth_limit_;
+  if (throttled_bytes_ < carry_over_limit)
+    throttled_bytes_ = static_cast<uint64_t>(carry_over_limit);
+  throttled_bytes_ += bytes;
+
+  const double due = static_cast<double>(throttled_bytes_) / bandwidth_limit_;
+  if (due > elapsed)
+    SafeSleepMs(static_cast<unsigned>((due - elapsed) * 1000));
 }
 
 
@@ -124,12 +294,25 @@ void CommandScrub::SymlinkCallback(const std::string &relative_path,
 
 
 void CommandScrub::FileProcessedCallback(StoredFile* const& file) {
+  atomic_inc64(&checked_objects_);
+  atomic_xadd64(&checked_bytes_, file->size());
+
   if (file->content_hash() != file->expected_hash()) {
+    atomic_inc64(&corrupted_objects_);
     std::stringstream ss;
     ss << "mismatch of file name and content hash: "
        << file->content_hash().ToString();
-    PrintWarning(ss.str(), file->path());
+    PrintWarning(ss.str(), file->path(), "corrupted");
+  } else if (database_ != NULL) {
+    // Corrupted objects are never recorded, they are checked again next time
+    const std::string object = file->path().substr(repo_path_.length() + 1);
+    if (!database_->SetVerified(object, time(NULL))) {
+      LogCvmfs(kLogUtility, kLogStderr, "failed to record verification of %s",
+               object.c_str());
+    }
   }
+
+  delete file;
 }
 
 
@@ -147,6 +330,8 @@ std::string CommandScrub::CheckPathAndExtractHash(
       last_character != 'H' && // history
       last_character != 'C' && // catalog
       last_character != 'P' && // partial
+      last_character != 'B' && // bundle
+      last_character != 'K' && // pack
       last_character != 'X' && // certificate
       last_character != 'L')   // micro catalogs (currently only reserved)
   {
@@ -207,20 +392,71 @@ bool CommandScrub::CheckHashString(const std::string &hash_string,
 
 int CommandScrub::Main(const swissknife::ArgumentList &args) {
   repo_path_ = *args.find('r')->second;
+  const unsigned scan_threads = (args.count('t') > 0) ?
+    String2Uint64(*args.find('t')->second) : kDefaultScanThreads;
+  const unsigned io_threads = (args.count('n') > 0) ?
+    String2Uint64(*args.find('n')->second) : ScrubbingReader::kDefaultIoThreads;
+  if (args.count('b') > 0)
+    bandwidth_limit_ = String2Uint64(*args.find('b')->second) * 1024 * 1024;
+  if ((args.count('a') > 0) && (args.count('d') == 0)) {
+    LogCvmfs(kLogUtility, kLogStderr, "-a requires a scrub database (-d)");
+    return 1;
+  }
 
   // initialize warning printer mutex
   const bool mutex_init = (pthread_mutex_init(&warning_mutex_, NULL) == 0);
   assert (mutex_init);
 
+  gettimeofday(&start_time_, NULL);
+  const time_t now = start_time_.tv_sec;
+
+  if (args.count('d') > 0) {
+    database_ = new ScrubDatabase();
+    if (!database_->Open(*args.find('d')->second))
+      return 1;
+    const time_t unfinished_run = database_->GetUnfinishedRun();
+    if (unfinished_run > 0) {
+      LogCvmfs(kLogUtility, kLogStdout, "resuming scrub run started %s",
+               StringifyTime(unfinished_run, false).c_str());
+      skip_verified_since_ = unfinished_run;
+    } else {
+      // objects verified within the same second are checked again
+      skip_verified_since_ = now + 1;
+      if (!database_->BeginRun(now))
+        return 1;
+    }
+    if (args.count('a') > 0) {
+      const time_t max_age = String2Uint64(*args.find('a')->second) * 86400;
+      skip_verified_since_ = std::min(skip_verified_since_, now - max_age);
+    }
+  }
+
+  if (args.count('o') > 0) {
+    const std::string &report_path = *args.find('o')->second;
+    report_ = fopen(report_path.c_str(), "w");
+    if (report_ == NULL) {
+      LogCvmfs(kLogUtility, kLogStderr, "failed to open report file %s",
+               report_path.c_str());
+      return 1;
+    }
+    fprintf(report_, "# cvmfs scrub report of %s, started %s\n",
+            repo_path_.c_str(), StringifyTime(now, true).c_str());
+    fprintf(report_, "# kind\tpath\tdetail\n");
+  }
+
   // initialize asynchronous reader
   const size_t       max_buffer_size     = 512 * 1024;
   const unsigned int max_files_in_flight = 100;
-  reader_ = new ScrubbingReader(max_buffer_size, max_files_in_flight);
+  reader_ = new ScrubbingReader(
+    max_buffer_size, max_files_in_flight,
+    tbb::task_scheduler_init::default_num_threads() + 1, io_threads);
   reader_->RegisterListener(&CommandScrub::FileProcessedCallback, this);
   reader_->Initialize();
 
-  // initialize file system recursion engine
-  FileSystemTraversal<CommandScrub> traverser(this, repo_path_, true);
+  // initialize file system recursion engine, directories are read ahead by
+  // the scanning threads
+  ParallelFileSystemTraversal<CommandScrub>
+    traverser(this, repo_path_, true, scan_threads);
   traverser.fn_new_file    = &CommandScrub::FileCallback;
   traverser.fn_enter_dir   = &CommandScrub::DirCallback;
   traverser.fn_new_symlink = &CommandScrub::SymlinkCallback;
@@ -230,14 +466,53 @@ int CommandScrub::Main(const swissknife::ArgumentList &args) {
   reader_->Wait();
   reader_->TearDown();
 
+  if ((database_ != NULL) && !database_->FinishRun()) {
+    LogCvmfs(kLogUtility, kLogStderr, "failed to finish scrub database");
+    return 1;
+  }
+  PrintSummary();
+
   return (warnings_ == 0) ? 0 : 1;
 }
 
 
+void CommandScrub::PrintSummary() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const double duration = DiffTimeSeconds(start_time_, now);
+  const int64_t checked_objects = atomic_read64(&checked_objects_);
+  const int64_t checked_bytes = atomic_read64(&checked_bytes_);
+  const int64_t skipped_objects = atomic_read64(&skipped_objects_);
+  const int64_t corrupted_objects = atomic_read64(&corrupted_objects_);
+
+  LogCvmfs(kLogUtility, kLogStdout,
+           "checked %"PRId64" objects (%.1f MB, %.1f MB/s), "
+           "skipped %"PRId64" recently verified objects, "
+           "found %"PRId64" corrupted objects and %u problems in %.1fs",
+           checked_objects, checked_bytes / (1024.0 * 1024.0),
+           (duration > 0.0) ? checked_bytes / (1024.0 * 1024.0) / duration : 0.0,
+           skipped_objects, corrupted_objects, warnings_, duration);
+
+  if (report_ != NULL) {
+    fprintf(report_, "summary\tchecked_objects\t%"PRId64"\n"
+                     "summary\tchecked_bytes\t%"PRId64"\n"
+                     "summary\tskipped_objects\t%"PRId64"\n"
+                     "summary\tcorrupted_objects\t%"PRId64"\n"
+                     "summary\tproblems\t%u\n"
+                     "summary\tduration_seconds\t%.1f\n",
+            checked_objects, checked_bytes, skipped_objects,
+            corrupted_objects, warnings_, duration);
+  }
+}
+
+
 void CommandScrub::PrintWarning(const std::string &msg,
-                                const std::string &path) const {
+                                const std::string &path,
+                                const std::string &kind) const {
   MutexLockGuard l(warning_mutex_);
   LogCvmfs(kLogUtility, kLogStderr, "%s | at: %s", msg.c_str(), path.c_str());
+  if (report_ != NULL)
+    fprintf(report_, "%s\t%s\t%s\n", kind.c_str(), path.c_str(), msg.c_str());
   ++warnings_;
 }
 
@@ -247,6 +522,9 @@ CommandScrub::~CommandScrub() {
     delete reader_;
     reader_ = NULL;
   }
+  delete database_;
+  if (report_ != NULL)
+    fclose(report_);
 
   pthread_mutex_destroy(&warning_mutex_);
 }
@@ -7,16 +7,72 @@
 
 #include "swissknife.h"
 
+#include <sys/time.h>
+
 #include <string>
 #include <openssl/sha.h>
 #include <cassert>
+#include <cstdio>
 
+#include "atomic.h"
+#include "duplex_sqlite3.h"
 #include "file_processing/async_reader.h"
 #include "file_processing/file.h"
 #include "hash.h"
+#include "sql.h"
 
 namespace swissknife {
 
+/**
+ * Sidecar database of scrub runs.  It records when each object was last
+ * verified successfully and whether a scrub run is in progress.  An inter-
+ * rupted run is resumed by skipping the objects verified since it started.
+ */
+class ScrubDatabase : SingleCopy {
+ public:
+  /**
+   * Verification records are committed in batches of this size, at most that
+   * many objects are checked again after an interruption.
+   */
+  static const unsigned kCheckpointInterval = 1000;
+
+  ScrubDatabase() : sqlite_db_(NULL), sql_lookup_(NULL), sql_insert_(NULL),
+    pending_records_(0)
+  {
+    const int retval = pthread_mutex_init(&lock_, NULL);
+    assert(retval == 0);
+  }
+  ~ScrubDatabase();
+
+  bool Open(const std::string &filename);
+
+  /**
+   * @return  start time of an interrupted run or 0 if there is none
+   */
+  time_t GetUnfinishedRun();
+  bool BeginRun(const time_t timestamp);
+  bool FinishRun();
+
+  /**
+   * @return  time of the last successful verification or 0 if never
+   */
+  time_t GetVerificationTime(const std::string &object);
+  bool SetVerified(const std::string &object, const time_t timestamp);
+  bool Checkpoint();
+
+ private:
+  bool SetProperty(const std::string &key, const std::string &value);
+  bool Execute(const std::string &statement);
+  bool CommitPending();
+
+  sqlite3     *sqlite_db_;
+  sqlite::Sql *sql_lookup_;
+  sqlite::Sql *sql_insert_;
+  unsigned     pending_records_;
+  pthread_mutex_t lock_;  ///< lookups and records come from different threads
+};
+
+
 class CommandScrub : public Command {
  private:
   class StoredFile : public upload::AbstractFile {
@@ -57,7 +113,15 @@ class CommandScrub : public Command {
   typedef upload::Reader<StoredFileScrubbingTask, StoredFile> ScrubbingReader;
 
  public:
-  CommandScrub() : reader_(NULL), warnings_(0) {}
+  CommandScrub() : reader_(NULL), warnings_(0), database_(NULL),
+    report_(NULL), skip_verified_since_(0), bandwidth_limit_(0),
+    throttled_bytes_(0)
+  {
+    atomic_init64(&checked_objects_);
+    atomic_init64(&checked_bytes_);
+    atomic_init64(&skipped_objects_);
+    atomic_init64(&corrupted_objects_);
+  }
   ~CommandScrub();
   std::string GetName() { return "scrub"; }
   std::string GetDescription() {
@@ -79,7 +143,12 @@ class CommandScrub : public Command {
 
   void FileProcessedCallback(StoredFile* const& file);
 
-  void PrintWarning(const std::string &msg, const std::string &path) const;
+  /**
+   * Logs a problem and adds it to the report.
+   * @param kind  first column of the report line
+   */
+  void PrintWarning(const std::string &msg, const std::string &path,
+                    const std::string &kind = "problem") const;
 
 
  private:
@@ -88,12 +157,27 @@ class CommandScrub : public Command {
                                       const std::string &full_path) const;
   bool CheckHashString(const std::string &hash_string,
                        const std::string &full_path) const;
+  void Throttle(const uint64_t bytes);
+  void PrintSummary();
 
  private:
   std::string              repo_path_;
   ScrubbingReader         *reader_;
   mutable unsigned int     warnings_;
   mutable pthread_mutex_t  warning_mutex_;
+
+  ScrubDatabase           *database_;         ///< optional, see -d
+  FILE                    *report_;           ///< optional, see -o
+  time_t                   skip_verified_since_;
+
+  uint64_t                 bandwidth_limit_;  ///< bytes per second, 0: none
+  uint64_t                 throttled_bytes_;
+  struct timeval           start_time_;
+
+  atomic_int64             checked_objects_;
+  atomic_int64             checked_bytes_;
+  atomic_int64             skipped_objects_;
+  atomic_int64             corrupted_objects_;
 };
 
 }
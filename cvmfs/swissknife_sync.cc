@@ -33,6 +33,8 @@
 #include "sync_union.h"
 #include "sync_mediator.h"
 #include "catalog_mgr_rw.h"
+#include "file_bundle.h"
+#include "file_pack.h"
 #include "util.h"
 #include "logging.h"
 #include "download.h"
@@ -242,6 +244,13 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
   if (args.find('m') != args.end()) params.mucatalogs = true;
   if (args.find('i') != args.end()) params.ignore_xdir_hardlinks = true;
   if (args.find('d') != args.end()) params.stop_for_catalog_tweaks = true;
+  if (args.find('j') != args.end()) {
+    params.num_scan_threads = String2Uint64(*args.find('j')->second);
+    if (params.num_scan_threads == 0) {
+      PrintError("invalid number of directory scanning threads");
+      return 1;
+    }
+  }
   if (args.find('z') != args.end()) {
     unsigned log_level =
     1 << (kLogLevel0 + String2Uint64(*args.find('z')->second));
@@ -260,6 +269,24 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     }
   }
 
+  if (args.find('e') != args.end()) {
+    params.max_bundle_file_size = String2Uint64(*args.find('e')->second);
+    if (params.max_bundle_file_size > FileBundle::kMaxSize / 2) {
+      PrintError("bundled files must not be larger than " +
+                 StringifyInt(FileBundle::kMaxSize / 2) + " bytes");
+      return 2;
+    }
+  }
+
+  if (args.find('k') != args.end()) {
+    params.max_pack_file_size = String2Uint64(*args.find('k')->second);
+    if (params.max_pack_file_size > FilePackLocation::kMaxPackSize / 2) {
+      PrintError("packed files must not be larger than " +
+                 StringifyInt(FilePackLocation::kMaxPackSize / 2) + " bytes");
+      return 2;
+    }
+  }
+
   if (!CheckParams(params)) return 2;
 
   // Start spooler
@@ -296,6 +323,7 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
              params.union_fs_type.c_str());
     return 3;
   }
+  sync->set_num_scan_threads(params.num_scan_threads);
 
   sync->Traverse();
   // TODO: consider using the unique pointer to come in Github Pull Request 46
@@ -19,9 +19,12 @@ struct SyncParameters {
     use_file_chunking(false),
     ignore_xdir_hardlinks(false),
     stop_for_catalog_tweaks(false),
+    num_scan_threads(1),
     min_file_chunk_size(4*1024*1024),
     avg_file_chunk_size(8*1024*1024),
-    max_file_chunk_size(16*1024*1024) {}
+    max_file_chunk_size(16*1024*1024),
+    max_bundle_file_size(0),
+    max_pack_file_size(0) {}
 
   upload::Spooler *spooler;
   std::string      dir_union;
@@ -39,9 +42,12 @@ struct SyncParameters {
   bool             use_file_chunking;
   bool             ignore_xdir_hardlinks;
   bool             stop_for_catalog_tweaks;
+  unsigned         num_scan_threads;
   size_t           min_file_chunk_size;
   size_t           avg_file_chunk_size;
   size_t           max_file_chunk_size;
+  size_t           max_bundle_file_size;  /**< zero: no bundles */
+  size_t           max_pack_file_size;    /**< zero: no packs */
 };
 
 
@@ -157,7 +163,13 @@ class CommandSync : public Command {
                                false));
     result.push_back(Parameter('h', "maximal file chunk size in bytes", true,
                                false));
+    result.push_back(Parameter('e', "bundle the regular files of a directory "
+                               "up to this size in bytes", true, false));
+    result.push_back(Parameter('k', "store regular files up to this size in "
+                               "bytes in packs", true, false));
     result.push_back(Parameter('f', "union filesystem type", true, false));
+    result.push_back(Parameter('j', "number of directory scanning threads "
+                               "(default: 1)", true, false));
     return result;
   }
   int Main(const ArgumentList &args);
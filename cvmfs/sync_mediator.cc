@@ -11,12 +11,17 @@
 #include <unistd.h>
 
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
 
+#include <algorithm>
+
 #include "compression.h"
+#include "file_bundle.h"
 #include "smalloc.h"
 #include "hash.h"
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "util.h"
 #include "util_concurrency.h"
 
@@ -33,6 +38,14 @@ SyncMediator::SyncMediator(catalog::WritableCatalogManager *catalog_manager,
 {
   int retval = pthread_mutex_init(&lock_file_queue_, NULL);
   assert(retval == 0);
+  retval = pthread_mutex_init(&lock_bundle_directories_, NULL);
+  assert(retval == 0);
+  retval = pthread_mutex_init(&lock_pack_, NULL);
+  assert(retval == 0);
+  pack_compressors_ = NULL;
+  pack_writer_ = NULL;
+  num_packed_files_ = 0;
+  add_traversal_ = NULL;
 
   params->spooler->RegisterListener(&SyncMediator::PublishFilesCallback, this);
 
@@ -41,7 +54,17 @@ SyncMediator::SyncMediator(catalog::WritableCatalogManager *catalog_manager,
 
 
 SyncMediator::~SyncMediator() {
+  if (pack_compressors_ != NULL) {
+    pack_compressors_->WaitForTermination();
+    delete pack_compressors_;
+  }
   pthread_mutex_destroy(&lock_file_queue_);
+  pthread_mutex_destroy(&lock_bundle_directories_);
+  pthread_mutex_destroy(&lock_pack_);
+  delete pack_writer_;
+  delete add_traversal_;
+  for (unsigned i = 0; i < finished_packs_.size(); ++i)
+    unlink(finished_packs_[i].second.c_str());
 }
 
 
@@ -74,6 +97,9 @@ void SyncMediator::Add(SyncItem &entry) {
       }
     }
 
+    if (entry.IsRegularFile())
+      MarkBundleDirectory(entry);
+
     // A file is a hard link if the link count is greater than 1
     if (entry.GetUnionLinkcount() > 1)
       InsertHardlink(entry);
@@ -123,6 +149,9 @@ void SyncMediator::Remove(SyncItem &entry) {
   }
 
   if (entry.IsRegularFile() || entry.IsSymlink()) {
+    if (entry.IsRegularFile())
+      MarkBundleDirectory(entry);
+
     // First remove the file...
     RemoveFile(entry);
 
@@ -214,12 +243,31 @@ manifest::Manifest *SyncMediator::Commit() {
 
   params_->spooler->UnregisterListeners();
 
-  LogCvmfs(kLogPublish, kLogStdout, "Committing file catalogs...");
+  const uint64_t deduplicated =
+    params_->spooler->GetNumberOfDeduplicatedObjects();
+  if (deduplicated > 0) {
+    LogCvmfs(kLogPublish, kLogStdout, "Skipped upload of %"PRIu64" objects "
+             "already present in the repository (%"PRIu64" kB)",
+             deduplicated, params_->spooler->GetDeduplicatedBytes() / 1024);
+  }
+
   if (params_->spooler->GetNumberOfErrors() > 0) {
     LogCvmfs(kLogPublish, kLogStderr, "failed to commit files");
     return NULL;
   }
 
+  if (!UploadPacks()) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to upload packs");
+    return NULL;
+  }
+
+  if (!BundleSmallFiles()) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to bundle small files");
+    return NULL;
+  }
+
+  LogCvmfs(kLogPublish, kLogStdout, "Committing file catalogs...");
+
   catalog_manager_->PrecalculateListings();
   return catalog_manager_->Commit(params_->stop_for_catalog_tweaks);
 }
@@ -329,15 +377,17 @@ void SyncMediator::AddDirectoryRecursively(SyncItem &entry) {
 
   // Create a recursion engine, which recursively adds all entries in a newly
   // created directory
-  FileSystemTraversal<SyncMediator> traversal(
-    this, union_engine_->scratch_path(), true);
-  traversal.fn_enter_dir = &SyncMediator::EnterAddedDirectoryCallback;
-  traversal.fn_leave_dir = &SyncMediator::LeaveAddedDirectoryCallback;
-  traversal.fn_new_file = &SyncMediator::AddFileCallback;
-  traversal.fn_new_symlink = &SyncMediator::AddSymlinkCallback;
-  traversal.fn_new_dir_prefix = &SyncMediator::AddDirectoryCallback;
-  traversal.fn_ignore_file = &SyncMediator::IgnoreFileCallback;
-  traversal.Recurse(entry.GetScratchPath());
+  if (add_traversal_ == NULL) {
+    add_traversal_ = new ParallelFileSystemTraversal<SyncMediator>(
+      this, union_engine_->scratch_path(), true, params_->num_scan_threads);
+    add_traversal_->fn_enter_dir = &SyncMediator::EnterAddedDirectoryCallback;
+    add_traversal_->fn_leave_dir = &SyncMediator::LeaveAddedDirectoryCallback;
+    add_traversal_->fn_new_file = &SyncMediator::AddFileCallback;
+    add_traversal_->fn_new_symlink = &SyncMediator::AddSymlinkCallback;
+    add_traversal_->fn_new_dir_prefix = &SyncMediator::AddDirectoryCallback;
+    add_traversal_->fn_ignore_file = &SyncMediator::IgnoreFileCallback;
+  }
+  add_traversal_->Recurse(entry.GetScratchPath());
 }
 
 
@@ -529,6 +579,8 @@ void SyncMediator::AddFile(SyncItem &entry) {
   // Symlinks are completely stored in the catalog
     catalog_manager_->AddFile(entry.CreateBasicCatalogDirent(),
                               entry.relative_parent_path());
+  } else if (IsPackable(entry)) {
+    PackFile(entry);
   } else {
     // Push the file to the spooler, remember the entry for the path
     pthread_mutex_lock(&lock_file_queue_);
@@ -571,8 +623,10 @@ void SyncMediator::AddDirectory(SyncItem &entry) {
 void SyncMediator::RemoveDirectory(SyncItem &entry) {
   if (params_->print_changeset)
     LogCvmfs(kLogPublish, kLogStdout, "[rem] %s", entry.GetUnionPath().c_str());
-  if (!params_->dry_run)
+  if (!params_->dry_run) {
+    catalog_manager_->RemoveBundle(entry.GetRelativePath());
     catalog_manager_->RemoveDirectory(entry.GetRelativePath());
+  }
 }
 
 
@@ -636,4 +690,345 @@ void SyncMediator::AddHardlinkGroup(const HardlinkGroup &group) {
                                      group.master.relative_parent_path());
 }
 
+void SyncMediator::MarkBundleDirectory(const SyncItem &entry) {
+  if (params_->dry_run)
+    return;
+  MutexLockGuard guard(lock_bundle_directories_);
+  bundle_directories_.insert(entry.relative_parent_path());
+}
+
+
+/**
+ * Reassembles the bundles of the directories with changed regular files.  If
+ * bundling is switched off, the bundles of these directories are removed
+ * because they would be outdated.
+ */
+bool SyncMediator::BundleSmallFiles() {
+  if (bundle_directories_.empty())
+    return true;
+
+  if (params_->max_bundle_file_size == 0) {
+    for (set<string>::const_iterator i = bundle_directories_.begin(),
+         iEnd = bundle_directories_.end(); i != iEnd; ++i)
+    {
+      catalog::DirectoryEntry dirent;
+      const string path = (*i == "") ? "" : "/" + *i;
+      if (catalog_manager_->LookupPath(path, catalog::kLookupSole, &dirent))
+        catalog_manager_->RemoveBundle(*i);
+    }
+    return true;
+  }
+
+  LogCvmfs(kLogPublish, kLogStdout, "Bundling small files of %u directories...",
+           bundle_directories_.size());
+  vector<string> uploads;
+  bool result = true;
+  for (set<string>::const_iterator i = bundle_directories_.begin(),
+       iEnd = bundle_directories_.end(); i != iEnd; ++i)
+  {
+    if (!BundleDirectory(*i, &uploads)) {
+      result = false;
+      break;
+    }
+  }
+
+  params_->spooler->WaitForUpload();
+  for (unsigned i = 0; i < uploads.size(); ++i)
+    unlink(uploads[i].c_str());
+  if (params_->spooler->GetNumberOfErrors() > 0)
+    result = false;
+  if (result) {
+    LogCvmfs(kLogPublish, kLogStdout, "Uploaded %u bundles", uploads.size());
+  }
+  return result;
+}
+
+
+static bool CompareDirentSize(const catalog::DirectoryEntry &a,
+                              const catalog::DirectoryEntry &b)
+{
+  if (a.size() != b.size())
+    return a.size() < b.size();
+  return a.name() < b.name();
+}
+
+
+/**
+ * Bundles the small regular files of a directory.  Files are taken by
+ * ascending size until the bundle is full, so that the bundle contains all
+ * files up to its maximum file size.  The files are read from the union
+ * volume; that includes the files that did not change.
+ *
+ * @param directory  path of the directory relative to the repository root
+ * @param uploads    receives the local path of a compressed bundle to be
+ *                   removed once it is uploaded
+ */
+bool SyncMediator::BundleDirectory(const string &directory,
+                                   vector<string> *uploads)
+{
+  const string path = (directory == "") ? "" : "/" + directory;
+
+  // The directory might have been removed in this transaction
+  catalog::DirectoryEntry dirent;
+  if (!catalog_manager_->LookupPath(path, catalog::kLookupSole, &dirent))
+    return true;
+
+  catalog::DirectoryEntryList listing;
+  if (!catalog_manager_->Listing(path, &listing)) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to list %s", path.c_str());
+    return false;
+  }
+  catalog::DirectoryEntryList candidates;
+  for (unsigned i = 0; i < listing.size(); ++i) {
+    if (listing[i].IsRegular() && !listing[i].IsChunkedFile() &&
+        (listing[i].size() > 0) &&
+        (listing[i].size() <= params_->max_bundle_file_size))
+    {
+      candidates.push_back(listing[i]);
+    }
+  }
+  sort(candidates.begin(), candidates.end(), CompareDirentSize);
+
+  vector<FileBundleSource> sources;
+  set<shash::Any> bundled_hashes;
+  uint64_t total_size = 0;
+  uint64_t max_file_size = 0;
+  for (unsigned i = 0; i < candidates.size(); ++i) {
+    const catalog::DirectoryEntry &candidate = candidates[i];
+    if (bundled_hashes.find(candidate.checksum()) != bundled_hashes.end()) {
+      max_file_size = candidate.size();
+      continue;
+    }
+    if (total_size + candidate.size() > FileBundle::kMaxSize) {
+      // Equally sized files in front of this one might be bundled already
+      if ((max_file_size > 0) && (max_file_size == candidate.size()))
+        max_file_size--;
+      break;
+    }
+    sources.push_back(FileBundleSource(
+      candidate.checksum(), candidate.size(),
+      params_->dir_union + path + "/" + candidate.name().ToString()));
+    bundled_hashes.insert(candidate.checksum());
+    total_size += candidate.size();
+    max_file_size = candidate.size();
+  }
+
+  // Equally sized files at the end might be bundled but not announced
+  unsigned num_announced = 0;
+  for (unsigned i = 0; i < sources.size(); ++i) {
+    if (sources[i].size <= max_file_size)
+      num_announced++;
+  }
+  // A single file is better fetched on its own
+  if (num_announced < 2) {
+    catalog_manager_->RemoveBundle(directory);
+    return true;
+  }
+
+  const string bundle_path =
+    CreateTempPath(params_->dir_temp + "/bundle", 0600);
+  if (bundle_path.empty()) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to create temporary bundle");
+    return false;
+  }
+  uint64_t bundle_size;
+  unsigned num_files;
+  if (!WriteFileBundle(sources, bundle_path, &bundle_size, &num_files))
+    return false;
+  // Clients only fetch a bundle that covers all the small files they list
+  if (num_files != sources.size()) {
+    unlink(bundle_path.c_str());
+    catalog_manager_->RemoveBundle(directory);
+    return true;
+  }
+
+  shash::Any bundle_hash(shash::kSha1);
+  const string compressed_path = bundle_path + ".compressed";
+  const bool retval =
+    zlib::CompressPath2Path(bundle_path, compressed_path, &bundle_hash);
+  unlink(bundle_path.c_str());
+  if (!retval) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to compress bundle of %s",
+             path.c_str());
+    unlink(compressed_path.c_str());
+    return false;
+  }
+
+  LogCvmfs(kLogPublish, kLogVerboseMsg, "bundled %u files of %s into %s",
+           num_files, path.c_str(), bundle_hash.ToString().c_str());
+  params_->spooler->Upload(compressed_path, "data" +
+                           bundle_hash.MakePath(1, 2) + FileBundle::kCasSuffix);
+  uploads->push_back(compressed_path);
+  catalog_manager_->SetBundle(directory,
+    FileBundle(bundle_hash, bundle_size, max_file_size, num_announced));
+  return true;
+}
+
+
+bool SyncMediator::IsPackable(const SyncItem &entry) const {
+  return (params_->max_pack_file_size > 0) && entry.IsRegularFile() &&
+         (static_cast<uint64_t>(entry.GetUnionStat().st_size) <=
+          params_->max_pack_file_size);
+}
+
+
+/**
+ * Reads a small file and compresses it in memory.  The result goes to
+ * SyncMediator::PackFileCallback().
+ */
+void PackCompressor::operator()(const expected_data &entry) {
+  Result result;
+  result.entry = entry;
+
+  unsigned char *plain;
+  unsigned plain_size;
+  if (!CopyPath2Mem(entry.GetUnionPath(), &plain, &plain_size)) {
+    master()->JobFailed(result);
+    return;
+  }
+  void *compressed;
+  const bool retval =
+    zlib::CompressMem2Mem(plain, plain_size, &compressed, &result.size);
+  free(plain);
+  if (!retval) {
+    master()->JobFailed(result);
+    return;
+  }
+
+  result.buffer = static_cast<unsigned char *>(compressed);
+  shash::HashMem(result.buffer, result.size, &result.content_hash);
+  master()->JobSuccessful(result);
+}
+
+
+/**
+ * Schedules a small file for compression.  The worker threads compress the
+ * files in parallel while the traversal continues.
+ */
+void SyncMediator::PackFile(SyncItem &entry) {
+  {
+    MutexLockGuard guard(lock_pack_);
+    if (pack_compressors_ == NULL) {
+      const unsigned cpus = GetNumberOfCpuCores();
+      pack_compressors_ =
+        new ConcurrentWorkers<PackCompressor>(cpus, cpus * 10);
+      if (!pack_compressors_->Initialize())
+        abort();
+      pack_compressors_->RegisterListener(&SyncMediator::PackFileCallback,
+                                          this);
+    }
+  }
+  pack_compressors_->Schedule(entry);
+}
+
+
+/**
+ * Appends a compressed small file to the current pack.  Like a failure of the
+ * spooler, a failure to pack the file aborts the publish process.
+ */
+void SyncMediator::PackFileCallback(const PackCompressor::Result &result) {
+  if (result.buffer == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "Pack failure for %s",
+             result.entry.GetUnionPath().c_str());
+    abort();
+  }
+  SyncItem entry = result.entry;
+  entry.SetContentHash(result.content_hash);
+
+  MutexLockGuard guard(lock_pack_);
+  if (pack_writer_ == NULL) {
+    pack_writer_ = new FilePackWriter();
+    if (!pack_writer_->Open(params_->dir_temp + "/pack"))
+      abort();
+  }
+
+  // Identical files share their bytes in the pack
+  uint64_t offset;
+  uint64_t size = result.size;
+  const map<shash::Any, unsigned>::const_iterator duplicate =
+    pack_index_.find(result.content_hash);
+  if (duplicate != pack_index_.end()) {
+    offset = pack_files_[duplicate->second].offset;
+    size = pack_files_[duplicate->second].size;
+  } else {
+    if (!pack_writer_->Append(result.buffer, result.size, &offset)) {
+      LogCvmfs(kLogPublish, kLogStderr, "Pack failure for %s",
+               entry.GetUnionPath().c_str());
+      abort();
+    }
+    pack_index_[result.content_hash] = pack_files_.size();
+  }
+  free(result.buffer);
+  pack_files_.push_back(PackedFile(entry.CreateBasicCatalogDirent(),
+                                   entry.relative_parent_path(),
+                                   offset, size));
+
+  if (pack_writer_->size() >= FilePackLocation::kMaxPackSize) {
+    if (!FinishPack())
+      abort();
+  }
+}
+
+
+/**
+ * Closes the current pack and adds its files to the catalogs.  Has to be
+ * called with lock_pack_ held.
+ */
+bool SyncMediator::FinishPack() {
+  if (pack_writer_ == NULL)
+    return true;
+
+  shash::Any pack_hash(shash::kSha1);
+  const bool retval = pack_writer_->Close(&pack_hash);
+  const string pack_path = pack_writer_->path();
+  delete pack_writer_;
+  pack_writer_ = NULL;
+  if (!retval)
+    return false;
+
+  LogCvmfs(kLogPublish, kLogVerboseMsg, "packed %u files into %s",
+           pack_files_.size(), pack_hash.ToString().c_str());
+  for (unsigned i = 0; i < pack_files_.size(); ++i) {
+    catalog_manager_->AddPackedFile(pack_files_[i].dirent,
+      pack_files_[i].parent_path,
+      FilePackLocation(pack_hash, pack_files_[i].offset, pack_files_[i].size));
+  }
+  finished_packs_.push_back(make_pair(pack_hash, pack_path));
+  num_packed_files_ += pack_files_.size();
+  pack_files_.clear();
+  pack_index_.clear();
+  return true;
+}
+
+
+/**
+ * Uploads the finished packs.  Runs after the spooler listeners are
+ * unregistered because the upload results of the packs do not belong to a
+ * file in the file queue.
+ */
+bool SyncMediator::UploadPacks() {
+  if (pack_compressors_ != NULL)
+    pack_compressors_->WaitForEmptyQueue();
+  {
+    MutexLockGuard guard(lock_pack_);
+    if (!FinishPack())
+      return false;
+  }
+  if (finished_packs_.empty())
+    return true;
+
+  LogCvmfs(kLogPublish, kLogStdout, "Uploading %u packs of %"PRIu64" small "
+           "files...", finished_packs_.size(), num_packed_files_);
+  for (unsigned i = 0; i < finished_packs_.size(); ++i) {
+    params_->spooler->Upload(finished_packs_[i].second, "data" +
+      finished_packs_[i].first.MakePath(1, 2) + FilePackLocation::kCasSuffix);
+  }
+  params_->spooler->WaitForUpload();
+  for (unsigned i = 0; i < finished_packs_.size(); ++i)
+    unlink(finished_packs_[i].second.c_str());
+  finished_packs_.clear();
+
+  return params_->spooler->GetNumberOfErrors() == 0;
+}
+
 }  // namespace publish
@@ -31,11 +31,15 @@
 #include <stack>
 #include <vector>
 #include <set>
+#include <utility>
 
 #include "platform.h"
 #include "catalog_mgr_rw.h"
+#include "file_pack.h"
+#include "fs_traversal_parallel.h"
 #include "swissknife_sync.h"
 #include "sync_item.h"
+#include "util_concurrency.h"
 
 namespace manifest {
 class Manifest;
@@ -68,6 +72,31 @@ struct HardlinkGroup {
 typedef std::map<uint64_t, HardlinkGroup> HardlinkGroupMap;
 
 
+/**
+ * Compresses and hashes a small file in memory.  A swarm of these workers
+ * prepares the files of a pack in parallel, so that only the append to the
+ * pack is serialized.
+ */
+class PackCompressor : public ConcurrentWorker<PackCompressor> {
+ public:
+  struct Result {
+    Result() : content_hash(shash::kSha1), buffer(NULL), size(0) { }
+
+    SyncItem entry;
+    shash::Any content_hash;
+    unsigned char *buffer;  //!< compressed file, NULL on failure
+    uint64_t size;
+  };
+
+  typedef SyncItem expected_data;
+  typedef Result   returned_data;
+  struct worker_context { };
+
+  explicit PackCompressor(const worker_context *context) { }
+  void operator()(const expected_data &entry);
+};
+
+
 /**
  * The SyncMediator refines the input received from a concrete UnionSync object.
  * For example, it resolves the insertion and deletion of complete directories
@@ -156,6 +185,19 @@ class SyncMediator {
   void AddLocalHardlinkGroups(const HardlinkGroupMap &hardlinks);
   void AddHardlinkGroup(const HardlinkGroup &group);
 
+  // Bundles of small files
+  void MarkBundleDirectory(const SyncItem &entry);
+  bool BundleSmallFiles();
+  bool BundleDirectory(const std::string &directory,
+                       std::vector<std::string> *uploads);
+
+  // Packs of small files
+  bool IsPackable(const SyncItem &entry) const;
+  void PackFile(SyncItem &entry);
+  void PackFileCallback(const PackCompressor::Result &result);
+  bool FinishPack();
+  bool UploadPacks();
+
   catalog::WritableCatalogManager *catalog_manager_;
   SyncUnion *union_engine_;
 
@@ -168,6 +210,12 @@ class SyncMediator {
    */
   HardlinkGroupMapStack hardlink_stack_;
 
+  /**
+   * Traverses newly added directories.  Created on first use and kept, so that
+   * its directory scanning threads serve all added directories.
+   */
+  ParallelFileSystemTraversal<SyncMediator> *add_traversal_;
+
   /**
    * New and modified files are sent to an external spooler for hashing and
    * compression.  A spooler callback adds them to the catalogs, once processed.
@@ -177,6 +225,41 @@ class SyncMediator {
 
   HardlinkGroupList hardlink_queue_;
 
+  /**
+   * Directories whose regular files changed.  Their bundles are reassembled
+   * after all files are processed.
+   */
+  pthread_mutex_t lock_bundle_directories_;
+  std::set<std::string> bundle_directories_;
+
+  /**
+   * A file in the pack that is currently written.
+   */
+  struct PackedFile {
+    PackedFile(const catalog::DirectoryEntryBase &d, const std::string &p,
+               const uint64_t o, const uint64_t s) :
+      dirent(d), parent_path(p), offset(o), size(s) { }
+
+    catalog::DirectoryEntryBase dirent;
+    std::string parent_path;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  /**
+   * Small files are compressed into packs instead of being spooled.  The files
+   * of a pack are added to the catalogs once the pack is finished.  Finished
+   * packs remain in the temporary directory until they are uploaded on commit.
+   * The files are compressed by pack_compressors_; its callback appends them.
+   */
+  ConcurrentWorkers<PackCompressor> *pack_compressors_;
+  pthread_mutex_t lock_pack_;
+  FilePackWriter *pack_writer_;
+  std::vector<PackedFile> pack_files_;
+  std::map<shash::Any, unsigned> pack_index_;  //!< deduplicates within a pack
+  std::vector< std::pair<shash::Any, std::string> > finished_packs_;
+  uint64_t num_packed_files_;
+
   const SyncParameters *params_;
 };  // class SyncMediator
 
@@ -20,6 +20,7 @@
 #include "platform.h"
 #include "util.h"
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "sync_item.h"
 #include "logging.h"
 #include "sync_mediator.h"
@@ -35,7 +36,8 @@ SyncUnion::SyncUnion(SyncMediator *mediator,
   rdonly_path_(rdonly_path),
   scratch_path_(scratch_path),
   union_path_(union_path),
-  mediator_(mediator)
+  mediator_(mediator),
+  num_scan_threads_(1)
 {
   mediator_->RegisterUnionEngine(this);
 }
@@ -150,7 +152,9 @@ SyncUnionAufs::SyncUnionAufs(SyncMediator *mediator,
 
 
 void SyncUnionAufs::Traverse() {
-  FileSystemTraversal<SyncUnionAufs> traversal(this, scratch_path(), true);
+  // New and opaque directories are declined and traversed by the mediator
+  ParallelFileSystemTraversal<SyncUnionAufs>
+    traversal(this, scratch_path(), true, num_scan_threads_, false);
 
   traversal.fn_enter_dir = &SyncUnionAufs::EnterDirectory;
   traversal.fn_leave_dir = &SyncUnionAufs::LeaveDirectory;
@@ -316,8 +320,9 @@ void SyncUnionOverlayfs::ProcessFileHardlinkCallback(const string &parent_dir,
 
 
 void SyncUnionOverlayfs::Traverse() {
-  FileSystemTraversal<SyncUnionOverlayfs>
-    traversal(this, scratch_path(), true);
+  // New and opaque directories are declined and traversed by the mediator
+  ParallelFileSystemTraversal<SyncUnionOverlayfs>
+    traversal(this, scratch_path(), true, num_scan_threads_, false);
 
   traversal.fn_enter_dir = &SyncUnionOverlayfs::EnterDirectory;
   traversal.fn_leave_dir = &SyncUnionOverlayfs::LeaveDirectory;
@@ -70,6 +70,14 @@ class SyncUnion {
   inline std::string union_path() const { return union_path_; }
   inline std::string scratch_path() const { return scratch_path_; }
 
+  /**
+   * With more than one thread, the scratch directory is read in parallel
+   * ahead of the traversal
+   */
+  void set_num_scan_threads(const unsigned num_threads) {
+    num_scan_threads_ = num_threads;
+  }
+
   /**
    * Whiteout files may have special naming conventions.
    * This method "unmangles" them and retrieves the original file name
@@ -114,6 +122,7 @@ class SyncUnion {
   std::string union_path_;
 
   SyncMediator *mediator_;
+  unsigned num_scan_threads_;
 
   /**
    * Callback when a regular file is found.
@@ -27,6 +27,7 @@
 #include <cassert>
 #include <cstdlib>
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -46,6 +47,7 @@
 #include "options.h"
 #include "cache.h"
 #include "monitor.h"
+#include "warmup.h"
 
 using namespace std;  // NOLINT
 
@@ -230,9 +232,11 @@ static void *MainTalk(void *data __attribute__((unused))) {
       } else if (line == "host info") {
         vector<string> host_chain;
         vector<int> rtt;
+        vector<download::HostStatistics> host_statistics;
         unsigned active_host;
 
-        cvmfs::download_manager_->GetHostInfo(&host_chain, &rtt, &active_host);
+        cvmfs::download_manager_->GetHostInfo(&host_chain, &rtt, &active_host,
+                                              &host_statistics);
         string host_str;
         for (unsigned i = 0; i < host_chain.size(); ++i) {
           host_str += "  [" + StringifyInt(i) + "] " + host_chain[i] + " (";
@@ -243,6 +247,20 @@ static void *MainTalk(void *data __attribute__((unused))) {
           else
             host_str += StringifyInt(rtt[i]) + " ms";
           host_str += ")\n";
+
+          const download::HostStatistics &stats = host_statistics[i];
+          host_str += "      latency ";
+          host_str += (stats.latency_ms < 0.0) ? "n/a" :
+                      StringifyInt(int64_t(stats.latency_ms)) + " ms";
+          host_str += ", throughput ";
+          host_str += (stats.throughput < 0.0) ? "n/a" :
+                      StringifyInt(int64_t(stats.throughput / 1024)) + " kB/s";
+          host_str += ", " + StringifyInt(stats.num_transfers) +
+                      " transfers, " + StringifyInt(stats.num_failures) +
+                      " failures, score ";
+          const double score = stats.GetScore();
+          host_str += (score < 0.0) ? "n/a" : StringifyInt(int64_t(score));
+          host_str += "\n";
         }
         host_str += "Active host " + StringifyInt(active_host) + ": " +
                     host_chain[active_host] + "\n";
@@ -264,7 +282,9 @@ static void *MainTalk(void *data __attribute__((unused))) {
       } else if (line == "proxy info") {
         vector< vector<string> > proxy_chain;
         unsigned active_group;
-        cvmfs::download_manager_->GetProxyInfo(&proxy_chain, &active_group);
+        map<string, download::ProxyHealth> proxy_health;
+        cvmfs::download_manager_->GetProxyInfo(&proxy_chain, &active_group,
+                                               &proxy_health);
 
         string proxy_str;
         if (proxy_chain.size()) {
@@ -275,6 +295,22 @@ static void *MainTalk(void *data __attribute__((unused))) {
           }
           proxy_str += "Active proxy: [" + StringifyInt(active_group) + "] " +
                        proxy_chain[active_group][0] + "\n";
+          // Only filled with proxy sharding
+          const time_t now = time(NULL);
+          for (map<string, download::ProxyHealth>::const_iterator i =
+               proxy_health.begin(), iEnd = proxy_health.end(); i != iEnd; ++i)
+          {
+            proxy_str += "  " + i->first + ": " +
+                         StringifyInt(i->second.num_requests) + " requests, " +
+                         StringifyInt(i->second.num_failures) + " failures";
+            if (i->second.timestamp_retry > now) {
+              proxy_str += ", out of rotation for " +
+                           StringifyInt(i->second.timestamp_retry - now) + "s";
+            } else if (i->second.is_probing) {
+              proxy_str += ", probing";
+            }
+            proxy_str += "\n";
+          }
         } else {
           proxy_str = "No proxies defined\n";
         }
@@ -349,6 +385,9 @@ static void *MainTalk(void *data __attribute__((unused))) {
 
         result += "File Catalogs:\n  " + cvmfs::GetCatalogStatistics().Print();
         result += "Certificate cache:\n  " + cvmfs::GetCertificateStats();
+        result += "Catalog prefetch:\n  " + cvmfs::GetCatalogPrefetchStats();
+        result += "Working set warm-up:\n  " + warmup::GetStatistics();
+        result += "RAM cache:\n  " + cvmfs::GetRamCacheStats();
 
         result += "Path Strings:\n  instances: " +
           StringifyInt(PathString::num_instances()) + "  overflows: " +
@@ -376,6 +415,12 @@ static void *MainTalk(void *data __attribute__((unused))) {
         cvmfs::GetReloadStatus(&drainout_mode, &maintenance_mode);
         result += "\nDrainout Mode: " + StringifyBool(drainout_mode) + "\n";
         result += "Maintenance Mode: " + StringifyBool(maintenance_mode) + "\n";
+        result += "Downloads by other processes sharing the cache: " +
+                  StringifyInt(cache::GetNumCoalescedDownloads()) + "\n";
+        result += "Files fetched in directory bundles: " +
+                  StringifyInt(cache::GetNumBundledDownloads()) + "\n";
+        result += "Files fetched from packs: " +
+                  StringifyInt(cache::GetNumPackedDownloads()) + "\n";
 
         if (cvmfs::nfs_maps_) {
           result += "\nNFS Map Statistics:\n";
@@ -396,7 +441,16 @@ static void *MainTalk(void *data __attribute__((unused))) {
         result += "Backup host: " + ((host_timestamp_failover > 0) ?
           ("Backup since " + StringifyTime(host_timestamp_failover, true)) :
           "Primary");
-        result += "\n\n";
+        result += "\n";
+        map<string, download::LatencyHistogram> latencies;
+        cvmfs::download_manager_->GetLatencyInfo(&latencies);
+        for (map<string, download::LatencyHistogram>::const_iterator i =
+             latencies.begin(), iEnd = latencies.end(); i != iEnd; ++i)
+        {
+          result += "First byte latency of " + i->first + ": " +
+                    i->second.PrintQuantiles() + "\n";
+        }
+        result += "\n";
 
         result += "SQlite Statistics:\n";
         sqlite3_status(SQLITE_STATUS_MALLOC_COUNT, &current, &highwater, 0);
@@ -103,3 +103,13 @@ void Spooler::WaitForUpload() const {
 unsigned int Spooler::GetNumberOfErrors() const {
   return uploader_->GetNumberOfErrors();
 }
+
+
+uint64_t Spooler::GetNumberOfDeduplicatedObjects() const {
+  return file_processor_->GetNumberOfDeduplicatedChunks();
+}
+
+
+uint64_t Spooler::GetDeduplicatedBytes() const {
+  return file_processor_->GetDeduplicatedBytes();
+}
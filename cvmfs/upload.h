@@ -202,6 +202,15 @@ namespace upload
      */
     unsigned int GetNumberOfErrors() const;
 
+    /**
+     * Processed objects that were already present in the backend storage and
+     * have not been uploaded again.
+     *
+     * @return   the number of skipped objects and their compressed size
+     */
+    uint64_t GetNumberOfDeduplicatedObjects() const;
+    uint64_t GetDeduplicatedBytes() const;
+
 
    protected:
     /**
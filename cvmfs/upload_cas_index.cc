@@ -0,0 +1,484 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "upload_cas_index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "logging.h"
+#include "platform.h"
+
+using namespace std;  // NOLINT
+
+namespace upload {
+
+const char *CasIndex::kFileName = ".cvmfscasindex";
+
+static const char     kMagic[8] = {'C', 'V', 'M', 'F', 'S', 'C', 'I', 'X'};
+static const uint32_t kVersion  = 1;
+
+
+static int HexDigit(const char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  return -1;
+}
+
+
+CasIndex::CasIndex(const string &upstream_path,
+                   const unsigned stale_check_interval) :
+  upstream_path_(upstream_path),
+  index_path_(upstream_path + "/" + kFileName),
+  stale_check_interval_(stale_check_interval),
+  mapped_file_(NULL),
+  num_records_(0),
+  mapped_inode_(0),
+  mapped_size_(0),
+  mapped_mtime_(0),
+  timestamp_stale_check_(0)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+CasIndex::~CasIndex() {
+  if (IsOpen())
+    Commit();
+  Unmap();
+  pthread_mutex_destroy(&lock_);
+}
+
+
+bool CasIndex::Open() {
+  pthread_mutex_lock(&lock_);
+  bool result = false;
+  if (FileExists(index_path_)) {
+    result = Map();
+    if (!result) {
+      LogCvmfs(kLogSpooler, kLogStderr, "ignoring invalid object index %s",
+               index_path_.c_str());
+    }
+  } else {
+    Unmap();
+  }
+  pthread_mutex_unlock(&lock_);
+  return result;
+}
+
+
+/**
+ * Maps the current index file and remembers its identity.  Called with lock_
+ * held.
+ */
+bool CasIndex::Map() const {
+  Unmap();
+  platform_stat64 info;
+  if (platform_stat(index_path_.c_str(), &info) != 0)
+    return false;
+  mapped_file_ = new MemoryMappedFile(index_path_);
+  if (!mapped_file_->Map() ||
+      !ValidateHeader(mapped_file_->buffer(), mapped_file_->size()))
+  {
+    Unmap();
+    return false;
+  }
+  num_records_ =
+    reinterpret_cast<const Header *>(mapped_file_->buffer())->num_records;
+  mapped_inode_ = info.st_ino;
+  mapped_size_  = info.st_size;
+  mapped_mtime_ = info.st_mtime;
+  timestamp_stale_check_ = time(NULL);
+  return true;
+}
+
+
+void CasIndex::Unmap() const {
+  delete mapped_file_;
+  mapped_file_ = NULL;
+  num_records_ = 0;
+}
+
+
+/**
+ * The index file is replaced by rename().  The mapping keeps the inode of the
+ * old index file in use, so a new index file has a different inode.  Size and
+ * mtime cover an index file that was rewritten in place.  The index file is
+ * only checked every stale_check_interval_ seconds.
+ */
+bool CasIndex::IsStale() const {
+  const time_t now = time(NULL);
+  if (now < timestamp_stale_check_ + time_t(stale_check_interval_))
+    return false;
+  timestamp_stale_check_ = now;
+
+  platform_stat64 info;
+  if (platform_stat(index_path_.c_str(), &info) != 0)
+    return true;
+  return (static_cast<uint64_t>(info.st_ino) != mapped_inode_) ||
+         (static_cast<uint64_t>(info.st_size) != mapped_size_) ||
+         (static_cast<int64_t>(info.st_mtime) != mapped_mtime_);
+}
+
+
+/**
+ * Converts data/ab/cdef...[suffix] into a Key.
+ */
+bool CasIndex::ParsePath(const string &path, Key *key) {
+  const string prefix = "data/";
+  if ((path.length() < prefix.length() + 3) ||
+      (path.compare(0, prefix.length(), prefix) != 0) ||
+      (path[prefix.length() + 2] != '/'))
+  {
+    return false;
+  }
+
+  string hex = path.substr(prefix.length(), 2) +
+               path.substr(prefix.length() + 3);
+  unsigned char suffix = 0;
+  if (!hex.empty() && (HexDigit(hex[hex.length() - 1]) < 0)) {
+    suffix = hex[hex.length() - 1];
+    hex.erase(hex.length() - 1);
+  }
+  if ((hex.length() != 2 * shash::kDigestSizes[shash::kMd5]) &&
+      (hex.length() != 2 * shash::kDigestSizes[shash::kSha1]))
+  {
+    return false;
+  }
+
+  *key = Key();
+  for (unsigned i = 0; i < hex.length(); i += 2) {
+    const int high = HexDigit(hex[i]);
+    const int low  = HexDigit(hex[i + 1]);
+    if ((high < 0) || (low < 0))
+      return false;
+    key->bytes[i / 2] = high * 16 + low;
+  }
+  key->bytes[shash::kMaxDigestSize]     = hex.length() / 2;
+  key->bytes[shash::kMaxDigestSize + 1] = suffix;
+  return true;
+}
+
+
+bool CasIndex::ValidateHeader(const unsigned char *buffer, const size_t size) {
+  if (size < sizeof(Header))
+    return false;
+  const Header *header = reinterpret_cast<const Header *>(buffer);
+  return (memcmp(header->magic, kMagic, sizeof(kMagic)) == 0) &&
+         (header->version == kVersion) &&
+         (header->key_size == kKeySize) &&
+         (header->buckets[256] == header->num_records) &&
+         (size == sizeof(Header) + header->num_records * kKeySize);
+}
+
+
+/**
+ * Binary search in the sorted keys of the data/xx directory of key.
+ */
+bool CasIndex::Search(const unsigned char *buffer, const Key &key) {
+  const Header *header = reinterpret_cast<const Header *>(buffer);
+  const unsigned char *records = buffer + sizeof(Header);
+  uint64_t low  = header->buckets[key.bytes[0]];
+  uint64_t high = header->buckets[key.bytes[0] + 1];
+  while (low < high) {
+    const uint64_t mid = low + (high - low) / 2;
+    const int cmp = memcmp(records + mid * kKeySize, key.bytes, kKeySize);
+    if (cmp == 0)
+      return true;
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return false;
+}
+
+
+bool CasIndex::Lookup(const string &path, bool *present) const {
+  Key key;
+  if (!ParsePath(path, &key))
+    return false;
+
+  pthread_mutex_lock(&lock_);
+  if (IsOpen() && IsStale())
+    Map();
+  const bool is_open = IsOpen();
+  if (is_open) {
+    if (pending_erases_.find(key) != pending_erases_.end())
+      *present = false;
+    else if (pending_inserts_.find(key) != pending_inserts_.end())
+      *present = true;
+    else
+      *present = Search(mapped_file_->buffer(), key);
+  }
+  pthread_mutex_unlock(&lock_);
+  return is_open;
+}
+
+
+void CasIndex::Insert(const string &path) {
+  Key key;
+  if (!ParsePath(path, &key))
+    return;
+
+  pthread_mutex_lock(&lock_);
+  if (IsOpen()) {
+    pending_erases_.erase(key);
+    pending_inserts_.insert(key);
+    if (pending_inserts_.size() + pending_erases_.size() >= kMaxPendingChanges)
+      DoCommit();
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+
+void CasIndex::Erase(const string &path) {
+  Key key;
+  if (!ParsePath(path, &key))
+    return;
+
+  pthread_mutex_lock(&lock_);
+  if (IsOpen()) {
+    pending_inserts_.erase(key);
+    pending_erases_.insert(key);
+    if (pending_inserts_.size() + pending_erases_.size() >= kMaxPendingChanges)
+      DoCommit();
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+
+bool CasIndex::Remove(const string &path) {
+  const string object_path = upstream_path_ + "/" + path;
+  Key key;
+  bool result = false;
+  pthread_mutex_lock(&lock_);
+  if (IsOpen() && ParsePath(path, &key)) {
+    pending_inserts_.erase(key);
+    pending_erases_.insert(key);
+    result = DoCommit(object_path);
+  } else {
+    result = unlink(object_path.c_str()) == 0;
+  }
+  pthread_mutex_unlock(&lock_);
+  return result;
+}
+
+
+bool CasIndex::Commit() {
+  pthread_mutex_lock(&lock_);
+  const bool result = DoCommit();
+  pthread_mutex_unlock(&lock_);
+  return result;
+}
+
+
+/**
+ * Writes the header for the keys with the given number per data/xx directory
+ * and flushes the index file.
+ */
+bool CasIndex::WriteHeader(FILE *f, const uint64_t counts[256],
+                           uint64_t *num_records)
+{
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version  = kVersion;
+  header.key_size = kKeySize;
+  for (unsigned b = 0; b < 256; ++b) {
+    header.buckets[b + 1] = header.buckets[b] + counts[b];
+  }
+  header.num_records = header.buckets[256];
+  *num_records = header.num_records;
+
+  return (fseek(f, 0, SEEK_SET) == 0) &&
+         (fwrite(&header, sizeof(header), 1, f) == 1) &&
+         (fflush(f) == 0) &&
+         (fsync(fileno(f)) == 0);
+}
+
+
+/**
+ * Writes the keys of old_index (may be NULL) and inserts, without the keys in
+ * erases, followed by the header.  Called with the file position after the
+ * header.
+ */
+bool CasIndex::WriteIndex(FILE *f, const unsigned char *old_index,
+                          const KeySet &inserts, const KeySet &erases,
+                          uint64_t *num_records)
+{
+  const unsigned char *old_records = NULL;
+  uint64_t old_size = 0;
+  if (old_index != NULL) {
+    old_records = old_index + sizeof(Header);
+    old_size = reinterpret_cast<const Header *>(old_index)->num_records;
+  }
+
+  uint64_t counts[256];
+  memset(counts, 0, sizeof(counts));
+  uint64_t i = 0;
+  KeySet::const_iterator j = inserts.begin();
+  const KeySet::const_iterator jend = inserts.end();
+  while ((i < old_size) || (j != jend)) {
+    const unsigned char *next;
+    if (j == jend) {
+      next = old_records + i * kKeySize;
+      ++i;
+    } else if (i == old_size) {
+      next = j->bytes;
+      ++j;
+    } else {
+      const int cmp = memcmp(old_records + i * kKeySize, j->bytes, kKeySize);
+      if (cmp <= 0) {
+        next = old_records + i * kKeySize;
+        ++i;
+        if (cmp == 0)
+          ++j;
+      } else {
+        next = j->bytes;
+        ++j;
+      }
+    }
+
+    if (!erases.empty()) {
+      Key key;
+      memcpy(key.bytes, next, kKeySize);
+      if (erases.find(key) != erases.end())
+        continue;
+    }
+    if (fwrite(next, kKeySize, 1, f) != 1)
+      return false;
+    ++counts[next[0]];
+  }
+
+  return WriteHeader(f, counts, num_records);
+}
+
+
+/**
+ * Merges the pending changes with the current index file.  The index file
+ * might have been replaced by another process in the meantime, so it is
+ * mapped again under the lock file.  Called with lock_ held.
+ *
+ * @param unlink_path  an erased object that is unlinked once the new index
+ *                     file is in place, before the lock file is released
+ */
+bool CasIndex::DoCommit(const string &unlink_path) {
+  if (!IsOpen() || (pending_inserts_.empty() && pending_erases_.empty()))
+    return true;
+
+  const int fd_lock = LockFile(index_path_ + ".lock");
+  if (fd_lock < 0) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to lock object index %s",
+             index_path_.c_str());
+    return false;
+  }
+
+  MemoryMappedFile current(index_path_);
+  const unsigned char *old_index = NULL;
+  if (FileExists(index_path_) && current.Map() &&
+      ValidateHeader(current.buffer(), current.size()))
+  {
+    old_index = current.buffer();
+  }
+
+  string tmp_path;
+  FILE *f = CreateTempFile(index_path_, 0644, "w", &tmp_path);
+  uint64_t num_records = 0;
+  bool retval = (f != NULL) &&
+                (fseek(f, sizeof(Header), SEEK_SET) == 0) &&
+                WriteIndex(f, old_index, pending_inserts_, pending_erases_,
+                           &num_records);
+  if (f != NULL)
+    retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(tmp_path.c_str(), index_path_.c_str()) == 0;
+  if (!retval) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to write object index %s (%d)",
+             index_path_.c_str(), errno);
+    if (!tmp_path.empty())
+      unlink(tmp_path.c_str());
+    UnlockFile(fd_lock);
+    return false;
+  }
+  if (!unlink_path.empty() && (unlink(unlink_path.c_str()) != 0)) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to remove %s (%d)",
+             unlink_path.c_str(), errno);
+    retval = false;
+  }
+  UnlockFile(fd_lock);
+
+  LogCvmfs(kLogSpooler, kLogVerboseMsg, "committed %u new and %u removed "
+           "objects to the object index (%"PRIu64" objects)",
+           unsigned(pending_inserts_.size()), unsigned(pending_erases_.size()),
+           num_records);
+  pending_inserts_.clear();
+  pending_erases_.clear();
+
+  return Map() && retval;
+}
+
+
+bool CasIndex::Rebuild(const string &upstream_path, uint64_t *num_objects) {
+  const string index_path = upstream_path + "/" + kFileName;
+  const int fd_lock = LockFile(index_path + ".lock");
+  if (fd_lock < 0)
+    return false;
+
+  string tmp_path;
+  FILE *f = CreateTempFile(index_path, 0644, "w", &tmp_path);
+  bool retval = (f != NULL) && (fseek(f, sizeof(Header), SEEK_SET) == 0);
+
+  // The keys of every data/xx directory form one sorted bucket, so only one
+  // directory is kept in memory at a time
+  uint64_t counts[256];
+  memset(counts, 0, sizeof(counts));
+  vector<Key> keys;
+  for (unsigned b = 0; retval && (b < 256); ++b) {
+    char dir_name[3];
+    snprintf(dir_name, sizeof(dir_name), "%02x", b);
+    const string relative_dir = string("data/") + dir_name;
+    DIR *dirp = opendir((upstream_path + "/" + relative_dir).c_str());
+    if (dirp == NULL)
+      continue;
+    keys.clear();
+    platform_dirent64 *d;
+    while ((d = platform_readdir(dirp)) != NULL) {
+      Key key;
+      if (ParsePath(relative_dir + "/" + d->d_name, &key))
+        keys.push_back(key);
+    }
+    closedir(dirp);
+
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    for (unsigned i = 0; retval && (i < keys.size()); ++i)
+      retval = fwrite(keys[i].bytes, kKeySize, 1, f) == 1;
+    counts[b] = keys.size();
+  }
+
+  retval = retval && WriteHeader(f, counts, num_objects);
+  if (f != NULL)
+    retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(tmp_path.c_str(), index_path.c_str()) == 0;
+  if (!retval && !tmp_path.empty())
+    unlink(tmp_path.c_str());
+  UnlockFile(fd_lock);
+  return retval;
+}
+
+}  // namespace upload
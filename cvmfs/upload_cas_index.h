@@ -0,0 +1,160 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UPLOAD_CAS_INDEX_H_
+#define CVMFS_UPLOAD_CAS_INDEX_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <set>
+#include <string>
+
+#include "hash.h"
+#include "util.h"
+
+namespace upload {
+
+/**
+ * A persistent index of the objects stored in the data/ directory of a local
+ * backend storage.  It answers existence queries without touching the (pos-
+ * sibly huge and slow) file system tree of the backend storage.
+ *
+ * The index is a single file (kFileName in the upstream directory) that con-
+ * tains a sorted array of fixed-size keys for each of the 256 data/xx sub
+ * directories.  The file is memory mapped and searched in place.  Objects
+ * inserted or erased by the uploader are kept in memory and merged into a
+ * new index file by Commit(), which atomically replaces the old one.  Changes
+ * are committed once the uploader is destroyed, i.e. once per publish, or
+ * earlier if too many of them are pending.  Objects removed from the backend
+ * storage are committed before they are unlinked (see Remove()).  Lookups
+ * map the index file again once another process replaced it, so that objects
+ * erased by others are not claimed present for long.
+ *
+ * Once the index file exists, it is authoritative for all object names it can
+ * represent (content hash plus an optional one-character suffix).  Changes to
+ * the backend storage that bypass the uploader require a Rebuild().
+ */
+class CasIndex : SingleCopy {
+ public:
+  static const char     *kFileName;
+  static const unsigned  kKeySize = shash::kMaxDigestSize + 2;
+  static const unsigned  kMaxPendingChanges = 1024 * 1024;
+  /**
+   * Lookups check every so many seconds if another process replaced the
+   * index file, so that not every lookup costs a stat() of the index file.
+   */
+  static const unsigned  kStaleCheckInterval = 5;
+
+  /**
+   * Binary representation of an object name: the digest (zero-padded), the
+   * digest size and the hash suffix (0 if none).
+   */
+  struct Key {
+    Key() { memset(bytes, 0, kKeySize); }
+    bool operator <(const Key &other) const {
+      return memcmp(bytes, other.bytes, kKeySize) < 0;
+    }
+    bool operator ==(const Key &other) const {
+      return memcmp(bytes, other.bytes, kKeySize) == 0;
+    }
+    unsigned char bytes[kKeySize];
+  };
+
+  explicit CasIndex(const std::string &upstream_path,
+                    const unsigned stale_check_interval = kStaleCheckInterval);
+  ~CasIndex();
+
+  /**
+   * Maps the index file of the upstream directory.
+   * @return  false if there is no (valid) index
+   */
+  bool Open();
+  bool IsOpen() const { return mapped_file_ != NULL; }
+
+  /**
+   * @param path     object path relative to upstream, like data/ab/cdef...C
+   * @param present  set to true if the object is in the backend storage
+   * @return         false if the index cannot tell, i.e. it is not open or
+   *                 the path is not an object name
+   */
+  bool Lookup(const std::string &path, bool *present) const;
+
+  void Insert(const std::string &path);
+  void Erase(const std::string &path);
+
+  /**
+   * Erases an object from the index and unlinks it from the backend storage.
+   * Unlike Erase(), the removal is committed right away and the object is
+   * only unlinked afterwards, under the lock file.  So the index file never
+   * claims a removed object, not even after a crash.  Objects that the index
+   * cannot represent are simply unlinked.
+   */
+  bool Remove(const std::string &path);
+
+  /**
+   * Merges the pending changes into the index file.  Other processes might
+   * update the same index, the merge is done under a lock file.
+   */
+  bool Commit();
+
+  /**
+   * Creates a fresh index file by listing the data/xx directories.
+   */
+  static bool Rebuild(const std::string &upstream_path, uint64_t *num_objects);
+
+  static bool ParsePath(const std::string &path, Key *key);
+
+  uint64_t size() const { return num_records_; }
+
+ protected:
+  typedef std::set<Key> KeySet;
+
+  struct Header {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  key_size;
+    uint64_t  num_records;
+    uint64_t  buckets[257];  ///< record index of the first key per data/xx
+  };
+
+  static bool ValidateHeader(const unsigned char *buffer, const size_t size);
+  static bool Search(const unsigned char *buffer, const Key &key);
+  static bool WriteHeader(FILE *f, const uint64_t counts[256],
+                          uint64_t *num_records);
+  static bool WriteIndex(FILE *f, const unsigned char *old_index,
+                         const KeySet &inserts, const KeySet &erases,
+                         uint64_t *num_records);
+  bool DoCommit(const std::string &unlink_path = "");
+  bool Map() const;
+  void Unmap() const;
+  bool IsStale() const;
+
+ private:
+  const std::string  upstream_path_;
+  const std::string  index_path_;
+  const unsigned     stale_check_interval_;
+
+  /**
+   * The mapped index file and its identity.  Lookup() maps the index file
+   * again once it was replaced.
+   */
+  mutable MemoryMappedFile *mapped_file_;
+  mutable uint64_t          num_records_;
+  mutable uint64_t          mapped_inode_;
+  mutable uint64_t          mapped_size_;
+  mutable int64_t           mapped_mtime_;
+  mutable time_t            timestamp_stale_check_;
+
+  KeySet             pending_inserts_;
+  KeySet             pending_erases_;
+  mutable pthread_mutex_t lock_;
+};
+
+}  // namespace upload
+
+#endif  // CVMFS_UPLOAD_CAS_INDEX_H_
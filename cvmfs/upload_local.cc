@@ -2,9 +2,12 @@
  * This file is part of the CernVM File System.
  */
 
+#define __STDC_FORMAT_MACROS
+
 #include "upload_local.h"
 
 #include <errno.h>
+#include <inttypes.h>
 
 #include "logging.h"
 #include "compression.h"
@@ -18,12 +21,18 @@ using namespace upload;
 LocalUploader::LocalUploader(const SpoolerDefinition &spooler_definition) :
   AbstractUploader(spooler_definition),
   upstream_path_(spooler_definition.spooler_configuration),
-  temporary_path_(spooler_definition.temporary_path)
+  temporary_path_(spooler_definition.temporary_path),
+  cas_index_(upstream_path_)
 {
   assert (spooler_definition.IsValid() &&
           spooler_definition.driver_type == SpoolerDefinition::Local);
 
   atomic_init32(&copy_errors_);
+  if (cas_index_.Open()) {
+    LogCvmfs(kLogSpooler, kLogVerboseMsg, "using object index of %s "
+                                          "(%"PRIu64" objects)",
+             upstream_path_.c_str(), cas_index_.size());
+  }
 }
 
 
@@ -98,6 +107,8 @@ void LocalUploader::FileUpload(const std::string &local_path,
                                           "'%s'",
              tmp_path.c_str(), remote_path.c_str());
     atomic_inc32(&copy_errors_);
+  } else {
+    cas_index_.Insert(remote_path);
   }
   Respond(callback, UploaderResults(retcode, local_path));
 }
@@ -182,9 +193,9 @@ void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
     return;
   }
 
-  const std::string final_path = upstream_path_ + "/data" +
-                                 content_hash.MakePath(1, 2) +
-                                 hash_suffix;
+  const std::string object_path = "data" + content_hash.MakePath(1, 2) +
+                                  hash_suffix;
+  const std::string final_path = upstream_path_ + "/" + object_path;
 
   retval = rename(local_handle->temporary_path.c_str(), final_path.c_str());
   if (retval != 0) {
@@ -199,6 +210,8 @@ void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
     return;
   }
 
+  cas_index_.Insert(object_path);
+
   const callback_t *callback = handle->commit_callback;
   delete local_handle;
 
@@ -211,12 +224,14 @@ bool LocalUploader::Remove(const std::string& file_to_delete) {
     return false;
   }
 
-  const int retval = unlink((upstream_path_ + "/" + file_to_delete).c_str());
-  return retval == 0;
+  return cas_index_.Remove(file_to_delete);
 }
 
 
 bool LocalUploader::Peek(const std::string& path) const {
+  bool present;
+  if (cas_index_.Lookup(path, &present))
+    return present;
   return FileExists(upstream_path_ + "/" + path);
 }
 
@@ -6,6 +6,7 @@
 #define CVMFS_UPLOAD_LOCAL_H_
 
 #include "upload_facility.h"
+#include "upload_cas_index.h"
 
 #include "util_concurrency.h"
 #include "atomic.h"
@@ -29,6 +30,8 @@ namespace upload
    * into a local CVMFS repository backend.
    * For a detailed description of the classes interface please have a look into
    * the AbstractSpooler base class.
+   * If the backend storage has an object index (see CasIndex), Peek() is
+   * answered by the index and uploaded and removed objects are recorded in it.
    */
   class LocalUploader : public AbstractUploader {
    public:
@@ -80,6 +83,7 @@ namespace upload
     const std::string    temporary_path_;
     mutable atomic_int32 copy_errors_;   //!< counts the number of occured
                                          //!< errors in Upload()
+    CasIndex             cas_index_;
   };
 }
 
@@ -530,6 +530,7 @@ void ConcurrentWorkers<WorkerT>::RunCallbackThread() {
 
     // signal the Spooler that all jobs are done...
     if (atomic_read32(&jobs_pending_) == 0) {
+      MutexLockGuard lock(jobs_all_done_mutex_);
       pthread_cond_broadcast(&jobs_all_done_);
     }
   }
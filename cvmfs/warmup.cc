@@ -0,0 +1,338 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The warmup module remembers the working set of a mount, i.e. the nested
+ * catalogs and the files that were opened, in a small text file in the cache
+ * directory.  On the next mount, the previous working set is replayed in the
+ * background by a few threads so that the first accesses after a reboot or a
+ * remount hit the cache.
+ *
+ * Entries are recorded by path, not by content hash.  On replay, the paths are
+ * resolved against the current catalogs, so that outdated objects are not
+ * downloaded.  The record is stored periodically by a background thread, so
+ * that the working set survives a crash or a killed Fuse module, and once
+ * more on unmount.  One line of the record file looks like
+ *   C /nested/catalog/mountpoint
+ *   F /path/to/file
+ */
+
+#include "cvmfs_config.h"
+#include "warmup.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "logging.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+namespace warmup {
+
+const unsigned kNumReplayThreads = 4;
+/**
+ * The record is stored at least this often if there are new entries, and
+ * earlier if kFlushEntries new files have been opened.
+ */
+const unsigned kFlushIntervalSec = 300;
+const unsigned kFlushEntries = 500;
+
+struct Entry {
+  Entry() : type(kEntryFile) { }
+  Entry(const EntryType t, const string &p) : type(t), path(p) { }
+  EntryType type;
+  string path;
+};
+
+bool active_ = false;
+string *record_path_ = NULL;
+unsigned max_entries_ = 0;
+ReplayFunction replay_ = NULL;
+MountpointsFunction mountpoints_ = NULL;
+vector<Entry> *previous_ = NULL;  /**< working set of the last session */
+vector<string> *recorded_ = NULL;  /**< opened files, in order of first access */
+set<string> *recorded_set_ = NULL;
+pthread_mutex_t lock_recorded_ = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_flush_ = PTHREAD_COND_INITIALIZER;
+unsigned num_stored_ = 0;  /**< size of recorded_ at the last store */
+bool flush_running_ = false;
+pthread_t thread_flush_;
+vector<pthread_t> *threads_replay_ = NULL;
+atomic_int32 next_entry_;
+atomic_int32 num_replayed_;
+atomic_int32 num_failed_;
+atomic_int32 terminate_;
+
+
+static void LoadRecord() {
+  FILE *f = fopen(record_path_->c_str(), "r");
+  if (!f) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "no working set record in %s",
+             record_path_->c_str());
+    return;
+  }
+  string line;
+  while (GetLineFile(f, &line)) {
+    if ((line.length() < 3) || (line[1] != ' '))
+      continue;
+    if ((line[0] != kEntryCatalog) && (line[0] != kEntryFile))
+      continue;
+    previous_->push_back(Entry(static_cast<EntryType>(line[0]),
+                               line.substr(2)));
+  }
+  fclose(f);
+  LogCvmfs(kLogCvmfs, kLogDebug, "loaded %u entries from working set record",
+           static_cast<unsigned>(previous_->size()));
+}
+
+
+/**
+ * Written to a temporary file first and renamed, so that a crash cannot leave
+ * a truncated record behind.
+ */
+static void StoreRecord(const vector<string> &catalog_mountpoints,
+                        const vector<string> &recorded)
+{
+  string temp_path;
+  FILE *f = CreateTempFile(*record_path_ + ".tmp", 0600, "w", &temp_path);
+  if (!f) {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+             "failed to store working set record (%d)", errno);
+    return;
+  }
+
+  for (unsigned i = 0; i < catalog_mountpoints.size(); ++i) {
+    // The root catalog is loaded on mount anyway
+    if (catalog_mountpoints[i].empty())
+      continue;
+    fprintf(f, "%c %s\n", kEntryCatalog, catalog_mountpoints[i].c_str());
+  }
+
+  // Files of this session first, then the ones from the previous session
+  // that have not been touched again, up to max_entries_
+  set<string> seen;
+  unsigned num_files = 0;
+  for (unsigned i = 0; (i < recorded.size()) && (num_files < max_entries_);
+       ++i)
+  {
+    const string &path = recorded[i];
+    if (path.find('\n') != string::npos)
+      continue;
+    fprintf(f, "%c %s\n", kEntryFile, path.c_str());
+    seen.insert(path);
+    num_files++;
+  }
+  for (unsigned i = 0; (i < previous_->size()) && (num_files < max_entries_);
+       ++i)
+  {
+    const Entry &entry = (*previous_)[i];
+    if ((entry.type != kEntryFile) || (seen.find(entry.path) != seen.end()))
+      continue;
+    fprintf(f, "%c %s\n", kEntryFile, entry.path.c_str());
+    seen.insert(entry.path);
+    num_files++;
+  }
+
+  if (fclose(f) != 0) {
+    unlink(temp_path.c_str());
+    return;
+  }
+  if (rename(temp_path.c_str(), record_path_->c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return;
+  }
+  LogCvmfs(kLogCvmfs, kLogDebug, "stored working set record (%u catalogs, "
+           "%u files)", static_cast<unsigned>(catalog_mountpoints.size()),
+           num_files);
+}
+
+
+/**
+ * Stores the record whenever enough new files have been opened or the flush
+ * interval has passed with new files.  Terminates with the replay threads.
+ */
+static void *MainFlush(void *data __attribute__((unused))) {
+  LogCvmfs(kLogCvmfs, kLogDebug, "starting working set flush thread");
+
+  pthread_mutex_lock(&lock_recorded_);
+  while (atomic_read32(&terminate_) == 0) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + kFlushIntervalSec;
+    deadline.tv_nsec = now.tv_usec * 1000;
+    while ((atomic_read32(&terminate_) == 0) &&
+           (recorded_->size() < num_stored_ + kFlushEntries))
+    {
+      if (pthread_cond_timedwait(&cond_flush_, &lock_recorded_, &deadline)
+          == ETIMEDOUT)
+      {
+        break;
+      }
+    }
+    if ((atomic_read32(&terminate_) != 0) ||
+        (recorded_->size() == num_stored_))
+    {
+      continue;
+    }
+
+    const vector<string> recorded(*recorded_);
+    num_stored_ = recorded.size();
+    pthread_mutex_unlock(&lock_recorded_);
+    StoreRecord(mountpoints_(), recorded);
+    pthread_mutex_lock(&lock_recorded_);
+  }
+  pthread_mutex_unlock(&lock_recorded_);
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "stopping working set flush thread");
+  return NULL;
+}
+
+
+static void *MainReplay(void *data __attribute__((unused))) {
+  LogCvmfs(kLogCvmfs, kLogDebug, "starting working set replay thread");
+
+  const int32_t num_entries = previous_->size();
+  while (atomic_read32(&terminate_) == 0) {
+    const int32_t idx = atomic_xadd32(&next_entry_, 1);
+    if (idx >= num_entries)
+      break;
+    const Entry &entry = (*previous_)[idx];
+    if (replay_(entry.type, entry.path)) {
+      atomic_inc32(&num_replayed_);
+    } else {
+      LogCvmfs(kLogCvmfs, kLogDebug, "failed to replay %s",
+               entry.path.c_str());
+      atomic_inc32(&num_failed_);
+    }
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "stopping working set replay thread");
+  return NULL;
+}
+
+
+/**
+ * Loads the working set of the previous session.  Replay starts with Spawn().
+ */
+bool Init(const string &record_path, const unsigned max_entries,
+          ReplayFunction replay, MountpointsFunction mountpoints)
+{
+  assert((replay != NULL) && (mountpoints != NULL));
+  record_path_ = new string(record_path);
+  max_entries_ = max_entries;
+  replay_ = replay;
+  mountpoints_ = mountpoints;
+  num_stored_ = 0;
+  previous_ = new vector<Entry>();
+  recorded_ = new vector<string>();
+  recorded_set_ = new set<string>();
+  threads_replay_ = new vector<pthread_t>();
+  atomic_init32(&next_entry_);
+  atomic_init32(&num_replayed_);
+  atomic_init32(&num_failed_);
+  atomic_init32(&terminate_);
+
+  LoadRecord();
+  active_ = true;
+  return true;
+}
+
+
+/**
+ * Has to be called after fork()
+ */
+void Spawn() {
+  if (!active_)
+    return;
+  int retval = pthread_create(&thread_flush_, NULL, MainFlush, NULL);
+  assert(retval == 0);
+  flush_running_ = true;
+
+  if (previous_->empty())
+    return;
+  for (unsigned i = 0; i < kNumReplayThreads; ++i) {
+    pthread_t thread;
+    retval = pthread_create(&thread, NULL, MainReplay, NULL);
+    assert(retval == 0);
+    threads_replay_->push_back(thread);
+  }
+}
+
+
+/**
+ * Stops the replay and stores the working set of this session.  Has to be
+ * called while the catalogs are still available for the replay function.
+ */
+void Fini(const vector<string> &catalog_mountpoints) {
+  if (!active_)
+    return;
+  pthread_mutex_lock(&lock_recorded_);
+  atomic_cas32(&terminate_, 0, 1);
+  pthread_cond_signal(&cond_flush_);
+  pthread_mutex_unlock(&lock_recorded_);
+  for (unsigned i = 0; i < threads_replay_->size(); ++i)
+    pthread_join((*threads_replay_)[i], NULL);
+  if (flush_running_) {
+    pthread_join(thread_flush_, NULL);
+    flush_running_ = false;
+  }
+
+  pthread_mutex_lock(&lock_recorded_);
+  active_ = false;
+  pthread_mutex_unlock(&lock_recorded_);
+  StoreRecord(catalog_mountpoints, *recorded_);
+
+  delete threads_replay_;
+  delete recorded_set_;
+  delete recorded_;
+  delete previous_;
+  delete record_path_;
+  threads_replay_ = NULL;
+  recorded_set_ = NULL;
+  recorded_ = NULL;
+  previous_ = NULL;
+  record_path_ = NULL;
+}
+
+
+void RecordFile(const PathString &path) {
+  if (!active_)
+    return;
+  pthread_mutex_lock(&lock_recorded_);
+  if (active_ && (recorded_->size() < max_entries_)) {
+    const string path_str(path.GetChars(), path.GetLength());
+    if (recorded_set_->insert(path_str).second) {
+      recorded_->push_back(path_str);
+      if (recorded_->size() == num_stored_ + kFlushEntries)
+        pthread_cond_signal(&cond_flush_);
+    }
+  }
+  pthread_mutex_unlock(&lock_recorded_);
+}
+
+
+string GetStatistics() {
+  if (!active_)
+    return "disabled\n";
+  pthread_mutex_lock(&lock_recorded_);
+  const unsigned num_recorded = recorded_->size();
+  pthread_mutex_unlock(&lock_recorded_);
+  return "replayed: " + StringifyInt(atomic_read32(&num_replayed_)) +
+    "    failed: " + StringifyInt(atomic_read32(&num_failed_)) +
+    "    of: " + StringifyInt(previous_->size()) +
+    "    recorded: " + StringifyInt(num_recorded) + "\n";
+}
+
+}  // namespace warmup
@@ -0,0 +1,42 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_WARMUP_H_
+#define CVMFS_WARMUP_H_
+
+#include <string>
+#include <vector>
+
+#include "shortstring.h"
+
+namespace warmup {
+
+enum EntryType {
+  kEntryCatalog = 'C',
+  kEntryFile = 'F',
+};
+
+/**
+ * Brings a recorded entry back into the cache.  Provided by the Fuse module,
+ * which resolves the path against the currently loaded catalogs.
+ */
+typedef bool (*ReplayFunction)(const EntryType type, const std::string &path);
+/**
+ * Mountpoints of the currently loaded nested catalogs, stored along with the
+ * opened files.
+ */
+typedef std::vector<std::string> (*MountpointsFunction)();
+
+bool Init(const std::string &record_path, const unsigned max_entries,
+          ReplayFunction replay, MountpointsFunction mountpoints);
+void Fini(const std::vector<std::string> &catalog_mountpoints);
+void Spawn();
+
+void RecordFile(const PathString &path);
+
+std::string GetStatistics();
+
+}  // namespace warmup
+
+#endif  // CVMFS_WARMUP_H_
@@ -0,0 +1,105 @@
+#!/usr/bin/python
+
+import BaseHTTPServer
+import SocketServer
+import sys
+import threading
+import time
+import urllib2
+import datetime
+
+def usage():
+	print >> sys.stderr, "This runs a minimal forward HTTP proxy on a given port number."
+	print >> sys.stderr, "Every request is logged with the port number, so that the load"
+	print >> sys.stderr, "distribution over several proxies can be counted from the logs."
+	print >> sys.stderr, "A delay given as <ms>/<n> stalls only every n-th request."
+	print >> sys.stderr, "Usage:" , sys.argv[0] , "<port number> [delay in ms[/n]] [upstream proxy]"
+	sys.stderr.flush()
+	sys.exit(1)
+
+print_lock = threading.Lock()
+def print_msg(msg):
+	global print_lock
+	print_lock.acquire()
+	print "[Forward Proxy]" , msg
+	print_lock.release()
+	sys.stdout.flush()
+
+
+class ForwardHandler(BaseHTTPServer.BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def do_GET(self):
+		self._Forward(True)
+
+	def do_HEAD(self):
+		self._Forward(False)
+
+	def _Forward(self, with_body):
+		global num_requests
+		print_lock.acquire()
+		num_requests += 1
+		stall = (num_requests % stall_every) == 0
+		print_lock.release()
+		if delay_ms > 0 and stall:
+			print_msg("(" + str(server_port) + ") stalling " + self.path)
+			time.sleep(delay_ms / 1000.0)
+		status = 502
+		body   = ""
+		try:
+			request = urllib2.Request(self.path)
+			if not with_body:
+				request.get_method = lambda: "HEAD"
+			response = opener.open(request, timeout = 30)
+			status = response.getcode()
+			body   = response.read()
+		except urllib2.HTTPError, e:
+			status = e.code
+		except Exception, e:
+			print_msg("(" + str(server_port) + ") upstream error for " + self.path + ": " + str(e))
+		print_msg("(" + str(server_port) + ") " + str(datetime.datetime.now()) + " " + self.command + " " + self.path + " " + str(status))
+
+		self.send_response(status)
+		self.send_header("Content-Length", str(len(body)))
+		self.end_headers()
+		if with_body:
+			self.wfile.write(body)
+
+	def log_message(self, format, *args):
+		pass
+
+class ThreadedHTTPServer(SocketServer.ThreadingMixIn, BaseHTTPServer.HTTPServer):
+	daemon_threads = True
+
+
+if len(sys.argv) < 2 or len(sys.argv) > 4:
+	usage()
+
+server_port  = 0
+delay_ms     = 0
+stall_every  = 1
+num_requests = 0
+try:
+	server_port = int(sys.argv[1])
+	if len(sys.argv) > 2:
+		delay = sys.argv[2].split("/")
+		delay_ms = int(delay[0])
+		if len(delay) > 1:
+			stall_every = int(delay[1])
+except:
+	usage()
+if stall_every < 1:
+	usage()
+
+if len(sys.argv) > 3:
+	opener = urllib2.build_opener(urllib2.ProxyHandler({"http": sys.argv[3]}))
+else:
+	opener = urllib2.build_opener(urllib2.ProxyHandler({}))
+
+try:
+	server = ThreadedHTTPServer(('localhost', server_port), ForwardHandler)
+	print_msg("starting a forward proxy on port " + str(server_port))
+	server.serve_forever()
+except Exception, msg:
+	print_msg("Failed to open port")
+	print msg
@@ -275,6 +275,32 @@ TEST_F (T_AsyncReader, ReadHugeFile) {
 //
 
 
+TEST_F (T_AsyncReader, ReadHugeFileWithoutIoThreads) {
+  TestFile *f = new TestFile(GetHugeFile(), GetHugeFileHash());
+
+  const size_t        max_buffer_size = 524288; // will NOT fit in one buffer
+  const unsigned int  max_buffers_in_flight = 10;
+  const unsigned int  tbb_threads = 2;
+  const unsigned int  io_threads = 0;  // Reader thread reads by itself
+
+  MyReader reader(max_buffer_size, max_buffers_in_flight, tbb_threads,
+                  io_threads);
+  reader.Initialize();
+
+  reader.ScheduleRead(f);
+  reader.Wait();
+
+  f->CheckHash();
+
+  reader.TearDown();
+}
+
+
+//
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+//
+
+
 TEST_F (T_AsyncReader, ReadManyBigFiles) {
   const int file_count = 5000;
 
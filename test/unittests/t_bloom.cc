@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "../../cvmfs/bloom.h"
+#include "../../cvmfs/catalog_rw.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/util.h"
+
+#include "testutil.h"
+
+class T_Bloom : public ::testing::Test {
+ protected:
+  static shash::Md5 MakePath(const unsigned i) {
+    const std::string path = "/software/lib/python2.7/" + StringifyInt(i);
+    return shash::Md5(path.data(), path.length());
+  }
+
+  static const unsigned kNumEntries = 100000;
+};
+
+
+TEST_F(T_Bloom, Empty) {
+  Md5BloomFilter filter(0);
+  EXPECT_EQ(0U, filter.size());
+  EXPECT_GE(filter.num_bits(), 64U);
+  EXPECT_FALSE(filter.Contains(MakePath(0)));
+}
+
+
+TEST_F(T_Bloom, NoFalseNegatives) {
+  Md5BloomFilter filter(kNumEntries);
+  for (unsigned i = 0; i < kNumEntries; ++i)
+    filter.Insert(MakePath(i));
+  EXPECT_EQ(static_cast<uint64_t>(kNumEntries), filter.size());
+
+  for (unsigned i = 0; i < kNumEntries; ++i)
+    EXPECT_TRUE(filter.Contains(MakePath(i)));
+}
+
+
+TEST_F(T_Bloom, FalsePositiveRate) {
+  Md5BloomFilter filter(kNumEntries);
+  for (unsigned i = 0; i < kNumEntries; ++i)
+    filter.Insert(MakePath(i));
+
+  unsigned false_positives = 0;
+  for (unsigned i = kNumEntries; i < 2*kNumEntries; ++i) {
+    if (filter.Contains(MakePath(i)))
+      false_positives++;
+  }
+  // Expected around 1%
+  EXPECT_LT(false_positives, kNumEntries / 50);
+}
+
+
+TEST_F(T_Bloom, CatalogPathFilter) {
+  const std::string file = "/tmp/cvmfs_ut_bloom." + StringifyInt(getpid());
+  const shash::Any hash(shash::kSha1);
+  ASSERT_TRUE(catalog::Database::Create(
+    file, "", catalog::DirectoryEntryTestFactory::Directory("")));
+  catalog::WritableCatalog *writable =
+    catalog::WritableCatalog::AttachFreely("", file, hash);
+  ASSERT_TRUE(writable != NULL);
+  writable->AddEntry(
+    catalog::DirectoryEntryTestFactory::RegularFile("file", hash), "/file", "");
+  writable->Commit();
+  delete writable;
+
+  catalog::Catalog *catalog = catalog::Catalog::AttachFreely("", file, hash);
+  ASSERT_TRUE(catalog != NULL);
+  catalog->EnablePathFilter();
+  catalog::DirectoryEntry dirent;
+  const PathString existing("/file", 5);
+  // The filter is built lazily after enough negative lookups
+  for (unsigned i = 0; i < catalog::Catalog::kPathFilterMinMisses; ++i) {
+    EXPECT_FALSE(catalog->HasPathFilter());
+    const std::string path = "/missing" + StringifyInt(i);
+    EXPECT_FALSE(
+      catalog->LookupPath(PathString(path.data(), path.length()), &dirent));
+    EXPECT_TRUE(catalog->LookupPath(existing, &dirent));
+  }
+  EXPECT_TRUE(catalog->HasPathFilter());
+  EXPECT_TRUE(catalog->LookupPath(existing, &dirent));
+  EXPECT_FALSE(catalog->LookupPath(PathString("/missing", 8), &dirent));
+
+  delete catalog;
+  EXPECT_EQ(0, unlink(file.c_str()));
+}
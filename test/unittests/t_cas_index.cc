@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/upload_cas_index.h"
+#include "../../cvmfs/util.h"
+
+using namespace upload;  // NOLINT
+
+
+class T_CasIndex : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    upstream_path_ = "/tmp/cvmfs_ut_cas_index." + StringifyInt(getpid());
+    ASSERT_TRUE(MkdirDeep(upstream_path_ + "/data/txn", 0755));
+    for (unsigned i = 0; i < 256; ++i) {
+      char dir_name[3];
+      snprintf(dir_name, sizeof(dir_name), "%02x", i);
+      ASSERT_TRUE(MkdirDeep(upstream_path_ + "/data/" + dir_name, 0755));
+    }
+
+    for (unsigned i = 0; i < 1000; ++i) {
+      shash::Any hash(i % 2 ? shash::kSha1 : shash::kMd5);
+      hash.Randomize();
+      const std::string suffix = (i % 3 == 0) ? "C" : "";
+      const std::string path = "data" + hash.MakePath(1, 2) + suffix;
+      MakeFile(path);
+      objects_.push_back(path);
+    }
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(RemoveTree(upstream_path_));
+  }
+
+  void MakeFile(const std::string &path) {
+    FILE *f = fopen((upstream_path_ + "/" + path).c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fclose(f);
+  }
+
+  std::string RandomObject(const std::string &suffix = "") {
+    shash::Any hash(shash::kSha1);
+    hash.Randomize();
+    return "data" + hash.MakePath(1, 2) + suffix;
+  }
+
+  bool IsPresent(const CasIndex &index, const std::string &path) {
+    bool present = false;
+    EXPECT_TRUE(index.Lookup(path, &present));
+    return present;
+  }
+
+  std::string upstream_path_;
+  std::vector<std::string> objects_;
+};
+
+
+TEST_F(T_CasIndex, ParsePath) {
+  CasIndex::Key key;
+  EXPECT_TRUE(CasIndex::ParsePath(
+    "data/ab/cdef0123456789abcdef0123456789abcdef01", &key));
+  EXPECT_EQ(0xab, key.bytes[0]);
+  EXPECT_EQ(0x01, key.bytes[19]);
+  EXPECT_EQ(20, key.bytes[20]);
+  EXPECT_EQ(0, key.bytes[21]);
+
+  EXPECT_TRUE(CasIndex::ParsePath("data/ab/cdef0123456789abcdef0123456789X",
+                                  &key));
+  EXPECT_EQ(16, key.bytes[20]);
+  EXPECT_EQ('X', key.bytes[21]);
+  EXPECT_EQ(0, key.bytes[16]);
+
+  EXPECT_FALSE(CasIndex::ParsePath("data/txn", &key));
+  EXPECT_FALSE(CasIndex::ParsePath("data/ab", &key));
+  EXPECT_FALSE(CasIndex::ParsePath("data/ab/cdef", &key));
+  EXPECT_FALSE(CasIndex::ParsePath(".cvmfspublished", &key));
+  EXPECT_FALSE(CasIndex::ParsePath(
+    "data/ab/cdef0123456789abcdef0123456789abcdeg", &key));
+  EXPECT_FALSE(CasIndex::ParsePath(
+    "dat/ab/cdef0123456789abcdef0123456789abcdef01", &key));
+}
+
+
+TEST_F(T_CasIndex, NoIndex) {
+  CasIndex index(upstream_path_);
+  EXPECT_FALSE(index.Open());
+  bool present;
+  EXPECT_FALSE(index.Lookup(objects_[0], &present));
+}
+
+
+TEST_F(T_CasIndex, Rebuild) {
+  uint64_t num_objects = 0;
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+  EXPECT_EQ(objects_.size(), num_objects);
+
+  CasIndex index(upstream_path_);
+  ASSERT_TRUE(index.Open());
+  EXPECT_EQ(objects_.size(), index.size());
+  for (unsigned i = 0; i < objects_.size(); ++i)
+    EXPECT_TRUE(IsPresent(index, objects_[i])) << objects_[i];
+  for (unsigned i = 0; i < 100; ++i)
+    EXPECT_FALSE(IsPresent(index, RandomObject()));
+
+  // Same digest, different suffix
+  const std::string plain = RandomObject();
+  MakeFile(plain);
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+  ASSERT_TRUE(index.Open());
+  EXPECT_TRUE(IsPresent(index, plain));
+  EXPECT_FALSE(IsPresent(index, plain + "C"));
+
+  bool present;
+  EXPECT_FALSE(index.Lookup("data/txn", &present));
+}
+
+
+TEST_F(T_CasIndex, InsertErase) {
+  uint64_t num_objects = 0;
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+
+  std::vector<std::string> inserted;
+  {
+    CasIndex index(upstream_path_);
+    ASSERT_TRUE(index.Open());
+    for (unsigned i = 0; i < 100; ++i) {
+      inserted.push_back(RandomObject(i % 2 ? "P" : ""));
+      index.Insert(inserted.back());
+      EXPECT_TRUE(IsPresent(index, inserted.back()));
+    }
+    index.Insert(objects_[0]);
+
+    index.Erase(objects_[1]);
+    EXPECT_FALSE(IsPresent(index, objects_[1]));
+    // Erase does not commit on its own
+    EXPECT_EQ(objects_.size(), index.size());
+    {
+      CasIndex other(upstream_path_);
+      ASSERT_TRUE(other.Open());
+      EXPECT_TRUE(IsPresent(other, objects_[1]));
+      EXPECT_FALSE(IsPresent(other, inserted[1]));
+    }
+
+    index.Erase(inserted[0]);
+    index.Insert(objects_[1]);
+    EXPECT_TRUE(IsPresent(index, objects_[1]));
+    EXPECT_TRUE(index.Commit());
+    EXPECT_EQ(objects_.size() + inserted.size() - 1, index.size());
+  }
+
+  CasIndex index(upstream_path_);
+  ASSERT_TRUE(index.Open());
+  EXPECT_EQ(objects_.size() + inserted.size() - 1, index.size());
+  for (unsigned i = 0; i < objects_.size(); ++i)
+    EXPECT_TRUE(IsPresent(index, objects_[i])) << objects_[i];
+  EXPECT_FALSE(IsPresent(index, inserted[0]));
+  for (unsigned i = 1; i < inserted.size(); ++i)
+    EXPECT_TRUE(IsPresent(index, inserted[i])) << inserted[i];
+}
+
+
+TEST_F(T_CasIndex, ConcurrentWriters) {
+  uint64_t num_objects = 0;
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+
+  CasIndex index1(upstream_path_);
+  CasIndex index2(upstream_path_);
+  ASSERT_TRUE(index1.Open());
+  ASSERT_TRUE(index2.Open());
+  const std::string object1 = RandomObject();
+  const std::string object2 = RandomObject();
+  index1.Insert(object1);
+  index2.Insert(object2);
+  EXPECT_TRUE(index1.Commit());
+  EXPECT_TRUE(index2.Commit());
+
+  // The second commit merges into the index written by the first one
+  EXPECT_TRUE(IsPresent(index2, object1));
+  EXPECT_TRUE(IsPresent(index2, object2));
+  EXPECT_EQ(objects_.size() + 2, index2.size());
+}
+
+
+TEST_F(T_CasIndex, Remove) {
+  uint64_t num_objects = 0;
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+
+  CasIndex index(upstream_path_);
+  ASSERT_TRUE(index.Open());
+  index.Insert(objects_[1]);
+  ASSERT_TRUE(index.Remove(objects_[0]));
+  EXPECT_FALSE(FileExists(upstream_path_ + "/" + objects_[0]));
+  EXPECT_FALSE(IsPresent(index, objects_[0]));
+  EXPECT_FALSE(index.Remove(objects_[0]));
+
+  // The removal is in the index file before the index is destroyed
+  {
+    CasIndex other(upstream_path_);
+    ASSERT_TRUE(other.Open());
+    EXPECT_FALSE(IsPresent(other, objects_[0]));
+    EXPECT_TRUE(IsPresent(other, objects_[1]));
+    EXPECT_EQ(objects_.size() - 1, other.size());
+  }
+
+  // Other files are just unlinked
+  MakeFile("data/txn/file");
+  EXPECT_TRUE(index.Remove("data/txn/file"));
+  EXPECT_FALSE(FileExists(upstream_path_ + "/data/txn/file"));
+}
+
+
+TEST_F(T_CasIndex, StaleMapping) {
+  uint64_t num_objects = 0;
+  ASSERT_TRUE(CasIndex::Rebuild(upstream_path_, &num_objects));
+
+  CasIndex reader(upstream_path_, 0);
+  ASSERT_TRUE(reader.Open());
+  CasIndex lazy_reader(upstream_path_);
+  ASSERT_TRUE(lazy_reader.Open());
+  EXPECT_TRUE(IsPresent(reader, objects_[0]));
+  const std::string object = RandomObject();
+  EXPECT_FALSE(IsPresent(reader, object));
+
+  {
+    CasIndex writer(upstream_path_);
+    ASSERT_TRUE(writer.Open());
+    writer.Erase(objects_[0]);
+    writer.Insert(object);
+    EXPECT_TRUE(IsPresent(reader, objects_[0]));
+  }
+
+  // The reader maps the index again that the writer committed on destruction
+  EXPECT_FALSE(IsPresent(reader, objects_[0]));
+  // Unless it has checked the index file only a moment ago
+  EXPECT_TRUE(IsPresent(lazy_reader, objects_[0]));
+  EXPECT_TRUE(IsPresent(reader, object));
+  EXPECT_EQ(objects_.size(), reader.size());
+
+  // Without an index file, the reader cannot tell anymore
+  ASSERT_EQ(0, unlink((upstream_path_ + "/" + CasIndex::kFileName).c_str()));
+  bool present;
+  EXPECT_FALSE(reader.Lookup(object, &present));
+}
+
+
+TEST_F(T_CasIndex, InvalidIndex) {
+  FILE *f = fopen((upstream_path_ + "/" + CasIndex::kFileName).c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "garbage");
+  fclose(f);
+
+  CasIndex index(upstream_path_);
+  EXPECT_FALSE(index.Open());
+}
@@ -0,0 +1,312 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../cvmfs/catalog_diff.h"
+#include "../../cvmfs/catalog_rw.h"
+#include "../../cvmfs/util.h"
+
+#include "testutil.h"
+
+using namespace catalog;  // NOLINT
+
+
+/**
+ * Serves catalogs from files and records the reported changes.
+ */
+class RecordingDiff : public CatalogDiff {
+ public:
+  explicit RecordingDiff(const std::map<shash::Any, std::string> &files)
+    : files_(files) { }
+
+  std::set<std::string> added;
+  std::set<std::string> removed;
+  std::map<std::string, DirectoryEntryBase::Differences> modified;
+
+ protected:
+  Catalog *LoadCatalog(const PathString &mountpoint,
+                       const shash::Any &catalog_hash)
+  {
+    std::map<shash::Any, std::string>::const_iterator i =
+      files_.find(catalog_hash);
+    if (i == files_.end())
+      return NULL;
+    return Catalog::AttachFreely(mountpoint.ToString(), i->second,
+                                 catalog_hash);
+  }
+
+  void OnAdd(const PathString &path, const DirectoryEntry &entry) {
+    EXPECT_TRUE(added.insert(path.ToString()).second);
+  }
+
+  void OnRemove(const PathString &path, const DirectoryEntry &entry) {
+    EXPECT_TRUE(removed.insert(path.ToString()).second);
+  }
+
+  void OnModify(const PathString &path,
+                const DirectoryEntry &old_entry,
+                const DirectoryEntry &new_entry,
+                const DirectoryEntryBase::Differences diff)
+  {
+    EXPECT_TRUE(modified.insert(std::make_pair(path.ToString(), diff)).second);
+  }
+
+ private:
+  const std::map<shash::Any, std::string> &files_;
+};
+
+
+class T_CatalogDiff : public ::testing::Test {
+ protected:
+  struct Entry {
+    Entry(const std::string &p, const DirectoryEntry &e) : path(p), entry(e) { }
+    std::string path;
+    DirectoryEntry entry;
+  };
+  typedef std::vector<Entry> EntryList;
+  typedef std::vector<std::pair<std::string, shash::Any> > NestedList;
+
+  virtual void SetUp() {
+    sandbox_ = "/tmp/cvmfs_ut_catalog_diff." + StringifyInt(getpid());
+    ASSERT_TRUE(MkdirDeep(sandbox_, 0755));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(RemoveTree(sandbox_));
+  }
+
+  static DirectoryEntry Dir(const std::string &name) {
+    return DirectoryEntryTestFactory::Directory(name);
+  }
+
+  static DirectoryEntry File(const std::string &name, const int content = 0) {
+    shash::Any hash(shash::kSha1);
+    hash.digest[0] = content;
+    return DirectoryEntryTestFactory::RegularFile(name, hash);
+  }
+
+  static DirectoryEntry Mountpoint(const std::string &name) {
+    DirectoryEntry dirent = Dir(name);
+    dirent.set_is_nested_catalog_mountpoint(true);
+    return dirent;
+  }
+
+  /**
+   * Creates a catalog at mountpoint with the given entries (parents first).
+   * @return  a random hash that identifies the catalog
+   */
+  shash::Any MakeCatalog(const std::string &mountpoint,
+                         const EntryList &entries,
+                         const NestedList &nested = NestedList())
+  {
+    shash::Any hash(shash::kSha1);
+    hash.Randomize();
+    const std::string file = sandbox_ + "/" + hash.ToString();
+
+    DirectoryEntry root = Dir(GetFileName(mountpoint));
+    root.set_is_nested_catalog_root(!mountpoint.empty());
+    EXPECT_TRUE(Database::Create(file, mountpoint, root));
+    WritableCatalog *catalog =
+      WritableCatalog::AttachFreely(mountpoint, file, hash);
+    EXPECT_TRUE(catalog != NULL);
+    for (unsigned i = 0; i < entries.size(); ++i)
+      catalog->AddEntry(entries[i].entry, entries[i].path,
+                        GetParentPath(entries[i].path));
+    for (unsigned i = 0; i < nested.size(); ++i)
+      catalog->InsertNestedCatalog(nested[i].first, NULL, nested[i].second, 0);
+    catalog->Commit();
+    delete catalog;
+
+    files_[hash] = file;
+    return hash;
+  }
+
+  EntryList BaseEntries() {
+    EntryList entries;
+    entries.push_back(Entry("/dir", Dir("dir")));
+    entries.push_back(Entry("/dir/sub", Dir("sub")));
+    entries.push_back(Entry("/dir/sub/file", File("file")));
+    entries.push_back(Entry("/dir/other", File("other")));
+    entries.push_back(Entry("/top", File("top")));
+    return entries;
+  }
+
+  std::string sandbox_;
+  std::map<shash::Any, std::string> files_;
+};
+
+
+TEST_F(T_CatalogDiff, Identical) {
+  const shash::Any root = MakeCatalog("", BaseEntries());
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", root, root));
+  EXPECT_EQ(0U, diff.statistics().num_catalogs_loaded);
+  EXPECT_EQ(1U, diff.statistics().num_catalogs_skipped);
+  EXPECT_TRUE(diff.added.empty());
+  EXPECT_TRUE(diff.removed.empty());
+  EXPECT_TRUE(diff.modified.empty());
+}
+
+
+TEST_F(T_CatalogDiff, SingleCatalog) {
+  const shash::Any old_root = MakeCatalog("", BaseEntries());
+
+  EntryList entries = BaseEntries();
+  entries[2].entry = File("file", 1);
+  entries.erase(entries.begin() + 3);
+  entries.push_back(Entry("/dir/sub/new", File("new")));
+  const shash::Any new_root = MakeCatalog("", entries);
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", old_root, new_root));
+  EXPECT_EQ(2U, diff.statistics().num_catalogs_loaded);
+  EXPECT_EQ(5U, diff.statistics().num_entries_compared);
+
+  ASSERT_EQ(1U, diff.added.size());
+  EXPECT_EQ("/dir/sub/new", *diff.added.begin());
+  ASSERT_EQ(1U, diff.removed.size());
+  EXPECT_EQ("/dir/other", *diff.removed.begin());
+  ASSERT_EQ(1U, diff.modified.size());
+  EXPECT_EQ("/dir/sub/file", diff.modified.begin()->first);
+  EXPECT_EQ(static_cast<DirectoryEntryBase::Differences>(
+              DirectoryEntryBase::Difference::kChecksum),
+            diff.modified.begin()->second);
+}
+
+
+TEST_F(T_CatalogDiff, Empty) {
+  const shash::Any root = MakeCatalog("", BaseEntries());
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", shash::Any(shash::kSha1), root));
+  // root directory and base entries
+  EXPECT_EQ(6U, diff.added.size());
+  EXPECT_EQ(1U, diff.added.count(""));
+  EXPECT_EQ(1U, diff.added.count("/dir/sub/file"));
+  EXPECT_TRUE(diff.removed.empty());
+}
+
+
+TEST_F(T_CatalogDiff, SkipUnchangedNested) {
+  EntryList nested_entries;
+  nested_entries.push_back(Entry("/nested/file", File("file")));
+  const shash::Any nested = MakeCatalog("/nested", nested_entries);
+
+  EntryList entries = BaseEntries();
+  entries.push_back(Entry("/nested", Mountpoint("nested")));
+  NestedList nested_list;
+  nested_list.push_back(std::make_pair("/nested", nested));
+  const shash::Any old_root = MakeCatalog("", entries, nested_list);
+  entries.push_back(Entry("/new", File("new")));
+  const shash::Any new_root = MakeCatalog("", entries, nested_list);
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", old_root, new_root));
+  EXPECT_EQ(2U, diff.statistics().num_catalogs_loaded);
+  EXPECT_EQ(1U, diff.statistics().num_catalogs_skipped);
+  ASSERT_EQ(1U, diff.added.size());
+  EXPECT_EQ("/new", *diff.added.begin());
+  EXPECT_TRUE(diff.removed.empty());
+  EXPECT_TRUE(diff.modified.empty());
+}
+
+
+TEST_F(T_CatalogDiff, ChangedNested) {
+  EntryList nested_entries;
+  nested_entries.push_back(Entry("/nested/sub", Dir("sub")));
+  nested_entries.push_back(Entry("/nested/sub/file", File("file")));
+  const shash::Any old_nested = MakeCatalog("/nested", nested_entries);
+  nested_entries[1].entry = File("file", 2);
+  const shash::Any new_nested = MakeCatalog("/nested", nested_entries);
+
+  EntryList entries = BaseEntries();
+  entries.push_back(Entry("/nested", Mountpoint("nested")));
+  NestedList nested_list;
+  nested_list.push_back(std::make_pair("/nested", old_nested));
+  const shash::Any old_root = MakeCatalog("", entries, nested_list);
+  nested_list[0].second = new_nested;
+  const shash::Any new_root = MakeCatalog("", entries, nested_list);
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", old_root, new_root));
+  EXPECT_EQ(4U, diff.statistics().num_catalogs_loaded);
+  // The nested catalogs are compared after the root catalogs are closed
+  EXPECT_EQ(2U, diff.statistics().max_catalogs_open);
+  EXPECT_TRUE(diff.added.empty());
+  EXPECT_TRUE(diff.removed.empty());
+  ASSERT_EQ(1U, diff.modified.size());
+  EXPECT_EQ("/nested/sub/file", diff.modified.begin()->first);
+}
+
+
+TEST_F(T_CatalogDiff, NewNestedCatalog) {
+  // The sub tree of /dir moves into a new nested catalog
+  const shash::Any old_root = MakeCatalog("", BaseEntries());
+
+  EntryList nested_entries;
+  nested_entries.push_back(Entry("/dir/sub", Dir("sub")));
+  nested_entries.push_back(Entry("/dir/sub/file", File("file")));
+  nested_entries.push_back(Entry("/dir/other", File("other", 3)));
+  const shash::Any nested = MakeCatalog("/dir", nested_entries);
+
+  EntryList entries;
+  entries.push_back(Entry("/dir", Mountpoint("dir")));
+  entries.push_back(Entry("/top", File("top")));
+  NestedList nested_list;
+  nested_list.push_back(std::make_pair("/dir", nested));
+  const shash::Any new_root = MakeCatalog("", entries, nested_list);
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", old_root, new_root));
+  EXPECT_EQ(3U, diff.statistics().num_catalogs_loaded);
+  EXPECT_EQ(3U, diff.statistics().max_catalogs_open);
+  EXPECT_TRUE(diff.added.empty());
+  EXPECT_TRUE(diff.removed.empty());
+  ASSERT_EQ(2U, diff.modified.size());
+  EXPECT_EQ(static_cast<DirectoryEntryBase::Differences>(
+              DirectoryEntryBase::Difference::kNestedCatalogTransitionFlags),
+            diff.modified["/dir"]);
+  EXPECT_EQ(static_cast<DirectoryEntryBase::Differences>(
+              DirectoryEntryBase::Difference::kChecksum),
+            diff.modified["/dir/other"]);
+}
+
+
+TEST_F(T_CatalogDiff, NewRepository) {
+  EntryList nested_entries;
+  nested_entries.push_back(Entry("/nested/file", File("file")));
+  const shash::Any nested = MakeCatalog("/nested", nested_entries);
+
+  EntryList entries = BaseEntries();
+  entries.push_back(Entry("/nested", Mountpoint("nested")));
+  NestedList nested_list;
+  nested_list.push_back(std::make_pair("/nested", nested));
+  const shash::Any root = MakeCatalog("", entries, nested_list);
+
+  RecordingDiff diff(files_);
+  ASSERT_TRUE(diff.Run("", shash::Any(shash::kSha1), root));
+  EXPECT_EQ(2U, diff.statistics().num_catalogs_loaded);
+  EXPECT_EQ(1U, diff.statistics().max_catalogs_open);
+  EXPECT_EQ(8U, diff.added.size());
+  EXPECT_EQ(1U, diff.added.count("/nested"));
+  EXPECT_EQ(1U, diff.added.count("/nested/file"));
+  EXPECT_TRUE(diff.removed.empty());
+}
+
+
+TEST_F(T_CatalogDiff, MissingParent) {
+  const shash::Any old_root = MakeCatalog("", BaseEntries());
+  EntryList entries = BaseEntries();
+  entries.push_back(Entry("/missing/file", File("file")));
+  const shash::Any new_root = MakeCatalog("", entries);
+
+  RecordingDiff diff(files_);
+  EXPECT_FALSE(diff.Run("", old_root, new_root));
+  EXPECT_TRUE(diff.added.empty());
+}
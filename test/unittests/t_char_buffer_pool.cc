@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include "../../cvmfs/file_processing/char_buffer_pool.h"
+
+using namespace upload;
+
+
+TEST(T_CharBufferPool, SizeClasses) {
+  CharBufferPool pool;
+
+  CharBuffer *small = pool.Acquire(0);
+  EXPECT_EQ (4096u, small->size_bytes());
+  EXPECT_EQ (0u, small->used_bytes());
+
+  CharBuffer *medium = pool.Acquire(5000);
+  EXPECT_EQ (6144u, medium->size_bytes());
+
+  CharBuffer *block = pool.Acquire(512 * 1024);
+  EXPECT_EQ (512u * 1024u, block->size_bytes());
+
+  CharBuffer *deflate_block = pool.Acquire(512 * 1024 + 200);
+  EXPECT_EQ (768u * 1024u, deflate_block->size_bytes());
+
+  // bigger than the biggest size class
+  CharBuffer *huge = pool.Acquire(5 * 1024 * 1024);
+  EXPECT_EQ (5u * 1024u * 1024u, huge->size_bytes());
+
+  pool.Release(small);
+  pool.Release(medium);
+  pool.Release(block);
+  pool.Release(deflate_block);
+  pool.Release(huge);
+  EXPECT_EQ (4096u + 6144u + 512u * 1024u + 768u * 1024u, pool.idle_bytes());
+}
+
+
+TEST(T_CharBufferPool, Recycle) {
+  CharBufferPool pool;
+
+  CharBuffer *buffer = pool.Acquire(1000);
+  buffer->SetUsedBytes(100);
+  buffer->SetBaseOffset(42);
+  pool.Release(buffer);
+  EXPECT_EQ (1u, pool.allocated());
+
+  CharBuffer *recycled = pool.Acquire(2000);
+  EXPECT_EQ (buffer, recycled);
+  EXPECT_EQ (0u, recycled->used_bytes());
+  EXPECT_EQ (0, recycled->base_offset());
+  EXPECT_EQ (1u, pool.allocated());
+  EXPECT_EQ (1u, pool.recycled());
+  EXPECT_EQ (0u, pool.idle_bytes());
+
+  // a different size class needs a new buffer
+  CharBuffer *other = pool.Acquire(100000);
+  EXPECT_NE (buffer, other);
+  EXPECT_EQ (2u, pool.allocated());
+
+  pool.Release(recycled);
+  pool.Release(other);
+}
+
+
+TEST(T_CharBufferPool, MaxIdleBytes) {
+  CharBufferPool pool(0, 8192);
+
+  CharBuffer *b1 = pool.Acquire(4096);
+  CharBuffer *b2 = pool.Acquire(4096);
+  CharBuffer *b3 = pool.Acquire(4096);
+  pool.Release(b1);
+  pool.Release(b2);
+  pool.Release(b3);  // exceeds the limit, freed
+  EXPECT_EQ (8192u, pool.idle_bytes());
+}
+
+
+TEST(T_CharBufferPool, ForeignBuffer) {
+  CharBufferPool pool;
+
+  // buffers of the exact size of a size class are recycled
+  pool.Release(new CharBuffer(8192));
+  EXPECT_EQ (8192u, pool.idle_bytes());
+  pool.Release(new CharBuffer(8000));
+  EXPECT_EQ (8192u, pool.idle_bytes());
+
+  CharBuffer *buffer = pool.Acquire(8192);
+  EXPECT_EQ (0u, pool.allocated());
+  pool.Release(buffer);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/compression.h"
+#include "../../cvmfs/file_bundle.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/util.h"
+
+
+class T_FileBundle : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    sandbox_ = "/tmp/cvmfs_ut_file_bundle." + StringifyInt(getpid());
+    ASSERT_TRUE(MkdirDeep(sandbox_, 0700));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(RemoveTree(sandbox_));
+  }
+
+  FileBundleSource MakeSource(const std::string &name,
+                              const std::string &content)
+  {
+    const std::string path = sandbox_ + "/" + name;
+    FILE *f = fopen(path.c_str(), "w");
+    EXPECT_TRUE(f != NULL);
+    EXPECT_EQ(content.length(), fwrite(content.data(), 1, content.length(), f));
+    fclose(f);
+
+    void *compressed;
+    uint64_t compressed_size;
+    EXPECT_TRUE(zlib::CompressMem2Mem(content.data(), content.length(),
+                                      &compressed, &compressed_size));
+    shash::Any hash(shash::kSha1);
+    shash::HashMem(static_cast<unsigned char *>(compressed), compressed_size,
+                   &hash);
+    free(compressed);
+    return FileBundleSource(hash, content.length(), path);
+  }
+
+  std::string ReadBundle(const std::string &path) {
+    std::string result;
+    FILE *f = fopen(path.c_str(), "r");
+    EXPECT_TRUE(f != NULL);
+    char buf[1024];
+    size_t nbytes;
+    while ((nbytes = fread(buf, 1, sizeof(buf), f)) > 0)
+      result.append(buf, nbytes);
+    fclose(f);
+    return result;
+  }
+
+  bool Parse(const std::string &bundle, FileBundleIndex *index) {
+    return ParseFileBundleIndex(
+      reinterpret_cast<const unsigned char *>(bundle.data()), bundle.length(),
+      index);
+  }
+
+  std::string sandbox_;
+};
+
+
+TEST_F(T_FileBundle, WriteAndParse) {
+  std::vector<FileBundleSource> sources;
+  sources.push_back(MakeSource("a", "first file\n"));
+  sources.push_back(MakeSource("b", std::string("binary\0data", 11)));
+  sources.push_back(MakeSource("c", "x"));
+
+  const std::string bundle_path = sandbox_ + "/bundle";
+  uint64_t bundle_size = 0;
+  unsigned num_files = 0;
+  ASSERT_TRUE(WriteFileBundle(sources, bundle_path, &bundle_size, &num_files));
+  EXPECT_EQ(sources.size(), num_files);
+  const std::string bundle = ReadBundle(bundle_path);
+  EXPECT_EQ(bundle.length(), bundle_size);
+
+  FileBundleIndex index;
+  ASSERT_TRUE(Parse(bundle, &index));
+  ASSERT_EQ(sources.size(), index.size());
+  for (unsigned i = 0; i < sources.size(); ++i) {
+    EXPECT_EQ(sources[i].content_hash, index[i].content_hash);
+    EXPECT_EQ(sources[i].size, index[i].size);
+  }
+  EXPECT_EQ("first file\n", bundle.substr(index[0].offset, index[0].size));
+  EXPECT_EQ(std::string("binary\0data", 11),
+            bundle.substr(index[1].offset, index[1].size));
+  EXPECT_EQ("x", bundle.substr(index[2].offset, index[2].size));
+  EXPECT_EQ(bundle.length(), index[2].offset + index[2].size);
+}
+
+
+TEST_F(T_FileBundle, SizeMismatch) {
+  std::vector<FileBundleSource> sources;
+  sources.push_back(MakeSource("a", "first file\n"));
+  sources.push_back(MakeSource("b", "second file\n"));
+  sources.push_back(MakeSource("c", "third file\n"));
+  sources[1].size++;
+
+  // Files that changed in the meantime are left out
+  const std::string bundle_path = sandbox_ + "/bundle";
+  uint64_t bundle_size = 0;
+  unsigned num_files = 0;
+  ASSERT_TRUE(WriteFileBundle(sources, bundle_path, &bundle_size, &num_files));
+  EXPECT_EQ(2U, num_files);
+  FileBundleIndex index;
+  ASSERT_TRUE(Parse(ReadBundle(bundle_path), &index));
+  ASSERT_EQ(2U, index.size());
+  EXPECT_EQ(sources[0].content_hash, index[0].content_hash);
+  EXPECT_EQ(sources[2].content_hash, index[1].content_hash);
+
+  sources[1].size -= 2;
+  ASSERT_TRUE(WriteFileBundle(sources, bundle_path, &bundle_size, &num_files));
+  EXPECT_EQ(2U, num_files);
+
+  sources[1].local_path = sandbox_ + "/missing";
+  EXPECT_FALSE(WriteFileBundle(sources, bundle_path, &bundle_size, &num_files));
+  EXPECT_EQ(0U, bundle_size);
+  EXPECT_EQ(0U, num_files);
+}
+
+
+TEST_F(T_FileBundle, HashMismatch) {
+  std::vector<FileBundleSource> sources;
+  sources.push_back(MakeSource("a", "first file\n"));
+  sources.push_back(MakeSource("b", "second file\n"));
+  // Same size, different content
+  sources.push_back(MakeSource("c", "third file\n"));
+  sources[2].content_hash = MakeSource("d", "other file\n").content_hash;
+
+  const std::string bundle_path = sandbox_ + "/bundle";
+  uint64_t bundle_size = 0;
+  unsigned num_files = 0;
+  ASSERT_TRUE(WriteFileBundle(sources, bundle_path, &bundle_size, &num_files));
+  EXPECT_EQ(2U, num_files);
+  const std::string bundle = ReadBundle(bundle_path);
+  EXPECT_EQ(bundle.length(), bundle_size);
+
+  FileBundleIndex index;
+  ASSERT_TRUE(Parse(bundle, &index));
+  ASSERT_EQ(2U, index.size());
+  EXPECT_EQ(sources[0].content_hash, index[0].content_hash);
+  EXPECT_EQ(sources[1].content_hash, index[1].content_hash);
+  EXPECT_EQ("second file\n", bundle.substr(index[1].offset, index[1].size));
+  EXPECT_EQ(bundle.length(), index[1].offset + index[1].size);
+}
+
+
+TEST_F(T_FileBundle, Malformed) {
+  const std::string hash = "0123456789abcdef0123456789abcdef01234567";
+  FileBundleIndex index;
+
+  EXPECT_TRUE(Parse("\n", &index));
+  EXPECT_TRUE(index.empty());
+  EXPECT_TRUE(Parse(hash + " 3\n\nabc", &index));
+  ASSERT_EQ(1U, index.size());
+  EXPECT_EQ(hash, index[0].content_hash.ToString());
+
+  EXPECT_FALSE(Parse("", &index));
+  EXPECT_FALSE(Parse(hash + " 3\nabc", &index));
+  EXPECT_FALSE(Parse(hash + " 4\n\nabc", &index));
+  EXPECT_FALSE(Parse(hash + " 2\n\nabc", &index));
+  EXPECT_FALSE(Parse(hash + " x\n\nabc", &index));
+  EXPECT_FALSE(Parse(hash + "3\n\nabc", &index));
+  EXPECT_FALSE(Parse(hash.substr(1) + " 3\n\nabc", &index));
+  EXPECT_FALSE(Parse("g" + hash.substr(1) + " 3\n\nabc", &index));
+  EXPECT_FALSE(Parse(hash + " 18446744073709551615\n\nabc", &index));
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../../cvmfs/compression.h"
+#include "../../cvmfs/file_pack.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/util.h"
+
+
+class T_FilePack : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    sandbox_ = "/tmp/cvmfs_ut_file_pack." + StringifyInt(getpid());
+    ASSERT_TRUE(MkdirDeep(sandbox_, 0700));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(RemoveTree(sandbox_));
+  }
+
+  /**
+   * Compresses content like a publisher worker thread and appends it.
+   */
+  void AppendContent(FilePackWriter *writer,
+                     const std::string &content,
+                     shash::Any *content_hash,
+                     uint64_t *offset,
+                     uint64_t *size)
+  {
+    void *compressed;
+    ASSERT_TRUE(zlib::CompressMem2Mem(content.data(), content.length(),
+                                      &compressed, size));
+    shash::HashMem(static_cast<unsigned char *>(compressed), *size,
+                   content_hash);
+    const bool retval = writer->Append(static_cast<unsigned char *>(compressed),
+                                       *size, offset);
+    free(compressed);
+    ASSERT_TRUE(retval);
+  }
+
+  std::string ReadPack(const std::string &path) {
+    std::string result;
+    FILE *f = fopen(path.c_str(), "r");
+    EXPECT_TRUE(f != NULL);
+    char buf[1024];
+    size_t nbytes;
+    while ((nbytes = fread(buf, 1, sizeof(buf), f)) > 0)
+      result.append(buf, nbytes);
+    fclose(f);
+    return result;
+  }
+
+  /**
+   * Checks that a byte range of the pack is a valid object of the given
+   * content.
+   */
+  void ExpectObject(const std::string &pack,
+                    const uint64_t offset,
+                    const uint64_t size,
+                    const shash::Any &content_hash,
+                    const std::string &content)
+  {
+    ASSERT_LE(offset + size, pack.length());
+    const std::string object = pack.substr(offset, size);
+
+    shash::Any hash(content_hash.algorithm);
+    shash::HashMem(reinterpret_cast<const unsigned char *>(object.data()),
+                   object.length(), &hash);
+    EXPECT_EQ(content_hash, hash);
+
+    void *plain = NULL;
+    uint64_t plain_size = 0;
+    ASSERT_TRUE(zlib::DecompressMem2Mem(object.data(), object.length(),
+                                        &plain, &plain_size));
+    EXPECT_EQ(content,
+              std::string(reinterpret_cast<char *>(plain), plain_size));
+    free(plain);
+  }
+
+  std::string sandbox_;
+};
+
+
+TEST_F(T_FilePack, AppendCompressed) {
+  const std::string content_a = "first file\n";
+  const std::string content_b = std::string("binary\0data", 11);
+  const std::string content_c = "";
+
+  FilePackWriter writer;
+  ASSERT_TRUE(writer.Open(sandbox_ + "/pack"));
+  EXPECT_EQ(0U, writer.size());
+
+  shash::Any hash_a(shash::kSha1);
+  shash::Any hash_b(shash::kSha1);
+  shash::Any hash_c(shash::kSha1);
+  uint64_t offset_a, offset_b, offset_c;
+  uint64_t size_a, size_b, size_c;
+  AppendContent(&writer, content_a, &hash_a, &offset_a, &size_a);
+  AppendContent(&writer, content_b, &hash_b, &offset_b, &size_b);
+  AppendContent(&writer, content_c, &hash_c, &offset_c, &size_c);
+  EXPECT_EQ(0U, offset_a);
+  EXPECT_EQ(offset_a + size_a, offset_b);
+  EXPECT_EQ(offset_b + size_b, offset_c);
+  EXPECT_EQ(offset_c + size_c, writer.size());
+
+  const std::string path = writer.path();
+  shash::Any pack_hash(shash::kSha1);
+  ASSERT_TRUE(writer.Close(&pack_hash));
+  const std::string pack = ReadPack(path);
+  EXPECT_EQ(writer.size(), pack.length());
+
+  shash::Any expected_hash(shash::kSha1);
+  ASSERT_TRUE(shash::HashFile(path, &expected_hash));
+  EXPECT_EQ(expected_hash, pack_hash);
+
+  ExpectObject(pack, offset_a, size_a, hash_a, content_a);
+  ExpectObject(pack, offset_b, size_b, hash_b, content_b);
+  ExpectObject(pack, offset_c, size_c, hash_c, content_c);
+  EXPECT_EQ(0, unlink(path.c_str()));
+}
+
+
+TEST_F(T_FilePack, UnclosedPackRemoved) {
+  std::string path;
+  {
+    FilePackWriter writer;
+    ASSERT_TRUE(writer.Open(sandbox_ + "/pack"));
+    shash::Any hash(shash::kSha1);
+    uint64_t offset, size;
+    AppendContent(&writer, "first file\n", &hash, &offset, &size);
+    path = writer.path();
+    EXPECT_TRUE(FileExists(path));
+  }
+  EXPECT_FALSE(FileExists(path));
+}
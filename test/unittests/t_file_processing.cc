@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <set>
 #include <string>
 #include <vector>
 #include <cerrno>
@@ -209,7 +210,7 @@ class MockUploader : public upload::AbstractUploader {
   }
 
   bool Peek(const std::string &path) const {
-    assert (MockUploader::not_implemented);
+    return existing_objects.count(path) > 0;
   }
 
   unsigned int GetNumberOfErrors() const {
@@ -221,6 +222,7 @@ class MockUploader : public upload::AbstractUploader {
 
  public:
   volatile bool worker_thread_running;
+  std::set<std::string> existing_objects;  ///< paths reported by Peek()
 };
 
 const std::string MockUploader::sandbox_path    = "/tmp/cvmfs_ut_fileprocessing";
@@ -642,6 +644,33 @@ TEST_F(T_FileProcessing, ProcessMultipleFilesInSeparateWaves) {
 }
 
 
+TEST_F(T_FileProcessing, SkipExistingObjects) {
+  const bool use_chunking = true;
+  upload::FileProcessor processor(uploader_, use_chunking,
+                                  MockUploader::min_chunk_size,
+                                  MockUploader::avg_chunk_size,
+                                  MockUploader::max_chunk_size);
+
+  const shash::Any small_file_hash(
+    shash::kSha1,
+    shash::HexPtr(GetSmallFileBulkHash().first));
+  uploader_->existing_objects.insert("data" + small_file_hash.MakePath(1, 2));
+
+  processor.Process(GetSmallFile(), true);
+  processor.Process(GetEmptyFile(), true);
+  processor.Process(GetSmallFile(), true, "X");
+  processor.WaitForProcessing();
+
+  ExpectedHashStrings hs;
+  hs.push_back(GetEmptyFileBulkHash());
+  hs.push_back(GetSmallFileBulkHash("X"));
+  CheckHashes(uploader_->results(), hs);
+  EXPECT_EQ (1u, processor.GetNumberOfDeduplicatedChunks());
+  EXPECT_LT (0u, processor.GetDeduplicatedBytes());
+  uploader_->existing_objects.clear();
+}
+
+
 struct CallbackTest {
   static void CallbackFn(const upload::SpoolerResult &result) {
     EXPECT_EQ (0,  result.return_code);
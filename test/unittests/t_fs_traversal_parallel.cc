@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/fs_traversal_parallel.h"
+#include "../../cvmfs/util.h"
+
+/**
+ * Records the callbacks of a traversal, so that the parallel traversal can be
+ * compared to the sequential one.
+ */
+class TraversalRecorder {
+ public:
+  TraversalRecorder() : skip_directory("none") {
+    pthread_mutex_init(&lock_read_directories_, NULL);
+  }
+  ~TraversalRecorder() {
+    pthread_mutex_destroy(&lock_read_directories_);
+  }
+
+  void EnterDir(const std::string &path, const std::string &name) {
+    Record("enter", path, name);
+  }
+  void LeaveDir(const std::string &path, const std::string &name) {
+    Record("leave", path, name);
+  }
+  void File(const std::string &path, const std::string &name) {
+    Record("file", path, name);
+  }
+  void Symlink(const std::string &path, const std::string &name) {
+    Record("symlink", path, name);
+  }
+  bool DirPrefix(const std::string &path, const std::string &name) {
+    Record("prefix", path, name);
+    return name != skip_directory;
+  }
+  void DirPostfix(const std::string &path, const std::string &name) {
+    Record("postfix", path, name);
+  }
+  bool Ignore(const std::string &path, const std::string &name) {
+    pthread_mutex_lock(&lock_read_directories_);
+    read_directories.insert(path);
+    pthread_mutex_unlock(&lock_read_directories_);
+    return name == "ignored";
+  }
+
+  template <class TraversalT>
+  void Register(TraversalT *traversal) {
+    traversal->fn_enter_dir       = &TraversalRecorder::EnterDir;
+    traversal->fn_leave_dir       = &TraversalRecorder::LeaveDir;
+    traversal->fn_new_file        = &TraversalRecorder::File;
+    traversal->fn_new_symlink     = &TraversalRecorder::Symlink;
+    traversal->fn_new_dir_prefix  = &TraversalRecorder::DirPrefix;
+    traversal->fn_new_dir_postfix = &TraversalRecorder::DirPostfix;
+    traversal->fn_ignore_file     = &TraversalRecorder::Ignore;
+  }
+
+  std::vector<std::string> events;
+  std::string skip_directory;
+  std::set<std::string> read_directories;  ///< non-empty ones
+
+ private:
+  pthread_mutex_t lock_read_directories_;
+  void Record(const std::string &event, const std::string &path,
+              const std::string &name)
+  {
+    events.push_back(event + " " + path + " " + name);
+  }
+};
+
+
+class T_FsTraversalParallel : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    testbed_path_ = "/tmp/cvmfs_ut_fs_traversal_parallel." +
+                    StringifyInt(getpid());
+    ASSERT_TRUE(MkdirDeep(testbed_path_, 0755));
+
+    for (unsigned i = 0; i < 8; ++i) {
+      const std::string dir = "dir" + StringifyInt(i);
+      MakeDirectory(dir);
+      for (unsigned j = 0; j < 4; ++j) {
+        const std::string subdir = dir + "/sub" + StringifyInt(j);
+        MakeDirectory(subdir);
+        MakeDirectory(subdir + "/empty");
+        for (unsigned k = 0; k < 10; ++k)
+          MakeFile(subdir + "/file" + StringifyInt(k));
+        MakeSymlink(subdir + "/link", "file0");
+      }
+      MakeFile(dir + "/ignored");
+      MakeDirectory(dir + "/skipped");
+      MakeFile(dir + "/skipped/file");
+    }
+    MakeDirectory("ignored");
+    MakeFile("ignored/file");
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(RemoveTree(testbed_path_));
+  }
+
+  std::vector<std::string> TraverseSequential(const std::string &skip,
+                                              const bool recurse = true)
+  {
+    TraversalRecorder recorder;
+    recorder.skip_directory = skip;
+    FileSystemTraversal<TraversalRecorder>
+      traversal(&recorder, testbed_path_, recurse);
+    recorder.Register(&traversal);
+    traversal.Recurse(testbed_path_);
+    return recorder.events;
+  }
+
+  std::vector<std::string> TraverseParallel(
+    const std::string &skip,
+    const bool recurse = true,
+    const bool deep_read_ahead = true,
+    std::set<std::string> *read_directories = NULL)
+  {
+    TraversalRecorder recorder;
+    recorder.skip_directory = skip;
+    ParallelFileSystemTraversal<TraversalRecorder>
+      traversal(&recorder, testbed_path_, recurse, 4, deep_read_ahead);
+    recorder.Register(&traversal);
+    traversal.Recurse(testbed_path_);
+    if (read_directories != NULL)
+      *read_directories = recorder.read_directories;
+    return recorder.events;
+  }
+
+  void MakeDirectory(const std::string &path) {
+    ASSERT_EQ(0, mkdir((testbed_path_ + "/" + path).c_str(), 0755));
+  }
+
+  void MakeFile(const std::string &path) {
+    FILE *f = fopen((testbed_path_ + "/" + path).c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fclose(f);
+  }
+
+  void MakeSymlink(const std::string &path, const std::string &target) {
+    ASSERT_EQ(0, symlink(target.c_str(), (testbed_path_ + "/" + path).c_str()));
+  }
+
+  std::string testbed_path_;
+};
+
+
+TEST_F(T_FsTraversalParallel, SameOrder) {
+  const std::vector<std::string> sequential = TraverseSequential("skipped");
+  // root: enter + leave; 8 directories: prefix + postfix, enter + leave,
+  // 4 sub directories (see SetUp()), skipped directory: prefix + postfix
+  EXPECT_EQ(2U + 8 * (2 + 2 + 4 * (2 + 2 + 4 + 10 + 1) + 2), sequential.size());
+
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_EQ(sequential, TraverseParallel("skipped"));
+}
+
+
+TEST_F(T_FsTraversalParallel, AllDirectories) {
+  const std::vector<std::string> sequential = TraverseSequential("none");
+  EXPECT_EQ(sequential, TraverseParallel("none"));
+}
+
+
+TEST_F(T_FsTraversalParallel, ShallowReadAhead) {
+  const std::vector<std::string> sequential = TraverseSequential("dir3");
+  for (unsigned i = 0; i < 10; ++i) {
+    std::set<std::string> read_directories;
+    EXPECT_EQ(sequential,
+              TraverseParallel("dir3", true, false, &read_directories));
+    // The declined directory itself is read ahead but not its sub directories
+    EXPECT_EQ(1U, read_directories.count("dir3"));
+    EXPECT_EQ(0U, read_directories.count("dir3/sub0"));
+    EXPECT_EQ(1U, read_directories.count("dir4/sub0"));
+  }
+}
+
+
+TEST_F(T_FsTraversalParallel, NoRecursion) {
+  const std::vector<std::string> sequential = TraverseSequential("none", false);
+  // root: enter + leave, prefix + postfix of 8 directories
+  EXPECT_EQ(2U + 8 * 2, sequential.size());
+  EXPECT_EQ(sequential, TraverseParallel("none", false));
+}
+
+
+TEST_F(T_FsTraversalParallel, Reuse) {
+  const std::vector<std::string> sequential = TraverseSequential("skipped");
+  TraversalRecorder recorder;
+  recorder.skip_directory = "skipped";
+  ParallelFileSystemTraversal<TraversalRecorder>
+    traversal(&recorder, testbed_path_, true, 4);
+  recorder.Register(&traversal);
+  for (unsigned i = 0; i < 5; ++i) {
+    recorder.events.clear();
+    traversal.Recurse(testbed_path_);
+    EXPECT_EQ(sequential, recorder.events);
+  }
+}
+
+
+TEST_F(T_FsTraversalParallel, UnreadableSkippedDirectories) {
+  // Neither ignored nor skipped directories are visited, so the traversal
+  // must not fail if they cannot be read
+  for (unsigned i = 0; i < 8; ++i) {
+    const std::string dir = testbed_path_ + "/dir" + StringifyInt(i);
+    ASSERT_EQ(0, chmod((dir + "/skipped").c_str(), 0000));
+  }
+  ASSERT_EQ(0, chmod((testbed_path_ + "/ignored").c_str(), 0000));
+
+  const std::vector<std::string> sequential = TraverseSequential("skipped");
+  EXPECT_EQ(sequential, TraverseParallel("skipped"));
+
+  for (unsigned i = 0; i < 8; ++i) {
+    const std::string dir = testbed_path_ + "/dir" + StringifyInt(i);
+    ASSERT_EQ(0, chmod((dir + "/skipped").c_str(), 0755));
+  }
+  ASSERT_EQ(0, chmod((testbed_path_ + "/ignored").c_str(), 0755));
+}
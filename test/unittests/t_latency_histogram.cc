@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../../cvmfs/latency_histogram.h"
+
+using namespace download;  // NOLINT
+
+
+TEST(T_LatencyHistogram, Empty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0U, histogram.num_samples);
+  EXPECT_LT(histogram.GetQuantile(0.5), 0.0);
+  EXPECT_EQ("n/a", histogram.PrintQuantiles());
+}
+
+
+TEST(T_LatencyHistogram, Binning) {
+  LatencyHistogram histogram;
+  // Below 1ms
+  histogram.Add(0.0);
+  histogram.Add(0.5);
+  EXPECT_EQ(2U, histogram.bins[0]);
+  // Four bins per power of two
+  histogram.Add(1.0);
+  EXPECT_EQ(1U, histogram.bins[1]);
+  histogram.Add(1.1);
+  EXPECT_EQ(2U, histogram.bins[1]);
+  histogram.Add(2.0);
+  EXPECT_EQ(1U, histogram.bins[5]);
+  histogram.Add(1024.0);
+  EXPECT_EQ(1U, histogram.bins[41]);
+  // Very long latencies end up in the last bin
+  histogram.Add(1e30);
+  EXPECT_EQ(1U, histogram.bins[LatencyHistogram::kNumBins - 1]);
+  EXPECT_EQ(7U, histogram.num_samples);
+}
+
+
+TEST(T_LatencyHistogram, Quantiles) {
+  LatencyHistogram histogram;
+  for (unsigned i = 0; i < 90; ++i)
+    histogram.Add(10.0);
+  for (unsigned i = 0; i < 10; ++i)
+    histogram.Add(1000.0);
+
+  // Upper bound of the bin, i.e. at most 19% above the sample
+  const double p50 = histogram.GetQuantile(0.5);
+  EXPECT_GE(p50, 10.0);
+  EXPECT_LT(p50, 10.0 * 1.19);
+  EXPECT_EQ(p50, histogram.GetQuantile(0.9));
+  const double p95 = histogram.GetQuantile(0.95);
+  EXPECT_GE(p95, 1000.0);
+  EXPECT_LT(p95, 1000.0 * 1.19);
+  EXPECT_EQ(p95, histogram.GetQuantile(1.0));
+  EXPECT_EQ("p50 11 ms, p99 1024 ms", histogram.PrintQuantiles());
+}
+
+
+TEST(T_LatencyHistogram, Aging) {
+  const uint64_t max_samples = LatencyHistogram::kMaxSamples;
+  LatencyHistogram histogram;
+  for (unsigned i = 0; i < max_samples - 1; ++i)
+    histogram.Add(1000.0);
+  EXPECT_EQ(max_samples - 1, histogram.num_samples);
+  EXPECT_GE(histogram.GetQuantile(0.5), 1000.0);
+
+  // The counts are halved once the maximum number of samples is reached
+  histogram.Add(1000.0);
+  EXPECT_EQ(max_samples / 2, histogram.num_samples);
+
+  // New samples take over after a few halvings
+  for (unsigned i = 0; i < 4 * max_samples; ++i)
+    histogram.Add(10.0);
+  EXPECT_LT(histogram.num_samples, max_samples);
+  EXPECT_LT(histogram.GetQuantile(0.99), 12.0);
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../../cvmfs/directory_entry.h"
+#include "../../cvmfs/hash.h"
+#include "testutil.h"
+
+using namespace catalog;  // NOLINT
+
+class T_PackedDirent : public ::testing::Test {
+ protected:
+  static shash::Any MakeHash(const shash::Algorithms algorithm) {
+    shash::Any hash(algorithm);
+    hash.Randomize();
+    return hash;
+  }
+
+  static DirectoryEntry RoundTrip(const DirectoryEntry &dirent) {
+    PackedDirectoryEntry packed(dirent);
+    DirectoryEntry result;
+    packed.Unpack(&result);
+    return result;
+  }
+};
+
+
+TEST_F(T_PackedDirent, Size) {
+  EXPECT_LT(sizeof(PackedDirectoryEntry), sizeof(DirectoryEntry));
+}
+
+
+TEST_F(T_PackedDirent, RegularFile) {
+  const shash::Any hash = MakeHash(shash::kSha1);
+  const DirectoryEntry dirent =
+    DirectoryEntryTestFactory::RegularFile("__init__.py", hash);
+  PackedDirectoryEntry packed(dirent);
+  EXPECT_EQ(0U, packed.GetOutOfLineSize());
+
+  DirectoryEntry result;
+  packed.Unpack(&result);
+  EXPECT_EQ("__init__.py", result.name().ToString());
+  EXPECT_EQ(hash, result.checksum());
+  EXPECT_EQ(dirent.mode(), result.mode());
+  EXPECT_EQ(dirent.size(), result.size());
+  EXPECT_EQ(dirent.inode(), result.inode());
+  EXPECT_EQ(dirent.parent_inode(), result.parent_inode());
+  EXPECT_TRUE(result.IsRegular());
+  EXPECT_FALSE(result.IsChunkedFile());
+  EXPECT_FALSE(result.IsNegative());
+}
+
+
+TEST_F(T_PackedDirent, Md5Digest) {
+  const shash::Any hash = MakeHash(shash::kMd5);
+  const DirectoryEntry result =
+    RoundTrip(DirectoryEntryTestFactory::RegularFile("data.root", hash));
+  EXPECT_EQ(shash::kMd5, result.checksum().algorithm);
+  EXPECT_EQ(hash, result.checksum());
+}
+
+
+TEST_F(T_PackedDirent, LongName) {
+  const std::string name(100, 'x');
+  const shash::Any hash = MakeHash(shash::kSha1);
+  const DirectoryEntry dirent =
+    DirectoryEntryTestFactory::RegularFile(name, hash);
+  PackedDirectoryEntry packed(dirent);
+  EXPECT_EQ(100U, packed.GetOutOfLineSize());
+
+  DirectoryEntry result;
+  packed.Unpack(&result);
+  EXPECT_EQ(name, result.name().ToString());
+  EXPECT_EQ(hash, result.checksum());
+}
+
+
+TEST_F(T_PackedDirent, DirectoryWithoutDigest) {
+  // Without a digest, the entire inline buffer is available for the name
+  const std::string name(PackedDirectoryEntry::kInlineSize, 'd');
+  const DirectoryEntry dirent = DirectoryEntryTestFactory::Directory(name);
+  PackedDirectoryEntry packed(dirent);
+  EXPECT_EQ(0U, packed.GetOutOfLineSize());
+
+  DirectoryEntry result;
+  packed.Unpack(&result);
+  EXPECT_EQ(name, result.name().ToString());
+  EXPECT_TRUE(result.checksum().IsNull());
+  EXPECT_TRUE(result.IsDirectory());
+}
+
+
+TEST_F(T_PackedDirent, Symlink) {
+  const std::string target = "../../lib/python2.7/site-packages";
+  const DirectoryEntry dirent =
+    DirectoryEntryTestFactory::Symlink("site-packages", target);
+  PackedDirectoryEntry packed(dirent);
+  EXPECT_EQ(target.length(), packed.GetOutOfLineSize());
+
+  const DirectoryEntry result = RoundTrip(dirent);
+  EXPECT_EQ("site-packages", result.name().ToString());
+  EXPECT_EQ(target, result.symlink().ToString());
+  EXPECT_TRUE(result.IsLink());
+}
+
+
+TEST_F(T_PackedDirent, FileFlags) {
+  DirectoryEntry dirent =
+    DirectoryEntryTestFactory::RegularFile("small", MakeHash(shash::kSha1));
+  dirent.set_is_packed_file(true);
+  DirectoryEntry result = RoundTrip(dirent);
+  EXPECT_TRUE(result.IsPackedFile());
+  EXPECT_FALSE(result.IsChunkedFile());
+
+  dirent.set_is_packed_file(false);
+  dirent.set_is_chunked_file(true);
+  result = RoundTrip(dirent);
+  EXPECT_FALSE(result.IsPackedFile());
+  EXPECT_TRUE(result.IsChunkedFile());
+}
+
+
+TEST_F(T_PackedDirent, Negative) {
+  const DirectoryEntry result = RoundTrip(DirectoryEntry(kDirentNegative));
+  EXPECT_TRUE(result.IsNegative());
+}
+
+
+TEST_F(T_PackedDirent, Copy) {
+  const std::string name(100, 'y');
+  PackedDirectoryEntry packed(
+    DirectoryEntryTestFactory::Symlink(name, "target"));
+  PackedDirectoryEntry copy(packed);
+  PackedDirectoryEntry assigned;
+  assigned = packed;
+
+  DirectoryEntry result;
+  copy.Unpack(&result);
+  EXPECT_EQ(name, result.name().ToString());
+  EXPECT_EQ("target", result.symlink().ToString());
+  assigned.Unpack(&result);
+  EXPECT_EQ(name, result.name().ToString());
+  EXPECT_EQ("target", result.symlink().ToString());
+}
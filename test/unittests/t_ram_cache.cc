@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+#include "../../cvmfs/ram_cache.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/util.h"
+
+class T_RamCache : public ::testing::Test {
+ protected:
+  static shash::Any MakeId(const unsigned i) {
+    const std::string content = "object " + StringifyInt(i);
+    shash::Any id(shash::kSha1);
+    shash::HashMem(reinterpret_cast<const unsigned char *>(content.data()),
+                   content.length(), &id);
+    return id;
+  }
+
+  // Inserts an object of the given size and drops the caller's reference
+  static void Put(cache::RamCache *cache, const unsigned i,
+                  const uint32_t size)
+  {
+    cache::RamObject *object = cache::RamObject::Create(size);
+    memset(object->data(), i & 0xFF, size);
+    cache->Insert(MakeId(i), object);
+    object->Release();
+  }
+
+  static bool Has(cache::RamCache *cache, const unsigned i) {
+    cache::RamObject *object = cache->Lookup(MakeId(i));
+    if (object == NULL)
+      return false;
+    object->Release();
+    return true;
+  }
+
+  static const uint32_t kObjectSize = 1024;
+};
+
+
+TEST_F(T_RamCache, InsertLookup) {
+  cache::RamCache cache(64 * kObjectSize);
+  EXPECT_FALSE(Has(&cache, 0));
+
+  Put(&cache, 0, kObjectSize);
+  cache::RamObject *object = cache.Lookup(MakeId(0));
+  ASSERT_TRUE(object != NULL);
+  EXPECT_EQ(static_cast<uint32_t>(kObjectSize), object->size);
+  EXPECT_EQ(0, object->data()[kObjectSize - 1]);
+  object->Release();
+  EXPECT_EQ(static_cast<uint64_t>(kObjectSize), cache.GetSize());
+}
+
+
+TEST_F(T_RamCache, TooBig) {
+  cache::RamCache cache(4 * kObjectSize);
+  // New objects are limited to the A1in share of the capacity
+  Put(&cache, 0, 2 * kObjectSize);
+  EXPECT_FALSE(Has(&cache, 0));
+  EXPECT_EQ(0U, cache.GetSize());
+}
+
+
+TEST_F(T_RamCache, ReferenceOutlivesEviction) {
+  cache::RamCache cache(4 * kObjectSize);
+  Put(&cache, 0, kObjectSize);
+  cache::RamObject *object = cache.Lookup(MakeId(0));
+  ASSERT_TRUE(object != NULL);
+
+  Put(&cache, 1, kObjectSize);
+  EXPECT_FALSE(Has(&cache, 0));
+  // Still readable through the reference of the open handle
+  EXPECT_EQ(0, object->data()[0]);
+  object->Release();
+}
+
+
+TEST_F(T_RamCache, ScanResistance) {
+  const unsigned kNumHot = 8;
+  cache::RamCache cache(64 * kObjectSize);
+
+  // Objects that come back after being evicted from A1in become hot
+  for (unsigned i = 0; i < kNumHot; ++i)
+    Put(&cache, i, kObjectSize);
+  for (unsigned i = 1000; i < 1100; ++i)
+    Put(&cache, i, kObjectSize);
+  for (unsigned i = 0; i < kNumHot; ++i) {
+    EXPECT_FALSE(Has(&cache, i));
+    Put(&cache, i, kObjectSize);
+  }
+  cache::RamCache::Statistics statistics = cache.statistics();
+  EXPECT_EQ(static_cast<int64_t>(kNumHot),
+            atomic_read64(&statistics.num_insert_hot));
+
+  // A long scan does not evict the hot objects
+  for (unsigned i = 2000; i < 12000; ++i)
+    Put(&cache, i, kObjectSize);
+  for (unsigned i = 0; i < kNumHot; ++i)
+    EXPECT_TRUE(Has(&cache, i));
+  EXPECT_LE(cache.GetSize(), static_cast<uint64_t>(64 * kObjectSize));
+}
@@ -3,6 +3,7 @@
 #include <pthread.h>
 
 #include <limits>
+#include <string>
 
 #include "../../cvmfs/smallhash.h"
 #include "../../cvmfs/murmur.h"
@@ -138,6 +139,32 @@ TEST_F(T_Smallhash, InsertAndErase) {
 }
 
 
+TEST_F(T_Smallhash, EraseReleasesValues) {
+  SmallHashFixed<int, std::string> strings;
+  strings.Init(64, -1, hasher_int);
+  for (int i = 0; i < 32; ++i)
+    strings.Insert(i, std::string(100, 'a' + (i % 26)));
+  for (int i = 0; i < 32; i += 2)
+    strings.Erase(i);
+
+  // Empty slots, also those vacated by rehashing, hold no string data
+  for (uint32_t i = 0; i < strings.capacity(); ++i) {
+    if (strings.keys()[i] == -1)
+      EXPECT_TRUE(strings.values()[i].empty());
+  }
+  for (int i = 1; i < 32; i += 2) {
+    const std::string *value = strings.Find(i);
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(std::string(100, 'a' + (i % 26)), *value);
+  }
+  EXPECT_TRUE(strings.Find(0) == NULL);
+
+  strings.Clear();
+  for (uint32_t i = 0; i < strings.capacity(); ++i)
+    EXPECT_TRUE(strings.values()[i].empty());
+}
+
+
 TEST_F(T_Smallhash, EraseUnknown) {
   unsigned N = kNumElements;
   for (unsigned i = 0; i < N; ++i) {
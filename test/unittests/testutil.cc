@@ -91,4 +91,35 @@ DirectoryEntry DirectoryEntryTestFactory::ChunkedFile() {
   return dirent;
 }
 
+
+DirectoryEntry DirectoryEntryTestFactory::RegularFile(
+  const std::string &name,
+  const shash::Any &checksum)
+{
+  DirectoryEntry dirent = RegularFile();
+  dirent.name_.Assign(name.data(), name.length());
+  dirent.checksum_ = checksum;
+  dirent.size_ = 4096;
+  dirent.inode_ = 42;
+  dirent.parent_inode_ = 41;
+  return dirent;
+}
+
+
+DirectoryEntry DirectoryEntryTestFactory::Directory(const std::string &name) {
+  DirectoryEntry dirent = Directory();
+  dirent.name_.Assign(name.data(), name.length());
+  return dirent;
+}
+
+
+DirectoryEntry DirectoryEntryTestFactory::Symlink(const std::string &name,
+                                                  const std::string &target)
+{
+  DirectoryEntry dirent = Symlink();
+  dirent.name_.Assign(name.data(), name.length());
+  dirent.symlink_.Assign(target.data(), target.length());
+  return dirent;
+}
+
 } /* namespace catalog */
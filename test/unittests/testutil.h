@@ -3,6 +3,8 @@
 
 #include <sys/types.h>
 
+#include <string>
+
 #include "../../cvmfs/directory_entry.h"
 #include "../../cvmfs/util.h"
 
@@ -16,6 +18,12 @@ class DirectoryEntryTestFactory {
   static catalog::DirectoryEntry Directory();
   static catalog::DirectoryEntry Symlink();
   static catalog::DirectoryEntry ChunkedFile();
+
+  static catalog::DirectoryEntry RegularFile(const std::string &name,
+                                             const shash::Any &checksum);
+  static catalog::DirectoryEntry Directory(const std::string &name);
+  static catalog::DirectoryEntry Symlink(const std::string &name,
+                                         const std::string &target);
 };
 
 } /* namespace catalog */